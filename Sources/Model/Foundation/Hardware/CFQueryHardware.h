@@ -86,6 +86,16 @@ namespace CF
             const double_t&     scale()  const;
             const std::string&  model()  const;
             
+            const bool&         avx2()   const;
+            const bool&         avx512() const;
+            
+            // Processor packages, one per socket
+            const size_t&       packages() const;
+            
+            // Per core data cache sizes, in bytes
+            const size_t&       l1()     const;
+            const size_t&       l2()     const;
+            
         private:
             std::string  m_Model;
             double_t     mnCPU;
@@ -93,6 +103,11 @@ namespace CF
             double_t     mnScale;
             size_t       mnCores;
             size_t       mnSize;
+            size_t       mnPackages;
+            size_t       mnL1;
+            size_t       mnL2;
+            bool         mbAVX2;
+            bool         mbAVX512;
         }; // Hardware
     } // Query
 } // CF
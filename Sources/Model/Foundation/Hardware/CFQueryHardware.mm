@@ -69,6 +69,10 @@ double_t CF::Query::Frequency::kHertz     = 1.0f;
 
 static const size_t kGigaBytes = 1073741824;
 
+// Cache sizes assumed when the kernel does not report them
+static const size_t kCacheL1 = 32768;
+static const size_t kCacheL2 = 262144;
+
 #pragma mark -
 #pragma mark Private - Utilities
 
@@ -171,6 +175,30 @@ static int CFQueryHardwareGetModel(std::string& model)
     return result;
 } // CFQueryHardwareGetModel
 
+static bool CFQueryHardwareGetFeature(const char *pName)
+{
+    int    value = 0;
+    size_t size  = sizeof(int);
+    
+    // Missing keys simply mean the feature is not present
+    int result = sysctlbyname(pName, &value, &size, NULL, 0);
+    
+    return (result > -1) && (value != 0);
+} // CFQueryHardwareGetFeature
+
+// Positive integer values, of either width, or the default when the
+// kernel does not report them
+static size_t CFQueryHardwareGetValue(const char *pName,
+                                      const size_t& nDefault)
+{
+    int64_t bytes = 0;
+    size_t  size  = sizeof(int64_t);
+    
+    int result = sysctlbyname(pName, &bytes, &size, NULL, 0);
+    
+    return ((result > -1) && (bytes > 0)) ? size_t(bytes) : nDefault;
+} // CFQueryHardwareGetValue
+
 #pragma mark -
 #pragma mark Public - Hardware
 
@@ -195,6 +223,14 @@ CF::Query::Hardware::Hardware(const double_t& frequency)
     
     CFQueryHardwareGetMemSize(mnSize);
     CFQueryHardwareGetModel(m_Model);
+    
+    mbAVX2   = CFQueryHardwareGetFeature("hw.optional.avx2_0") && CFQueryHardwareGetFeature("hw.optional.fma");
+    mbAVX512 = CFQueryHardwareGetFeature("hw.optional.avx512f");
+    
+    mnL1 = CFQueryHardwareGetValue("hw.l1dcachesize", kCacheL1);
+    mnL2 = CFQueryHardwareGetValue("hw.l2cachesize", kCacheL2);
+    
+    mnPackages = CFQueryHardwareGetValue("hw.packages", 1);
 } // Constructor
 
 CF::Query::Hardware::~Hardware()
@@ -205,6 +241,14 @@ CF::Query::Hardware::~Hardware()
     mnCPU   = 0.0f;
     mnScale = 0.0f;
     
+    mbAVX2   = false;
+    mbAVX512 = false;
+    
+    mnL1 = 0;
+    mnL2 = 0;
+    
+    mnPackages = 0;
+    
     m_Model.clear();
 } // Destructor
 
@@ -216,6 +260,14 @@ CF::Query::Hardware::Hardware(const CF::Query::Hardware& hw)
     mnFreq  = hw.mnFreq;
     mnScale = hw.mnScale;
     m_Model = hw.m_Model;
+    
+    mbAVX2   = hw.mbAVX2;
+    mbAVX512 = hw.mbAVX512;
+    
+    mnL1 = hw.mnL1;
+    mnL2 = hw.mnL2;
+    
+    mnPackages = hw.mnPackages;
 } // Copy Constructor
 
 CF::Query::Hardware& CF::Query::Hardware::operator=(const CF::Query::Hardware& hw)
@@ -228,6 +280,14 @@ CF::Query::Hardware& CF::Query::Hardware::operator=(const CF::Query::Hardware& h
         mnFreq  = hw.mnFreq;
         mnScale = hw.mnScale;
         m_Model = hw.m_Model;
+        
+        mbAVX2   = hw.mbAVX2;
+        mbAVX512 = hw.mbAVX512;
+        
+        mnL1 = hw.mnL1;
+        mnL2 = hw.mnL2;
+        
+        mnPackages = hw.mnPackages;
     } // if
     
     return *this;
@@ -265,3 +325,27 @@ const std::string& CF::Query::Hardware::model() const
     return m_Model;
 } // model
 
+const bool& CF::Query::Hardware::avx2() const
+{
+    return mbAVX2;
+} // avx2
+
+const bool& CF::Query::Hardware::avx512() const
+{
+    return mbAVX512;
+} // avx512
+
+const size_t& CF::Query::Hardware::packages() const
+{
+    return mnPackages;
+} // packages
+
+const size_t& CF::Query::Hardware::l1() const
+{
+    return mnL1;
+} // l1
+
+const size_t& CF::Query::Hardware::l2() const
+{
+    return mnL2;
+} // l2
@@ -91,6 +91,93 @@ namespace NBody
         const GLuint  kCount  = 16384;//16384;//32768;//65536;//kCountMax;
     }; // Defaults
 
+    namespace Tree
+    {
+        const GLfloat kOpeningAngle          = 0.5f;
+        const GLfloat kMultipoleOpeningAngle = 0.6f;
+        const GLuint  kLeafSize              = 16;
+        const GLuint  kExpansionOrder        = 4;
+        const GLuint  kExpansionOrderMax     = 8;
+    }; // Tree
+
+    namespace Block
+    {
+        const GLuint  kLevels       = 1;
+        const GLuint  kLevelsMax    = 16;
+        const GLfloat kAccuracy     = 0.025f;
+        const GLfloat kJerkAccuracy = 0.1f;
+    }; // Block
+
+    // Fourth order Yoshida weights, w1 = 1/(2 - 2^(1/3)) and
+    // w0 = -2^(1/3) w1
+    namespace Yoshida
+    {
+        const GLfloat kW0 = -1.7024143839193153f;
+        const GLfloat kW1 =  1.3512071919596578f;
+    }; // Yoshida
+
+    // Softening of the pairs with a dark matter body, over that of the
+    // stars, since each one stands for a smooth halo rather than a star
+    namespace Dark
+    {
+        const GLfloat kSoftening = 2.0f;
+    }; // Dark
+
+    // Mass, scale radius and, for a disk, scale height of the analytic
+    // background potential, in the units of the bodies with G = 1
+    namespace Halo
+    {
+        const GLfloat kMass   = 100.0f;
+        const GLfloat kScale  = 10.0f;
+        const GLfloat kHeight = 1.0f;
+        const GLfloat kRadius = 1.0e-4f;
+    }; // Halo
+
+    // Direct sums in a periodic box. The Ewald correction is tabulated
+    // on kTableSize intervals per axis of half the box, from images
+    // within kImages boxes and wave vectors within kWaves, split at kAlpha.
+    namespace Periodic
+    {
+        const GLfloat kBoxSize   = 100.0f;
+        const GLuint  kTableSize = 32;
+        const GLfloat kAlpha     = 2.0f;
+        const GLuint  kImages    = 2;
+        const GLuint  kWaves     = 3;
+    }; // Periodic
+
+    // Integration steps enqueued back to back by the gpu simulator
+    // between readbacks, one by default and adapted up to the given
+    // count, itself at most kStepsMax
+    namespace Batch
+    {
+        const GLuint kSteps    = 1;
+        const GLuint kStepsMax = 64;
+    }; // Batch
+
+    // Smoothed particle hydrodynamics of the gas bodies. Smoothing
+    // lengths start at kEta times the mean spacing of the gas, and are
+    // kept within kSmoothingMin and kSmoothingMax times that.
+    namespace SPH
+    {
+        const GLfloat kGamma        = 5.0f / 3.0f;
+        const GLfloat kAlpha        = 1.0f;
+        const GLfloat kBeta         = 2.0f;
+        const GLfloat kEta          = 1.2f;
+        const GLfloat kSmoothingMin = 0.05f;
+        const GLfloat kSmoothingMax = 2.0f;
+        const GLfloat kEnergy       = 0.05f;
+        const GLfloat kEnergyMin    = 1.0e-6f;
+    }; // SPH
+
+    namespace Mesh
+    {
+        const GLuint  kSize       = 64;
+        const GLuint  kSizeMin    = 16;
+        const GLfloat kPadding    = 1.05f;
+        const GLfloat kSplitScale = 1.25f;
+        const GLfloat kCutoff     = 4.5f;
+    }; // Mesh
+
     namespace Star
     {
         const GLfloat kSize  = 4.0f;
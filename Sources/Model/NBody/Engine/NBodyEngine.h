@@ -96,6 +96,14 @@ namespace NBody
         
     private:
         void setDemo(const GLubyte& nCommand);
+        
+        // Cycle or toggle a solver or physics option from its key, and
+        // restart the active demo with it
+        void setOption(const GLubyte& nCommand);
+        
+        // Overlay the options chosen from the keyboard on the parameters
+        // of the active demo
+        void options();
 
         void sync(const bool& doSync);
         bool simulators(const GLuint& nBodies);
@@ -116,6 +124,7 @@ namespace NBody
         Simulation::Mediator   *mpMediator;
         Simulation::Visualizer *mpVisualizer;
         Simulation::Params      m_ActiveParams;
+        Simulation::Params      m_Options;
         
         GLuint    mnBodies;
         GLuint    mnActiveDemo;
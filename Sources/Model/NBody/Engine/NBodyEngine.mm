@@ -67,6 +67,53 @@
 
 #import "NBodyEngine.h"
 
+#pragma mark -
+#pragma mark Private - Constants
+
+// Block time step levels, and the fraction of the bodies that are gas,
+// dark matter and tracers, when each option is switched on
+static const GLuint  kEngineBlockLevels   = 4;
+static const GLuint  kEngineSpeciesShare  = 4;
+
+// Merge radius as a fraction of the softening of each demo
+static const GLfloat kEngineMergeFraction = 0.25f;
+
+static const char *kEngineSolvers[] =
+{
+    "default", "gpu", "cpu", "barnes-hut", "fmm", "particle-mesh", "treepm"
+};
+
+static const char *kEngineIntegrators[] =
+{
+    "default", "euler", "leapfrog", "yoshida", "hermite"
+};
+
+static const char *kEnginePrecisions[] =
+{
+    "default", "float", "double", "double-single"
+};
+
+static const char *kEnginePotentials[] =
+{
+    "none", "none", "point mass", "hernquist", "nfw", "miyamoto-nagai"
+};
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Next of the default and the values from nFirst to nLast, in order
+static GLuint NBodyEngineCycle(const GLuint& nValue,
+                               const GLuint& nFirst,
+                               const GLuint& nLast)
+{
+    if(nValue == 0)
+    {
+        return nFirst;
+    } // if
+    
+    return (nValue < nLast) ? (nValue + 1) : 0;
+} // NBodyEngineCycle
+
 #pragma mark -
 #pragma mark Private - Utilities - Reset/Restart
 
@@ -187,6 +234,111 @@ void NBody::Engine::setDemo(const GLubyte& nCommand)
     } // if
 } // setDemo
 
+#pragma mark -
+#pragma mark Private - Utilities - Options
+
+void NBody::Engine::setOption(const GLubyte& nCommand)
+{
+    const GLuint nShare = mnBodies / kEngineSpeciesShare;
+    
+    std::cout << ">> N-body Engine: ";
+    
+    switch(nCommand)
+    {
+        case 's':
+            m_Options.mnSolver = NBodyEngineCycle(m_Options.mnSolver,
+                                                  NBody::Simulation::eSolverCPU,
+                                                  NBody::Simulation::eSolverTreePM);
+            
+            std::cout << "solver " << kEngineSolvers[m_Options.mnSolver];
+            break;
+            
+        case 'i':
+            m_Options.mnIntegrator = NBodyEngineCycle(m_Options.mnIntegrator,
+                                                      NBody::Simulation::eIntegratorLeapfrog,
+                                                      NBody::Simulation::eIntegratorHermite);
+            
+            std::cout << "integrator " << kEngineIntegrators[m_Options.mnIntegrator];
+            break;
+            
+        case 'p':
+            m_Options.mnPrecision = NBodyEngineCycle(m_Options.mnPrecision,
+                                                     NBody::Simulation::ePrecisionDouble,
+                                                     NBody::Simulation::ePrecisionDoubleSingle);
+            
+            std::cout << "precision " << kEnginePrecisions[m_Options.mnPrecision];
+            break;
+            
+        case 'x':
+            m_Options.mnPotential = NBodyEngineCycle(m_Options.mnPotential,
+                                                     NBody::Simulation::ePotentialPointMass,
+                                                     NBody::Simulation::ePotentialMiyamotoNagai);
+            
+            std::cout << "background potential " << kEnginePotentials[m_Options.mnPotential];
+            break;
+            
+        case 't':
+            m_Options.mnBlockLevels = (m_Options.mnBlockLevels > 0) ? 0 : kEngineBlockLevels;
+            
+            std::cout << "block time steps " << ((m_Options.mnBlockLevels > 0) ? "on" : "off");
+            break;
+            
+        case 'g':
+            m_Options.mnGasCount = (m_Options.mnGasCount > 0) ? 0 : nShare;
+            
+            std::cout << "gas bodies " << m_Options.mnGasCount;
+            break;
+            
+        case 'd':
+            m_Options.mnDarkCount   = (m_Options.mnDarkCount > 0) ? 0 : nShare;
+            m_Options.mnTracerCount = m_Options.mnDarkCount;
+            
+            std::cout << "dark matter and tracer bodies " << m_Options.mnDarkCount;
+            break;
+            
+        case 'm':
+            m_Options.mnMergeRadius = (m_Options.mnMergeRadius > 0.0f) ? 0.0f : kEngineMergeFraction;
+            
+            std::cout << "merging " << ((m_Options.mnMergeRadius > 0.0f) ? "on" : "off");
+            break;
+            
+        case 'o':
+            m_Options.mnPeriodic = (m_Options.mnPeriodic > 0) ? 0 : 1;
+            
+            std::cout << "periodic box " << ((m_Options.mnPeriodic > 0) ? "on" : "off");
+            break;
+            
+        case 'l':
+            m_Options.mnLayout = (m_Options.mnLayout == NBody::Simulation::eLayoutSoA)
+            ? NBody::Simulation::eLayoutDefault
+            : NBody::Simulation::eLayoutSoA;
+            
+            std::cout << "gpu layout " << ((m_Options.mnLayout == NBody::Simulation::eLayoutSoA) ? "streams" : "bodies");
+            break;
+    } // switch
+    
+    std::cout << std::endl;
+    
+    reset(mnActiveDemo);
+} // setOption
+
+// The merge radius is kept as a fraction of the softening, so that it
+// scales with each demo
+void NBody::Engine::options()
+{
+    m_ActiveParams.mnSolver      = m_Options.mnSolver;
+    m_ActiveParams.mnIntegrator  = m_Options.mnIntegrator;
+    m_ActiveParams.mnPrecision   = m_Options.mnPrecision;
+    m_ActiveParams.mnBlockLevels = m_Options.mnBlockLevels;
+    m_ActiveParams.mnLayout      = m_Options.mnLayout;
+    m_ActiveParams.mnGasCount    = m_Options.mnGasCount;
+    m_ActiveParams.mnDarkCount   = m_Options.mnDarkCount;
+    m_ActiveParams.mnTracerCount = m_Options.mnTracerCount;
+    m_ActiveParams.mnMergeRadius = m_Options.mnMergeRadius * m_ActiveParams.mnSoftening;
+    m_ActiveParams.mnPotential   = m_Options.mnPotential;
+    m_ActiveParams.mnPeriodic    = m_Options.mnPeriodic;
+} // options
+
 #pragma mark -
 #pragma mark Public - Constructor
 
@@ -194,6 +346,7 @@ NBody::Engine::Engine(const GLfloat& nStarScale,
                       const GLuint& nActiveDemo)
 {
     std::memset(&m_ActiveParams, 0x0, sizeof(NBody::Simulation::Params));
+    std::memset(&m_Options, 0x0, sizeof(NBody::Simulation::Params));
     
     mbWaitingForData  = true;
     mbIsRotating      = true;
@@ -307,10 +460,29 @@ void NBody::Engine::run(const GLubyte& nCommand)
             restart();
             break;
             
+        case 'b':
+            mpMediator->benchmark();
+            break;
+            
         case 'n':
             nextDemo();
             break;
             
+        // Solver, integrator, precision and background potential cycle
+        // through their choices, the other options are switched on and off
+        case 's':
+        case 'i':
+        case 'p':
+        case 'x':
+        case 't':
+        case 'g':
+        case 'd':
+        case 'm':
+        case 'o':
+        case 'l':
+            setOption(nCommand);
+            break;
+            
         case '0': // galaxy
         case '1':
         case '2':
@@ -358,6 +530,8 @@ void NBody::Engine::setActiveDemo(const GLuint& nActiveDemo)
 {
     mnActiveDemo   = nActiveDemo;
     m_ActiveParams = NBody::Simulation::Demo::kParams[mnActiveDemo];
+    
+    options();
 } // setActiveDemo
 
 void NBody::Engine::setFrame(const CGRect& rFrame)
@@ -0,0 +1,53 @@
+/*
+     File: NBodySimulationBarnesHut.h
+ Abstract: 
+ Utility class for managing a Barnes-Hut tree code on the cpu for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_BARNES_HUT_H_
+#define _NBODY_SIMULATION_BARNES_HUT_H_
+
+#import "NBodySimulationCPU.h"
+#import "NBodySimulationOctree.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class BarnesHut : public CPU
+        {
+        public:
+            BarnesHut(const size_t& nBodies,
+                      const Params& rParams);
+            
+            virtual ~BarnesHut();
+            
+        protected:
+            // Rebuild the octree and walk it once for every small group of
+            // bodies, accepting cells that subtend less than the opening
+            // angle from all of the group's bodies
+            void accelerate();
+            
+            // No jerk from the approximate forces, so Hermite falls back
+            // to leapfrog
+            bool jerk();
+            
+            // No direct sum kernels to benchmark
+            void measure();
+            
+        private:
+            GLfloat              mnOpeningAngle;
+            Octree               m_Octree;
+            std::vector<GLuint>  m_Groups;
+        }; // BarnesHut
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
@@ -0,0 +1,355 @@
+/*
+     File: NBodySimulationBarnesHut.mm
+ Abstract: 
+ Utility class for managing a Barnes-Hut tree code on the cpu for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <atomic>
+#import <cfloat>
+#import <cmath>
+#import <cstring>
+#import <iostream>
+
+#import "NBodySimulationBarnesHut.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Groups handed to a worker at a time
+static const size_t kGrainSize = 4;
+
+// Largest cell whose bodies share one interaction list
+static const GLuint kGroupCount = 64;
+
+// Sink bodies evaluated together against the list, one vector loop
+static const size_t kGroupSize = 16;
+
+// Deepest walk is 21 levels of at most 8 pending children
+static const size_t kStackSize = 256;
+
+#pragma mark -
+#pragma mark Private - Data Structures
+
+// Interaction list shared by the bodies of one group: the bodies of the
+// opened leaves as structure-of-arrays, and the accepted cells
+struct NBodySimulationBarnesHutList
+{
+    std::vector<GLfloat> m_Source[4];
+    std::vector<GLuint>  m_Cells;
+};
+
+typedef struct NBodySimulationBarnesHutList NBodySimulationBarnesHutList;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Walk the tree once for all bodies of a group. A cell is accepted when
+// its centre of mass is outside the opening radius from every point of
+// the group's bounding box, so the list is valid for each of its bodies.
+static void NBodySimulationBarnesHutGather(const NBody::Simulation::Octree& rTree,
+                                           const NBody::Simulation::Octree::Node& rGroup,
+                                           NBodySimulationBarnesHutList& rList)
+{
+    const NBody::Simulation::Octree::Node *pNodes = rTree.nodes().data();
+    
+    const GLfloat *pPosition = rTree.positions();
+    
+    GLfloat lo[3] = { FLT_MAX,  FLT_MAX,  FLT_MAX};
+    GLfloat hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    
+    GLuint i;
+    GLuint k;
+    
+    for(i = rGroup.mnFirst; i < (rGroup.mnFirst + rGroup.mnCount); ++i)
+    {
+        for(k = 0; k < 3; ++k)
+        {
+            lo[k] = std::min(lo[k], pPosition[4 * i + k]);
+            hi[k] = std::max(hi[k], pPosition[4 * i + k]);
+        } // for
+    } // for
+    
+    for(k = 0; k < 4; ++k)
+    {
+        rList.m_Source[k].clear();
+    } // for
+    
+    rList.m_Cells.clear();
+    
+    GLuint stack[kStackSize];
+    
+    size_t nDepth = 0;
+    
+    stack[nDepth++] = 0;
+    
+    while(nDepth)
+    {
+        const GLuint nNode = stack[--nDepth];
+        
+        const NBody::Simulation::Octree::Node& rNode = pNodes[nNode];
+        
+        const GLfloat dx = std::max(std::max(lo[0] - rNode.mnMass[0], rNode.mnMass[0] - hi[0]), 0.0f);
+        const GLfloat dy = std::max(std::max(lo[1] - rNode.mnMass[1], rNode.mnMass[1] - hi[1]), 0.0f);
+        const GLfloat dz = std::max(std::max(lo[2] - rNode.mnMass[2], rNode.mnMass[2] - hi[2]), 0.0f);
+        
+        if((dx * dx + dy * dy + dz * dz) > rNode.mnOpen)
+        {
+            rList.m_Cells.push_back(nNode);
+        } // if
+        else if(rNode.mnChildren)
+        {
+            GLuint c;
+            
+            for(c = 0; c < rNode.mnChildren; ++c)
+            {
+                stack[nDepth++] = rNode.mnChild + c;
+            } // for
+        } // else if
+        else
+        {
+            for(i = rNode.mnFirst; i < (rNode.mnFirst + rNode.mnCount); ++i)
+            {
+                for(k = 0; k < 4; ++k)
+                {
+                    rList.m_Source[k].push_back(pPosition[4 * i + k]);
+                } // for
+            } // for
+        } // else
+    } // while
+} // NBodySimulationBarnesHutGather
+
+// Accelerations on up to kGroupSize sink bodies from an interaction list.
+// Bodies are summed with the same maths as ComputeForce, accepted cells
+// contribute their softened monopole and quadrupole terms. Sinks are the
+// inner loop so that it vectorizes without reassociating the sums.
+static void NBodySimulationBarnesHutEvaluate(const NBody::Simulation::Octree& rTree,
+                                             const NBodySimulationBarnesHutList& rList,
+                                             const GLfloat * const pSink,
+                                             const size_t& nCount,
+                                             const GLfloat& nSofteningSq,
+                                             GLfloat *pAcceleration)
+{
+    const NBody::Simulation::Octree::Node *pNodes = rTree.nodes().data();
+    
+    GLfloat x[kGroupSize];
+    GLfloat y[kGroupSize];
+    GLfloat z[kGroupSize];
+    
+    GLfloat ax[kGroupSize];
+    GLfloat ay[kGroupSize];
+    GLfloat az[kGroupSize];
+    
+    size_t i;
+    size_t j;
+    
+    // Short groups are padded with the first sink, so that every inner
+    // loop has the same fixed trip count
+    for(i = 0; i < kGroupSize; ++i)
+    {
+        const size_t k = (i < nCount) ? i : 0;
+        
+        x[i] = pSink[4 * k + 0];
+        y[i] = pSink[4 * k + 1];
+        z[i] = pSink[4 * k + 2];
+        
+        ax[i] = 0.0f;
+        ay[i] = 0.0f;
+        az[i] = 0.0f;
+    } // for
+    
+    const GLfloat *pX = rList.m_Source[0].data();
+    const GLfloat *pY = rList.m_Source[1].data();
+    const GLfloat *pZ = rList.m_Source[2].data();
+    const GLfloat *pM = rList.m_Source[3].data();
+    
+    const size_t nBodies = rList.m_Source[0].size();
+    
+    for(j = 0; j < nBodies; ++j)
+    {
+        for(i = 0; i < kGroupSize; ++i)
+        {
+            const GLfloat dx = pX[j] - x[i];
+            const GLfloat dy = pY[j] - y[i];
+            const GLfloat dz = pZ[j] - z[i];
+            
+            const GLfloat d2 = dx * dx + dy * dy + dz * dz + nSofteningSq;
+            const GLfloat r  = 1.0f / std::sqrt(d2);
+            const GLfloat s  = pM[j] * r * r * r;
+            
+            ax[i] += dx * s;
+            ay[i] += dy * s;
+            az[i] += dz * s;
+        } // for
+    } // for
+    
+    for(GLuint nNode : rList.m_Cells)
+    {
+        const NBody::Simulation::Octree::Node& rNode = pNodes[nNode];
+        
+        const GLfloat *q = rNode.mnQuad;
+        
+        for(i = 0; i < kGroupSize; ++i)
+        {
+            const GLfloat dx = rNode.mnMass[0] - x[i];
+            const GLfloat dy = rNode.mnMass[1] - y[i];
+            const GLfloat dz = rNode.mnMass[2] - z[i];
+            
+            const GLfloat r  = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + nSofteningSq);
+            const GLfloat r2 = r * r;
+            const GLfloat r3 = r * r2;
+            const GLfloat r5 = r3 * r2;
+            const GLfloat r7 = r5 * r2;
+            
+            const GLfloat qx = q[0] * dx + q[1] * dy + q[2] * dz;
+            const GLfloat qy = q[1] * dx + q[3] * dy + q[4] * dz;
+            const GLfloat qz = q[2] * dx + q[4] * dy + q[5] * dz;
+            
+            const GLfloat s = rNode.mnMass[3] * r3 + 2.5f * (dx * qx + dy * qy + dz * qz) * r7;
+            
+            ax[i] += dx * s - qx * r5;
+            ay[i] += dy * s - qy * r5;
+            az[i] += dz * s - qz * r5;
+        } // for
+    } // for
+    
+    for(i = 0; i < nCount; ++i)
+    {
+        pAcceleration[4 * i + 0] = ax[i];
+        pAcceleration[4 * i + 1] = ay[i];
+        pAcceleration[4 * i + 2] = az[i];
+        pAcceleration[4 * i + 3] = 0.0f;
+    } // for
+} // NBodySimulationBarnesHutEvaluate
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::BarnesHut::BarnesHut(const size_t& nbodies,
+                                        const NBody::Simulation::Params& params)
+: NBody::Simulation::CPU(nbodies, params)
+, m_Octree(nbodies)
+{
+    mnOpeningAngle = (params.mnOpeningAngle > 0.0f) ? params.mnOpeningAngle : Tree::kOpeningAngle;
+    
+    std::cout
+    << ">> N-body Simulation: Barnes-Hut opening angle "
+    << mnOpeningAngle
+    << std::endl;
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::BarnesHut::~BarnesHut()
+{
+    // The simulation thread walks the octree, so stop it before the
+    // octree is released
+    stop();
+} // Destructor
+
+#pragma mark -
+#pragma mark Protected - Utilities
+
+void NBody::Simulation::BarnesHut::accelerate()
+{
+    m_Octree.build(mpPosition, mnOpeningAngle, m_Dispatch);
+    
+    const std::vector<Octree::Node>& rNodes = m_Octree.nodes();
+    
+    // Sink groups are the largest cells with at most kGroupCount bodies
+    m_Groups.clear();
+    
+    std::vector<GLuint> stack(1, 0);
+    
+    while(!stack.empty())
+    {
+        const GLuint nNode = stack.back();
+        
+        stack.pop_back();
+        
+        if((rNodes[nNode].mnCount <= kGroupCount) || (rNodes[nNode].mnChildren == 0))
+        {
+            m_Groups.push_back(nNode);
+        } // if
+        else
+        {
+            GLuint c;
+            
+            for(c = 0; c < rNodes[nNode].mnChildren; ++c)
+            {
+                stack.push_back(rNodes[nNode].mnChild + c);
+            } // for
+        } // else
+    } // while
+    
+    const GLfloat nSofteningSq = m_ActiveParams.mnSoftening * m_ActiveParams.mnSoftening;
+    
+    const GLuint  *pIndex    = m_Octree.index();
+    const GLfloat *pPosition = m_Octree.positions();
+    
+    std::atomic<size_t> nInteractions(0);
+    
+    parallel(0, m_Groups.size(), kGrainSize, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        NBodySimulationBarnesHutList list;
+        
+        GLfloat acceleration[4 * kGroupSize];
+        
+        size_t nCount = 0;
+        size_t l;
+        size_t g;
+        size_t i;
+        
+        for(l = nBegin; l < nEnd; ++l)
+        {
+            const Octree::Node& rGroup = rNodes[m_Groups[l]];
+            
+            NBodySimulationBarnesHutGather(m_Octree, rGroup, list);
+            
+            for(g = rGroup.mnFirst; g < (rGroup.mnFirst + rGroup.mnCount); g += kGroupSize)
+            {
+                const size_t nGroup = std::min(kGroupSize, size_t(rGroup.mnFirst + rGroup.mnCount) - g);
+                
+                NBodySimulationBarnesHutEvaluate(m_Octree,
+                                                 list,
+                                                 pPosition + 4 * g,
+                                                 nGroup,
+                                                 nSofteningSq,
+                                                 acceleration);
+                
+                // Scatter back to the active range only
+                for(i = 0; i < nGroup; ++i)
+                {
+                    const size_t j = pIndex[g + i];
+                    
+                    if((j >= mnMinIndex) && (j < mnMaxIndex))
+                    {
+                        std::memcpy(mpAcceleration + 4 * j, acceleration + 4 * i, 4 * sizeof(GLfloat));
+                        
+                        nCount += list.m_Source[0].size() + list.m_Cells.size();
+                    } // if
+                } // for
+            } // for
+        } // for
+        
+        nInteractions += nCount;
+    });
+    
+    mnInteractions = GLdouble(nInteractions.load());
+} // accelerate
+
+bool NBody::Simulation::BarnesHut::jerk()
+{
+    return false;
+} // jerk
+
+void NBody::Simulation::BarnesHut::measure()
+{
+} // measure
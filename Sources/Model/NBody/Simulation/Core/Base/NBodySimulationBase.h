@@ -51,6 +51,7 @@
 #ifndef _NBODY_SIMULATION_BASE_H_
 #define _NBODY_SIMULATION_BASE_H_
 
+#import <atomic>
 #import <string>
 
 #import <pthread.h>
@@ -89,12 +90,23 @@ namespace NBody
             
             void exit();
             
+            // Time the alternative force kernels of the simulator before
+            // its next step, and log the results. Ignored by simulators
+            // with a single kernel.
+            void benchmark();
+            
             const bool isAcquired() const;
             const bool isPaused()   const;
             const bool isStopped()  const;
             
+            // Whether initialize returned without acquiring the simulator,
+            // in which case the thread has exited without a single step
+            const bool isFailed()   const;
+            
             const GLdouble&  performance() const;
             const GLdouble&  updates()     const;
+            const GLdouble&  hydro()       const;
+            const GLdouble&  hydroTime()   const;
             const GLdouble&  year()        const;
             const size_t&    size()        const;
             const size_t&    minimum()     const;
@@ -110,20 +122,49 @@ namespace NBody
                           
             void invalidate(const bool& v = true);
             
-            void setData(const GLfloat * const pData);
+            // Publish positions for data(), always as float4 bodies.
+            // Positions in the stream layout are interleaved on the way.
+            void setData(const GLfloat * const pData,
+                         const GLuint& nLayout = eLayoutAoS);
+            
+            // Publish positions owned by the simulator, as float4 bodies,
+            // for data() without a copy. Frames displaced before they are
+            // taken go back through release().
+            void setFrame(GLfloat *pFrame);
             
             GLfloat *data();
             
+            // Hand back positions taken from data() once the consumer is
+            // done with them, freed unless the simulator owns them
+            virtual void release(GLfloat *pData);
+            
+            // Whether the last published positions have been taken by
+            // data(), so that the consumer is waiting on newer ones
+            const bool isConsumed() const;
+            
         private:
             
             void run();
             
             friend void *simulate(void *arg);
             
+        protected:
+            
+            // Convert between float4 bodies and the first nStreams of
+            // their components as separate streams of mnBodyCount floats
+            void split(const GLfloat * const pBodies,
+                       GLfloat *pStreams,
+                       const size_t& nStreams) const;
+            
+            void merge(const GLfloat * const pStreams,
+                       GLfloat *pBodies,
+                       const size_t& nStreams) const;
+            
         protected:
             
             bool     mbAcquired;
             bool     mbIsUpdated;
+            bool     mbBenchmark;
             GLuint   mnDeviceCount;
             GLuint   mnDevices;
             size_t   mnLength;
@@ -135,6 +176,19 @@ namespace NBody
             String   m_DeviceName;
             Params   m_ActiveParams;
             
+            // Pairwise interactions evaluated by a single step. Simulators
+            // that do not perform a direct sum update this every step.
+            GLdouble mnInteractions;
+            
+            // Integration steps taken by a single call to step, for the
+            // update rate and the simulated years
+            GLuint   mnStepCount;
+            
+            // Pairs visited by the gas passes of a single step, and the
+            // seconds spent in them, for simulators with gas bodies
+            GLdouble mnHydroInteractions;
+            GLdouble mnHydroTime;
+            
         private:
             
             bool  mbStop;
@@ -142,6 +196,8 @@ namespace NBody
             bool  mbPaused;
             bool  mbKeepAlive;
             
+            std::atomic<bool>   mbFailed;
+            
             String              m_Options;
             
             void * volatile     mpData;
@@ -154,6 +210,8 @@ namespace NBody
             GLdouble            mnYear;
             GLdouble            mnFreq;
             GLdouble            mnDelta;
+            GLdouble            mnPerf;
+            GLdouble            mnHydroPerf;
             size_t              mnCardinality;
         }; // Base
     } // Simulation
@@ -53,6 +53,8 @@
 
 #import <libkern/OSAtomic.h>
 
+#include <chrono>
+#include <cstring>
 #include <thread>
 #include <stdio.h>
 
@@ -100,10 +102,12 @@ NBody::Simulation::Base::Base(const size_t& nbodies,
         
         mbAcquired  = false;
         mbIsUpdated = true;
+        mbBenchmark = false;
         mbKeepAlive = true;
         mbStop      = false;
         mbReload    = false;
         mbPaused    = false;
+        mbFailed    = false;
         
         mpData   = NULL;
         m_Thread = NULL;
@@ -114,6 +118,16 @@ NBody::Simulation::Base::Base(const size_t& nbodies,
         mnDeviceCount = 0;
         mnDevices     = 0;
         
+        mnYear         = 0.0;
+        mnFreq         = 0.0;
+        mnPerf         = 0.0;
+        mnInteractions = GLdouble(mnCardinality);
+        mnStepCount    = 1;
+        
+        mnHydroInteractions = 0.0;
+        mnHydroTime         = 0.0;
+        mnHydroPerf         = 0.0;
+        
         CF::Query::Hardware hw;
         
         // This number is used to measure relative performance.
@@ -165,6 +179,11 @@ const bool NBody::Simulation::Base::isStopped() const
     return mbStop;
 } // isStopped
 
+const bool NBody::Simulation::Base::isFailed() const
+{
+    return mbFailed.load(std::memory_order_acquire);
+} // isFailed
+
 void NBody::Simulation::Base::start(const bool& paused)
 {
     pause();
@@ -177,15 +196,20 @@ void NBody::Simulation::Base::start(const bool& paused)
     } // if
 } // start
 
+// Derived simulators stop the thread before their own members are
+// released, so a second call from a base destructor does nothing
 void NBody::Simulation::Base::stop()
 {
-    pause();
+    if(!mbStop)
     {
-        mbStop = true;
-    }
-    unpause();
-    
-    pthread_join(m_Thread, NULL);
+        pause();
+        {
+            mbStop = true;
+        }
+        unpause();
+        
+        pthread_join(m_Thread, NULL);
+    } // if
     
     mbAcquired = false;
 } // stop
@@ -218,6 +242,11 @@ void NBody::Simulation::Base::exit()
     mbKeepAlive = false;
 } // exit
 
+void NBody::Simulation::Base::benchmark()
+{
+    mbBenchmark = true;
+} // benchmark
+
 void NBody::Simulation::Base::resetParams(const NBody::Simulation::Params& params)
 {
     pause();
@@ -251,15 +280,61 @@ void NBody::Simulation::Base::invalidate(const bool& v)
     mbIsUpdated = v;
 } // invalidate
 
-void NBody::Simulation::Base::setData(const GLfloat * const pData)
+void NBody::Simulation::Base::split(const GLfloat * const pBodies,
+                                    GLfloat *pStreams,
+                                    const size_t& nStreams) const
+{
+    size_t i;
+    size_t k;
+    
+    for(k = 0; k < nStreams; ++k)
+    {
+        GLfloat *pStream = pStreams + k * mnBodyCount;
+        
+        for(i = 0; i < mnBodyCount; ++i)
+        {
+            pStream[i] = pBodies[4 * i + k];
+        } // for
+    } // for
+} // split
+
+// Components past nStreams are left as they are
+void NBody::Simulation::Base::merge(const GLfloat * const pStreams,
+                                    GLfloat *pBodies,
+                                    const size_t& nStreams) const
+{
+    size_t i;
+    size_t k;
+    
+    for(k = 0; k < nStreams; ++k)
+    {
+        const GLfloat *pStream = pStreams + k * mnBodyCount;
+        
+        for(i = 0; i < mnBodyCount; ++i)
+        {
+            pBodies[4 * i + k] = pStream[i];
+        } // for
+    } // for
+} // merge
+
+void NBody::Simulation::Base::setData(const GLfloat * const pData,
+                                      const GLuint& nLayout)
 {
     if(pData != NULL)
     {
-        GLfloat *pDataDst = (GLfloat *)calloc(mnLength, mnSamples);
+        // Every element is written below, so there is nothing to zero
+        GLfloat *pDataDst = (GLfloat *)malloc(mnSize);
         
         if(pDataDst != NULL)
         {
-            std::memcpy(pDataDst, pData, mnSize);
+            if(nLayout == eLayoutSoA)
+            {
+                merge(pData, pDataDst, 4);
+            } // if
+            else
+            {
+                std::memcpy(pDataDst, pData, mnSize);
+            } // else
             
             void *pDataSrc = NULL;
             
@@ -269,13 +344,29 @@ void NBody::Simulation::Base::setData(const GLfloat * const pData)
             }
             while(!OSAtomicCompareAndSwapPtrBarrier(pDataSrc, pDataDst, &mpData));
             
-            free(pDataSrc);
+            release((GLfloat *)pDataSrc);
             
             pDataSrc = NULL;
         }// if
     } // if
 } // setData
 
+void NBody::Simulation::Base::setFrame(GLfloat *pFrame)
+{
+    if(pFrame != NULL)
+    {
+        void *pDataSrc = NULL;
+        
+        do
+        {
+            pDataSrc = mpData;
+        }
+        while(!OSAtomicCompareAndSwapPtrBarrier(pDataSrc, pFrame, &mpData));
+        
+        release((GLfloat *)pDataSrc);
+    } // if
+} // setFrame
+
 GLfloat *NBody::Simulation::Base::data()
 {
     void *pDataSrc = NULL;
@@ -289,10 +380,32 @@ GLfloat *NBody::Simulation::Base::data()
     return (GLfloat *)pDataSrc;
 } // data
 
+void NBody::Simulation::Base::release(GLfloat *pData)
+{
+    if(pData != NULL)
+    {
+        free(pData);
+    } // if
+} // release
+
+const bool NBody::Simulation::Base::isConsumed() const
+{
+    return mpData == NULL;
+} // isConsumed
+
 void NBody::Simulation::Base::run()
 {
     initialize(m_Options);
     
+    // Resources set up before the failure are released by the destructor
+    // of the simulator, after it has joined this thread
+    if(!mbAcquired)
+    {
+        mbFailed.store(true, std::memory_order_release);
+        
+        return;
+    } // if
+    
     while(mbKeepAlive)
     {
         pthread_mutex_lock(&m_RunLock);
@@ -311,12 +424,27 @@ void NBody::Simulation::Base::run()
                 mbReload = false;
             } // if
             
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            
             step();
+            
+            std::chrono::duration<GLdouble> elapsed = std::chrono::high_resolution_clock::now() - start;
+            
+            if(elapsed.count() > 0.0)
+            {
+                mnFreq = GLdouble(mnStepCount) / elapsed.count();
+                mnPerf = mnInteractions * mnFreq;
+            } // if
+            
+            if(mnHydroTime > 0.0)
+            {
+                mnHydroPerf = mnHydroInteractions / mnHydroTime;
+            } // if
         }
         pthread_mutex_unlock(&m_RunLock);
                 
         // normalize for NBody::Scale::kTime at 0.4
-        mnYear += kScaleYear * m_ActiveParams.mnTimeStamp;
+        mnYear += kScaleYear * m_ActiveParams.mnTimeStamp * mnStepCount;
         
         std::this_thread::yield();
     } // while
@@ -324,6 +452,27 @@ void NBody::Simulation::Base::run()
     terminate();
 } // run
 
+const GLdouble& NBody::Simulation::Base::performance() const
+{
+    return mnPerf;
+} // performance
+
+const GLdouble& NBody::Simulation::Base::updates() const
+{
+    return mnFreq;
+} // updates
+
+// Pair interactions per second in the gas passes alone
+const GLdouble& NBody::Simulation::Base::hydro() const
+{
+    return mnHydroPerf;
+} // hydro
+
+const GLdouble& NBody::Simulation::Base::hydroTime() const
+{
+    return mnHydroTime;
+} // hydroTime
+
 const GLdouble& NBody::Simulation::Base::year() const
 {
     return mnYear;
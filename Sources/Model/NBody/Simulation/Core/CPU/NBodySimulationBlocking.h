@@ -0,0 +1,76 @@
+/*
+     File: NBodySimulationBlocking.h
+ Abstract:
+ Cache blocked direct sum for the cpu simulators, with sink blocks sized
+ to the L1 cache, source tiles sized to the L2 cache, and block sizes
+ tuned per host model.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_BLOCKING_H_
+#define _NBODY_SIMULATION_BLOCKING_H_
+
+#import <string>
+
+#import <OpenGL/OpenGL.h>
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class Blocking
+        {
+        public:
+            // Largest sink block, bounded by the accumulators kept on
+            // the stack of each worker
+            static const size_t kBlockMax = 256;
+            
+        public:
+            // Sizes from the caches of the host, or from an earlier
+            // tuning run on the same model when one was stored
+            Blocking();
+            
+            virtual ~Blocking();
+            
+            // Accelerations of the sinks [nBegin, nEnd), stored as float4,
+            // from all nCount source bodies in structure-of-arrays form
+            void accelerate(const GLfloat * const * const pSource,
+                            const size_t& nCount,
+                            const size_t& nBegin,
+                            const size_t& nEnd,
+                            const GLfloat& nSoftening,
+                            GLfloat *pAcceleration) const;
+            
+            // Time the candidate sizes on the calling thread, keep the
+            // fastest, and store them for the host model
+            void tune(const GLfloat * const * const pSource,
+                      const size_t& nCount,
+                      const GLfloat& nSoftening);
+            
+            const size_t& block()  const;
+            const size_t& tile()   const;
+            const size_t& unroll() const;
+            
+            const bool& isTuned() const;
+            
+        private:
+            bool load();
+            void store() const;
+            
+        private:
+            size_t       mnBlock;
+            size_t       mnTile;
+            size_t       mnUnroll;
+            bool         mbTuned;
+            std::string  m_Key;
+        }; // Blocking
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
@@ -0,0 +1,475 @@
+/*
+     File: NBodySimulationBlocking.mm
+ Abstract:
+ Cache blocked direct sum for the cpu simulators, with sink blocks sized
+ to the L1 cache, source tiles sized to the L2 cache, and block sizes
+ tuned per host model.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <chrono>
+#import <cmath>
+#import <iostream>
+#import <vector>
+
+#import <CoreFoundation/CoreFoundation.h>
+
+#import "CFQueryHardware.h"
+
+#import "NBodySimulationBlocking.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Smallest sink block, and the alignment of source tiles to cache lines
+static const size_t kBlockMin = 16;
+static const size_t kTileMin  = 256;
+static const size_t kTileMax  = 16384;
+static const size_t kLineSize = 16;
+
+// Bytes per sink held in L1, position and accumulator, and per source
+// held in L2, position and mass
+static const size_t kSinkBytes   = 6 * sizeof(GLfloat);
+static const size_t kSourceBytes = 4 * sizeof(GLfloat);
+
+// Sinks used to time each candidate, and the timed runs of each
+static const size_t kTuneSinks = 512;
+static const size_t kTuneRuns  = 2;
+
+// Prefix of the preference key holding the tuned sizes of a model
+static const char *kPreferenceKey = "NBodyBlocking.";
+
+#pragma mark -
+#pragma mark Private - Class Constants
+
+const size_t NBody::Simulation::Blocking::kBlockMax;
+
+#pragma mark -
+#pragma mark Private - Utilities - Kernels
+
+// Largest power of two no greater than n
+static size_t NBodySimulationBlockingFloor2(const size_t& n)
+{
+    size_t p = 1;
+    
+    while((p << 1) <= n)
+    {
+        p <<= 1;
+    } // while
+    
+    return p;
+} // NBodySimulationBlockingFloor2
+
+// Sources [nBegin, nEnd) on a block of nRows sinks, U sources at a time.
+// The sink loop is innermost, so that it vectorises, and the U sources
+// are fully unrolled within it, like the manual unroll of the force loop
+// in the IntegrateSystem kernel.
+template <size_t U>
+static void NBodySimulationBlockingTile(const GLfloat * const * const pSource,
+                                        const size_t& nBegin,
+                                        const size_t& nEnd,
+                                        const size_t& nRows,
+                                        const GLfloat& nSofteningSq,
+                                        const GLfloat * __restrict pXi,
+                                        const GLfloat * __restrict pYi,
+                                        const GLfloat * __restrict pZi,
+                                        GLfloat * __restrict pAx,
+                                        GLfloat * __restrict pAy,
+                                        GLfloat * __restrict pAz)
+{
+    const GLfloat *pX = pSource[0];
+    const GLfloat *pY = pSource[1];
+    const GLfloat *pZ = pSource[2];
+    const GLfloat *pM = pSource[3];
+    
+    size_t i;
+    size_t j;
+    size_t u;
+    
+    for(j = nBegin; (j + U) <= nEnd; j += U)
+    {
+        for(i = 0; i < nRows; ++i)
+        {
+            GLfloat ax = pAx[i];
+            GLfloat ay = pAy[i];
+            GLfloat az = pAz[i];
+
+#pragma clang loop unroll(full)
+            for(u = 0; u < U; ++u)
+            {
+                const GLfloat dx = pX[j + u] - pXi[i];
+                const GLfloat dy = pY[j + u] - pYi[i];
+                const GLfloat dz = pZ[j + u] - pZi[i];
+                
+                const GLfloat d2 = dx * dx + dy * dy + dz * dz + nSofteningSq;
+                const GLfloat r  = 1.0f / std::sqrt(d2);
+                const GLfloat s  = pM[j + u] * r * r * r;
+                
+                ax += dx * s;
+                ay += dy * s;
+                az += dz * s;
+            } // for
+            
+            pAx[i] = ax;
+            pAy[i] = ay;
+            pAz[i] = az;
+        } // for
+    } // for
+} // NBodySimulationBlockingTile
+
+// Touch the lines of [nBegin, nEnd) of every source stream, so that the
+// next tile is on its way to the L2 cache while this one is summed
+static void NBodySimulationBlockingPrefetch(const GLfloat * const * const pSource,
+                                            const size_t& nBegin,
+                                            const size_t& nEnd)
+{
+    size_t j;
+    size_t k;
+    
+    for(k = 0; k < 4; ++k)
+    {
+        for(j = nBegin; j < nEnd; j += kLineSize)
+        {
+            __builtin_prefetch(pSource[k] + j, 0, 2);
+        } // for
+    } // for
+} // NBodySimulationBlockingPrefetch
+
+// The source tiles are outermost, so that a tile stays in L2 while every
+// sink block of the range sweeps it, and the partial sums of each block
+// are carried between tiles in the output
+static void NBodySimulationBlockingAccelerate(const GLfloat * const * const pSource,
+                                              const size_t& nCount,
+                                              const size_t& nBegin,
+                                              const size_t& nEnd,
+                                              const GLfloat& nSoftening,
+                                              const size_t& nBlock,
+                                              const size_t& nTile,
+                                              const size_t& nUnroll,
+                                              GLfloat *pAcceleration)
+{
+    const GLfloat nSofteningSq = nSoftening * nSoftening;
+    
+    const size_t nBlocks = (nEnd - nBegin + nBlock - 1) / nBlock;
+    
+    GLfloat ax[NBody::Simulation::Blocking::kBlockMax];
+    GLfloat ay[NBody::Simulation::Blocking::kBlockMax];
+    GLfloat az[NBody::Simulation::Blocking::kBlockMax];
+    
+    size_t i;
+    size_t r;
+    size_t b;
+    size_t j;
+    
+    for(j = 0; j < nCount; j += nTile)
+    {
+        const size_t jEnd  = std::min(j + nTile, nCount);
+        const size_t jNext = std::min(jEnd + nTile, nCount);
+        const size_t jTail = jEnd - (jEnd - j) % nUnroll;
+        
+        // A share of the next tile for each block, in whole lines
+        const size_t nSlice = (((jNext - jEnd + nBlocks - 1) / nBlocks) + kLineSize - 1) & ~(kLineSize - 1);
+        
+        for(i = nBegin, b = 0; i < nEnd; i += nBlock, ++b)
+        {
+            const size_t nRows = std::min(nBlock, nEnd - i);
+            
+            for(r = 0; r < nRows; ++r)
+            {
+                ax[r] = (j == 0) ? 0.0f : pAcceleration[4 * (i + r) + 0];
+                ay[r] = (j == 0) ? 0.0f : pAcceleration[4 * (i + r) + 1];
+                az[r] = (j == 0) ? 0.0f : pAcceleration[4 * (i + r) + 2];
+            } // for
+            
+            if(jEnd < jNext)
+            {
+                NBodySimulationBlockingPrefetch(pSource,
+                                                std::min(jEnd + b * nSlice, jNext),
+                                                std::min(jEnd + (b + 1) * nSlice, jNext));
+            } // if
+            
+            const GLfloat *pXi = pSource[0] + i;
+            const GLfloat *pYi = pSource[1] + i;
+            const GLfloat *pZi = pSource[2] + i;
+            
+            switch(nUnroll)
+            {
+                case 8:
+                    NBodySimulationBlockingTile<8>(pSource, j, jTail, nRows, nSofteningSq, pXi, pYi, pZi, ax, ay, az);
+                    break;
+                
+                case 4:
+                    NBodySimulationBlockingTile<4>(pSource, j, jTail, nRows, nSofteningSq, pXi, pYi, pZi, ax, ay, az);
+                    break;
+                
+                case 2:
+                    NBodySimulationBlockingTile<2>(pSource, j, jTail, nRows, nSofteningSq, pXi, pYi, pZi, ax, ay, az);
+                    break;
+                
+                default:
+                    NBodySimulationBlockingTile<1>(pSource, j, jTail, nRows, nSofteningSq, pXi, pYi, pZi, ax, ay, az);
+                    break;
+            } // switch
+            
+            NBodySimulationBlockingTile<1>(pSource, jTail, jEnd, nRows, nSofteningSq, pXi, pYi, pZi, ax, ay, az);
+            
+            for(r = 0; r < nRows; ++r)
+            {
+                pAcceleration[4 * (i + r) + 0] = ax[r];
+                pAcceleration[4 * (i + r) + 1] = ay[r];
+                pAcceleration[4 * (i + r) + 2] = az[r];
+                pAcceleration[4 * (i + r) + 3] = 0.0f;
+            } // for
+        } // for
+    } // for
+} // NBodySimulationBlockingAccelerate
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Stored sizes are an array of block, tile and unroll, under a key
+// that names the host model
+bool NBody::Simulation::Blocking::load()
+{
+    bool bLoaded = false;
+    
+    CFStringRef pKey = CFStringCreateWithCString(kCFAllocatorDefault, m_Key.c_str(), kCFStringEncodingUTF8);
+    
+    if(pKey != NULL)
+    {
+        CFPropertyListRef pValue = CFPreferencesCopyAppValue(pKey, kCFPreferencesCurrentApplication);
+        
+        if(pValue != NULL)
+        {
+            if((CFGetTypeID(pValue) == CFArrayGetTypeID()) && (CFArrayGetCount(CFArrayRef(pValue)) == 3))
+            {
+                long nSizes[3] = {0, 0, 0};
+                
+                CFIndex k;
+                
+                bLoaded = true;
+                
+                for(k = 0; k < 3; ++k)
+                {
+                    CFTypeRef pSize = CFArrayGetValueAtIndex(CFArrayRef(pValue), k);
+                    
+                    bLoaded = bLoaded
+                    && (CFGetTypeID(pSize) == CFNumberGetTypeID())
+                    && CFNumberGetValue(CFNumberRef(pSize), kCFNumberLongType, &nSizes[k])
+                    && (nSizes[k] > 0);
+                } // for
+                
+                bLoaded = bLoaded
+                && (size_t(nSizes[0]) <= kBlockMax)
+                && (size_t(nSizes[1]) <= kTileMax)
+                && (nSizes[2] <= 8);
+                
+                if(bLoaded)
+                {
+                    mnBlock  = size_t(nSizes[0]);
+                    mnTile   = size_t(nSizes[1]);
+                    mnUnroll = size_t(nSizes[2]);
+                } // if
+            } // if
+            
+            CFRelease(pValue);
+        } // if
+        
+        CFRelease(pKey);
+    } // if
+    
+    return bLoaded;
+} // load
+
+void NBody::Simulation::Blocking::store() const
+{
+    CFStringRef pKey = CFStringCreateWithCString(kCFAllocatorDefault, m_Key.c_str(), kCFStringEncodingUTF8);
+    
+    if(pKey != NULL)
+    {
+        const long nSizes[3] = {long(mnBlock), long(mnTile), long(mnUnroll)};
+        
+        CFNumberRef pSizes[3] =
+        {
+            CFNumberCreate(kCFAllocatorDefault, kCFNumberLongType, &nSizes[0]),
+            CFNumberCreate(kCFAllocatorDefault, kCFNumberLongType, &nSizes[1]),
+            CFNumberCreate(kCFAllocatorDefault, kCFNumberLongType, &nSizes[2])
+        };
+        
+        if((pSizes[0] != NULL) && (pSizes[1] != NULL) && (pSizes[2] != NULL))
+        {
+            CFArrayRef pValue = CFArrayCreate(kCFAllocatorDefault, (const void **)pSizes, 3, &kCFTypeArrayCallBacks);
+            
+            if(pValue != NULL)
+            {
+                CFPreferencesSetAppValue(pKey, pValue, kCFPreferencesCurrentApplication);
+                CFPreferencesAppSynchronize(kCFPreferencesCurrentApplication);
+                
+                CFRelease(pValue);
+            } // if
+        } // if
+        
+        size_t k;
+        
+        for(k = 0; k < 3; ++k)
+        {
+            if(pSizes[k] != NULL)
+            {
+                CFRelease(pSizes[k]);
+            } // if
+        } // for
+        
+        CFRelease(pKey);
+    } // if
+} // store
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Blocking::Blocking()
+{
+    CF::Query::Hardware hw;
+    
+    // Half of each cache for the working set, leaving the rest to the
+    // output and whatever else shares it
+    mnBlock = NBodySimulationBlockingFloor2(std::max(hw.l1() / (2 * kSinkBytes), kBlockMin));
+    mnBlock = std::min(mnBlock, kBlockMax);
+    
+    mnTile = (hw.l2() / (2 * kSourceBytes)) & ~(kLineSize - 1);
+    mnTile = std::min(std::max(mnTile, kTileMin), kTileMax);
+    
+    mnUnroll = 4;
+    
+    m_Key = std::string(kPreferenceKey) + hw.model();
+    
+    mbTuned = load();
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Blocking::~Blocking()
+{
+    m_Key.clear();
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+void NBody::Simulation::Blocking::accelerate(const GLfloat * const * const pSource,
+                                             const size_t& nCount,
+                                             const size_t& nBegin,
+                                             const size_t& nEnd,
+                                             const GLfloat& nSoftening,
+                                             GLfloat *pAcceleration) const
+{
+    NBodySimulationBlockingAccelerate(pSource, nCount, nBegin, nEnd, nSoftening, mnBlock, mnTile, mnUnroll, pAcceleration);
+} // accelerate
+
+void NBody::Simulation::Blocking::tune(const GLfloat * const * const pSource,
+                                       const size_t& nCount,
+                                       const GLfloat& nSoftening)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    const size_t nSinks = std::min(nCount, kTuneSinks);
+    
+    // Blocks and tiles around the sizes from the caches, and every unroll
+    const size_t nBlocks[4]  = {mnBlock / 4, mnBlock / 2, mnBlock, std::min(2 * mnBlock, kBlockMax)};
+    const size_t nTiles[3]   = {mnTile / 2, mnTile, 2 * mnTile};
+    const size_t nUnrolls[4] = {1, 2, 4, 8};
+    
+    std::vector<GLfloat> acceleration(4 * nSinks);
+    
+    GLdouble nBest = 0.0;
+    
+    size_t nBestBlock  = mnBlock;
+    size_t nBestTile   = mnTile;
+    size_t nBestUnroll = mnUnroll;
+    
+    size_t b;
+    size_t t;
+    size_t u;
+    size_t n;
+    
+    for(b = 0; b < 4; ++b)
+    {
+        if((nBlocks[b] < kBlockMin) || ((b > 0) && (nBlocks[b] == nBlocks[b - 1])))
+        {
+            continue;
+        } // if
+        
+        for(t = 0; t < 3; ++t)
+        {
+            const size_t nTile = std::min(std::max(nTiles[t], kTileMin), kTileMax);
+            
+            for(u = 0; u < 4; ++u)
+            {
+                GLdouble nTime = 0.0;
+                
+                for(n = 0; n < kTuneRuns; ++n)
+                {
+                    Clock::time_point t0 = Clock::now();
+                    
+                    NBodySimulationBlockingAccelerate(pSource, nCount, 0, nSinks, nSoftening, nBlocks[b], nTile, nUnrolls[u], acceleration.data());
+                    
+                    Clock::time_point t1 = Clock::now();
+                    
+                    const GLdouble nRun = std::chrono::duration<GLdouble>(t1 - t0).count();
+                    
+                    nTime = (n == 0) ? nRun : std::min(nTime, nRun);
+                } // for
+                
+                if((nBest == 0.0) || (nTime < nBest))
+                {
+                    nBest       = nTime;
+                    nBestBlock  = nBlocks[b];
+                    nBestTile   = nTile;
+                    nBestUnroll = nUnrolls[u];
+                } // if
+            } // for
+        } // for
+    } // for
+    
+    mnBlock  = nBestBlock;
+    mnTile   = nBestTile;
+    mnUnroll = nBestUnroll;
+    mbTuned  = true;
+    
+    store();
+    
+    std::cout
+    << ">> N-body Simulation: Tuned blocked kernel, block "
+    << mnBlock
+    << ", tile "
+    << mnTile
+    << ", unroll "
+    << mnUnroll
+    << std::endl;
+} // tune
+
+const size_t& NBody::Simulation::Blocking::block() const
+{
+    return mnBlock;
+} // block
+
+const size_t& NBody::Simulation::Blocking::tile() const
+{
+    return mnTile;
+} // tile
+
+const size_t& NBody::Simulation::Blocking::unroll() const
+{
+    return mnUnroll;
+} // unroll
+
+const bool& NBody::Simulation::Blocking::isTuned() const
+{
+    return mbTuned;
+} // isTuned
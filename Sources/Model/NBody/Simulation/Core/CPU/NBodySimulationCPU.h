@@ -0,0 +1,215 @@
+/*
+     File: NBodySimulationCPU.h
+ Abstract: 
+ Utility class for managing cpu bound computes for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_CPU_H_
+#define _NBODY_SIMULATION_CPU_H_
+
+#import <vector>
+
+#import "NBodySimulationBase.h"
+#import "NBodySimulationBlocking.h"
+#import "NBodySimulationCells.h"
+#import "NBodySimulationDispatch.h"
+#import "NBodySimulationEwald.h"
+#import "NBodySimulationExternal.h"
+#import "NBodySimulationHydro.h"
+#import "NBodySimulationMorton.h"
+#import "NBodySimulationRandom.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class CPU : public Base
+        {
+        public:
+            CPU(const size_t& nBodies,
+                const Params& rParams);
+            
+            virtual ~CPU();
+            
+            void initialize(const String& options);
+            
+            GLint reset();
+            void  step();
+            void  terminate();
+            
+        protected:
+            // Compute accelerations for the active range of bodies
+            // into mpAcceleration, from the current positions
+            virtual void accelerate();
+            
+            // Apply boundary conditions to the positions after each
+            // step. Open boundaries by default, so nothing to do.
+            virtual void boundary();
+            
+            // Compute accelerations and jerks for the active range of
+            // bodies into mpAcceleration and m_Jerk, from the current
+            // positions and velocities. Solvers without a jerk return
+            // false, and the Hermite integrator falls back to leapfrog.
+            virtual bool jerk();
+            
+            // Time the direct sum kernels against each other and keep the
+            // fastest. Solvers without a direct sum have nothing to time.
+            virtual void measure();
+            
+            // Split [nBegin, nEnd) into contiguous ranges, aligned to
+            // nGrain, and run the task on all worker threads
+            void parallel(const size_t& nBegin,
+                          const size_t& nEnd,
+                          const size_t& nGrain,
+                          const Dispatch::Task& task);
+                          
+        private:
+            GLint restart();
+            
+            void transpose();
+            
+            // One global time step with the selected integrator, as
+            // kick and drift stages between force evaluations
+            void integrate();
+            void advance(const GLfloat& nKick,
+                         const GLfloat& nDrift,
+                         const GLfloat& nDamping);
+            void leapfrog();
+            void yoshida();
+            void hermite();
+            
+            // Accelerations from the solver and, with a cutoff, the
+            // short range pass over the bodies in neighbouring cells,
+            // the pressure forces of the gas bodies, and the analytic
+            // background field at each body
+            void force();
+            void cutoff();
+            void hydro();
+            void external();
+            
+            // Merge the stars closer than the merge radius in pairs, and
+            // gather the merged bodies past the live ones, which are the
+            // only ones integrated or summed over from then on
+            void collide();
+            void compact(const std::vector<bool>& rMerged);
+            
+            // Direct sums, gathering every pair from both sides or each
+            // pair once into per-worker partial sums, then reduced. The
+            // gathering sum is cache blocked when mbBlocked is set.
+            void asymmetric();
+            void symmetric();
+            void reduce();
+            
+            // Direct sum by blocks of species, with the bodies sorted by
+            // species and a force law for each pair of them, skipping
+            // the blocks without any force. Classify finds the range of
+            // each species among the live bodies.
+            void species();
+            void classify();
+            
+            // Direct sum in a periodic box, over the nearest image of
+            // each pair plus the tabulated Ewald correction for all the
+            // others, with the positions wrapped back into the box
+            void periodic();
+            
+            // Zero the body arrays from the workers that own each range
+            // of them, so that their pages are placed on the domain that
+            // uses them, and time reads of those ranges per domain
+            void touch();
+            void bandwidth();
+            
+            // Sort the bodies into Morton order, every few steps, and
+            // track the original index of each one so that readback
+            // can restore the order the rest of the app expects
+            void reorder();
+            
+            // Gather the state of the first nCount bodies by index
+            void permute(const GLuint * const pIndex,
+                         const size_t& nCount);
+            
+            const GLfloat *ordered();
+            
+            // Hierarchical block time steps. Bodies are kept sorted from
+            // the finest level to the coarsest, so the bodies due for a
+            // kick at any sub-step are a prefix of the range.
+            void   block();
+            void   prime();
+            void   drift(const GLfloat& nTimeStep);
+            void   kick(const size_t& nActive,
+                        const GLuint& nLevel);
+            void   arrange(const size_t& nActive);
+            GLuint level(const GLfloat * const pAcceleration,
+                         const GLfloat * const pJerk) const;
+                         
+        protected:
+            bool          mbTerminated;
+            size_t        mnThreads;
+            Dispatch      m_Dispatch;
+            GLfloat      *mpPosition;
+            GLfloat      *mpVelocity;
+            GLfloat      *mpAcceleration;
+            GLfloat      *mpSource[4];
+            Data::Random  mConductor;
+            std::vector<GLfloat> m_Jerk;
+            
+        private:
+            bool          mbSymmetric;
+            bool          mbBlocked;
+            Blocking     *mpBlocking;
+            GLfloat       mnCutoff;
+            Cells        *mpCells;
+            size_t        mnGasCount;
+            Hydro        *mpHydro;
+            std::vector<Gas> m_Gas;
+            External     *mpExternal;
+            GLfloat       mnMergeRadius;
+            size_t        mnLiveCount;
+            Cells        *mpContacts;
+            std::vector<GLuint> m_Partner;
+            std::vector<GLuint> m_Host;
+            bool          mbSpecies;
+            size_t        mnDarkCount;
+            size_t        mnTracerCount;
+            size_t        m_Range[eSpeciesCount + 1];
+            std::vector<GLubyte> m_Species;
+            bool          mbPeriodic;
+            GLfloat       mnBoxSize;
+            Ewald        *mpEwald;
+            GLuint        mnISA;
+            std::vector<GLfloat> m_Partial;
+            GLuint        mnReorderInterval;
+            size_t        mnSteps;
+            Morton       *mpMorton;
+            GLfloat      *mpOrdered;
+            std::vector<GLuint> m_Identity;
+            GLuint        mnLevels;
+            bool          mbPrimed;
+            std::vector<GLuint>  m_Level;
+            std::vector<GLuint>  m_Order;
+            std::vector<GLfloat> m_Kick;
+            GLuint        mnIntegrator;
+            bool          mbAccelerated;
+            std::vector<GLfloat> m_Velocity;
+            std::vector<GLfloat> m_Start;
+            
+            // Precision of the direct sum and of the kick and drift. The
+            // wider ones keep float low parts of the positions and the
+            // velocities, which writers that only know the high parts
+            // leave at most an ulp stale.
+            GLuint        mnPrecision;
+            GLfloat      *mpSourceLow[3];
+            std::vector<GLfloat> m_PositionLow;
+            std::vector<GLfloat> m_VelocityLow;
+            std::vector<GLfloat> m_SourceLow;
+        }; // CPU
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
@@ -0,0 +1,2960 @@
+/*
+     File: NBodySimulationCPU.mm
+ Abstract: 
+ Utility class for managing cpu bound computes for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <chrono>
+#import <cmath>
+#import <cstring>
+#import <functional>
+#import <iostream>
+
+#if defined(__x86_64__)
+#import <immintrin.h>
+#endif
+
+#import "CFQueryHardware.h"
+
+#import "NBodySimulationCPU.h"
+#import "NBodySimulationPrecision.h"
+
+#pragma mark -
+#pragma mark Private - Enumerated Types
+
+enum NBodySimulationCPUISA
+{
+    eNBodyCPUScalar = 0,
+    eNBodyCPUAVX2,
+    eNBodyCPUAVX512
+};
+
+typedef enum NBodySimulationCPUISA NBodySimulationCPUISA;
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Bodies handed to a worker are a multiple of the widest vector
+static const size_t kGrainSize = 16;
+
+// Bodies in a tile of the symmetric kernel. A pair of tiles, positions
+// and partial accelerations, stays within the L2 cache.
+static const size_t kTileSize = 512;
+
+// Rows of a tile that share each vector of source bodies, as unrolled
+// in the vector kernels
+static const size_t kRows = 4;
+
+// Fewest bodies for which the symmetric kernel is used by default. Below
+// this the partial sums and their reduction cost more than they save.
+static const size_t kSymmetricMin = 8 * kTileSize;
+
+// Evaluations of each kernel timed by a benchmark
+static const size_t kBenchmarkRuns = 3;
+
+#pragma mark -
+#pragma mark Private - Utilities - Kernels
+
+// Same maths as ComputeForce in nbody_gpu.ocl, with the source
+// bodies in structure-of-arrays form (x, y, z and mass streams). Real
+// sets the precision of the positions and accumulators, whose low parts
+// are in the x, y and z streams of pLow when it is compensated.
+template <typename Real>
+static void NBodySimulationCPUAccelerateScalar(const GLfloat * const * const pSource,
+                                               const GLfloat * const * const pLow,
+                                               const size_t& nCount,
+                                               const size_t& nBegin,
+                                               const size_t& nEnd,
+                                               const GLfloat& nSoftening,
+                                               GLfloat *pAcceleration)
+{
+    typedef NBody::Simulation::Arithmetic<Real> Arithmetic;
+    typedef typename Arithmetic::Scalar         Scalar;
+    
+    const GLfloat *pX = pSource[0];
+    const GLfloat *pY = pSource[1];
+    const GLfloat *pZ = pSource[2];
+    const GLfloat *pM = pSource[3];
+    
+    const GLfloat *pXl = Arithmetic::kCompensated ? pLow[0] : pX;
+    const GLfloat *pYl = Arithmetic::kCompensated ? pLow[1] : pY;
+    const GLfloat *pZl = Arithmetic::kCompensated ? pLow[2] : pZ;
+    
+    const Scalar nSofteningSq = Scalar(nSoftening) * Scalar(nSoftening);
+    
+    size_t i;
+    size_t j;
+    
+    for(i = nBegin; i < nEnd; ++i)
+    {
+        const Real x = Arithmetic::load(pX[i], pXl[i]);
+        const Real y = Arithmetic::load(pY[i], pYl[i]);
+        const Real z = Arithmetic::load(pZ[i], pZl[i]);
+        
+        Real ax(0.0f);
+        Real ay(0.0f);
+        Real az(0.0f);
+        
+        for(j = 0; j < nCount; ++j)
+        {
+            const Scalar dx = Scalar(Arithmetic::load(pX[j], pXl[j]) - x);
+            const Scalar dy = Scalar(Arithmetic::load(pY[j], pYl[j]) - y);
+            const Scalar dz = Scalar(Arithmetic::load(pZ[j], pZl[j]) - z);
+            
+            const Scalar d2 = dx * dx + dy * dy + dz * dz + nSofteningSq;
+            const Scalar r  = Scalar(1) / std::sqrt(d2);
+            const Scalar s  = Scalar(pM[j]) * r * r * r;
+            
+            ax += dx * s;
+            ay += dy * s;
+            az += dz * s;
+        } // for
+        
+        pAcceleration[4 * i + 0] = GLfloat(ax);
+        pAcceleration[4 * i + 1] = GLfloat(ay);
+        pAcceleration[4 * i + 2] = GLfloat(az);
+        pAcceleration[4 * i + 3] = 0.0f;
+    } // for
+} // NBodySimulationCPUAccelerateScalar
+
+// Force law of the sources of one species on the sinks of another.
+// Tracers have no mass, so no block has them as sources, and any pair
+// with a dark matter body is softened over the wider dark scale, from
+// both sides alike.
+template <GLuint nSink, GLuint nSource>
+struct NBodySimulationCPULaw
+{
+    static const bool kActive = nSource != NBody::Simulation::eSpeciesTracer;
+    
+    static GLfloat softening()
+    {
+        return ((nSink == NBody::Simulation::eSpeciesDark) || (nSource == NBody::Simulation::eSpeciesDark)) ? NBody::Dark::kSoftening : 1.0f;
+    } // softening
+}; // NBodySimulationCPULaw
+
+// Add the accelerations of the sinks [nBegin, nEnd) from the sources
+// [nFirst, nLast), under the force law of their species
+template <GLuint nSink, GLuint nSource>
+static void NBodySimulationCPUAccelerateBlock(const GLfloat * const * const pSource,
+                                              const size_t& nFirst,
+                                              const size_t& nLast,
+                                              const size_t& nBegin,
+                                              const size_t& nEnd,
+                                              const GLfloat& nSoftening,
+                                              GLfloat *pAcceleration)
+{
+    typedef NBodySimulationCPULaw<nSink, nSource> Law;
+    
+    const GLfloat *pX = pSource[0];
+    const GLfloat *pY = pSource[1];
+    const GLfloat *pZ = pSource[2];
+    const GLfloat *pM = pSource[3];
+    
+    const GLfloat nEpsilon     = Law::softening() * nSoftening;
+    const GLfloat nSofteningSq = nEpsilon * nEpsilon;
+    
+    size_t i;
+    size_t j;
+    
+    for(i = nBegin; i < nEnd; ++i)
+    {
+        const GLfloat x = pX[i];
+        const GLfloat y = pY[i];
+        const GLfloat z = pZ[i];
+        
+        GLfloat ax = 0.0f;
+        GLfloat ay = 0.0f;
+        GLfloat az = 0.0f;
+        
+        for(j = nFirst; j < nLast; ++j)
+        {
+            const GLfloat dx = pX[j] - x;
+            const GLfloat dy = pY[j] - y;
+            const GLfloat dz = pZ[j] - z;
+            
+            const GLfloat d2 = dx * dx + dy * dy + dz * dz + nSofteningSq;
+            const GLfloat r  = 1.0f / std::sqrt(d2);
+            const GLfloat s  = pM[j] * r * r * r;
+            
+            ax += dx * s;
+            ay += dy * s;
+            az += dz * s;
+        } // for
+        
+        pAcceleration[4 * i + 0] += ax;
+        pAcceleration[4 * i + 1] += ay;
+        pAcceleration[4 * i + 2] += az;
+    } // for
+} // NBodySimulationCPUAccelerateBlock
+
+typedef void (*NBodySimulationCPUBlock)(const GLfloat * const * const pSource,
+                                        const size_t& nFirst,
+                                        const size_t& nLast,
+                                        const size_t& nBegin,
+                                        const size_t& nEnd,
+                                        const GLfloat& nSoftening,
+                                        GLfloat *pAcceleration);
+
+// The kernel of a block, or none when its law has no force
+template <GLuint nSink, GLuint nSource>
+static NBodySimulationCPUBlock NBodySimulationCPUSelectBlock()
+{
+    return NBodySimulationCPULaw<nSink, nSource>::kActive ? &NBodySimulationCPUAccelerateBlock<nSink, nSource> : NULL;
+} // NBodySimulationCPUSelectBlock
+
+// Kick then drift in the precision of Real, carrying the low parts of
+// the positions and velocities when it is compensated
+template <typename Real>
+static void NBodySimulationCPUAdvance(GLfloat *pPosition,
+                                      GLfloat *pVelocity,
+                                      GLfloat *pPositionLow,
+                                      GLfloat *pVelocityLow,
+                                      const GLfloat * const pAcceleration,
+                                      const size_t& nBegin,
+                                      const size_t& nEnd,
+                                      const GLfloat& nKick,
+                                      const GLfloat& nDrift,
+                                      const GLfloat& nDamping)
+{
+    typedef NBody::Simulation::Arithmetic<Real> Arithmetic;
+    
+    size_t i;
+    size_t k;
+    
+    for(i = nBegin; i < nEnd; ++i)
+    {
+        for(k = 4 * i; k < 4 * i + 3; ++k)
+        {
+            Real x = Arithmetic::load(pPosition[k], Arithmetic::kCompensated ? pPositionLow[k] : 0.0f);
+            Real v = Arithmetic::load(pVelocity[k], Arithmetic::kCompensated ? pVelocityLow[k] : 0.0f);
+            
+            v  = (v + pAcceleration[k] * nKick) * nDamping;
+            x += v * nDrift;
+            
+            pPosition[k] = Arithmetic::high(x);
+            pVelocity[k] = Arithmetic::high(v);
+            
+            if(Arithmetic::kCompensated)
+            {
+                pPositionLow[k] = Arithmetic::low(x);
+                pVelocityLow[k] = Arithmetic::low(v);
+            } // if
+        } // for
+    } // for
+} // NBodySimulationCPUAdvance
+
+// Accelerations and jerks for the Hermite integrator, as AccelerateJerk
+// in nbody_gpu.ocl, with the source velocities as x, y and z streams
+static void NBodySimulationCPUJerkScalar(const GLfloat * const * const pSource,
+                                         const GLfloat * const * const pVelocity,
+                                         const size_t& nCount,
+                                         const size_t& nBegin,
+                                         const size_t& nEnd,
+                                         const GLfloat& nSoftening,
+                                         GLfloat *pAcceleration,
+                                         GLfloat *pJerk)
+{
+    const GLfloat *pX = pSource[0];
+    const GLfloat *pY = pSource[1];
+    const GLfloat *pZ = pSource[2];
+    const GLfloat *pM = pSource[3];
+    
+    const GLfloat *pU = pVelocity[0];
+    const GLfloat *pV = pVelocity[1];
+    const GLfloat *pW = pVelocity[2];
+    
+    const GLfloat nSofteningSq = nSoftening * nSoftening;
+    
+    size_t i;
+    size_t j;
+    
+    for(i = nBegin; i < nEnd; ++i)
+    {
+        const GLfloat x = pX[i];
+        const GLfloat y = pY[i];
+        const GLfloat z = pZ[i];
+        const GLfloat u = pU[i];
+        const GLfloat v = pV[i];
+        const GLfloat w = pW[i];
+        
+        GLfloat ax = 0.0f;
+        GLfloat ay = 0.0f;
+        GLfloat az = 0.0f;
+        GLfloat jx = 0.0f;
+        GLfloat jy = 0.0f;
+        GLfloat jz = 0.0f;
+        
+        for(j = 0; j < nCount; ++j)
+        {
+            const GLfloat dx = pX[j] - x;
+            const GLfloat dy = pY[j] - y;
+            const GLfloat dz = pZ[j] - z;
+            const GLfloat du = pU[j] - u;
+            const GLfloat dv = pV[j] - v;
+            const GLfloat dw = pW[j] - w;
+            
+            const GLfloat d2 = dx * dx + dy * dy + dz * dz + nSofteningSq;
+            const GLfloat r  = 1.0f / std::sqrt(d2);
+            const GLfloat r2 = r * r;
+            const GLfloat s  = pM[j] * r2 * r;
+            const GLfloat t  = 3.0f * (dx * du + dy * dv + dz * dw) * r2;
+            
+            ax += dx * s;
+            ay += dy * s;
+            az += dz * s;
+            
+            jx += (du - t * dx) * s;
+            jy += (dv - t * dy) * s;
+            jz += (dw - t * dz) * s;
+        } // for
+        
+        pAcceleration[4 * i + 0] = ax;
+        pAcceleration[4 * i + 1] = ay;
+        pAcceleration[4 * i + 2] = az;
+        pAcceleration[4 * i + 3] = 0.0f;
+        
+        pJerk[4 * i + 0] = jx;
+        pJerk[4 * i + 1] = jy;
+        pJerk[4 * i + 2] = jz;
+        pJerk[4 * i + 3] = 0.0f;
+    } // for
+} // NBodySimulationCPUJerkScalar
+
+#if defined(__x86_64__)
+
+// Eight sink bodies per register, broadcasting one source body at a
+// time. The hardware reciprocal square root estimate is refined with
+// a single Newton-Raphson step to full single precision.
+__attribute__((target("avx2,fma")))
+static void NBodySimulationCPUAccelerateAVX2(const GLfloat * const * const pSource,
+                                             const size_t& nCount,
+                                             const size_t& nBegin,
+                                             const size_t& nEnd,
+                                             const GLfloat& nSoftening,
+                                             GLfloat *pAcceleration)
+{
+    const GLfloat *pX = pSource[0];
+    const GLfloat *pY = pSource[1];
+    const GLfloat *pZ = pSource[2];
+    const GLfloat *pM = pSource[3];
+    
+    const __m256 eps   = _mm256_set1_ps(nSoftening * nSoftening);
+    const __m256 half  = _mm256_set1_ps(0.5f);
+    const __m256 three = _mm256_set1_ps(1.5f);
+    
+    GLfloat ax[8];
+    GLfloat ay[8];
+    GLfloat az[8];
+    
+    size_t i = nBegin;
+    size_t j;
+    size_t k;
+    
+    for(; (i + 8) <= nEnd; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(pX + i);
+        const __m256 y = _mm256_loadu_ps(pY + i);
+        const __m256 z = _mm256_loadu_ps(pZ + i);
+        
+        __m256 fx = _mm256_setzero_ps();
+        __m256 fy = _mm256_setzero_ps();
+        __m256 fz = _mm256_setzero_ps();
+        
+        for(j = 0; j < nCount; ++j)
+        {
+            const __m256 dx = _mm256_sub_ps(_mm256_broadcast_ss(pX + j), x);
+            const __m256 dy = _mm256_sub_ps(_mm256_broadcast_ss(pY + j), y);
+            const __m256 dz = _mm256_sub_ps(_mm256_broadcast_ss(pZ + j), z);
+            
+            const __m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps)));
+            
+            __m256 r = _mm256_rsqrt_ps(d2);
+            
+            r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, d2), _mm256_mul_ps(r, r), three));
+            
+            const __m256 s = _mm256_mul_ps(_mm256_broadcast_ss(pM + j), _mm256_mul_ps(r, _mm256_mul_ps(r, r)));
+            
+            fx = _mm256_fmadd_ps(dx, s, fx);
+            fy = _mm256_fmadd_ps(dy, s, fy);
+            fz = _mm256_fmadd_ps(dz, s, fz);
+        } // for
+        
+        _mm256_storeu_ps(ax, fx);
+        _mm256_storeu_ps(ay, fy);
+        _mm256_storeu_ps(az, fz);
+        
+        for(k = 0; k < 8; ++k)
+        {
+            pAcceleration[4 * (i + k) + 0] = ax[k];
+            pAcceleration[4 * (i + k) + 1] = ay[k];
+            pAcceleration[4 * (i + k) + 2] = az[k];
+            pAcceleration[4 * (i + k) + 3] = 0.0f;
+        } // for
+    } // for
+    
+    NBodySimulationCPUAccelerateScalar<GLfloat>(pSource, NULL, nCount, i, nEnd, nSoftening, pAcceleration);
+} // NBodySimulationCPUAccelerateAVX2
+
+// Sixteen sink bodies per register
+__attribute__((target("avx512f")))
+static void NBodySimulationCPUAccelerateAVX512(const GLfloat * const * const pSource,
+                                               const size_t& nCount,
+                                               const size_t& nBegin,
+                                               const size_t& nEnd,
+                                               const GLfloat& nSoftening,
+                                               GLfloat *pAcceleration)
+{
+    const GLfloat *pX = pSource[0];
+    const GLfloat *pY = pSource[1];
+    const GLfloat *pZ = pSource[2];
+    const GLfloat *pM = pSource[3];
+    
+    const __m512 eps   = _mm512_set1_ps(nSoftening * nSoftening);
+    const __m512 half  = _mm512_set1_ps(0.5f);
+    const __m512 three = _mm512_set1_ps(1.5f);
+    
+    GLfloat ax[16];
+    GLfloat ay[16];
+    GLfloat az[16];
+    
+    size_t i = nBegin;
+    size_t j;
+    size_t k;
+    
+    for(; (i + 16) <= nEnd; i += 16)
+    {
+        const __m512 x = _mm512_loadu_ps(pX + i);
+        const __m512 y = _mm512_loadu_ps(pY + i);
+        const __m512 z = _mm512_loadu_ps(pZ + i);
+        
+        __m512 fx = _mm512_setzero_ps();
+        __m512 fy = _mm512_setzero_ps();
+        __m512 fz = _mm512_setzero_ps();
+        
+        for(j = 0; j < nCount; ++j)
+        {
+            const __m512 dx = _mm512_sub_ps(_mm512_set1_ps(pX[j]), x);
+            const __m512 dy = _mm512_sub_ps(_mm512_set1_ps(pY[j]), y);
+            const __m512 dz = _mm512_sub_ps(_mm512_set1_ps(pZ[j]), z);
+            
+            const __m512 d2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, eps)));
+            
+            __m512 r = _mm512_rsqrt14_ps(d2);
+            
+            r = _mm512_mul_ps(r, _mm512_fnmadd_ps(_mm512_mul_ps(half, d2), _mm512_mul_ps(r, r), three));
+            
+            const __m512 s = _mm512_mul_ps(_mm512_set1_ps(pM[j]), _mm512_mul_ps(r, _mm512_mul_ps(r, r)));
+            
+            fx = _mm512_fmadd_ps(dx, s, fx);
+            fy = _mm512_fmadd_ps(dy, s, fy);
+            fz = _mm512_fmadd_ps(dz, s, fz);
+        } // for
+        
+        _mm512_storeu_ps(ax, fx);
+        _mm512_storeu_ps(ay, fy);
+        _mm512_storeu_ps(az, fz);
+        
+        for(k = 0; k < 16; ++k)
+        {
+            pAcceleration[4 * (i + k) + 0] = ax[k];
+            pAcceleration[4 * (i + k) + 1] = ay[k];
+            pAcceleration[4 * (i + k) + 2] = az[k];
+            pAcceleration[4 * (i + k) + 3] = 0.0f;
+        } // for
+    } // for
+    
+    NBodySimulationCPUAccelerateAVX2(pSource, nCount, i, nEnd, nSoftening, pAcceleration);
+} // NBodySimulationCPUAccelerateAVX512
+
+#endif
+
+#pragma mark -
+#pragma mark Private - Utilities - Symmetric Kernels
+
+// Interactions of body i with the bodies [nBegin, nEnd), each pair once.
+// Body i gathers its acceleration as usual, and the opposite reaction,
+// scaled by the mass of i, is scattered back to the other bodies. Both
+// go to accelerations private to the calling worker.
+static void NBodySimulationCPUSymmetricScalar(const GLfloat * const * const pSource,
+                                              const size_t& i,
+                                              const size_t& nBegin,
+                                              const size_t& nEnd,
+                                              const GLfloat& nSofteningSq,
+                                              GLfloat * const * const pAcceleration)
+{
+    const GLfloat *pX = pSource[0];
+    const GLfloat *pY = pSource[1];
+    const GLfloat *pZ = pSource[2];
+    const GLfloat *pM = pSource[3];
+    
+    GLfloat *pAX = pAcceleration[0];
+    GLfloat *pAY = pAcceleration[1];
+    GLfloat *pAZ = pAcceleration[2];
+    
+    const GLfloat x = pX[i];
+    const GLfloat y = pY[i];
+    const GLfloat z = pZ[i];
+    const GLfloat m = pM[i];
+    
+    GLfloat ax = 0.0f;
+    GLfloat ay = 0.0f;
+    GLfloat az = 0.0f;
+    
+    size_t j;
+    
+    for(j = nBegin; j < nEnd; ++j)
+    {
+        const GLfloat dx = pX[j] - x;
+        const GLfloat dy = pY[j] - y;
+        const GLfloat dz = pZ[j] - z;
+        
+        const GLfloat d2 = dx * dx + dy * dy + dz * dz + nSofteningSq;
+        const GLfloat r  = 1.0f / std::sqrt(d2);
+        const GLfloat s  = r * r * r;
+        const GLfloat si = pM[j] * s;
+        const GLfloat sj = m * s;
+        
+        ax += dx * si;
+        ay += dy * si;
+        az += dz * si;
+        
+        pAX[j] -= dx * sj;
+        pAY[j] -= dy * sj;
+        pAZ[j] -= dz * sj;
+    } // for
+    
+    pAX[i] += ax;
+    pAY[i] += ay;
+    pAZ[i] += az;
+} // NBodySimulationCPUSymmetricScalar
+
+#if defined(__x86_64__)
+
+// One row against eight source bodies: the gathered acceleration of the
+// row in f, and the reactions on the sources in g
+__attribute__((target("avx2,fma"), always_inline))
+static inline void NBodySimulationCPUSymmetricRowAVX2(const GLfloat * const * const pSource,
+                                                      const size_t& i,
+                                                      const __m256& x,
+                                                      const __m256& y,
+                                                      const __m256& z,
+                                                      const __m256& m,
+                                                      const __m256& eps,
+                                                      __m256& fx,
+                                                      __m256& fy,
+                                                      __m256& fz,
+                                                      __m256& gx,
+                                                      __m256& gy,
+                                                      __m256& gz)
+{
+    const __m256 half  = _mm256_set1_ps(0.5f);
+    const __m256 three = _mm256_set1_ps(1.5f);
+    
+    const __m256 dx = _mm256_sub_ps(x, _mm256_broadcast_ss(pSource[0] + i));
+    const __m256 dy = _mm256_sub_ps(y, _mm256_broadcast_ss(pSource[1] + i));
+    const __m256 dz = _mm256_sub_ps(z, _mm256_broadcast_ss(pSource[2] + i));
+    
+    const __m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps)));
+    
+    __m256 r = _mm256_rsqrt_ps(d2);
+    
+    r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, d2), _mm256_mul_ps(r, r), three));
+    
+    const __m256 s  = _mm256_mul_ps(r, _mm256_mul_ps(r, r));
+    const __m256 si = _mm256_mul_ps(m, s);
+    const __m256 sj = _mm256_mul_ps(_mm256_broadcast_ss(pSource[3] + i), s);
+    
+    fx = _mm256_fmadd_ps(dx, si, fx);
+    fy = _mm256_fmadd_ps(dy, si, fy);
+    fz = _mm256_fmadd_ps(dz, si, fz);
+    
+    gx = _mm256_fnmadd_ps(dx, sj, gx);
+    gy = _mm256_fnmadd_ps(dy, sj, gy);
+    gz = _mm256_fnmadd_ps(dz, sj, gz);
+} // NBodySimulationCPUSymmetricRowAVX2
+
+__attribute__((target("avx2,fma")))
+static void NBodySimulationCPUSymmetricSumAVX2(const __m256& f,
+                                               GLfloat& a)
+{
+    GLfloat v[8];
+    size_t  k;
+    
+    _mm256_storeu_ps(v, f);
+    
+    for(k = 0; k < 8; ++k)
+    {
+        a += v[k];
+    } // for
+} // NBodySimulationCPUSymmetricSumAVX2
+
+// Four rows, from i, against eight source bodies per register. The rows
+// share every load and store of the sources and of their reactions.
+__attribute__((target("avx2,fma")))
+static void NBodySimulationCPUSymmetricAVX2(const GLfloat * const * const pSource,
+                                            const size_t& i,
+                                            const size_t& nBegin,
+                                            const size_t& nEnd,
+                                            const GLfloat& nSofteningSq,
+                                            GLfloat * const * const pAcceleration)
+{
+    GLfloat *pAX = pAcceleration[0];
+    GLfloat *pAY = pAcceleration[1];
+    GLfloat *pAZ = pAcceleration[2];
+    
+    const __m256 eps = _mm256_set1_ps(nSofteningSq);
+    
+    __m256 fx0 = _mm256_setzero_ps(), fy0 = _mm256_setzero_ps(), fz0 = _mm256_setzero_ps();
+    __m256 fx1 = _mm256_setzero_ps(), fy1 = _mm256_setzero_ps(), fz1 = _mm256_setzero_ps();
+    __m256 fx2 = _mm256_setzero_ps(), fy2 = _mm256_setzero_ps(), fz2 = _mm256_setzero_ps();
+    __m256 fx3 = _mm256_setzero_ps(), fy3 = _mm256_setzero_ps(), fz3 = _mm256_setzero_ps();
+    
+    size_t j = nBegin;
+    size_t r;
+    
+    for(; (j + 8) <= nEnd; j += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(pSource[0] + j);
+        const __m256 y = _mm256_loadu_ps(pSource[1] + j);
+        const __m256 z = _mm256_loadu_ps(pSource[2] + j);
+        const __m256 m = _mm256_loadu_ps(pSource[3] + j);
+        
+        __m256 gx = _mm256_loadu_ps(pAX + j);
+        __m256 gy = _mm256_loadu_ps(pAY + j);
+        __m256 gz = _mm256_loadu_ps(pAZ + j);
+        
+        NBodySimulationCPUSymmetricRowAVX2(pSource, i + 0, x, y, z, m, eps, fx0, fy0, fz0, gx, gy, gz);
+        NBodySimulationCPUSymmetricRowAVX2(pSource, i + 1, x, y, z, m, eps, fx1, fy1, fz1, gx, gy, gz);
+        NBodySimulationCPUSymmetricRowAVX2(pSource, i + 2, x, y, z, m, eps, fx2, fy2, fz2, gx, gy, gz);
+        NBodySimulationCPUSymmetricRowAVX2(pSource, i + 3, x, y, z, m, eps, fx3, fy3, fz3, gx, gy, gz);
+        
+        _mm256_storeu_ps(pAX + j, gx);
+        _mm256_storeu_ps(pAY + j, gy);
+        _mm256_storeu_ps(pAZ + j, gz);
+    } // for
+    
+    NBodySimulationCPUSymmetricSumAVX2(fx0, pAX[i + 0]);
+    NBodySimulationCPUSymmetricSumAVX2(fy0, pAY[i + 0]);
+    NBodySimulationCPUSymmetricSumAVX2(fz0, pAZ[i + 0]);
+    NBodySimulationCPUSymmetricSumAVX2(fx1, pAX[i + 1]);
+    NBodySimulationCPUSymmetricSumAVX2(fy1, pAY[i + 1]);
+    NBodySimulationCPUSymmetricSumAVX2(fz1, pAZ[i + 1]);
+    NBodySimulationCPUSymmetricSumAVX2(fx2, pAX[i + 2]);
+    NBodySimulationCPUSymmetricSumAVX2(fy2, pAY[i + 2]);
+    NBodySimulationCPUSymmetricSumAVX2(fz2, pAZ[i + 2]);
+    NBodySimulationCPUSymmetricSumAVX2(fx3, pAX[i + 3]);
+    NBodySimulationCPUSymmetricSumAVX2(fy3, pAY[i + 3]);
+    NBodySimulationCPUSymmetricSumAVX2(fz3, pAZ[i + 3]);
+    
+    for(r = 0; r < kRows; ++r)
+    {
+        NBodySimulationCPUSymmetricScalar(pSource, i + r, j, nEnd, nSofteningSq, pAcceleration);
+    } // for
+} // NBodySimulationCPUSymmetricAVX2
+
+// One row against sixteen source bodies
+__attribute__((target("avx512f"), always_inline))
+static inline void NBodySimulationCPUSymmetricRowAVX512(const GLfloat * const * const pSource,
+                                                        const size_t& i,
+                                                        const __m512& x,
+                                                        const __m512& y,
+                                                        const __m512& z,
+                                                        const __m512& m,
+                                                        const __m512& eps,
+                                                        __m512& fx,
+                                                        __m512& fy,
+                                                        __m512& fz,
+                                                        __m512& gx,
+                                                        __m512& gy,
+                                                        __m512& gz)
+{
+    const __m512 half  = _mm512_set1_ps(0.5f);
+    const __m512 three = _mm512_set1_ps(1.5f);
+    
+    const __m512 dx = _mm512_sub_ps(x, _mm512_set1_ps(pSource[0][i]));
+    const __m512 dy = _mm512_sub_ps(y, _mm512_set1_ps(pSource[1][i]));
+    const __m512 dz = _mm512_sub_ps(z, _mm512_set1_ps(pSource[2][i]));
+    
+    const __m512 d2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, eps)));
+    
+    __m512 r = _mm512_rsqrt14_ps(d2);
+    
+    r = _mm512_mul_ps(r, _mm512_fnmadd_ps(_mm512_mul_ps(half, d2), _mm512_mul_ps(r, r), three));
+    
+    const __m512 s  = _mm512_mul_ps(r, _mm512_mul_ps(r, r));
+    const __m512 si = _mm512_mul_ps(m, s);
+    const __m512 sj = _mm512_mul_ps(_mm512_set1_ps(pSource[3][i]), s);
+    
+    fx = _mm512_fmadd_ps(dx, si, fx);
+    fy = _mm512_fmadd_ps(dy, si, fy);
+    fz = _mm512_fmadd_ps(dz, si, fz);
+    
+    gx = _mm512_fnmadd_ps(dx, sj, gx);
+    gy = _mm512_fnmadd_ps(dy, sj, gy);
+    gz = _mm512_fnmadd_ps(dz, sj, gz);
+} // NBodySimulationCPUSymmetricRowAVX512
+
+// Four rows, from i, against sixteen source bodies per register
+__attribute__((target("avx512f")))
+static void NBodySimulationCPUSymmetricAVX512(const GLfloat * const * const pSource,
+                                              const size_t& i,
+                                              const size_t& nBegin,
+                                              const size_t& nEnd,
+                                              const GLfloat& nSofteningSq,
+                                              GLfloat * const * const pAcceleration)
+{
+    GLfloat *pAX = pAcceleration[0];
+    GLfloat *pAY = pAcceleration[1];
+    GLfloat *pAZ = pAcceleration[2];
+    
+    const __m512 eps = _mm512_set1_ps(nSofteningSq);
+    
+    __m512 fx0 = _mm512_setzero_ps(), fy0 = _mm512_setzero_ps(), fz0 = _mm512_setzero_ps();
+    __m512 fx1 = _mm512_setzero_ps(), fy1 = _mm512_setzero_ps(), fz1 = _mm512_setzero_ps();
+    __m512 fx2 = _mm512_setzero_ps(), fy2 = _mm512_setzero_ps(), fz2 = _mm512_setzero_ps();
+    __m512 fx3 = _mm512_setzero_ps(), fy3 = _mm512_setzero_ps(), fz3 = _mm512_setzero_ps();
+    
+    size_t j = nBegin;
+    size_t r;
+    
+    for(; (j + 16) <= nEnd; j += 16)
+    {
+        const __m512 x = _mm512_loadu_ps(pSource[0] + j);
+        const __m512 y = _mm512_loadu_ps(pSource[1] + j);
+        const __m512 z = _mm512_loadu_ps(pSource[2] + j);
+        const __m512 m = _mm512_loadu_ps(pSource[3] + j);
+        
+        __m512 gx = _mm512_loadu_ps(pAX + j);
+        __m512 gy = _mm512_loadu_ps(pAY + j);
+        __m512 gz = _mm512_loadu_ps(pAZ + j);
+        
+        NBodySimulationCPUSymmetricRowAVX512(pSource, i + 0, x, y, z, m, eps, fx0, fy0, fz0, gx, gy, gz);
+        NBodySimulationCPUSymmetricRowAVX512(pSource, i + 1, x, y, z, m, eps, fx1, fy1, fz1, gx, gy, gz);
+        NBodySimulationCPUSymmetricRowAVX512(pSource, i + 2, x, y, z, m, eps, fx2, fy2, fz2, gx, gy, gz);
+        NBodySimulationCPUSymmetricRowAVX512(pSource, i + 3, x, y, z, m, eps, fx3, fy3, fz3, gx, gy, gz);
+        
+        _mm512_storeu_ps(pAX + j, gx);
+        _mm512_storeu_ps(pAY + j, gy);
+        _mm512_storeu_ps(pAZ + j, gz);
+    } // for
+    
+    pAX[i + 0] += _mm512_reduce_add_ps(fx0);
+    pAY[i + 0] += _mm512_reduce_add_ps(fy0);
+    pAZ[i + 0] += _mm512_reduce_add_ps(fz0);
+    pAX[i + 1] += _mm512_reduce_add_ps(fx1);
+    pAY[i + 1] += _mm512_reduce_add_ps(fy1);
+    pAZ[i + 1] += _mm512_reduce_add_ps(fz1);
+    pAX[i + 2] += _mm512_reduce_add_ps(fx2);
+    pAY[i + 2] += _mm512_reduce_add_ps(fy2);
+    pAZ[i + 2] += _mm512_reduce_add_ps(fz2);
+    pAX[i + 3] += _mm512_reduce_add_ps(fx3);
+    pAY[i + 3] += _mm512_reduce_add_ps(fy3);
+    pAZ[i + 3] += _mm512_reduce_add_ps(fz3);
+    
+    for(r = 0; r < kRows; ++r)
+    {
+        NBodySimulationCPUSymmetricScalar(pSource, i + r, j, nEnd, nSofteningSq, pAcceleration);
+    } // for
+} // NBodySimulationCPUSymmetricAVX512
+
+#endif
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Root mean square difference of accelerations from those of the
+// reference, relative to the reference
+static GLdouble NBodySimulationCPUDifference(const GLfloat * const pAcceleration,
+                                             const GLfloat * const pReference,
+                                             const size_t& nCount)
+{
+    GLdouble nError = 0.0;
+    GLdouble nNorm  = 0.0;
+    
+    size_t i;
+    
+    for(i = 0; i < nCount; ++i)
+    {
+        const GLdouble d = GLdouble(pAcceleration[i]) - GLdouble(pReference[i]);
+        
+        nError += d * d;
+        nNorm  += GLdouble(pReference[i]) * GLdouble(pReference[i]);
+    } // for
+    
+    return (nNorm > 0.0) ? std::sqrt(nError / nNorm) : 0.0;
+} // NBodySimulationCPUDifference
+
+void NBody::Simulation::CPU::parallel(const size_t& nBegin,
+                                      const size_t& nEnd,
+                                      const size_t& nGrain,
+                                      const Dispatch::Task& task)
+{
+    m_Dispatch.apply(nBegin, nEnd, nGrain, task);
+} // parallel
+
+void NBody::Simulation::CPU::transpose()
+{
+    parallel(0, mnBodyCount, kGrainSize, [this](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            mpSource[0][i] = mpPosition[4 * i + 0];
+            mpSource[1][i] = mpPosition[4 * i + 1];
+            mpSource[2][i] = mpPosition[4 * i + 2];
+            mpSource[3][i] = mpPosition[4 * i + 3];
+        } // for
+        
+        if(mpSourceLow[0] != NULL)
+        {
+            for(i = nBegin; i < nEnd; ++i)
+            {
+                mpSourceLow[0][i] = m_PositionLow[4 * i + 0];
+                mpSourceLow[1][i] = m_PositionLow[4 * i + 1];
+                mpSourceLow[2][i] = m_PositionLow[4 * i + 2];
+            } // for
+        } // if
+    });
+} // transpose
+
+// Every active body gathers the force of every body, so each pair is
+// evaluated twice, once from either side
+void NBody::Simulation::CPU::asymmetric()
+{
+    transpose();
+    
+    const GLfloat nSoftening = m_ActiveParams.mnSoftening;
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [this, nSoftening](const size_t& nBegin, const size_t& nEnd)
+    {
+        if(mbBlocked)
+        {
+            mpBlocking->accelerate(mpSource, mnLiveCount, nBegin, nEnd, nSoftening, mpAcceleration);
+            
+            return;
+        } // if
+        
+        switch(mnISA)
+        {
+#if defined(__x86_64__)
+            case eNBodyCPUAVX512:
+                NBodySimulationCPUAccelerateAVX512(mpSource, mnLiveCount, nBegin, nEnd, nSoftening, mpAcceleration);
+                break;
+            
+            case eNBodyCPUAVX2:
+                NBodySimulationCPUAccelerateAVX2(mpSource, mnLiveCount, nBegin, nEnd, nSoftening, mpAcceleration);
+                break;
+#endif
+
+            default:
+                switch(mnPrecision)
+                {
+                    case ePrecisionDouble:
+                        NBodySimulationCPUAccelerateScalar<GLdouble>(mpSource, mpSourceLow, mnLiveCount, nBegin, nEnd, nSoftening, mpAcceleration);
+                        break;
+                    
+                    case ePrecisionDoubleSingle:
+                        NBodySimulationCPUAccelerateScalar<DoubleSingle>(mpSource, mpSourceLow, mnLiveCount, nBegin, nEnd, nSoftening, mpAcceleration);
+                        break;
+                    
+                    default:
+                        NBodySimulationCPUAccelerateScalar<GLfloat>(mpSource, NULL, mnLiveCount, nBegin, nEnd, nSoftening, mpAcceleration);
+                        break;
+                } // switch
+                break;
+        } // switch
+    });
+} // asymmetric
+
+// Each pair once, by Newton's third law. Pairs of tiles are split evenly
+// between the workers, each with its own partial accelerations.
+void NBody::Simulation::CPU::symmetric()
+{
+    transpose();
+    
+    const GLfloat nSofteningSq = m_ActiveParams.mnSoftening * m_ActiveParams.mnSoftening;
+    
+    const size_t nTiles = (mnLiveCount + kTileSize - 1) / kTileSize;
+    const size_t nPairs = nTiles * (nTiles + 1) / 2;
+    const size_t nSlots = mnThreads;
+    
+    // Allocated on first use, since the tree and mesh solvers derived
+    // from this class never need it
+    m_Partial.resize(3 * mnBodyCount * nSlots);
+    
+    parallel(0, nSlots, 1, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t nSlot;
+        
+        for(nSlot = nBegin; nSlot < nEnd; ++nSlot)
+        {
+            GLfloat *pPartial = m_Partial.data() + 3 * mnBodyCount * nSlot;
+            
+            GLfloat *pAcceleration[3] = {pPartial, pPartial + mnBodyCount, pPartial + 2 * mnBodyCount};
+            
+            std::fill(pPartial, pPartial + 3 * mnBodyCount, 0.0f);
+            
+            const size_t nFirst = (nPairs * nSlot) / nSlots;
+            const size_t nLast  = (nPairs * (nSlot + 1)) / nSlots;
+            
+            // Pairs are numbered row by row over the upper triangle,
+            // (0,0), (0,1), ..., (1,1), (1,2), ...
+            size_t nRow = 0;
+            size_t nCol = nFirst;
+            size_t p;
+            size_t i;
+            size_t r;
+            
+            while(nCol >= (nTiles - nRow))
+            {
+                nCol -= nTiles - nRow;
+                
+                ++nRow;
+            } // while
+            
+            nCol += nRow;
+            
+            for(p = nFirst; p < nLast; ++p)
+            {
+                const size_t nRowBegin = nRow * kTileSize;
+                const size_t nRowEnd   = std::min(nRowBegin + kTileSize, mnLiveCount);
+                const size_t nColBegin = nCol * kTileSize;
+                const size_t nColEnd   = std::min(nColBegin + kTileSize, mnLiveCount);
+                
+                for(i = nRowBegin; i < nRowEnd; i += kRows)
+                {
+                    const size_t nRows = std::min(kRows, nRowEnd - i);
+                    const size_t j     = std::max(nColBegin, i + nRows);
+                    
+                    // On a diagonal tile, the pairs within the rows and
+                    // with the columns up to the end of the rows
+                    for(r = 0; r < nRows; ++r)
+                    {
+                        NBodySimulationCPUSymmetricScalar(mpSource, i + r, std::max(nColBegin, i + r + 1), j, nSofteningSq, pAcceleration);
+                    } // for
+                    
+                    if(nRows < kRows)
+                    {
+                        for(r = 0; r < nRows; ++r)
+                        {
+                            NBodySimulationCPUSymmetricScalar(mpSource, i + r, j, nColEnd, nSofteningSq, pAcceleration);
+                        } // for
+                        
+                        continue;
+                    } // if
+                    
+                    switch(mnISA)
+                    {
+#if defined(__x86_64__)
+                        case eNBodyCPUAVX512:
+                            NBodySimulationCPUSymmetricAVX512(mpSource, i, j, nColEnd, nSofteningSq, pAcceleration);
+                            break;
+                        
+                        case eNBodyCPUAVX2:
+                            NBodySimulationCPUSymmetricAVX2(mpSource, i, j, nColEnd, nSofteningSq, pAcceleration);
+                            break;
+#endif
+
+                        default:
+                            for(r = 0; r < kRows; ++r)
+                            {
+                                NBodySimulationCPUSymmetricScalar(mpSource, i + r, j, nColEnd, nSofteningSq, pAcceleration);
+                            } // for
+                            break;
+                    } // switch
+                } // for
+                
+                if(++nCol == nTiles)
+                {
+                    ++nRow;
+                    
+                    nCol = nRow;
+                } // if
+            } // for
+        } // for
+    });
+} // symmetric
+
+// Sum the partial accelerations of all workers
+void NBody::Simulation::CPU::reduce()
+{
+    const size_t nSlots = mnThreads;
+    
+    parallel(0, mnBodyCount, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        size_t k;
+        size_t s;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            for(k = 0; k < 3; ++k)
+            {
+                const GLfloat *pPartial = m_Partial.data() + k * mnBodyCount + i;
+                
+                GLfloat a = 0.0f;
+                
+                for(s = 0; s < nSlots; ++s)
+                {
+                    a += pPartial[3 * mnBodyCount * s];
+                } // for
+                
+                mpAcceleration[4 * i + k] = a;
+            } // for
+            
+            mpAcceleration[4 * i + 3] = 0.0f;
+        } // for
+    });
+} // reduce
+
+// Each range of sinks is split at the species boundaries, and every
+// part gathers the blocks of sources with a force on it
+void NBody::Simulation::CPU::species()
+{
+    static const NBodySimulationCPUBlock kBlocks[eSpeciesCount][eSpeciesCount] =
+    {
+        {
+            NBodySimulationCPUSelectBlock<eSpeciesStar, eSpeciesStar>(),
+            NBodySimulationCPUSelectBlock<eSpeciesStar, eSpeciesDark>(),
+            NBodySimulationCPUSelectBlock<eSpeciesStar, eSpeciesTracer>()
+        },
+        {
+            NBodySimulationCPUSelectBlock<eSpeciesDark, eSpeciesStar>(),
+            NBodySimulationCPUSelectBlock<eSpeciesDark, eSpeciesDark>(),
+            NBodySimulationCPUSelectBlock<eSpeciesDark, eSpeciesTracer>()
+        },
+        {
+            NBodySimulationCPUSelectBlock<eSpeciesTracer, eSpeciesStar>(),
+            NBodySimulationCPUSelectBlock<eSpeciesTracer, eSpeciesDark>(),
+            NBodySimulationCPUSelectBlock<eSpeciesTracer, eSpeciesTracer>()
+        }
+    };
+    
+    transpose();
+    
+    const GLfloat nSoftening = m_ActiveParams.mnSoftening;
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t s;
+        size_t t;
+        
+        for(s = 0; s < eSpeciesCount; ++s)
+        {
+            const size_t nFirst = std::max(nBegin, m_Range[s]);
+            const size_t nLast  = std::min(nEnd, m_Range[s + 1]);
+            
+            if(nFirst >= nLast)
+            {
+                continue;
+            } // if
+            
+            std::fill(mpAcceleration + 4 * nFirst, mpAcceleration + 4 * nLast, 0.0f);
+            
+            for(t = 0; t < eSpeciesCount; ++t)
+            {
+                if((kBlocks[s][t] != NULL) && (m_Range[t] < m_Range[t + 1]))
+                {
+                    kBlocks[s][t](mpSource, m_Range[t], m_Range[t + 1], nFirst, nLast, nSoftening, mpAcceleration);
+                } // if
+            } // for
+        } // for
+    });
+    
+    // Pairs of the blocks with a force only
+    mnInteractions = 0.0;
+    
+    size_t s;
+    size_t t;
+    
+    for(s = 0; s < eSpeciesCount; ++s)
+    {
+        const size_t nFirst = std::max(mnMinIndex, m_Range[s]);
+        const size_t nLast  = std::min(mnMaxIndex, m_Range[s + 1]);
+        
+        for(t = 0; (t < eSpeciesCount) && (nFirst < nLast); ++t)
+        {
+            if(kBlocks[s][t] != NULL)
+            {
+                mnInteractions += GLdouble(nLast - nFirst) * GLdouble(m_Range[t + 1] - m_Range[t]);
+            } // if
+        } // for
+    } // for
+} // species
+
+// One sink at a time, as the nearest image of each source depends on
+// the pair, with the correction of the images of a unit mass looked up
+// from the table and scaled by the mass of the source
+void NBody::Simulation::CPU::periodic()
+{
+    const GLfloat nSoftening = m_ActiveParams.mnSoftening;
+    const GLfloat nBox       = mnBoxSize;
+    const GLfloat nInvBox    = 1.0f / mnBoxSize;
+    const size_t  nSources   = mnLiveCount;
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        const GLfloat nSofteningSq = nSoftening * nSoftening;
+        
+        size_t i;
+        size_t j;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            const GLfloat *x = mpPosition + 4 * i;
+            
+            GLfloat a[3] = {0.0f, 0.0f, 0.0f};
+            
+            for(j = 0; j < nSources; ++j)
+            {
+                const GLfloat *y = mpPosition + 4 * j;
+                
+                if((j == i) || (y[3] == 0.0f))
+                {
+                    continue;
+                } // if
+                
+                GLfloat d[3];
+                
+                for(k = 0; k < 3; ++k)
+                {
+                    d[k] = x[k] - y[k];
+                    d[k] -= nBox * std::nearbyint(d[k] * nInvBox);
+                } // for
+                
+                const GLfloat r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + nSofteningSq;
+                const GLfloat s  = y[3] / (r2 * std::sqrt(r2));
+                
+                GLfloat c[3] = {0.0f, 0.0f, 0.0f};
+                
+                mpEwald->correct(d, nBox, c);
+                
+                for(k = 0; k < 3; ++k)
+                {
+                    a[k] += y[3] * c[k] - s * d[k];
+                } // for
+            } // for
+            
+            GLfloat *pAcceleration = mpAcceleration + 4 * i;
+            
+            pAcceleration[0] = a[0];
+            pAcceleration[1] = a[1];
+            pAcceleration[2] = a[2];
+            pAcceleration[3] = 0.0f;
+        } // for
+    });
+    
+    mnInteractions = GLdouble(mnMaxIndex - mnMinIndex) * GLdouble(mnLiveCount);
+} // periodic
+
+// The live bodies are kept sorted by species, so each one is a range
+void NBody::Simulation::CPU::classify()
+{
+    size_t nCount[eSpeciesCount] = {0};
+    
+    size_t i;
+    
+    for(i = 0; i < mnLiveCount; ++i)
+    {
+        ++nCount[m_Species[i]];
+    } // for
+    
+    m_Range[0] = 0;
+    
+    for(i = 0; i < eSpeciesCount; ++i)
+    {
+        m_Range[i + 1] = m_Range[i] + nCount[i];
+    } // for
+} // classify
+
+// Time the direct kernels on the current bodies, compare the blocked
+// and symmetric accelerations with those of the asymmetric kernel, and
+// keep the fastest kernel for the following steps.
+// The blocked kernel is tuned first, unless sizes for this host model
+// were stored by an earlier run. Runs on the simulation thread, between
+// two steps.
+void NBody::Simulation::CPU::measure()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    const size_t nCount = 4 * mnBodyCount;
+    
+    std::vector<GLfloat> reference(nCount);
+    
+    GLdouble nAsymmetric = 0.0;
+    GLdouble nBlocked    = 0.0;
+    GLdouble nSymmetric  = 0.0;
+    GLdouble nReduce     = 0.0;
+    
+    GLdouble nBlockedError   = 0.0;
+    GLdouble nSymmetricError = 0.0;
+    
+    const bool bBlocking = (mpBlocking != NULL) && (mnPrecision == ePrecisionFloat);
+    
+    size_t n;
+    
+    if(bBlocking && !mpBlocking->isTuned())
+    {
+        transpose();
+        
+        mpBlocking->tune(mpSource, mnBodyCount, m_ActiveParams.mnSoftening);
+    } // if
+    
+    for(n = 0; n < kBenchmarkRuns; ++n)
+    {
+        mbBlocked = false;
+        
+        Clock::time_point t0 = Clock::now();
+        
+        asymmetric();
+        
+        Clock::time_point t1 = Clock::now();
+        
+        if(n == 0)
+        {
+            std::memcpy(reference.data(), mpAcceleration, nCount * sizeof(GLfloat));
+        } // if
+        
+        mbBlocked = bBlocking;
+        
+        Clock::time_point t2 = Clock::now();
+        
+        if(mbBlocked)
+        {
+            asymmetric();
+        } // if
+        
+        Clock::time_point t3 = Clock::now();
+        
+        mbBlocked = false;
+        
+        if(bBlocking && (n == 0))
+        {
+            nBlockedError = NBodySimulationCPUDifference(mpAcceleration, reference.data(), nCount);
+        } // if
+        
+        Clock::time_point t4 = Clock::now();
+        
+        symmetric();
+        
+        Clock::time_point t5 = Clock::now();
+        
+        reduce();
+        
+        Clock::time_point t6 = Clock::now();
+        
+        if(n == 0)
+        {
+            nSymmetricError = NBodySimulationCPUDifference(mpAcceleration, reference.data(), nCount);
+        } // if
+        
+        nAsymmetric += std::chrono::duration<GLdouble>(t1 - t0).count();
+        nBlocked    += std::chrono::duration<GLdouble>(t3 - t2).count();
+        nSymmetric  += std::chrono::duration<GLdouble>(t5 - t4).count();
+        nReduce     += std::chrono::duration<GLdouble>(t6 - t5).count();
+    } // for
+    
+    const GLdouble nScale = 1000.0 / GLdouble(kBenchmarkRuns);
+    
+    std::cout
+    << ">> N-body Simulation: Benchmark of "
+    << mnBodyCount
+    << " bodies, asymmetric "
+    << nScale * nAsymmetric
+    << " ms, blocked "
+    << nScale * nBlocked
+    << " ms, symmetric "
+    << nScale * (nSymmetric + nReduce)
+    << " ms (reduction "
+    << nScale * nReduce
+    << " ms), speedup "
+    << nAsymmetric / (nSymmetric + nReduce)
+    << "x, rms difference blocked "
+    << nBlockedError
+    << ", symmetric "
+    << nSymmetricError
+    << std::endl;
+    
+    bandwidth();
+    
+    // Only the asymmetric scalar kernel has the wider precisions
+    mbBlocked   = bBlocking && (nBlocked < nAsymmetric);
+    mbSymmetric = ((nSymmetric + nReduce) < (mbBlocked ? nBlocked : nAsymmetric)) && (mnPrecision == ePrecisionFloat);
+} // measure
+
+// The ranges of place are those that each worker owns in parallel, so
+// when every body is active a worker mostly streams its own pages
+void NBody::Simulation::CPU::touch()
+{
+    m_Dispatch.place(0, mnBodyCount, kGrainSize, [this](const size_t& nBegin, const size_t& nEnd)
+    {
+        const size_t nCount = nEnd - nBegin;
+        const size_t nBytes = 4 * nCount * sizeof(GLfloat);
+        
+        size_t k;
+        
+        std::memset(mpPosition     + 4 * nBegin, 0x0, nBytes);
+        std::memset(mpVelocity     + 4 * nBegin, 0x0, nBytes);
+        std::memset(mpAcceleration + 4 * nBegin, 0x0, nBytes);
+        
+        for(k = 0; k < 4; ++k)
+        {
+            std::memset(mpSource[k] + nBegin, 0x0, nCount * sizeof(GLfloat));
+        } // for
+        
+        if(mpOrdered != NULL)
+        {
+            std::memset(mpOrdered + 4 * nBegin, 0x0, nBytes);
+        } // if
+    });
+} // touch
+
+// Only meaningful once the body arrays are well past the caches
+void NBody::Simulation::CPU::bandwidth()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    const size_t nDomains = m_Dispatch.domains();
+    
+    std::vector<GLdouble> seconds(mnThreads, 0.0);
+    std::vector<GLdouble> bytes(mnThreads, 0.0);
+    std::vector<GLfloat>  sums(mnThreads, 0.0f);
+    
+    m_Dispatch.place(0, mnBodyCount, kGrainSize, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        const size_t nWorker = m_Dispatch.worker();
+        
+        GLfloat nSum = 0.0f;
+        
+        size_t n;
+        size_t i;
+        size_t k;
+        
+        Clock::time_point t0 = Clock::now();
+        
+        for(n = 0; n < kBenchmarkRuns; ++n)
+        {
+            for(i = 4 * nBegin; i < 4 * nEnd; ++i)
+            {
+                nSum += mpPosition[i] + mpVelocity[i] + mpAcceleration[i];
+            } // for
+            
+            for(k = 0; k < 4; ++k)
+            {
+                for(i = nBegin; i < nEnd; ++i)
+                {
+                    nSum += mpSource[k][i];
+                } // for
+            } // for
+        } // for
+        
+        Clock::time_point t1 = Clock::now();
+        
+        seconds[nWorker] = std::chrono::duration<GLdouble>(t1 - t0).count();
+        bytes[nWorker]   = GLdouble(kBenchmarkRuns * 16 * (nEnd - nBegin) * sizeof(GLfloat));
+        sums[nWorker]    = nSum;
+    });
+    
+    std::cout << ">> N-body Simulation: Read bandwidth";
+    
+    size_t d;
+    size_t w;
+    
+    for(d = 0; d < nDomains; ++d)
+    {
+        GLdouble nBytes   = 0.0;
+        GLdouble nSeconds = 0.0;
+        
+        for(w = 0; w < mnThreads; ++w)
+        {
+            if(m_Dispatch.domain(w) == d)
+            {
+                nBytes  += bytes[w];
+                nSeconds = std::max(nSeconds, seconds[w]);
+            } // if
+        } // for
+        
+        std::cout
+        << ((d > 0) ? ", " : " ")
+        << "domain "
+        << d
+        << " "
+        << ((nSeconds > 0.0) ? (1.0e-9 * nBytes / nSeconds) : 0.0)
+        << " GB/s";
+    } // for
+    
+    std::cout << std::endl;
+} // bandwidth
+
+void NBody::Simulation::CPU::accelerate()
+{
+    if(mpEwald != NULL)
+    {
+        periodic();
+        
+        return;
+    } // if
+    
+    // Species count the pairs of their blocks with a force only
+    if(mbSpecies)
+    {
+        species();
+        
+        return;
+    } // if
+    
+    // The symmetric kernel always produces the accelerations of every
+    // body, so it is only worth it when all of them are active
+    if(mbSymmetric && (mnMinIndex == 0) && (mnMaxIndex == mnLiveCount))
+    {
+        symmetric();
+        reduce();
+    } // if
+    else
+    {
+        asymmetric();
+    } // else
+    
+    mnInteractions = GLdouble(mnMaxIndex - mnMinIndex) * GLdouble(mnLiveCount);
+} // accelerate
+
+// Wrap positions back into the periodic box, centred on the origin
+void NBody::Simulation::CPU::boundary()
+{
+    if(!mbPeriodic)
+    {
+        return;
+    } // if
+    
+    const GLfloat nBox     = mnBoxSize;
+    const GLfloat nInvBox  = 1.0f / mnBoxSize;
+    const GLfloat nHalfBox = 0.5f * mnBoxSize;
+    
+    parallel(0, mnBodyCount, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            for(k = 0; k < 3; ++k)
+            {
+                GLfloat& x = mpPosition[4 * i + k];
+                
+                x -= nBox * std::floor((x + nHalfBox) * nInvBox);
+                
+                // Rounding can leave x exactly on the upper face
+                if(x >= nHalfBox)
+                {
+                    x -= nBox;
+                } // if
+            } // for
+        } // for
+    });
+} // boundary
+
+// Long range accelerations from the solver, then the short range ones
+// from the bodies within the cutoff, and those of the background field
+void NBody::Simulation::CPU::force()
+{
+    accelerate();
+    
+    cutoff();
+    hydro();
+    external();
+} // force
+
+// Bin the bodies into cells no smaller than the cutoff, and add the
+// pair forces from the same and adjacent cells only, so the cost grows
+// with the bodies and their neighbours rather than with all pairs
+void NBody::Simulation::CPU::cutoff()
+{
+    if(mpCells == NULL)
+    {
+        return;
+    } // if
+    
+    const GLfloat nSoftening = m_ActiveParams.mnSoftening;
+    
+    mpCells->build(mpPosition, mnCutoff, m_Dispatch);
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        mpCells->accelerate(mpPosition, nBegin, nEnd, nSoftening, mpAcceleration);
+    });
+} // cutoff
+
+// Pressure and viscous forces of the gas bodies, timed and counted
+// apart from the gravity of the step
+void NBody::Simulation::CPU::hydro()
+{
+    if(mpHydro == NULL)
+    {
+        return;
+    } // if
+    
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    mpHydro->accelerate(mpPosition, mpVelocity, m_Gas.data(), mnMinIndex, mnMaxIndex, mpAcceleration, m_Dispatch);
+    
+    std::chrono::duration<GLdouble> elapsed = std::chrono::high_resolution_clock::now() - start;
+    
+    mnHydroInteractions += mpHydro->interactions();
+    mnHydroTime         += elapsed.count();
+} // hydro
+
+// Closed form accelerations of the background potential, a single
+// evaluation per body in place of the bodies it stands for
+void NBody::Simulation::CPU::external()
+{
+    if(mpExternal == NULL)
+    {
+        return;
+    } // if
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        mpExternal->accelerate(mpPosition, nBegin, nEnd, mpAcceleration);
+    });
+} // external
+
+// Each live star finds its nearest live star of a higher index within
+// the merge radius, from the cells around it, in parallel. The pairs
+// are then merged in index order, skipping bodies already merged, into
+// the lower index with the total mass, the centre of mass and the
+// momentum of the pair.
+void NBody::Simulation::CPU::collide()
+{
+    if(mpContacts == NULL)
+    {
+        return;
+    } // if
+    
+    const size_t  nLive     = mnLiveCount;
+    const GLfloat nRadiusSq = mnMergeRadius * mnMergeRadius;
+    
+    mpContacts->build(mpPosition, mnMergeRadius, m_Dispatch);
+    
+    m_Partner.resize(nLive);
+    
+    parallel(0, nLive, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        const GLuint *pIndex = mpContacts->index();
+        
+        GLuint first[9];
+        GLuint last[9];
+        
+        size_t i;
+        size_t j;
+        size_t r;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            GLuint  nPartner = GLuint(i);
+            GLfloat nNearest = nRadiusSq;
+            
+            // Gas bodies collide through their pressure instead, and
+            // only stars merge
+            if((m_Gas.empty() || !(m_Gas[i].mnSmoothing > 0.0f)) && (m_Species.empty() || (m_Species[i] == eSpeciesStar)))
+            {
+                const GLfloat *x = mpPosition + 4 * i;
+                
+                const size_t nRows = mpContacts->rows(i, first, last);
+                
+                for(r = 0; r < nRows; ++r)
+                {
+                    for(j = first[r]; j < last[r]; ++j)
+                    {
+                        const GLuint k = pIndex[j];
+                        
+                        if((k <= i) || (k >= nLive) || (!m_Gas.empty() && (m_Gas[k].mnSmoothing > 0.0f)) || (!m_Species.empty() && (m_Species[k] != eSpeciesStar)))
+                        {
+                            continue;
+                        } // if
+                        
+                        const GLfloat *y = mpPosition + 4 * k;
+                        
+                        const GLfloat dx = y[0] - x[0];
+                        const GLfloat dy = y[1] - x[1];
+                        const GLfloat dz = y[2] - x[2];
+                        
+                        const GLfloat d2 = dx * dx + dy * dy + dz * dz;
+                        
+                        if(d2 < nNearest)
+                        {
+                            nNearest = d2;
+                            nPartner = k;
+                        } // if
+                    } // for
+                } // for
+            } // if
+            
+            m_Partner[i] = nPartner;
+        } // for
+    });
+    
+    std::vector<bool> merged(mnBodyCount, false);
+    
+    size_t nMerged = 0;
+    size_t i;
+    size_t k;
+    
+    // Each body merged into, by creation order, which the published
+    // positions draw the merged ones on
+    if(m_Host.empty())
+    {
+        m_Host.resize(mnBodyCount);
+        
+        for(k = 0; k < mnBodyCount; ++k)
+        {
+            m_Host[k] = GLuint(k);
+        } // for
+    } // if
+    
+    for(i = 0; i < nLive; ++i)
+    {
+        const size_t j = m_Partner[i];
+        
+        if((j == i) || merged[i] || merged[j])
+        {
+            continue;
+        } // if
+        
+        GLfloat *xi = mpPosition + 4 * i;
+        GLfloat *xj = mpPosition + 4 * j;
+        GLfloat *vi = mpVelocity + 4 * i;
+        GLfloat *vj = mpVelocity + 4 * j;
+        
+        const GLfloat m = xi[3] + xj[3];
+        
+        if(!(m > 0.0f))
+        {
+            continue;
+        } // if
+        
+        for(k = 0; k < 3; ++k)
+        {
+            xi[k] = (xi[3] * xi[k] + xj[3] * xj[k]) / m;
+            vi[k] = (xi[3] * vi[k] + xj[3] * vj[k]) / m;
+            
+            // The merged body stays where the pair met, at rest and
+            // without mass, so it no longer pulls on anything
+            xj[k] = xi[k];
+            vj[k] = 0.0f;
+        } // for
+        
+        xi[3] = m;
+        xj[3] = 0.0f;
+        
+        // Low parts of the wider precisions restart from the new sums
+        for(std::vector<GLfloat> *pLow : {&m_PositionLow, &m_VelocityLow})
+        {
+            if(!pLow->empty())
+            {
+                std::fill(pLow->begin() + 4 * i, pLow->begin() + 4 * i + 4, 0.0f);
+                std::fill(pLow->begin() + 4 * j, pLow->begin() + 4 * j + 4, 0.0f);
+            } // if
+        } // for
+        
+        merged[j] = true;
+        
+        if(m_Identity.empty())
+        {
+            m_Host[j] = GLuint(i);
+        } // if
+        else
+        {
+            m_Host[m_Identity[j]] = m_Identity[i];
+        } // else
+        
+        ++nMerged;
+    } // for
+    
+    if(nMerged > 0)
+    {
+        compact(merged);
+        
+        mnLiveCount -= nMerged;
+        
+        if(mbSpecies)
+        {
+            classify();
+        } // if
+        
+        // The accelerations kept for the next step include the pairs
+        mbAccelerated = false;
+    } // if
+} // collide
+
+// Stable gather of the live bodies to the front, then the newly merged
+// ones, then those merged before
+void NBody::Simulation::CPU::compact(const std::vector<bool>& rMerged)
+{
+    std::vector<GLuint> index;
+    
+    index.reserve(mnBodyCount);
+    
+    size_t i;
+    
+    for(i = 0; i < mnLiveCount; ++i)
+    {
+        if(!rMerged[i])
+        {
+            index.push_back(GLuint(i));
+        } // if
+    } // for
+    
+    for(i = 0; i < mnLiveCount; ++i)
+    {
+        if(rMerged[i])
+        {
+            index.push_back(GLuint(i));
+        } // if
+    } // for
+    
+    for(i = mnLiveCount; i < mnBodyCount; ++i)
+    {
+        index.push_back(GLuint(i));
+    } // for
+    
+    permute(index.data(), mnBodyCount);
+} // compact
+
+// Direct sum of the accelerations and jerks, with the velocities of the
+// source bodies transposed alongside their positions
+bool NBody::Simulation::CPU::jerk()
+{
+    transpose();
+    
+    m_Jerk.resize(4 * mnBodyCount);
+    m_Velocity.resize(3 * mnBodyCount);
+    
+    GLfloat *pVelocity[3] = {m_Velocity.data(), m_Velocity.data() + mnBodyCount, m_Velocity.data() + 2 * mnBodyCount};
+    
+    parallel(0, mnBodyCount, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            pVelocity[0][i] = mpVelocity[4 * i + 0];
+            pVelocity[1][i] = mpVelocity[4 * i + 1];
+            pVelocity[2][i] = mpVelocity[4 * i + 2];
+        } // for
+    });
+    
+    const GLfloat nSoftening = m_ActiveParams.mnSoftening;
+    
+    GLfloat *pJerk = m_Jerk.data();
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        NBodySimulationCPUJerkScalar(mpSource, pVelocity, mnLiveCount, nBegin, nEnd, nSoftening, mpAcceleration, pJerk);
+    });
+    
+    mnInteractions = GLdouble(mnMaxIndex - mnMinIndex) * GLdouble(mnLiveCount);
+    
+    return true;
+} // jerk
+
+// Kick then drift, as in AdvanceSystem. Semi-implicit Euler with
+// damping, as in IntegrateSystem, is a single full kick and drift.
+void NBody::Simulation::CPU::advance(const GLfloat& nKick,
+                                     const GLfloat& nDrift,
+                                     const GLfloat& nDamping)
+{
+    GLfloat *pPositionLow = m_PositionLow.data();
+    GLfloat *pVelocityLow = m_VelocityLow.data();
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        switch(mnPrecision)
+        {
+            case ePrecisionDouble:
+                NBodySimulationCPUAdvance<GLdouble>(mpPosition, mpVelocity, pPositionLow, pVelocityLow, mpAcceleration, nBegin, nEnd, nKick, nDrift, nDamping);
+                break;
+            
+            case ePrecisionDoubleSingle:
+                NBodySimulationCPUAdvance<DoubleSingle>(mpPosition, mpVelocity, pPositionLow, pVelocityLow, mpAcceleration, nBegin, nEnd, nKick, nDrift, nDamping);
+                break;
+            
+            default:
+                NBodySimulationCPUAdvance<GLfloat>(mpPosition, mpVelocity, NULL, NULL, mpAcceleration, nBegin, nEnd, nKick, nDrift, nDamping);
+                break;
+        } // switch
+    });
+} // advance
+
+// Kick-drift-kick, reusing the accelerations of the last closing kick
+// for the next opening kick
+void NBody::Simulation::CPU::leapfrog()
+{
+    const GLfloat nTimeStamp = m_ActiveParams.mnTimeStamp;
+    const GLfloat nDamping   = m_ActiveParams.mnDamping;
+    
+    GLdouble nInteractions = 0.0;
+    
+    if(!mbAccelerated)
+    {
+        force();
+        
+        nInteractions += mnInteractions;
+    } // if
+    
+    advance(0.5f * nTimeStamp, nTimeStamp, 1.0f);
+    boundary();
+    
+    force();
+    
+    advance(0.5f * nTimeStamp, 0.0f, nDamping);
+    
+    mnInteractions += nInteractions;
+    mbAccelerated   = true;
+} // leapfrog
+
+// Fourth order Yoshida, as a composition of three drift-kick-drift
+// leapfrogs with the weights w1, w0 and w1
+void NBody::Simulation::CPU::yoshida()
+{
+    const GLfloat nTimeStamp = m_ActiveParams.mnTimeStamp;
+    const GLfloat nDamping   = m_ActiveParams.mnDamping;
+    
+    const GLfloat c[4] = {0.5f * Yoshida::kW1, 0.5f * (Yoshida::kW0 + Yoshida::kW1), 0.5f * (Yoshida::kW0 + Yoshida::kW1), 0.5f * Yoshida::kW1};
+    const GLfloat d[3] = {Yoshida::kW1, Yoshida::kW0, Yoshida::kW1};
+    
+    GLdouble nInteractions = 0.0;
+    
+    advance(0.0f, c[0] * nTimeStamp, 1.0f);
+    boundary();
+    
+    size_t s;
+    
+    for(s = 0; s < 3; ++s)
+    {
+        force();
+        
+        nInteractions += mnInteractions;
+        
+        advance(d[s] * nTimeStamp, c[s + 1] * nTimeStamp, (s == 2) ? nDamping : 1.0f);
+        boundary();
+    } // for
+    
+    mnInteractions = nInteractions;
+    mbAccelerated  = false;
+} // yoshida
+
+// Fourth order Hermite predictor-corrector, with the accelerations and
+// jerks at the predicted positions and velocities kept for the next step
+void NBody::Simulation::CPU::hermite()
+{
+    GLdouble nInteractions = 0.0;
+    
+    if(!mbAccelerated)
+    {
+        // Without a jerk from the solver, keep to leapfrog from now on
+        if(!jerk())
+        {
+            mnIntegrator = eIntegratorLeapfrog;
+            
+            leapfrog();
+            
+            return;
+        } // if
+        
+        cutoff();
+        hydro();
+        external();
+        
+        nInteractions += mnInteractions;
+    } // if
+    
+    const GLfloat nTimeStamp = m_ActiveParams.mnTimeStamp;
+    const GLfloat nDamping   = m_ActiveParams.mnDamping;
+    
+    m_Start.resize(16 * mnBodyCount);
+    
+    GLfloat *pStart = m_Start.data();
+    GLfloat *pJerk  = m_Jerk.data();
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        const GLfloat dt  = nTimeStamp;
+        const GLfloat dt2 = 0.5f * dt * dt;
+        const GLfloat dt3 = dt2 * dt / 3.0f;
+        
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            GLfloat *x = mpPosition     + 4 * i;
+            GLfloat *v = mpVelocity     + 4 * i;
+            GLfloat *a = mpAcceleration + 4 * i;
+            GLfloat *j = pJerk          + 4 * i;
+            GLfloat *p = pStart         + 16 * i;
+            
+            for(k = 0; k < 4; ++k)
+            {
+                p[k +  0] = x[k];
+                p[k +  4] = v[k];
+                p[k +  8] = a[k];
+                p[k + 12] = j[k];
+            } // for
+            
+            for(k = 0; k < 3; ++k)
+            {
+                x[k] += v[k] * dt + a[k] * dt2 + j[k] * dt3;
+                v[k] += a[k] * dt + j[k] * dt2;
+            } // for
+        } // for
+    });
+    
+    // The short range forces and the background field add no jerk,
+    // which only costs the order of the corrector for those
+    jerk();
+    cutoff();
+    hydro();
+    external();
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        const GLfloat h  = 0.5f * nTimeStamp;
+        const GLfloat h2 = nTimeStamp * nTimeStamp / 12.0f;
+        
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            GLfloat *x  = mpPosition     + 4 * i;
+            GLfloat *v  = mpVelocity     + 4 * i;
+            GLfloat *a1 = mpAcceleration + 4 * i;
+            GLfloat *j1 = pJerk          + 4 * i;
+            
+            const GLfloat *x0 = pStart + 16 * i;
+            const GLfloat *v0 = x0 + 4;
+            const GLfloat *a0 = x0 + 8;
+            const GLfloat *j0 = x0 + 12;
+            
+            for(k = 0; k < 3; ++k)
+            {
+                const GLfloat v1 = v0[k] + (a0[k] + a1[k]) * h + (j0[k] - j1[k]) * h2;
+                
+                x[k] = x0[k] + (v0[k] + v1) * h + (a0[k] - a1[k]) * h2;
+                v[k] = v1 * nDamping;
+            } // for
+        } // for
+    });
+    
+    boundary();
+    
+    mnInteractions += nInteractions;
+    mbAccelerated   = true;
+} // hermite
+
+void NBody::Simulation::CPU::integrate()
+{
+    switch(mnIntegrator)
+    {
+        case eIntegratorLeapfrog:
+            leapfrog();
+            break;
+        
+        case eIntegratorYoshida:
+            yoshida();
+            break;
+        
+        case eIntegratorHermite:
+            hermite();
+            break;
+        
+        default:
+            force();
+            advance(m_ActiveParams.mnTimeStamp, m_ActiveParams.mnTimeStamp, m_ActiveParams.mnDamping);
+            boundary();
+            break;
+    } // switch
+} // integrate
+
+// Gather positions and velocities into Morton order, so that bodies
+// close in space are close in memory for the tree walks and the kernels
+void NBody::Simulation::CPU::reorder()
+{
+    mpMorton->sort(mpPosition, m_Dispatch);
+    
+    if(mbSpecies)
+    {
+        // Morton order within each species, with the merged bodies
+        // kept past the live ones
+        std::vector<GLuint> index(mpMorton->index(), mpMorton->index() + mnBodyCount);
+        
+        const size_t nLive = mnLiveCount;
+        
+        const GLubyte *pSpecies = m_Species.data();
+        
+        std::stable_sort(index.begin(), index.end(), [=](const GLuint& a, const GLuint& b)
+        {
+            const GLuint ka = (a < nLive) ? pSpecies[a] : GLuint(eSpeciesCount);
+            const GLuint kb = (b < nLive) ? pSpecies[b] : GLuint(eSpeciesCount);
+            
+            return ka < kb;
+        });
+        
+        permute(index.data(), mnBodyCount);
+    } // if
+    else if(mnLiveCount < mnBodyCount)
+    {
+        // Morton order among the live bodies, with the merged ones kept
+        // past them
+        std::vector<GLuint> index(mpMorton->index(), mpMorton->index() + mnBodyCount);
+        
+        const size_t nLive = mnLiveCount;
+        
+        std::stable_partition(index.begin(), index.end(), [=](const GLuint& j)
+        {
+            return j < nLive;
+        });
+        
+        permute(index.data(), mnBodyCount);
+    } // else if
+    else
+    {
+        permute(mpMorton->index(), mnBodyCount);
+    } // else
+    
+    // The accelerations kept for the next step are in the old order
+    mbAccelerated = false;
+    
+    // Restore the level order, keeping Morton order within each level
+    if(mbPrimed)
+    {
+        arrange(mnBodyCount);
+    } // if
+} // reorder
+
+void NBody::Simulation::CPU::permute(const GLuint * const pIndex,
+                                     const size_t& nCount)
+{
+    size_t i;
+    
+    if(m_Identity.empty())
+    {
+        m_Identity.resize(mnBodyCount);
+        
+        for(i = 0; i < mnBodyCount; ++i)
+        {
+            m_Identity[i] = GLuint(i);
+        } // for
+    } // if
+    
+    GLfloat *pState[6] =
+    {
+        mpPosition,
+        mpVelocity,
+        m_Kick.empty()        ? NULL : m_Kick.data(),
+        m_PositionLow.empty() ? NULL : m_PositionLow.data(),
+        m_VelocityLow.empty() ? NULL : m_VelocityLow.data(),
+        m_Gas.empty()         ? NULL : reinterpret_cast<GLfloat *>(m_Gas.data())
+    };
+    
+    for(GLfloat *pData : pState)
+    {
+        if(pData != NULL)
+        {
+            parallel(0, nCount, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+            {
+                size_t i;
+                
+                for(i = nBegin; i < nEnd; ++i)
+                {
+                    const GLuint j = pIndex[i];
+                    
+                    mpOrdered[4 * i + 0] = pData[4 * j + 0];
+                    mpOrdered[4 * i + 1] = pData[4 * j + 1];
+                    mpOrdered[4 * i + 2] = pData[4 * j + 2];
+                    mpOrdered[4 * i + 3] = pData[4 * j + 3];
+                } // for
+            });
+            
+            std::memcpy(pData, mpOrdered, 4 * nCount * sizeof(GLfloat));
+        } // if
+    } // for
+    
+    // Compose the permutations, slot i now holds the body that was in
+    // slot index[i], which started out in slot identity[index[i]]
+    std::vector<GLuint> identity(nCount);
+    
+    for(i = 0; i < nCount; ++i)
+    {
+        identity[i] = m_Identity[pIndex[i]];
+    } // for
+    
+    std::copy(identity.begin(), identity.end(), m_Identity.begin());
+    
+    if(!m_Level.empty())
+    {
+        for(i = 0; i < nCount; ++i)
+        {
+            identity[i] = m_Level[pIndex[i]];
+        } // for
+        
+        std::copy(identity.begin(), identity.end(), m_Level.begin());
+    } // if
+    
+    if(!m_Species.empty())
+    {
+        std::vector<GLubyte> species(nCount);
+        
+        for(i = 0; i < nCount; ++i)
+        {
+            species[i] = m_Species[pIndex[i]];
+        } // for
+        
+        std::copy(species.begin(), species.end(), m_Species.begin());
+    } // if
+} // permute
+
+// Positions in the order the bodies were created in
+const GLfloat *NBody::Simulation::CPU::ordered()
+{
+    if(m_Identity.empty())
+    {
+        return mpPosition;
+    } // if
+    
+    const GLuint *pIdentity = m_Identity.data();
+    
+    parallel(0, mnBodyCount, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            const GLuint j = pIdentity[i];
+            
+            mpOrdered[4 * j + 0] = mpPosition[4 * i + 0];
+            mpOrdered[4 * j + 1] = mpPosition[4 * i + 1];
+            mpOrdered[4 * j + 2] = mpPosition[4 * i + 2];
+            mpOrdered[4 * j + 3] = mpPosition[4 * i + 3];
+        } // for
+    });
+    
+    // Merged bodies are drawn on the live body they went into, rather
+    // than left behind where they merged
+    size_t i;
+    
+    for(i = mnLiveCount; i < mnBodyCount; ++i)
+    {
+        const GLuint j = pIdentity[i];
+        
+        GLuint h = m_Host[j];
+        
+        while(m_Host[h] != h)
+        {
+            h = m_Host[h];
+        } // while
+        
+        mpOrdered[4 * j + 0] = mpOrdered[4 * h + 0];
+        mpOrdered[4 * j + 1] = mpOrdered[4 * h + 1];
+        mpOrdered[4 * j + 2] = mpOrdered[4 * h + 2];
+    } // for
+    
+    return mpOrdered;
+} // ordered
+
+// Level of the largest power of two fraction of the time step within
+// both the acceleration criterion, sqrt(2 eta eps / |a|), and the jerk
+// criterion, eta' |a| / |j|
+GLuint NBody::Simulation::CPU::level(const GLfloat * const pAcceleration,
+                                     const GLfloat * const pJerk) const
+{
+    const GLfloat nTimeStamp = m_ActiveParams.mnTimeStamp;
+    const GLfloat nSoftening = m_ActiveParams.mnSoftening;
+    
+    const GLfloat a2 = pAcceleration[0] * pAcceleration[0] + pAcceleration[1] * pAcceleration[1] + pAcceleration[2] * pAcceleration[2];
+    const GLfloat j2 = pJerk[0] * pJerk[0] + pJerk[1] * pJerk[1] + pJerk[2] * pJerk[2];
+    
+    GLfloat nStep = nTimeStamp;
+    
+    if(a2 > 0.0f)
+    {
+        const GLfloat a = std::sqrt(a2);
+        
+        nStep = std::min(nStep, std::sqrt(2.0f * Block::kAccuracy * nSoftening / a));
+        
+        if(j2 > 0.0f)
+        {
+            nStep = std::min(nStep, Block::kJerkAccuracy * a / std::sqrt(j2));
+        } // if
+    } // if
+    
+    GLfloat nBlock = nTimeStamp;
+    GLuint  nLevel = 0;
+    
+    while((nBlock > nStep) && (nLevel < (mnLevels - 1)))
+    {
+        nBlock *= 0.5f;
+        
+        ++nLevel;
+    } // while
+    
+    return nLevel;
+} // level
+
+// Accelerations of every body, its first level, and the opening kick
+void NBody::Simulation::CPU::prime()
+{
+    const GLfloat nTimeStamp = m_ActiveParams.mnTimeStamp;
+    
+    force();
+    
+    m_Level.resize(mnBodyCount);
+    m_Kick.resize(4 * mnBodyCount);
+    
+    parallel(0, mnBodyCount, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        const GLfloat zero[3] = {0.0f, 0.0f, 0.0f};
+        
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            const GLfloat *pAcceleration = mpAcceleration + 4 * i;
+            
+            const GLuint  nLevel = level(pAcceleration, zero);
+            const GLfloat nHalf  = 0.5f * std::ldexp(nTimeStamp, -GLint(nLevel));
+            
+            for(k = 0; k < 3; ++k)
+            {
+                mpVelocity[4 * i + k] += pAcceleration[k] * nHalf;
+                
+                m_Kick[4 * i + k] = pAcceleration[k];
+            } // for
+            
+            m_Level[i] = nLevel;
+        } // for
+    });
+    
+    arrange(mnBodyCount);
+    
+    mbPrimed = true;
+} // prime
+
+void NBody::Simulation::CPU::drift(const GLfloat& nTimeStep)
+{
+    parallel(0, mnLiveCount, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            for(k = 0; k < 3; ++k)
+            {
+                mpPosition[4 * i + k] += mpVelocity[4 * i + k] * nTimeStep;
+            } // for
+        } // for
+    });
+} // drift
+
+// Closing kick of the active bodies, a new level from the acceleration
+// and the jerk over the step just ended, and the opening kick. A body
+// may only move to a level whose steps start now, and coarsens by at
+// most one level at a time.
+void NBody::Simulation::CPU::kick(const size_t& nActive,
+                                  const GLuint& nLevel)
+{
+    const GLfloat nTimeStamp = m_ActiveParams.mnTimeStamp;
+    const GLfloat nDamping   = m_ActiveParams.mnDamping;
+    
+    parallel(0, nActive, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            const GLfloat *pAcceleration = mpAcceleration + 4 * i;
+            
+            GLfloat *pVelocity = mpVelocity + 4 * i;
+            GLfloat *pKick     = m_Kick.data() + 4 * i;
+            
+            const GLuint  nOld  = m_Level[i];
+            const GLfloat nStep = std::ldexp(nTimeStamp, -GLint(nOld));
+            
+            // Damping as in IntegrateSystem, per global time step
+            const GLfloat nScale = std::pow(nDamping, std::ldexp(1.0f, -GLint(nOld)));
+            
+            GLfloat jerk[3];
+            
+            for(k = 0; k < 3; ++k)
+            {
+                pVelocity[k] += pAcceleration[k] * 0.5f * nStep;
+                pVelocity[k] *= nScale;
+                
+                jerk[k] = (pAcceleration[k] - pKick[k]) / nStep;
+            } // for
+            
+            const GLuint nNew = std::max(level(pAcceleration, jerk), std::max(nLevel, (nOld > 0) ? (nOld - 1) : 0));
+            const GLfloat nHalf = 0.5f * std::ldexp(nTimeStamp, -GLint(nNew));
+            
+            for(k = 0; k < 3; ++k)
+            {
+                pVelocity[k] += pAcceleration[k] * nHalf;
+                
+                pKick[k] = pAcceleration[k];
+            } // for
+            
+            m_Level[i] = nNew;
+        } // for
+    });
+} // kick
+
+// Stable counting sort of the first nActive bodies by level, finest
+// first. Levels only change for active bodies, and never to a level
+// coarser than any inactive body, so sorting the prefix is enough.
+void NBody::Simulation::CPU::arrange(const size_t& nActive)
+{
+    if(std::is_sorted(m_Level.begin(), m_Level.begin() + nActive, std::greater<GLuint>()))
+    {
+        return;
+    } // if
+    
+    size_t offsets[Block::kLevelsMax + 1] = {0};
+    
+    size_t i;
+    GLuint l;
+    
+    for(i = 0; i < nActive; ++i)
+    {
+        ++offsets[mnLevels - 1 - m_Level[i] + 1];
+    } // for
+    
+    for(l = 1; l <= mnLevels; ++l)
+    {
+        offsets[l] += offsets[l - 1];
+    } // for
+    
+    m_Order.resize(mnBodyCount);
+    
+    for(i = 0; i < nActive; ++i)
+    {
+        m_Order[offsets[mnLevels - 1 - m_Level[i]]++] = GLuint(i);
+    } // for
+    
+    permute(m_Order.data(), nActive);
+} // arrange
+
+// One global time step as a block of sub-steps at the finest level.
+// Every body drifts each sub-step, and only those whose own step ends
+// there get new accelerations, so a few close encounters no longer set
+// the step of the whole system.
+void NBody::Simulation::CPU::block()
+{
+    if(!mbPrimed)
+    {
+        prime();
+    } // if
+    
+    const size_t  nSteps = size_t(1) << (mnLevels - 1);
+    const GLfloat nDrift = std::ldexp(m_ActiveParams.mnTimeStamp, -GLint(mnLevels - 1));
+    
+    GLdouble nInteractions = 0.0;
+    
+    size_t s;
+    
+    for(s = 1; s <= nSteps; ++s)
+    {
+        drift(nDrift);
+        
+        boundary();
+        
+        // Coarsest level with a step ending here
+        GLuint nLevel = mnLevels - 1;
+        
+        while((nLevel > 0) && !(s & (size_t(1) << (mnLevels - 1 - nLevel))))
+        {
+            --nLevel;
+        } // while
+        
+        // Only the live bodies are kept sorted by level, the merged ones
+        // past them keep whatever level they had
+        const size_t nActive = std::partition_point(m_Level.begin(),
+                                                    m_Level.begin() + mnLiveCount,
+                                                    [=](const GLuint& l)
+                                                    {
+                                                        return l >= nLevel;
+                                                    }) - m_Level.begin();
+        
+        if(nActive > 0)
+        {
+            mnMaxIndex = std::min(nActive, mnLiveCount);
+            
+            force();
+            
+            nInteractions += mnInteractions;
+            
+            kick(nActive, nLevel);
+            arrange(nActive);
+        } // if
+    } // for
+    
+    mnMaxIndex     = mnLiveCount;
+    mnInteractions = nInteractions;
+} // block
+
+GLint NBody::Simulation::CPU::restart()
+{
+    std::memset(mpPosition, 0x0, mnSize);
+    std::memset(mpVelocity, 0x0, mnSize);
+    
+    std::fill(m_PositionLow.begin(), m_PositionLow.end(), 0.0f);
+    std::fill(m_VelocityLow.begin(), m_VelocityLow.end(), 0.0f);
+    
+    m_Identity.clear();
+    m_Host.clear();
+    m_Level.clear();
+    m_Kick.clear();
+    
+    mnSteps       = 0;
+    mnLiveCount   = mnBodyCount;
+    mbPrimed      = false;
+    mbAccelerated = false;
+    
+    if(!mConductor.acquire(mpPosition, mpVelocity))
+    {
+        return -1;
+    } // if
+    
+    if(mpHydro != NULL)
+    {
+        mpHydro->seed(mpPosition, m_Gas.data(), m_ActiveParams.mnGasEnergy);
+    } // if
+    
+    // Dark matter first, then the tracers, which lose their mass, then
+    // the stars, with the gas at the end
+    if(mbSpecies)
+    {
+        size_t i;
+        
+        for(i = 0; i < mnBodyCount; ++i)
+        {
+            if(i < mnDarkCount)
+            {
+                m_Species[i] = eSpeciesDark;
+            } // if
+            else if(i < (mnDarkCount + mnTracerCount))
+            {
+                m_Species[i] = eSpeciesTracer;
+                
+                mpPosition[4 * i + 3] = 0.0f;
+            } // else if
+            else
+            {
+                m_Species[i] = eSpeciesStar;
+            } // else
+        } // for
+        
+        classify();
+    } // if
+    
+    return 0;
+} // restart
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::CPU::CPU(const size_t& nbodies,
+                            const NBody::Simulation::Params& params)
+: NBody::Simulation::Base(nbodies, params)
+, m_Dispatch(0, params.mnAffinity)
+, mConductor(nbodies, params)
+{
+    CF::Query::Hardware hw;
+    
+    mnDeviceCount = 1;
+    mnThreads     = m_Dispatch.threads();
+    mbTerminated  = false;
+    
+    mnISA = eNBodyCPUScalar;
+    
+    mnPrecision = (params.mnPrecision != ePrecisionDefault) ? params.mnPrecision : GLuint(ePrecisionFloat);
+    
+    mbSymmetric = (nbodies >= kSymmetricMin) && (mnPrecision == ePrecisionFloat) && (params.mnDarkCount == 0) && (params.mnTracerCount == 0) && (params.mnPeriodic == 0);
+    
+    mnReorderInterval = params.mnReorderInterval;
+    mnSteps           = 0;
+    
+    mnLevels = (params.mnBlockLevels > 0) ? params.mnBlockLevels : Block::kLevels;
+    mnLevels = std::min(mnLevels, Block::kLevelsMax);
+    mbPrimed = false;
+    
+    mnIntegrator  = params.mnIntegrator;
+    mbAccelerated = false;
+    
+    mbBlocked  = false;
+    mpBlocking = NULL;
+    
+    mnCutoff = std::max(params.mnCutoff, 0.0f);
+    mpCells  = NULL;
+    
+    mnGasCount = std::min(size_t(params.mnGasCount), nbodies);
+    mpHydro    = NULL;
+    
+    mpExternal = NULL;
+    
+    mnMergeRadius = std::max(params.mnMergeRadius, 0.0f);
+    mnLiveCount   = nbodies;
+    mpContacts    = NULL;
+    
+    // A periodic box for the direct sum only, as the tree and mesh
+    // solvers bring their own boundaries
+    mbPeriodic = (params.mnPeriodic != 0)
+              && ((params.mnSolver == eSolverCPU) || (params.mnSolver == eSolverDefault));
+    mnBoxSize  = (params.mnBoxSize > 0.0f) ? params.mnBoxSize : Periodic::kBoxSize;
+    mpEwald    = NULL;
+    
+    // Species take the bodies before the gas, and have no periodic sum
+    mnDarkCount   = mbPeriodic ? 0 : std::min(size_t(params.mnDarkCount), nbodies - mnGasCount);
+    mnTracerCount = mbPeriodic ? 0 : std::min(size_t(params.mnTracerCount), nbodies - mnGasCount - mnDarkCount);
+    mbSpecies     = (mnDarkCount + mnTracerCount) > 0;
+    
+    m_Range[0] = 0;
+    
+    std::fill(m_Range + 1, m_Range + eSpeciesCount + 1, nbodies);
+    
+    // Merges and species reorder the bodies, which the level order of
+    // the block time steps does not follow
+    if((mnMergeRadius > 0.0f) || mbSpecies)
+    {
+        mnLevels = 1;
+    } // if
+    
+    // The jerk of the direct sum has no periodic images
+    if(mbPeriodic && (mnIntegrator == eIntegratorHermite))
+    {
+        mnIntegrator = eIntegratorLeapfrog;
+    } // if
+
+#if defined(__x86_64__)
+    if(mnPrecision != ePrecisionFloat)
+    {
+        mnISA = eNBodyCPUScalar;
+    } // if
+    else if(hw.avx512())
+    {
+        mnISA = eNBodyCPUAVX512;
+    } // else if
+    else if(hw.avx2())
+    {
+        mnISA = eNBodyCPUAVX2;
+    } // else if
+#endif
+
+    mpPosition     = NULL;
+    mpVelocity     = NULL;
+    mpAcceleration = NULL;
+    
+    mpSource[0] = NULL;
+    mpSource[1] = NULL;
+    mpSource[2] = NULL;
+    mpSource[3] = NULL;
+    
+    mpSourceLow[0] = NULL;
+    mpSourceLow[1] = NULL;
+    mpSourceLow[2] = NULL;
+    
+    mpMorton  = NULL;
+    mpOrdered = NULL;
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::CPU::~CPU()
+{
+    stop();
+    
+    terminate();
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+void NBody::Simulation::CPU::initialize(const NBody::Simulation::String&)
+{
+    if(!mbTerminated)
+    {
+        CF::Query::Hardware hw;
+        
+        // Left untouched here, and zeroed by touch below
+        mpPosition     = (GLfloat *) malloc(mnSize);
+        mpVelocity     = (GLfloat *) malloc(mnSize);
+        mpAcceleration = (GLfloat *) malloc(mnSize);
+        mpSource[0]    = (GLfloat *) malloc(mnSize);
+        
+        if(mpSource[0] != NULL)
+        {
+            mpSource[1] = mpSource[0] + mnBodyCount;
+            mpSource[2] = mpSource[1] + mnBodyCount;
+            mpSource[3] = mpSource[2] + mnBodyCount;
+        } // if
+        
+        // Low parts of the positions and velocities, and of the position
+        // streams, for the compensated precisions
+        if(mnPrecision != ePrecisionFloat)
+        {
+            m_PositionLow.assign(mnLength, 0.0f);
+            m_VelocityLow.assign(mnLength, 0.0f);
+            m_SourceLow.assign(3 * mnBodyCount, 0.0f);
+            
+            mpSourceLow[0] = m_SourceLow.data();
+            mpSourceLow[1] = mpSourceLow[0] + mnBodyCount;
+            mpSourceLow[2] = mpSourceLow[1] + mnBodyCount;
+        } // if
+        
+        if(mnReorderInterval > 0)
+        {
+            mpMorton = new Morton(mnBodyCount);
+        } // if
+        
+        // The blocked sum replaces the plain scalar one by default, and
+        // a benchmark decides between it and the vector ones
+        if(mnPrecision == ePrecisionFloat)
+        {
+            mpBlocking = new Blocking;
+            mbBlocked  = (mnISA == eNBodyCPUScalar);
+        } // if
+        
+        if(mnCutoff > 0.0f)
+        {
+            mpCells = new Cells(mnBodyCount);
+        } // if
+        
+        // Gas state alongside every body, zero for the stars
+        if(mnGasCount > 0)
+        {
+            mpHydro = new Hydro(mnBodyCount, mnGasCount);
+            
+            m_Gas.resize(mnBodyCount);
+        } // if
+        
+        // Background potential, if any, with its defaults resolved
+        External field(m_ActiveParams);
+        
+        if(field.active())
+        {
+            mpExternal = new External(field);
+        } // if
+        
+        if(mnMergeRadius > 0.0f)
+        {
+            mpContacts = new Cells(mnBodyCount);
+        } // if
+        
+        // The correction table only depends on the shape of the box, so
+        // it is built once here in units of the box
+        if(mbPeriodic)
+        {
+            mpEwald = new Ewald(Periodic::kTableSize, m_Dispatch);
+        } // if
+        
+        if(mbSpecies)
+        {
+            m_Species.assign(mnBodyCount, GLubyte(eSpeciesStar));
+        } // if
+        
+        if((mnReorderInterval > 0) || (mnLevels > 1) || (mpContacts != NULL))
+        {
+            mpOrdered = (GLfloat *) malloc(mnSize);
+        } // if
+        
+        m_DeviceName = hw.model();
+        mnDevices    = GLuint(mnThreads);
+        
+        mbAcquired = (mpPosition != NULL) && (mpVelocity != NULL) && (mpAcceleration != NULL) && (mpSource[0] != NULL) && (((mnReorderInterval == 0) && (mnLevels < 2) && (mpContacts == NULL)) || (mpOrdered != NULL));
+        
+        if(!mbAcquired)
+        {
+            std::cerr
+            << ">> N-body Simulation: Failed setting up cpu compute device!"
+            << std::endl;
+        } // if
+        else
+        {
+            touch();
+            
+            std::cout
+            << ">> N-body Simulation: Using \""
+            << m_DeviceName
+            << "\" with "
+            << mnThreads
+            << " threads ("
+            << ((mnISA == eNBodyCPUAVX512) ? "AVX-512" : ((mnISA == eNBodyCPUAVX2) ? "AVX2" : "scalar"))
+            << ((mnPrecision == ePrecisionDouble) ? ", double" : ((mnPrecision == ePrecisionDoubleSingle) ? ", double-single" : ""))
+            << ")"
+            << std::endl;
+            
+            if(mbBlocked)
+            {
+                std::cout
+                << ">> N-body Simulation: Blocked direct sum, block "
+                << mpBlocking->block()
+                << ", tile "
+                << mpBlocking->tile()
+                << ", unroll "
+                << mpBlocking->unroll()
+                << std::endl;
+            } // if
+            
+            if(mpCells != NULL)
+            {
+                std::cout
+                << ">> N-body Simulation: Short range forces within "
+                << mnCutoff
+                << std::endl;
+            } // if
+            
+            if(mpHydro != NULL)
+            {
+                std::cout
+                << ">> N-body Simulation: "
+                << mnGasCount
+                << " gas bodies"
+                << std::endl;
+            } // if
+            
+            if(mpExternal != NULL)
+            {
+                std::cout
+                << ">> N-body Simulation: Background potential "
+                << mpExternal->potential()
+                << " of mass "
+                << mpExternal->mass()
+                << " and scale "
+                << mpExternal->scale()
+                << std::endl;
+            } // if
+            
+            if(mpEwald != NULL)
+            {
+                std::cout
+                << ">> N-body Simulation: Periodic box of side "
+                << mnBoxSize
+                << ", Ewald table of "
+                << mpEwald->size()
+                << "^3"
+                << std::endl;
+            } // if
+            
+            if(mpContacts != NULL)
+            {
+                std::cout
+                << ">> N-body Simulation: Merging stars within "
+                << mnMergeRadius
+                << std::endl;
+            } // if
+            
+            if(mbSpecies)
+            {
+                std::cout
+                << ">> N-body Simulation: "
+                << mnDarkCount
+                << " dark matter and "
+                << mnTracerCount
+                << " tracer bodies"
+                << std::endl;
+            } // if
+        } // else
+    } // if
+} // initialize
+
+GLint NBody::Simulation::CPU::reset()
+{
+    GLint err = mbAcquired ? restart() : -1;
+    
+    if(err != 0)
+    {
+        std::cerr
+        << ">> N-body Simulation["
+        << err
+        << "]: Failed resetting cpu bodies!"
+        << std::endl;
+    } // if
+    
+    return err;
+} // reset
+
+void NBody::Simulation::CPU::step()
+{
+    if(mbAcquired && (!isPaused() || !isStopped()))
+    {
+        if(mbBenchmark)
+        {
+            measure();
+            
+            mbBenchmark = false;
+        } // if
+        
+        mnHydroInteractions = 0.0;
+        mnHydroTime         = 0.0;
+        
+        collide();
+        
+        // Merged bodies sit past the live ones and are never integrated
+        mnMaxIndex = std::min(mnMaxIndex, mnLiveCount);
+        mnMinIndex = std::min(mnMinIndex, mnMaxIndex);
+        
+        if((mnLevels > 1) && (mnMinIndex == 0) && (mnMaxIndex == mnLiveCount))
+        {
+            block();
+        } // if
+        else
+        {
+            integrate();
+        } // else
+        
+        if(mpHydro != NULL)
+        {
+            mpHydro->update(mpPosition, m_Gas.data(), m_ActiveParams.mnTimeStamp, m_Dispatch);
+        } // if
+        
+        // A sort moves bodies across the whole range, so only reorder
+        // when every body is active
+        if((mpMorton != NULL) && (mnMinIndex == 0) && (mnMaxIndex == mnLiveCount) && ((++mnSteps % mnReorderInterval) == 0))
+        {
+            reorder();
+        } // if
+        
+        if(mbIsUpdated)
+        {
+            setData(ordered());
+        } // if
+    } // if
+} // step
+
+void NBody::Simulation::CPU::terminate()
+{
+    if(!mbTerminated)
+    {
+        if(mpPosition != NULL)
+        {
+            free(mpPosition);
+            
+            mpPosition = NULL;
+        } // if
+        
+        if(mpVelocity != NULL)
+        {
+            free(mpVelocity);
+            
+            mpVelocity = NULL;
+        } // if
+        
+        if(mpAcceleration != NULL)
+        {
+            free(mpAcceleration);
+            
+            mpAcceleration = NULL;
+        } // if
+        
+        if(mpSource[0] != NULL)
+        {
+            free(mpSource[0]);
+            
+            mpSource[0] = NULL;
+            mpSource[1] = NULL;
+            mpSource[2] = NULL;
+            mpSource[3] = NULL;
+        } // if
+        
+        if(mpOrdered != NULL)
+        {
+            free(mpOrdered);
+            
+            mpOrdered = NULL;
+        } // if
+        
+        if(mpMorton != NULL)
+        {
+            delete mpMorton;
+            
+            mpMorton = NULL;
+        } // if
+        
+        if(mpBlocking != NULL)
+        {
+            delete mpBlocking;
+            
+            mpBlocking = NULL;
+            mbBlocked  = false;
+        } // if
+        
+        if(mpCells != NULL)
+        {
+            delete mpCells;
+            
+            mpCells = NULL;
+        } // if
+        
+        if(mpHydro != NULL)
+        {
+            delete mpHydro;
+            
+            mpHydro = NULL;
+        } // if
+        
+        m_Gas.clear();
+        
+        if(mpExternal != NULL)
+        {
+            delete mpExternal;
+            
+            mpExternal = NULL;
+        } // if
+        
+        if(mpEwald != NULL)
+        {
+            delete mpEwald;
+            
+            mpEwald = NULL;
+        } // if
+        
+        if(mpContacts != NULL)
+        {
+            delete mpContacts;
+            
+            mpContacts = NULL;
+        } // if
+        
+        m_Partner.clear();
+        m_Host.clear();
+        m_Species.clear();
+        
+        m_Identity.clear();
+        m_Level.clear();
+        m_Kick.clear();
+        m_Jerk.clear();
+        m_Velocity.clear();
+        m_Start.clear();
+        m_PositionLow.clear();
+        m_VelocityLow.clear();
+        m_SourceLow.clear();
+        
+        mpSourceLow[0] = NULL;
+        mpSourceLow[1] = NULL;
+        mpSourceLow[2] = NULL;
+        
+        mbTerminated = true;
+    } // if
+} // terminate
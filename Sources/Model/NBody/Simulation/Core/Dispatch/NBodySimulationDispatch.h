@@ -0,0 +1,136 @@
+/*
+     File: NBodySimulationDispatch.h
+ Abstract:
+ Utility class for splitting data parallel and fork/join work across the
+ cpu cores, on a pool of workers that steal work from each other.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_DISPATCH_H_
+#define _NBODY_SIMULATION_DISPATCH_H_
+
+#import <atomic>
+#import <functional>
+
+#import <OpenGL/OpenGL.h>
+
+#import "NBodySimulationTypes.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class Dispatch
+        {
+        public:
+            // Work functor invoked with a half-open range [nBegin, nEnd)
+            typedef std::function<void(const size_t& nBegin, const size_t& nEnd)> Task;
+            
+            // Work functor for a single forked task
+            typedef std::function<void()> Job;
+            
+            // Fork/join scope. Jobs forked into a group may run on any
+            // worker, and may fork and join groups of their own. Joining
+            // runs queued jobs, from any worker, until the group is done.
+            class Group
+            {
+            public:
+                Group(const Dispatch& rDispatch);
+                
+                virtual ~Group();
+                
+                void fork(const Job& job);
+                void join();
+            
+            private:
+                friend class Dispatch;
+                
+                const Dispatch&      mrDispatch;
+                std::atomic<size_t>  mnPending;
+            }; // Group
+            
+        public:
+            // Zero threads means one per physical core. Pinned workers
+            // each get an affinity tag of their own, so that the kernel
+            // keeps them on separate cores, and socket affinity gives the
+            // workers of each socket, or domain, a shared tag.
+            Dispatch(const size_t& nThreads = 0,
+                     const GLuint& nAffinity = eAffinityDefault);
+            
+            virtual ~Dispatch();
+            
+            // Split [nBegin, nEnd) into contiguous ranges, aligned to
+            // nGrain, and run the task on all threads. There are never
+            // more ranges than grains, and up to a few per thread, so
+            // that idle workers can steal the ranges of busy ones. Each
+            // range is queued on the worker that owns that part of the
+            // span, which runs it unless it was stolen first. The
+            // calling thread helps and returns once all are done.
+            void apply(const size_t& nBegin,
+                       const size_t& nEnd,
+                       const size_t& nGrain,
+                       const Task& task) const;
+            
+            // As apply, but every worker runs exactly the part of the
+            // span that it owns in apply, and none is stolen. For first
+            // touch of memory, so that its pages are placed on the
+            // domain of the worker that will use them most.
+            void place(const size_t& nBegin,
+                       const size_t& nEnd,
+                       const size_t& nGrain,
+                       const Task& task) const;
+            
+            // Index of the calling worker, 0 outside the pool, and the
+            // domain it is grouped in
+            size_t worker() const;
+            size_t domain(const size_t& nWorker) const;
+            
+            const size_t& threads() const;
+            const size_t& domains() const;
+            
+        private:
+            // Workers, their deques, and the wake up of idle workers
+            struct Pool;
+            
+            Dispatch(const Dispatch& rDispatch);
+            
+            Dispatch& operator=(const Dispatch& rDispatch);
+            
+            // Queue a job on a worker, the calling one when nWorker is
+            // past the last. Bound jobs are never stolen.
+            void submit(const Job& job,
+                        std::atomic<size_t>& rPending,
+                        const size_t& nWorker = ~size_t(0),
+                        const bool& bBound = false) const;
+            
+            // Ranges of apply, and the worker owning each
+            void range(const size_t& nRange,
+                       const size_t& nRanges,
+                       const size_t& nBegin,
+                       const size_t& nEnd,
+                       const size_t& nGrain,
+                       size_t& nFirst,
+                       size_t& nLast) const;
+            
+            size_t owner(const size_t& nRange,
+                         const size_t& nRanges) const;
+            
+            // Run one queued job, from the deque of the calling worker
+            // or stolen from another, and return false if there was none
+            bool help() const;
+            
+        private:
+            size_t  mnThreads;
+            size_t  mnDomains;
+            Pool   *mpPool;
+        }; // Dispatch
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
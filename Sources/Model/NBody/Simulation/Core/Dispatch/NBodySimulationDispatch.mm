@@ -0,0 +1,501 @@
+/*
+     File: NBodySimulationDispatch.mm
+ Abstract:
+ Utility class for splitting data parallel and fork/join work across the
+ cpu cores, on a pool of workers that steal work from each other.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <condition_variable>
+#import <deque>
+#import <mutex>
+#import <thread>
+#import <vector>
+
+#import <pthread.h>
+#import <mach/mach.h>
+#import <mach/thread_policy.h>
+
+#import "CFQueryHardware.h"
+
+#import "NBodySimulationDispatch.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Ranges per thread made by apply, for workers to steal from each other
+static const size_t kRangesPerThread = 4;
+
+#pragma mark -
+#pragma mark Private - Data Structures
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        // A job, the pending count of the group it was forked into, and
+        // whether it must run on the worker it was queued on
+        struct DispatchItem
+        {
+            Dispatch::Job         m_Job;
+            std::atomic<size_t>  *mpPending;
+            bool                  mbBound;
+        }; // DispatchItem
+        
+        // Owners push and pop at the back, thieves take the first free job
+        // from the front, so a thief gets the oldest and usually the largest
+        // piece of work. The count is kept under the lock, and read without
+        // it by an idle owner.
+        struct DispatchDeque
+        {
+            std::mutex                m_Lock;
+            std::deque<DispatchItem>  m_Items;
+            std::atomic<size_t>       mnItems;
+            
+            DispatchDeque()
+            : mnItems(0) {}
+        }; // DispatchDeque
+    } // Simulation
+} // NBody
+
+// Deque 0 takes the jobs of threads outside the pool, and deque i the
+// jobs of worker i
+struct NBody::Simulation::Dispatch::Pool
+{
+    std::vector<std::thread>    m_Threads;
+    std::vector<DispatchDeque>  m_Deques;
+    std::mutex                  m_Lock;
+    std::condition_variable     m_Wake;
+    std::atomic<size_t>         mnStealable;
+    bool                        mbStop;
+    
+    Pool(const size_t& nDeques)
+    : m_Deques(nDeques), mnStealable(0), mbStop(false) {}
+}; // Pool
+
+#pragma mark -
+#pragma mark Private - Worker State
+
+// Pool and deque of the calling thread, when it is one of the workers
+static thread_local const void *gpDispatchPool  = NULL;
+static thread_local size_t      gnDispatchWorker = 0;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Affinity tags are a hint, threads with different tags are kept apart
+// where the hardware allows it
+static void NBodySimulationDispatchPin(const size_t& nTag)
+{
+    thread_affinity_policy_data_t policy = { integer_t(nTag) };
+    
+    thread_policy_set(pthread_mach_thread_np(pthread_self()),
+                      THREAD_AFFINITY_POLICY,
+                      thread_policy_t(&policy),
+                      THREAD_AFFINITY_POLICY_COUNT);
+} // NBodySimulationDispatchPin
+
+// Owners take from the back, thieves the first job from the front that
+// is not bound to the owner
+static bool NBodySimulationDispatchTake(NBody::Simulation::DispatchDeque& rDeque,
+                                        const bool& bBack,
+                                        std::atomic<size_t>& rStealable,
+                                        NBody::Simulation::DispatchItem& rItem)
+{
+    std::lock_guard<std::mutex> lock(rDeque.m_Lock);
+    
+    std::deque<NBody::Simulation::DispatchItem>::iterator pItem = rDeque.m_Items.end();
+    
+    if(bBack)
+    {
+        if(!rDeque.m_Items.empty())
+        {
+            pItem = rDeque.m_Items.end() - 1;
+        } // if
+    } // if
+    else
+    {
+        pItem = std::find_if(rDeque.m_Items.begin(),
+                             rDeque.m_Items.end(),
+                             [](const NBody::Simulation::DispatchItem& rQueued) { return !rQueued.mbBound; });
+    } // else
+    
+    if(pItem == rDeque.m_Items.end())
+    {
+        return false;
+    } // if
+    
+    rItem = *pItem;
+    
+    rDeque.m_Items.erase(pItem);
+    rDeque.mnItems.fetch_sub(1);
+    
+    if(!rItem.mbBound)
+    {
+        rStealable.fetch_sub(1);
+    } // if
+    
+    return true;
+} // NBodySimulationDispatchTake
+
+bool NBody::Simulation::Dispatch::help() const
+{
+    if(mpPool == NULL)
+    {
+        return false;
+    } // if
+    
+    const size_t nDeques = mpPool->m_Deques.size();
+    const size_t nSelf   = worker();
+    
+    DispatchItem item;
+    
+    bool bFound = NBodySimulationDispatchTake(mpPool->m_Deques[nSelf], true, mpPool->mnStealable, item);
+    
+    size_t i;
+    
+    for(i = 1; !bFound && (i < nDeques); ++i)
+    {
+        bFound = NBodySimulationDispatchTake(mpPool->m_Deques[(nSelf + i) % nDeques], false, mpPool->mnStealable, item);
+    } // for
+    
+    if(bFound)
+    {
+        item.m_Job();
+        
+        item.mpPending->fetch_sub(1, std::memory_order_release);
+    } // if
+    
+    return bFound;
+} // help
+
+void NBody::Simulation::Dispatch::submit(const Job& job,
+                                         std::atomic<size_t>& rPending,
+                                         const size_t& nWorker,
+                                         const bool& bBound) const
+{
+    rPending.fetch_add(1);
+    
+    if(mpPool == NULL)
+    {
+        job();
+        
+        rPending.fetch_sub(1, std::memory_order_release);
+        
+        return;
+    } // if
+    
+    DispatchDeque& rDeque = mpPool->m_Deques[(nWorker < mnThreads) ? nWorker : worker()];
+    
+    {
+        std::lock_guard<std::mutex> lock(rDeque.m_Lock);
+        
+        rDeque.m_Items.push_back(DispatchItem{job, &rPending, bBound});
+        rDeque.mnItems.fetch_add(1);
+        
+        if(!bBound)
+        {
+            mpPool->mnStealable.fetch_add(1);
+        } // if
+    }
+    
+    // Taking the lock orders this with an idle worker checking the counts
+    {
+        std::lock_guard<std::mutex> lock(mpPool->m_Lock);
+    }
+    
+    // Any idle worker may steal a free job, but only its owner can run
+    // a bound one
+    if(bBound)
+    {
+        mpPool->m_Wake.notify_all();
+    } // if
+    else
+    {
+        mpPool->m_Wake.notify_one();
+    } // else
+} // submit
+
+void NBody::Simulation::Dispatch::range(const size_t& nRange,
+                                        const size_t& nRanges,
+                                        const size_t& nBegin,
+                                        const size_t& nEnd,
+                                        const size_t& nGrain,
+                                        size_t& nFirst,
+                                        size_t& nLast) const
+{
+    const size_t nBlocks = (nEnd - nBegin + nGrain - 1) / nGrain;
+    
+    nFirst = std::min(nEnd, nBegin + ((nBlocks * nRange) / nRanges) * nGrain);
+    
+    nLast = (nRange == (nRanges - 1))
+    ? nEnd
+    : std::min(nEnd, nBegin + ((nBlocks * (nRange + 1)) / nRanges) * nGrain);
+} // range
+
+size_t NBody::Simulation::Dispatch::owner(const size_t& nRange,
+                                          const size_t& nRanges) const
+{
+    return (nRange * mnThreads) / nRanges;
+} // owner
+
+#pragma mark -
+#pragma mark Public - Group
+
+NBody::Simulation::Dispatch::Group::Group(const Dispatch& rDispatch)
+: mrDispatch(rDispatch), mnPending(0)
+{
+} // Constructor
+
+NBody::Simulation::Dispatch::Group::~Group()
+{
+    join();
+} // Destructor
+
+void NBody::Simulation::Dispatch::Group::fork(const Job& job)
+{
+    mrDispatch.submit(job, mnPending);
+} // fork
+
+void NBody::Simulation::Dispatch::Group::join()
+{
+    while(mnPending.load(std::memory_order_acquire) > 0)
+    {
+        if(!mrDispatch.help())
+        {
+            std::this_thread::yield();
+        } // if
+    } // while
+} // join
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Dispatch::Dispatch(const size_t& nThreads,
+                                      const GLuint& nAffinity)
+{
+    CF::Query::Hardware hw;
+    
+    mnDomains = std::max(hw.packages(), size_t(1));
+    
+    if(nThreads > 0)
+    {
+        mnThreads = nThreads;
+    } // if
+    else
+    {
+        mnThreads = (hw.cores() > 0) ? hw.cores() : 1;
+    } // else
+    
+    mnDomains = std::min(mnDomains, mnThreads);
+    
+    mpPool = NULL;
+    
+    if(mnThreads > 1)
+    {
+        mpPool = new Pool(mnThreads);
+        
+        size_t i;
+        
+        // The thread calling apply or join is the first worker, so the
+        // pool runs one thread fewer than there are cores
+        for(i = 1; i < mnThreads; ++i)
+        {
+            mpPool->m_Threads.push_back(std::thread([this, i, nAffinity]()
+            {
+                gpDispatchPool   = mpPool;
+                gnDispatchWorker = i;
+                
+                switch(nAffinity)
+                {
+                    case eAffinityPinned:
+                        NBodySimulationDispatchPin(i + 1);
+                        break;
+                    
+                    case eAffinitySocket:
+                        NBodySimulationDispatchPin(domain(i) + 1);
+                        break;
+                    
+                    default:
+                        break;
+                } // switch
+                
+                while(true)
+                {
+                    if(help())
+                    {
+                        continue;
+                    } // if
+                    
+                    std::unique_lock<std::mutex> lock(mpPool->m_Lock);
+                    
+                    // Only its own jobs, or free ones of any worker, can
+                    // be run here, so jobs bound to other workers do not
+                    // keep this one awake
+                    const DispatchDeque& rDeque = mpPool->m_Deques[i];
+                    
+                    mpPool->m_Wake.wait(lock, [this, &rDeque]()
+                    {
+                        return mpPool->mbStop || (rDeque.mnItems.load() > 0) || (mpPool->mnStealable.load() > 0);
+                    });
+                    
+                    if(mpPool->mbStop)
+                    {
+                        break;
+                    } // if
+                } // while
+            }));
+        } // for
+    } // if
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Dispatch::~Dispatch()
+{
+    if(mpPool != NULL)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mpPool->m_Lock);
+            
+            mpPool->mbStop = true;
+        }
+        
+        mpPool->m_Wake.notify_all();
+        
+        size_t i;
+        
+        for(i = 0; i < mpPool->m_Threads.size(); ++i)
+        {
+            mpPool->m_Threads[i].join();
+        } // for
+        
+        delete mpPool;
+        
+        mpPool = NULL;
+    } // if
+    
+    mnThreads = 0;
+    mnDomains = 0;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+void NBody::Simulation::Dispatch::apply(const size_t& nBegin,
+                                        const size_t& nEnd,
+                                        const size_t& nGrain,
+                                        const Task& task) const
+{
+    if(nEnd <= nBegin)
+    {
+        return;
+    } // if
+    
+    const size_t nGrainSize = (nGrain > 0) ? nGrain : 1;
+    const size_t nBlocks    = (nEnd - nBegin + nGrainSize - 1) / nGrainSize;
+    const size_t nRanges    = std::min(kRangesPerThread * mnThreads, nBlocks);
+    
+    if((nRanges < 2) || (mpPool == NULL))
+    {
+        task(nBegin, nEnd);
+        
+        return;
+    } // if
+    
+    Group group(*this);
+    
+    size_t nFirst = 0;
+    size_t nLast  = 0;
+    size_t i;
+    
+    for(i = 0; i < nRanges; ++i)
+    {
+        range(i, nRanges, nBegin, nEnd, nGrainSize, nFirst, nLast);
+        
+        submit([&task, nFirst, nLast]() { task(nFirst, nLast); }, group.mnPending, owner(i, nRanges));
+    } // for
+    
+    group.join();
+} // apply
+
+void NBody::Simulation::Dispatch::place(const size_t& nBegin,
+                                        const size_t& nEnd,
+                                        const size_t& nGrain,
+                                        const Task& task) const
+{
+    if(nEnd <= nBegin)
+    {
+        return;
+    } // if
+    
+    const size_t nGrainSize = (nGrain > 0) ? nGrain : 1;
+    const size_t nBlocks    = (nEnd - nBegin + nGrainSize - 1) / nGrainSize;
+    const size_t nRanges    = std::min(kRangesPerThread * mnThreads, nBlocks);
+    
+    // Only the simulation thread, outside the pool, stands in for the
+    // first worker
+    if((nRanges < 2) || (mpPool == NULL) || (gpDispatchPool == mpPool))
+    {
+        apply(nBegin, nEnd, nGrain, task);
+        
+        return;
+    } // if
+    
+    Group group(*this);
+    
+    size_t nFirst = 0;
+    size_t nLast  = 0;
+    size_t nStart = nBegin;
+    size_t i;
+    
+    // The ranges of a worker in apply are consecutive, so each worker
+    // gets their union as a single bound job
+    for(i = 0; i < nRanges; ++i)
+    {
+        const size_t nOwner = owner(i, nRanges);
+        
+        range(i, nRanges, nBegin, nEnd, nGrainSize, nFirst, nLast);
+        
+        if((i == (nRanges - 1)) || (owner(i + 1, nRanges) != nOwner))
+        {
+            submit([&task, nStart, nLast]() { task(nStart, nLast); }, group.mnPending, nOwner, true);
+            
+            nStart = nLast;
+        } // if
+    } // for
+    
+    group.join();
+} // place
+
+size_t NBody::Simulation::Dispatch::worker() const
+{
+    return ((mpPool != NULL) && (gpDispatchPool == mpPool)) ? gnDispatchWorker : 0;
+} // worker
+
+// Workers are grouped into domains in order, so the first workers share
+// a domain with the simulation thread
+size_t NBody::Simulation::Dispatch::domain(const size_t& nWorker) const
+{
+    return (nWorker * mnDomains) / mnThreads;
+} // domain
+
+#pragma mark -
+#pragma mark Public - Accessors
+
+const size_t& NBody::Simulation::Dispatch::threads() const
+{
+    return mnThreads;
+} // threads
+
+const size_t& NBody::Simulation::Dispatch::domains() const
+{
+    return mnDomains;
+} // domains
@@ -0,0 +1,61 @@
+/*
+     File: NBodySimulationExternal.h
+ Abstract:
+ Utility class for an analytic background potential of an n-body
+ simulation, evaluated in closed form at each body.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_EXTERNAL_H_
+#define _NBODY_SIMULATION_EXTERNAL_H_
+
+#import <OpenGL/OpenGL.h>
+
+#import "NBodySimulationTypes.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class External
+        {
+        public:
+            // The potential, mass, scale and height of the parameters,
+            // with the defaults for those left at zero
+            External(const Params& rParams);
+            
+            virtual ~External();
+            
+            // Add the accelerations of the field at the bodies within
+            // [nBegin, nEnd) to those as float4
+            void accelerate(const GLfloat * const pPosition,
+                            const size_t& nBegin,
+                            const size_t& nEnd,
+                            GLfloat *pAcceleration) const;
+            
+            // Build options that compile the same field into the kernels
+            String options() const;
+            
+            const bool&    active()    const;
+            const GLuint&  potential() const;
+            const GLfloat& mass()      const;
+            const GLfloat& scale()     const;
+            const GLfloat& height()    const;
+            
+        private:
+            bool     mbActive;
+            GLuint   mnPotential;
+            GLfloat  mnMass;
+            GLfloat  mnScale;
+            GLfloat  mnHeight;
+        }; // External
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
@@ -0,0 +1,191 @@
+/*
+     File: NBodySimulationExternal.mm
+ Abstract:
+ Utility class for an analytic background potential of an n-body
+ simulation, evaluated in closed form at each body.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <cmath>
+#import <cstdio>
+
+#import "NBodyConstants.h"
+
+#import "NBodySimulationExternal.h"
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Mass of an NFW halo within q scale radii, over its characteristic
+// mass, with the leading terms of the series near the centre where the
+// difference of the closed form cancels
+static inline GLfloat NBodySimulationExternalNFW(const GLfloat& q)
+{
+    if(q < 1.0e-2f)
+    {
+        return q * q * (0.5f - q * (2.0f / 3.0f - 0.75f * q));
+    } // if
+    
+    return std::log1p(q) - q / (1.0f + q);
+} // NBodySimulationExternalNFW
+
+// Acceleration of the field at a position, with G = 1, as the
+// negative gradient of the potential
+static inline void NBodySimulationExternalAcceleration(const GLuint& nPotential,
+                                                       const GLfloat& nMass,
+                                                       const GLfloat& nScale,
+                                                       const GLfloat& nHeight,
+                                                       const GLfloat * const x,
+                                                       GLfloat *a)
+{
+    const GLfloat r2 = x[0] * x[0] + x[1] * x[1] + x[2] * x[2];
+    const GLfloat r  = std::max(std::sqrt(r2), NBody::Halo::kRadius);
+    
+    GLfloat s  = 0.0f;
+    GLfloat sz = 0.0f;
+    
+    if(nPotential == NBody::Simulation::ePotentialPointMass)
+    {
+        // -M / sqrt(r^2 + a^2), a point mass softened over the scale
+        const GLfloat d2 = r2 + nScale * nScale;
+        
+        s  = nMass / (d2 * std::sqrt(d2));
+        sz = s;
+    } // if
+    else if(nPotential == NBody::Simulation::ePotentialHernquist)
+    {
+        // -M / (r + a)
+        const GLfloat d = r + nScale;
+        
+        s  = nMass / (r * d * d);
+        sz = s;
+    } // else if
+    else if(nPotential == NBody::Simulation::ePotentialNFW)
+    {
+        // -M ln(1 + r/a) / r
+        s  = nMass * NBodySimulationExternalNFW(r / nScale) / (r * r * r);
+        sz = s;
+    } // else if
+    else if(nPotential == NBody::Simulation::ePotentialMiyamotoNagai)
+    {
+        // -M / sqrt(R^2 + (a + sqrt(z^2 + b^2))^2)
+        const GLfloat zb = std::sqrt(x[2] * x[2] + nHeight * nHeight);
+        const GLfloat az = nScale + zb;
+        const GLfloat d2 = x[0] * x[0] + x[1] * x[1] + az * az;
+        
+        s  = nMass / (d2 * std::sqrt(d2));
+        sz = s * az / zb;
+    } // else if
+    
+    a[0] -= s  * x[0];
+    a[1] -= s  * x[1];
+    a[2] -= sz * x[2];
+} // NBodySimulationExternalAcceleration
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::External::External(const Params& rParams)
+{
+    mnPotential = rParams.mnPotential;
+    mnMass      = (rParams.mnPotentialMass   > 0.0f) ? rParams.mnPotentialMass   : NBody::Halo::kMass;
+    mnScale     = (rParams.mnPotentialScale  > 0.0f) ? rParams.mnPotentialScale  : NBody::Halo::kScale;
+    mnHeight    = (rParams.mnPotentialHeight > 0.0f) ? rParams.mnPotentialHeight : NBody::Halo::kHeight;
+    
+    mbActive = (mnPotential > ePotentialNone) && (mnPotential <= ePotentialMiyamotoNagai);
+    
+    if(!mbActive)
+    {
+        mnPotential = ePotentialNone;
+    } // if
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::External::~External()
+{
+    mbActive    = false;
+    mnPotential = ePotentialNone;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+void NBody::Simulation::External::accelerate(const GLfloat * const pPosition,
+                                             const size_t& nBegin,
+                                             const size_t& nEnd,
+                                             GLfloat *pAcceleration) const
+{
+    if(!mbActive)
+    {
+        return;
+    } // if
+    
+    size_t i;
+    
+    for(i = nBegin; i < nEnd; ++i)
+    {
+        NBodySimulationExternalAcceleration(mnPotential,
+                                            mnMass,
+                                            mnScale,
+                                            mnHeight,
+                                            pPosition + 4 * i,
+                                            pAcceleration + 4 * i);
+    } // for
+} // accelerate
+
+NBody::Simulation::String NBody::Simulation::External::options() const
+{
+    if(!mbActive)
+    {
+        return String();
+    } // if
+    
+    char options[256];
+    
+    std::snprintf(options,
+                  sizeof(options),
+                  " -DNBODY_POTENTIAL=%u -DNBODY_POTENTIAL_MASS=%.9ef -DNBODY_POTENTIAL_SCALE=%.9ef -DNBODY_POTENTIAL_HEIGHT=%.9ef -DNBODY_POTENTIAL_RADIUS=%.9ef",
+                  mnPotential,
+                  mnMass,
+                  mnScale,
+                  mnHeight,
+                  NBody::Halo::kRadius);
+    
+    return String(options);
+} // options
+
+#pragma mark -
+#pragma mark Public - Accessors
+
+const bool& NBody::Simulation::External::active() const
+{
+    return mbActive;
+} // active
+
+const GLuint& NBody::Simulation::External::potential() const
+{
+    return mnPotential;
+} // potential
+
+const GLfloat& NBody::Simulation::External::mass() const
+{
+    return mnMass;
+} // mass
+
+const GLfloat& NBody::Simulation::External::scale() const
+{
+    return mnScale;
+} // scale
+
+const GLfloat& NBody::Simulation::External::height() const
+{
+    return mnHeight;
+} // height
@@ -0,0 +1,74 @@
+/*
+     File: NBodySimulationFMM.h
+ Abstract: 
+ Utility class for managing a fast multipole method solver on the cpu for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_FMM_H_
+#define _NBODY_SIMULATION_FMM_H_
+
+#import "NBodySimulationCPU.h"
+#import "NBodySimulationExpansion.h"
+#import "NBodySimulationOctree.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class FMM : public CPU
+        {
+        public:
+            FMM(const size_t& nBodies,
+                const Params& rParams);
+            
+            virtual ~FMM();
+            
+        protected:
+            // Rebuild the octree, form the multipoles upward, interact
+            // cell pairs by a dual tree walk, and pass the local
+            // expansions down to the bodies
+            void accelerate();
+            
+            // No jerk from the approximate forces, so Hermite falls back
+            // to leapfrog
+            bool jerk();
+            
+            // No direct sum kernels to benchmark
+            void measure();
+            
+        private:
+            void upward();
+            
+            void interact(const GLuint& nSink,
+                          const GLuint& nSource,
+                          size_t& nInteractions);
+            
+            void direct(const GLuint& nSink,
+                        const GLuint& nSource);
+            
+            void downward(const GLuint& nNode);
+            
+        private:
+            GLfloat                             mnOpeningAngle;
+            GLdouble                            mnSofteningSq;
+            Expansion                           m_Expansion;
+            Octree                              m_Octree;
+            std::vector<GLuint>                 m_Sinks;
+            std::vector< std::vector<GLuint> >  m_Levels;
+            std::vector<GLdouble>               m_Center;
+            std::vector<GLdouble>               m_Radius;
+            std::vector<GLdouble>               m_Moments;
+            std::vector<GLdouble>               m_Local;
+            std::vector<GLfloat>                m_Acceleration;
+        }; // FMM
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
@@ -0,0 +1,479 @@
+/*
+     File: NBodySimulationFMM.mm
+ Abstract: 
+ Utility class for managing a fast multipole method solver on the cpu for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <atomic>
+#import <cmath>
+#import <cstring>
+#import <iostream>
+
+#import "NBodySimulationFMM.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Bodies per leaf, balancing direct sums against expansions
+static const GLuint kLeafSize = 32;
+
+// Sink bodies summed together in one vector loop
+static const size_t kGroupSize = 16;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Direct sum from a range of source bodies onto up to kGroupSize sinks,
+// with the same maths as ComputeForce. Short groups are padded with the
+// first sink so that the inner loop has a fixed trip count.
+static void NBodySimulationFMMDirect(const GLfloat * const pSink,
+                                     const size_t& nSink,
+                                     const GLfloat * const pSource,
+                                     const size_t& nSource,
+                                     const GLfloat& nSofteningSq,
+                                     GLfloat *pAcceleration)
+{
+    GLfloat x[kGroupSize];
+    GLfloat y[kGroupSize];
+    GLfloat z[kGroupSize];
+    
+    GLfloat ax[kGroupSize];
+    GLfloat ay[kGroupSize];
+    GLfloat az[kGroupSize];
+    
+    size_t i;
+    size_t j;
+    
+    for(i = 0; i < kGroupSize; ++i)
+    {
+        const size_t k = (i < nSink) ? i : 0;
+        
+        x[i] = pSink[4 * k + 0];
+        y[i] = pSink[4 * k + 1];
+        z[i] = pSink[4 * k + 2];
+        
+        ax[i] = 0.0f;
+        ay[i] = 0.0f;
+        az[i] = 0.0f;
+    } // for
+    
+    for(j = 0; j < nSource; ++j)
+    {
+        const GLfloat sx = pSource[4 * j + 0];
+        const GLfloat sy = pSource[4 * j + 1];
+        const GLfloat sz = pSource[4 * j + 2];
+        const GLfloat sm = pSource[4 * j + 3];
+        
+        for(i = 0; i < kGroupSize; ++i)
+        {
+            const GLfloat dx = sx - x[i];
+            const GLfloat dy = sy - y[i];
+            const GLfloat dz = sz - z[i];
+            
+            const GLfloat d2 = dx * dx + dy * dy + dz * dz + nSofteningSq;
+            const GLfloat r  = 1.0f / std::sqrt(d2);
+            const GLfloat s  = sm * r * r * r;
+            
+            ax[i] += dx * s;
+            ay[i] += dy * s;
+            az[i] += dz * s;
+        } // for
+    } // for
+    
+    for(i = 0; i < nSink; ++i)
+    {
+        pAcceleration[4 * i + 0] += ax[i];
+        pAcceleration[4 * i + 1] += ay[i];
+        pAcceleration[4 * i + 2] += az[i];
+    } // for
+} // NBodySimulationFMMDirect
+
+#pragma mark -
+#pragma mark Private - Passes
+
+// Multipoles about each cell's centre of mass, deepest level first, with
+// the radius of the sphere about that centre that holds all its bodies
+void NBody::Simulation::FMM::upward()
+{
+    const std::vector<Octree::Node>& rNodes = m_Octree.nodes();
+    
+    const GLfloat *pPosition = m_Octree.positions();
+    
+    const size_t nSize = m_Expansion.size();
+    
+    size_t l;
+    
+    for(l = m_Levels.size(); l > 0; --l)
+    {
+        const std::vector<GLuint>& rLevel = m_Levels[l - 1];
+        
+        parallel(0, rLevel.size(), 16, [&](const size_t& nBegin, const size_t& nEnd)
+        {
+            size_t i;
+            size_t k;
+            
+            for(i = nBegin; i < nEnd; ++i)
+            {
+                const GLuint        n     = rLevel[i];
+                const Octree::Node& rNode = rNodes[n];
+                
+                GLdouble *pCenter  = m_Center.data()  + 3 * n;
+                GLdouble *pMoments = m_Moments.data() + nSize * n;
+                
+                pCenter[0] = rNode.mnMass[0];
+                pCenter[1] = rNode.mnMass[1];
+                pCenter[2] = rNode.mnMass[2];
+                
+                GLdouble r = 0.0;
+                
+                if(rNode.mnChildren == 0)
+                {
+                    const GLfloat *pBodies = pPosition + 4 * rNode.mnFirst;
+                    
+                    m_Expansion.moments(pBodies, rNode.mnCount, pCenter, pMoments);
+                    
+                    for(k = 0; k < rNode.mnCount; ++k)
+                    {
+                        const GLdouble dx = pBodies[4 * k + 0] - pCenter[0];
+                        const GLdouble dy = pBodies[4 * k + 1] - pCenter[1];
+                        const GLdouble dz = pBodies[4 * k + 2] - pCenter[2];
+                        
+                        r = std::max(r, dx * dx + dy * dy + dz * dz);
+                    } // for
+                    
+                    r = std::sqrt(r);
+                } // if
+                else
+                {
+                    for(k = rNode.mnChild; k < (rNode.mnChild + rNode.mnChildren); ++k)
+                    {
+                        const GLdouble d[3] =
+                        {
+                            m_Center[3 * k + 0] - pCenter[0],
+                            m_Center[3 * k + 1] - pCenter[1],
+                            m_Center[3 * k + 2] - pCenter[2]
+                        };
+                        
+                        m_Expansion.shiftMoments(m_Moments.data() + nSize * k, d, pMoments);
+                        
+                        r = std::max(r, std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) + m_Radius[k]);
+                    } // for
+                } // else
+                
+                m_Radius[n] = r;
+            } // for
+        });
+    } // for
+} // upward
+
+// Dual tree walk onto the sink cell only. A pair is accepted when the
+// spheres of both cells, grown by 1/theta, do not overlap; otherwise the
+// larger cell is split, and leaf pairs are summed directly.
+void NBody::Simulation::FMM::interact(const GLuint& nSink,
+                                      const GLuint& nSource,
+                                      size_t& nInteractions)
+{
+    const std::vector<Octree::Node>& rNodes = m_Octree.nodes();
+    
+    const Octree::Node& rSink   = rNodes[nSink];
+    const Octree::Node& rSource = rNodes[nSource];
+    
+    if(rSource.mnMass[3] == 0.0f)
+    {
+        return;
+    } // if
+    
+    GLuint a;
+    GLuint b;
+    
+    if(nSink == nSource)
+    {
+        if(rSink.mnChildren == 0)
+        {
+            direct(nSink, nSource);
+            
+            nInteractions += size_t(rSink.mnCount) * size_t(rSink.mnCount);
+        } // if
+        else
+        {
+            for(a = rSink.mnChild; a < (rSink.mnChild + rSink.mnChildren); ++a)
+            {
+                for(b = rSink.mnChild; b < (rSink.mnChild + rSink.mnChildren); ++b)
+                {
+                    interact(a, b, nInteractions);
+                } // for
+            } // for
+        } // else
+        
+        return;
+    } // if
+    
+    const GLdouble R[3] =
+    {
+        m_Center[3 * nSink + 0] - m_Center[3 * nSource + 0],
+        m_Center[3 * nSink + 1] - m_Center[3 * nSource + 1],
+        m_Center[3 * nSink + 2] - m_Center[3 * nSource + 2]
+    };
+    
+    const GLdouble d2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2];
+    const GLdouble r  = (m_Radius[nSink] + m_Radius[nSource]) / mnOpeningAngle;
+    
+    if((r * r) < d2)
+    {
+        m_Expansion.interact(m_Moments.data() + m_Expansion.size() * nSource,
+                             R,
+                             mnSofteningSq,
+                             m_Local.data() + m_Expansion.size() * nSink);
+        
+        ++nInteractions;
+    } // if
+    else if((rSink.mnChildren == 0) && (rSource.mnChildren == 0))
+    {
+        direct(nSink, nSource);
+        
+        nInteractions += size_t(rSink.mnCount) * size_t(rSource.mnCount);
+    } // else if
+    else if(rSink.mnChildren && ((rSource.mnChildren == 0) || (m_Radius[nSink] > m_Radius[nSource])))
+    {
+        for(a = rSink.mnChild; a < (rSink.mnChild + rSink.mnChildren); ++a)
+        {
+            interact(a, nSource, nInteractions);
+        } // for
+    } // else if
+    else
+    {
+        for(b = rSource.mnChild; b < (rSource.mnChild + rSource.mnChildren); ++b)
+        {
+            interact(nSink, b, nInteractions);
+        } // for
+    } // else
+} // interact
+
+void NBody::Simulation::FMM::direct(const GLuint& nSink,
+                                    const GLuint& nSource)
+{
+    const std::vector<Octree::Node>& rNodes = m_Octree.nodes();
+    
+    const Octree::Node& rSink   = rNodes[nSink];
+    const Octree::Node& rSource = rNodes[nSource];
+    
+    const GLfloat *pPosition = m_Octree.positions();
+    
+    const GLfloat nSofteningSq = GLfloat(mnSofteningSq);
+    
+    GLuint g;
+    
+    for(g = rSink.mnFirst; g < (rSink.mnFirst + rSink.mnCount); g += kGroupSize)
+    {
+        NBodySimulationFMMDirect(pPosition + 4 * g,
+                                 std::min(size_t(kGroupSize), size_t(rSink.mnFirst + rSink.mnCount - g)),
+                                 pPosition + 4 * rSource.mnFirst,
+                                 rSource.mnCount,
+                                 nSofteningSq,
+                                 m_Acceleration.data() + 4 * g);
+    } // for
+} // direct
+
+// Translate local expansions down to the leaves, then evaluate them
+// at each body on top of the direct sums
+void NBody::Simulation::FMM::downward(const GLuint& nNode)
+{
+    const Octree::Node& rNode = m_Octree.nodes()[nNode];
+    
+    const size_t nSize = m_Expansion.size();
+    
+    const GLdouble *pCenter = m_Center.data() + 3 * nNode;
+    const GLdouble *pLocal  = m_Local.data()  + nSize * nNode;
+    
+    GLuint k;
+    
+    if(rNode.mnChildren == 0)
+    {
+        const GLfloat *pPosition = m_Octree.positions();
+        
+        GLdouble u[3];
+        GLdouble a[3];
+        
+        for(k = rNode.mnFirst; k < (rNode.mnFirst + rNode.mnCount); ++k)
+        {
+            u[0] = pPosition[4 * k + 0] - pCenter[0];
+            u[1] = pPosition[4 * k + 1] - pCenter[1];
+            u[2] = pPosition[4 * k + 2] - pCenter[2];
+            
+            m_Expansion.evaluate(pLocal, u, a);
+            
+            m_Acceleration[4 * k + 0] += GLfloat(a[0]);
+            m_Acceleration[4 * k + 1] += GLfloat(a[1]);
+            m_Acceleration[4 * k + 2] += GLfloat(a[2]);
+        } // for
+    } // if
+    else
+    {
+        for(k = rNode.mnChild; k < (rNode.mnChild + rNode.mnChildren); ++k)
+        {
+            const GLdouble d[3] =
+            {
+                m_Center[3 * k + 0] - pCenter[0],
+                m_Center[3 * k + 1] - pCenter[1],
+                m_Center[3 * k + 2] - pCenter[2]
+            };
+            
+            m_Expansion.shiftLocal(pLocal, d, m_Local.data() + nSize * k);
+            
+            downward(k);
+        } // for
+    } // else
+} // downward
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::FMM::FMM(const size_t& nbodies,
+                            const NBody::Simulation::Params& params)
+: NBody::Simulation::CPU(nbodies, params)
+, m_Expansion((params.mnExpansionOrder > 0) ? params.mnExpansionOrder : Tree::kExpansionOrder)
+, m_Octree(nbodies, kLeafSize)
+{
+    mnOpeningAngle = (params.mnOpeningAngle > 0.0f) ? params.mnOpeningAngle : Tree::kMultipoleOpeningAngle;
+    mnSofteningSq  = 0.0;
+    
+    m_Acceleration.resize(4 * nbodies);
+    
+    std::cout
+    << ">> N-body Simulation: Fast multipole method of order "
+    << m_Expansion.order()
+    << ", opening angle "
+    << mnOpeningAngle
+    << std::endl;
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::FMM::~FMM()
+{
+    // The simulation thread walks the octree, so stop it before the
+    // octree and expansions are released
+    stop();
+} // Destructor
+
+#pragma mark -
+#pragma mark Protected - Utilities
+
+void NBody::Simulation::FMM::accelerate()
+{
+    m_Octree.build(mpPosition, mnOpeningAngle, m_Dispatch);
+    
+    const std::vector<Octree::Node>& rNodes = m_Octree.nodes();
+    
+    const size_t nNodes = rNodes.size();
+    const size_t nSize  = m_Expansion.size();
+    
+    mnSofteningSq = GLdouble(m_ActiveParams.mnSoftening) * GLdouble(m_ActiveParams.mnSoftening);
+    
+    m_Center.resize(3 * nNodes);
+    m_Radius.resize(nNodes);
+    
+    m_Moments.assign(nSize * nNodes, 0.0);
+    m_Local.assign(nSize * nNodes, 0.0);
+    
+    std::fill(m_Acceleration.begin(), m_Acceleration.end(), 0.0f);
+    
+    for(std::vector<GLuint>& rLevel : m_Levels)
+    {
+        rLevel.clear();
+    } // for
+    
+    size_t n;
+    
+    for(n = 0; n < nNodes; ++n)
+    {
+        if(rNodes[n].mnLevel >= m_Levels.size())
+        {
+            m_Levels.resize(rNodes[n].mnLevel + 1);
+        } // if
+        
+        m_Levels[rNodes[n].mnLevel].push_back(GLuint(n));
+    } // for
+    
+    upward();
+    
+    // Sinks are disjoint cells covering every body, so each task writes
+    // only to its own locals and accelerations
+    const size_t nLimit = std::max(mnBodyCount / (8 * mnThreads), size_t(kLeafSize));
+    
+    std::vector<GLuint> stack(1, 0);
+    
+    m_Sinks.clear();
+    
+    while(!stack.empty())
+    {
+        const GLuint nNode = stack.back();
+        
+        stack.pop_back();
+        
+        if((rNodes[nNode].mnCount <= nLimit) || (rNodes[nNode].mnChildren == 0))
+        {
+            m_Sinks.push_back(nNode);
+        } // if
+        else
+        {
+            for(n = rNodes[nNode].mnChild; n < (rNodes[nNode].mnChild + rNodes[nNode].mnChildren); ++n)
+            {
+                stack.push_back(GLuint(n));
+            } // for
+        } // else
+    } // while
+    
+    std::atomic<size_t> nInteractions(0);
+    
+    parallel(0, m_Sinks.size(), 1, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t nCount = 0;
+        size_t s;
+        
+        for(s = nBegin; s < nEnd; ++s)
+        {
+            interact(m_Sinks[s], 0, nCount);
+            
+            downward(m_Sinks[s]);
+        } // for
+        
+        nInteractions += nCount;
+    });
+    
+    const GLuint *pIndex = m_Octree.index();
+    
+    parallel(0, mnBodyCount, 1024, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t k;
+        
+        for(k = nBegin; k < nEnd; ++k)
+        {
+            const size_t i = pIndex[k];
+            
+            if((i >= mnMinIndex) && (i < mnMaxIndex))
+            {
+                std::memcpy(mpAcceleration + 4 * i, m_Acceleration.data() + 4 * k, 4 * sizeof(GLfloat));
+            } // if
+        } // for
+    });
+    
+    mnInteractions = GLdouble(nInteractions.load());
+} // accelerate
+
+bool NBody::Simulation::FMM::jerk()
+{
+    return false;
+} // jerk
+
+void NBody::Simulation::FMM::measure()
+{
+} // measure
@@ -0,0 +1,56 @@
+/*
+     File: NBodySimulationCache.h
+ Abstract:
+ Utility class for a persistent cache of the device binaries of the
+ n-body OpenCL program.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_CACHE_H_
+#define _NBODY_SIMULATION_CACHE_H_
+
+#import <OpenCL/OpenCL.h>
+
+#import "NBodySimulationTypes.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class Cache
+        {
+        public:
+            // Binaries of the program built from the source, with the
+            // options, for the device, keyed by a hash of those and of
+            // the device name, vendor, version and driver version
+            Cache(const cl_device_id& pDevice,
+                  const char * const pSource,
+                  const String& options);
+            
+            virtual ~Cache();
+            
+            // Program built from the cached binary, or NULL when there is
+            // none or the driver rejects it, in which case it is removed
+            cl_program acquire(const cl_context& pContext) const;
+            
+            // Keep the binary of a program built from the source
+            bool store(const cl_program& pProgram) const;
+            
+            // File of the binary in the user's cache directory
+            const String& path() const;
+        
+        private:
+            cl_device_id  mpDevice;
+            String        m_Options;
+            String        m_Path;
+        }; // Cache
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
@@ -0,0 +1,262 @@
+/*
+     File: NBodySimulationCache.mm
+ Abstract:
+ Utility class for a persistent cache of the device binaries of the
+ n-body OpenCL program.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <unistd.h>
+
+#import <climits>
+
+#import <cstdio>
+#import <cstring>
+#import <fstream>
+#import <iterator>
+#import <vector>
+
+#import "NBodySimulationCache.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+static const uint64_t kHashBasis = 14695981039346656037ULL;
+static const uint64_t kHashPrime = 1099511628211ULL;
+
+static const size_t kInfoSize = 256;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// FNV-1a over a string, with its terminator so that adjacent fields
+// cannot run into each other
+static uint64_t NBodySimulationCacheHash(const uint64_t& nHash,
+                                         const char * const pString)
+{
+    uint64_t nResult = nHash;
+    
+    size_t i;
+    
+    const size_t nLength = std::strlen(pString) + 1;
+    
+    for(i = 0; i < nLength; ++i)
+    {
+        nResult ^= uint64_t((unsigned char)pString[i]);
+        nResult *= kHashPrime;
+    } // for
+    
+    return nResult;
+} // NBodySimulationCacheHash
+
+static uint64_t NBodySimulationCacheHash(const uint64_t& nHash,
+                                         const cl_device_id& pDevice,
+                                         const cl_device_info& nInfo)
+{
+    char info[kInfoSize] = {0};
+    
+    clGetDeviceInfo(pDevice, nInfo, kInfoSize - 1, info, NULL);
+    
+    return NBodySimulationCacheHash(nHash, info);
+} // NBodySimulationCacheHash
+
+// The per-user cache directory, or an empty string without one
+static NBody::Simulation::String NBodySimulationCacheDirectory()
+{
+    char directory[PATH_MAX] = {0};
+    
+    const size_t nLength = confstr(_CS_DARWIN_USER_CACHE_DIR, directory, PATH_MAX);
+    
+    if((nLength == 0) || (nLength > PATH_MAX))
+    {
+        return NBody::Simulation::String();
+    } // if
+    
+    return NBody::Simulation::String(directory);
+} // NBodySimulationCacheDirectory
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Cache::Cache(const cl_device_id& pDevice,
+                                const char * const pSource,
+                                const NBody::Simulation::String& options)
+{
+    mpDevice  = pDevice;
+    m_Options = options;
+    
+    String directory = NBodySimulationCacheDirectory();
+    
+    if(!directory.empty() && (pSource != NULL))
+    {
+        uint64_t nHash = kHashBasis;
+        
+        nHash = NBodySimulationCacheHash(nHash, pSource);
+        nHash = NBodySimulationCacheHash(nHash, m_Options.c_str());
+        nHash = NBodySimulationCacheHash(nHash, mpDevice, CL_DEVICE_NAME);
+        nHash = NBodySimulationCacheHash(nHash, mpDevice, CL_DEVICE_VENDOR);
+        nHash = NBodySimulationCacheHash(nHash, mpDevice, CL_DEVICE_VERSION);
+        nHash = NBodySimulationCacheHash(nHash, mpDevice, CL_DRIVER_VERSION);
+        
+        char name[32] = {0};
+        
+        std::snprintf(name, sizeof(name), "nbody_gpu.%016llx.bin", (unsigned long long)nHash);
+        
+        if(directory[directory.size() - 1] != '/')
+        {
+            directory += '/';
+        } // if
+        
+        m_Path = directory + name;
+    } // if
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Cache::~Cache()
+{
+    mpDevice = NULL;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Accessors
+
+const NBody::Simulation::String& NBody::Simulation::Cache::path() const
+{
+    return m_Path;
+} // path
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+cl_program NBody::Simulation::Cache::acquire(const cl_context& pContext) const
+{
+    if(m_Path.empty())
+    {
+        return NULL;
+    } // if
+    
+    std::ifstream file(m_Path.c_str(), std::ios::in | std::ios::binary);
+    
+    if(!file.is_open())
+    {
+        return NULL;
+    } // if
+    
+    std::vector<unsigned char> binary((std::istreambuf_iterator<char>(file)),
+                                      std::istreambuf_iterator<char>());
+    
+    file.close();
+    
+    if(binary.empty())
+    {
+        return NULL;
+    } // if
+    
+    const size_t         nSize   = binary.size();
+    const unsigned char *pBinary = binary.data();
+    
+    cl_int status = CL_SUCCESS;
+    cl_int err    = CL_SUCCESS;
+    
+    cl_program pProgram = clCreateProgramWithBinary(pContext,
+                                                    1,
+                                                    &mpDevice,
+                                                    &nSize,
+                                                    &pBinary,
+                                                    &status,
+                                                    &err);
+    
+    if((err == CL_SUCCESS) && (status == CL_SUCCESS))
+    {
+        const char *pOptions = !m_Options.empty() ? m_Options.c_str() : NULL;
+        
+        err = clBuildProgram(pProgram,
+                             1,
+                             &mpDevice,
+                             pOptions,
+                             NULL,
+                             NULL);
+    } // if
+    
+    // A binary of another driver, or a damaged one, is rebuilt from the
+    // source and replaced
+    if((err != CL_SUCCESS) || (status != CL_SUCCESS))
+    {
+        if(pProgram != NULL)
+        {
+            clReleaseProgram(pProgram);
+            
+            pProgram = NULL;
+        } // if
+        
+        std::remove(m_Path.c_str());
+    } // if
+    
+    return pProgram;
+} // acquire
+
+bool NBody::Simulation::Cache::store(const cl_program& pProgram) const
+{
+    if(m_Path.empty() || (pProgram == NULL))
+    {
+        return false;
+    } // if
+    
+    size_t nSize = 0;
+    
+    cl_int err = clGetProgramInfo(pProgram,
+                                  CL_PROGRAM_BINARY_SIZES,
+                                  sizeof(nSize),
+                                  &nSize,
+                                  NULL);
+    
+    if((err != CL_SUCCESS) || (nSize == 0))
+    {
+        return false;
+    } // if
+    
+    std::vector<unsigned char> binary(nSize);
+    
+    unsigned char *pBinary = binary.data();
+    
+    err = clGetProgramInfo(pProgram,
+                           CL_PROGRAM_BINARIES,
+                           sizeof(pBinary),
+                           &pBinary,
+                           NULL);
+    
+    if(err != CL_SUCCESS)
+    {
+        return false;
+    } // if
+    
+    // Written aside and renamed, so that a concurrent launch never reads
+    // a partial binary
+    const String temp = m_Path + "." + std::to_string(getpid());
+    
+    std::ofstream file(temp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    
+    if(!file.is_open())
+    {
+        return false;
+    } // if
+    
+    file.write((const char *)pBinary, std::streamsize(nSize));
+    file.close();
+    
+    if(file.fail() || (std::rename(temp.c_str(), m_Path.c_str()) != 0))
+    {
+        std::remove(temp.c_str());
+        
+        return false;
+    } // if
+    
+    return true;
+} // store
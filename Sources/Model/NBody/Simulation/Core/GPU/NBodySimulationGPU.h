@@ -52,6 +52,9 @@
 
 #import <OpenCL/OpenCL.h>
 
+#import <atomic>
+#import <vector>
+
 #import "NBodySimulationBase.h"
 #import "NBodySimulationRandom.h"
 
@@ -76,14 +79,84 @@ namespace NBody
             void  step();
             void  terminate();
             
+            // Frames of positions published by step are mapped from pinned
+            // buffers, and are only recycled once handed back here
+            void release(GLfloat *pData);
+            
+            // OpenCL device type of a device kind, and the devices of
+            // that type over all the platforms, at most nMax of them
+            static cl_device_type type(const GLuint& nDevice);
+            static GLuint devices(const cl_device_type& nType,
+                                  cl_device_id *pDevices,
+                                  const GLuint& nMax);
+            
             
         private:
             GLint setup(const String& options);
             
+            // The default kernel is bound twice, once for each direction
+            // of the ping-pong buffers, so that a step only enqueues it
             GLint bind();
             GLint execute();
+            
+            // Steps of the next batch, grown while the consumer has yet
+            // to take the last frame and shrunk while it waits on one,
+            // so that a batch spans about a frame of the renderer
+            GLuint batch();
             GLint restart();
             
+            // Staged integrators, as chains of force, kick and drift
+            // kernels with the state of the step in the write buffers
+            GLint build();
+            GLint enqueue(cl_kernel pKernel);
+            GLint enqueue(cl_kernel pKernel,
+                          const size_t& nGlobal,
+                          const size_t& nLocal,
+                          cl_event *pEvent = NULL);
+            GLint accelerate(cl_mem pPosition,
+                             cl_mem pVelocity);
+            GLint advance(cl_mem pPosition,
+                          cl_mem pVelocity,
+                          const GLfloat& nKick,
+                          const GLfloat& nDrift,
+                          const GLfloat& nDamping);
+            GLint leapfrog();
+            GLint yoshida();
+            GLint hermite();
+            
+            // Short range pass over the neighbouring cells, when there
+            // is a cutoff, adding to the accelerations of the active bodies
+            GLint cutoff(cl_mem pPosition,
+                         cl_mem pAcceleration);
+            
+            // Cell list of the bodies [nBegin, nEnd), with cells of side
+            // 1 / nInvSide, into the shared cell buffers
+            GLint bin(cl_mem pPosition,
+                      const cl_float& nInvSide,
+                      const size_t& nBegin,
+                      const size_t& nEnd);
+            
+            // Gas passes of the last bodies, with each kernel profiled
+            // into events that step folds into the hydro timing
+            GLint hydro(cl_mem pPosition,
+                        cl_mem pVelocity,
+                        cl_mem pAcceleration);
+            GLint heat(cl_mem pPosition);
+            
+            // Hydro timing and pairs of the steps behind the last read of
+            // the pair counter, once it is done, without a host sync
+            void profile();
+            
+            // Readback of the positions on a queue of its own, so that a
+            // step's transfer overlaps the next step's kernels. Readback
+            // copies the write buffers into a free pinned frame once the
+            // kernels of the step are done and maps it, without blocking,
+            // and publish hands a finished map to setFrame, waiting for
+            // one still in flight only when bWait is set.
+            GLint readback();
+            void  publish(const bool& bWait);
+            void  discard();
+            
         private:
             bool              mbTerminated;
             GLfloat*          mpHostPosition;
@@ -100,6 +173,58 @@ namespace NBody
             cl_mem            mpDevicePosition[2];
             cl_mem            mpDeviceVelocity[2];
             cl_mem            mpBodyRangeParams;
+            cl_kernel         mpAccelerateKernel;
+            cl_kernel         mpJerkKernel;
+            cl_kernel         mpAdvanceKernel;
+            cl_kernel         mpPredictKernel;
+            cl_kernel         mpCorrectKernel;
+            cl_mem            mpDeviceAcceleration[2];
+            cl_mem            mpDeviceJerk[2];
+            GLuint            mnForceIndex;
+            GLuint            mnIntegrator;
+            bool              mbAccelerated;
+            GLuint            mnPrecision;
+            GLuint            mnLayout;
+            cl_mem            mpDevicePositionLow[2];
+            cl_mem            mpDeviceVelocityLow[2];
+            cl_kernel         mpCountKernel;
+            cl_kernel         mpScanKernel;
+            cl_kernel         mpScatterKernel;
+            cl_kernel         mpShortKernel;
+            cl_mem            mpCellCount;
+            cl_mem            mpCellStart;
+            cl_mem            mpBodyCell;
+            cl_mem            mpBodyRank;
+            cl_mem            mpCellIndex;
+            size_t            mnCells;
+            GLfloat           mnCutoff;
+            cl_kernel         mpDensityKernel;
+            cl_kernel         mpForceKernel;
+            cl_kernel         mpUpdateKernel;
+            cl_mem            mpDeviceGas;
+            cl_mem            mpDeviceFluid;
+            cl_mem            mpPairCount;
+            size_t            mnGasCount;
+            GLfloat           mnSmoothing;
+            cl_device_type    mnDeviceType;
+            bool              mbVector;
+            bool              mbPeriodic;
+            GLfloat           mnBoxSize;
+            cl_mem            mpDeviceEwald;
+            std::vector<cl_event>  m_Events;
+            cl_command_queue  mpReadQueue;
+            cl_mem            mpFrameBuffer[3];
+            GLfloat*          mpHostFrame[3];
+            std::atomic<bool> mbFrameFree[3];
+            GLuint            mnFrameIndex;
+            cl_event          mpReadEvent;
+            GLuint            mnReadBuffer;
+            cl_kernel         mpSwapKernel;
+            GLuint            mnBoundIndex;
+            GLuint            mnBatch;
+            cl_event          mpPairEvent;
+            cl_uint           mnPairCount;
+            size_t            mnPairEvents;
             Data::Random      mConductor;
         }; // GPU
     } // Simulation
@@ -50,14 +50,25 @@
 #pragma mark -
 #pragma mark Private - Headers
 
+#import <algorithm>
+#import <chrono>
 #import <cmath>
+#import <cstring>
 #import <iostream>
+#import <string>
+#import <vector>
 
 #import "GLMSizes.h"
 
 #import "CFIFStream.h"
 
+#import "NBodyConstants.h"
+
 #import "NBodySimulationRandom.h"
+#import "NBodySimulationCache.h"
+#import "NBodySimulationEwald.h"
+#import "NBodySimulationExternal.h"
+#import "NBodySimulationHydro.h"
 #import "NBodySimulationGPU.h"
 
 #pragma mark -
@@ -67,30 +78,37 @@ static GLuint kWorkItemsX = 128;
 static GLuint kWorkItemsY = 1;
 
 static const size_t kKernelParams = 11;
+static const size_t kPreciseParams = 16;
 static const size_t kSizeCLMem    = sizeof(cl_mem);
 
-static const char *kIntegrateSystem = "IntegrateSystem";
+static const GLuint kMaxPlatforms = 8;
+static const GLuint kMaxDevices   = 16;
+
+// Sources per iteration of the vector kernels for cpu devices
+static const size_t kVectorWidth = 8;
+
+static const char *kIntegrateSystem  = "IntegrateSystem";
+static const char *kIntegratePrecise = "IntegrateSystemPrecise";
+static const char *kIntegrateSoA     = "IntegrateSystemSoA";
+static const char *kIntegrateVector  = "IntegrateSystemCPU";
+static const char *kAccelerateSystem = "AccelerateSystem";
+static const char *kPeriodicSystem   = "AccelerateSystemPeriodic";
+static const char *kVectorSystem     = "AccelerateSystemCPU";
+static const char *kJerkSystem       = "AccelerateJerkSystem";
+static const char *kAdvanceSystem    = "AdvanceSystem";
+static const char *kPredictSystem    = "PredictSystem";
+static const char *kCorrectSystem    = "CorrectSystem";
+static const char *kCountCells       = "CountCells";
+static const char *kScanCells        = "ScanCells";
+static const char *kScatterCells     = "ScatterCells";
+static const char *kShortRangeSystem = "ShortRangeSystem";
+static const char *kHydroDensity     = "HydroDensity";
+static const char *kHydroForce       = "HydroForce";
+static const char *kHydroUpdate      = "HydroUpdate";
 
 #pragma mark -
 #pragma mark Private - Utilities
 
-static GLint NBodySimulationGPUReadBuffer(cl_command_queue compute_commands,
-                                          GLfloat *host_data,
-                                          cl_mem device_data,
-                                          size_t size,
-                                          size_t offset)
-{
-    return clEnqueueReadBuffer(compute_commands,
-                               device_data,
-                               CL_TRUE,
-                               offset,
-                               size,
-                               host_data,
-                               0,
-                               NULL,
-                               NULL);
-} // NBodySimulationGPUReadBuffer
-
 static GLint NBodySimulationGPUWriteBuffer(cl_command_queue compute_commands,
                                            const GLfloat * const host_data,
                                            cl_mem device_data,
@@ -107,54 +125,111 @@ static GLint NBodySimulationGPUWriteBuffer(cl_command_queue compute_commands,
                                 NULL);
 } // NBodySimulationGPUWriteBuffer
 
+static GLint NBodySimulationGPUSetArgs(cl_kernel kernel,
+                                       const size_t count,
+                                       const size_t * const sizes,
+                                       const void * const * const values)
+{
+    GLint err = CL_SUCCESS;
+    
+    GLuint i;
+    
+    for(i = 0; i < count; ++i)
+    {
+        err = clSetKernelArg(kernel, i, sizes[i], values[i]);
+        
+        if(err != CL_SUCCESS)
+        {
+            return err;
+        } // if
+    } // for
+    
+    return err;
+} // NBodySimulationGPUSetArgs
+
 GLint NBody::Simulation::GPU::bind()
 {
     GLint err = CL_INVALID_KERNEL;
     
     if(mpKernel != NULL)
     {
+        cl_kernel pKernels[2] = {mpKernel, mpSwapKernel};
+        
         GLuint i = 0;
+        GLuint k = 0;
         
-        size_t  sizes[kKernelParams];
-        void   *pValues[kKernelParams];
-        
-        pValues[0]  = &mpDevicePosition[mnWriteIndex];
-        pValues[1]  = &mpDeviceVelocity[mnWriteIndex];
-        pValues[2]  = &mpDevicePosition[mnReadIndex];
-        pValues[3]  = &mpDeviceVelocity[mnReadIndex];
-        pValues[4]  = (void *) &m_ActiveParams.mnTimeStamp;
-        pValues[5]  = (void *) &m_ActiveParams.mnDamping;
-        pValues[6]  = (void *) &m_ActiveParams.mnSoftening;
-        pValues[7]  = (void *) &mnBodyCount;
-        pValues[8]  = &mnMinIndex;
-        pValues[9]  = &mnMaxIndex;
-        pValues[10] = NULL;
-        
-        sizes[0]  = kSizeCLMem;
-        sizes[1]  = kSizeCLMem;
-        sizes[2]  = kSizeCLMem;
-        sizes[3]  = kSizeCLMem;
-        sizes[4]  = mnSamples;
-        sizes[5]  = mnSamples;
-        sizes[6]  = mnSamples;
-        sizes[7]  = GLM::Size::kInt;
-        sizes[8]  = GLM::Size::kInt;
-        sizes[9]  = GLM::Size::kInt;
-        sizes[10] = 4 * mnSamples * mnWorkItemX * kWorkItemsY;
-        
-        for (i = 0; i < kKernelParams; ++i)
-        {
-            err = clSetKernelArg(mpKernel, i, sizes[i], pValues[i]);
+        for(k = 0; (k < 2) && (pKernels[k] != NULL); ++k)
+        {
+            const GLuint nRead  = k ? mnWriteIndex : mnReadIndex;
+            const GLuint nWrite = k ? mnReadIndex  : mnWriteIndex;
             
-            if(err != CL_SUCCESS)
+            size_t  sizes[kKernelParams];
+            void   *pValues[kKernelParams];
+            
+            pValues[0]  = &mpDevicePosition[nWrite];
+            pValues[1]  = &mpDeviceVelocity[nWrite];
+            pValues[2]  = &mpDevicePosition[nRead];
+            pValues[3]  = &mpDeviceVelocity[nRead];
+            pValues[4]  = (void *) &m_ActiveParams.mnTimeStamp;
+            pValues[5]  = (void *) &m_ActiveParams.mnDamping;
+            pValues[6]  = (void *) &m_ActiveParams.mnSoftening;
+            pValues[7]  = (void *) &mnBodyCount;
+            pValues[8]  = &mnMinIndex;
+            pValues[9]  = &mnMaxIndex;
+            pValues[10] = NULL;
+            
+            sizes[0]  = kSizeCLMem;
+            sizes[1]  = kSizeCLMem;
+            sizes[2]  = kSizeCLMem;
+            sizes[3]  = kSizeCLMem;
+            sizes[4]  = mnSamples;
+            sizes[5]  = mnSamples;
+            sizes[6]  = mnSamples;
+            sizes[7]  = GLM::Size::kInt;
+            sizes[8]  = GLM::Size::kInt;
+            sizes[9]  = GLM::Size::kInt;
+            sizes[10] = 4 * mnSamples * mnWorkItemX * kWorkItemsY;
+            
+            for (i = 0; i < kKernelParams; ++i)
             {
-                return err;
+                err = clSetKernelArg(pKernels[k], i, sizes[i], pValues[i]);
+                
+                if(err != CL_SUCCESS)
+                {
+                    return err;
+                } // if
+            } // for
+            
+            if(mpDevicePositionLow[0] != NULL)
+            {
+                const void *values[5] =
+                {
+                    &mpDevicePositionLow[nWrite],
+                    &mpDeviceVelocityLow[nWrite],
+                    &mpDevicePositionLow[nRead],
+                    &mpDeviceVelocityLow[nRead],
+                    NULL
+                };
+                
+                const size_t lows[5] = {kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, 4 * mnSamples * mnWorkItemX};
+                
+                for (i = kKernelParams; i < kPreciseParams; ++i)
+                {
+                    err = clSetKernelArg(pKernels[k], i, lows[i - kKernelParams], values[i - kKernelParams]);
+                    
+                    if(err != CL_SUCCESS)
+                    {
+                        return err;
+                    } // if
+                } // for
             } // if
         } // for
+        
+        mnBoundIndex = mnReadIndex;
     } // if
     
     return err;
-} // restart
+} // bind
 
 GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
 {
@@ -164,11 +239,13 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     
     GLint err = CL_SUCCESS;
     
-    err = clGetDeviceIDs(NULL, CL_DEVICE_TYPE_GPU, 4, mpDevice, &mnDevices);
+    cl_device_id devices[kMaxDevices] = {0};
     
-    if(err != CL_SUCCESS)
+    mnDevices = GPU::devices(mnDeviceType, devices, kMaxDevices);
+    
+    if(i >= mnDevices)
     {
-        return err;
+        return CL_DEVICE_NOT_FOUND;
     } // if
     
     std::cout
@@ -182,13 +259,13 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     char name[1024]   = {0};
     char vendor[1024] = {0};
     
-    clGetDeviceInfo(mpDevice[i],
+    clGetDeviceInfo(devices[i],
                     CL_DEVICE_NAME,
                     sizeof(name),
                     &name,
                     &nSize);
     
-    clGetDeviceInfo(mpDevice[i],
+    clGetDeviceInfo(devices[i],
                     CL_DEVICE_VENDOR,
                     sizeof(vendor),
                     &vendor,
@@ -196,6 +273,27 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     
     m_DeviceName = name;
     
+    // Cpu runtimes gain nothing from the local memory tiles, and get the
+    // vector kernels when the bodies fill whole vectors
+    cl_device_type nType = CL_DEVICE_TYPE_GPU;
+    
+    clGetDeviceInfo(devices[i],
+                    CL_DEVICE_TYPE,
+                    sizeof(nType),
+                    &nType,
+                    &nSize);
+    
+    mbVector = ((nType & CL_DEVICE_TYPE_CPU) != 0) && ((mnBodyCount % kVectorWidth) == 0);
+    
+    if(mbVector)
+    {
+        std::cout
+        << ">> N-body Simulation: Device["
+        << i
+        << "] is a cpu, using the vector kernels"
+        << std::endl;
+    } // if
+    
     std::cout
     << ">> N-body Simulation: Using Device["
     << i
@@ -204,9 +302,25 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     << "\""
     << std::endl;
     
-    mpDevice[0] = mpDevice[i];
+    mpDevice[0] = devices[i];
+    
+    // The device may be on any platform, so name it for the context
+    cl_platform_id platform = NULL;
+    
+    clGetDeviceInfo(mpDevice[0],
+                    CL_DEVICE_PLATFORM,
+                    sizeof(platform),
+                    &platform,
+                    &nSize);
+    
+    const cl_context_properties context[3] =
+    {
+        CL_CONTEXT_PLATFORM,
+        cl_context_properties(platform),
+        0
+    };
     
-    mpContext = clCreateContext(NULL,
+    mpContext = clCreateContext(context,
                                 1,
                                 &mpDevice[0],
                                 NULL,
@@ -232,9 +346,12 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     }
     
     
+    // Profiled when there is gas, for the timing of its passes
+    const cl_command_queue_properties properties = (mnGasCount > 0) ? CL_QUEUE_PROFILING_ENABLE : 0;
+    
     mpQueue[0] = clCreateCommandQueue(mpContext,
                                       mpDevice[0],
-                                      0,
+                                      properties,
                                       &err);
     
     if(err != CL_SUCCESS)
@@ -255,6 +372,23 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
         << std::endl;
     }
     
+    // Transfers go on a queue of their own, ordered after the kernels
+    // by events rather than by the compute queue
+    mpReadQueue = clCreateCommandQueue(mpContext,
+                                       mpDevice[0],
+                                       0,
+                                       &err);
+    
+    if(err != CL_SUCCESS)
+    {
+        std::cout
+        << ">> N-body Simulation: Device["
+        << i
+        << "] could not clCreateCommandQueue for readback!"
+        << std::endl;
+        return err;
+    } // if
+    
     CF::IFStreamRef pStream = CF::IFStreamCreate(CFSTR("nbody_gpu"), CFSTR("ocl"));
     
     if(!CF::IFStreamIsValid(pStream))
@@ -277,30 +411,82 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     
     const char *pBuffer = CF::IFStreamGetBuffer(pStream);
     
-    mpProgram = clCreateProgramWithSource(mpContext,
-                                          1,
-                                          &pBuffer,
-                                          NULL,
-                                          &err);
+    // Double needs cl_khr_fp64, and otherwise falls back to double-single
+    if(mnPrecision == ePrecisionDouble)
+    {
+        char extensions[4096] = {0};
+        
+        clGetDeviceInfo(mpDevice[0],
+                        CL_DEVICE_EXTENSIONS,
+                        sizeof(extensions),
+                        &extensions,
+                        &nSize);
+        
+        if(std::strstr(extensions, "cl_khr_fp64") == NULL)
+        {
+            std::cout
+            << ">> N-body Simulation: Device["
+            << i
+            << "] has no cl_khr_fp64, using double-single precision"
+            << std::endl;
+            
+            mnPrecision = ePrecisionDoubleSingle;
+        } // if
+    } // if
     
-    if(err != CL_SUCCESS)
+    // The wider precisions select their kernel by a define, and must not
+    // be built with fast or relaxed maths, which double-single relies on.
+    // A background potential is compiled in by defines of its own.
+    String flags = (mnPrecision != ePrecisionFloat)
+                 ? "-DNBODY_PRECISION=" + std::to_string(mnPrecision)
+                 : options;
+    
+    flags += External(m_ActiveParams).options();
+    
+    if(mbPeriodic)
     {
-        std::cout
-        << ">> N-body Simulation: Device["
-        << i
-        << "] could not compile 'nbody_gp.ocl'!"
-        << std::endl;
-        return err;
+        flags += " -DNBODY_BOX=" + std::to_string(mnBoxSize) + "f -DNBODY_EWALD_SIZE=" + std::to_string(Periodic::kTableSize);
     } // if
     
-    const char *pOptions = !options.empty() ? options.c_str() : NULL;
+    const char *pOptions = !flags.empty() ? flags.c_str() : NULL;
+    
+    // Device binaries of an earlier launch with the same source, options
+    // and driver skip the compiler, which takes seconds on some drivers
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
     
-    err = clBuildProgram(mpProgram,
-                         mnDeviceCount,
-                         mpDevice,
-                         pOptions,
-                         NULL,
-                         NULL);
+    Cache cache(mpDevice[0], pBuffer, flags);
+    
+    mpProgram = cache.acquire(mpContext);
+    
+    const bool bCached = mpProgram != NULL;
+    
+    err = CL_SUCCESS;
+    
+    if(!bCached)
+    {
+        mpProgram = clCreateProgramWithSource(mpContext,
+                                              1,
+                                              &pBuffer,
+                                              NULL,
+                                              &err);
+        
+        if(err != CL_SUCCESS)
+        {
+            std::cout
+            << ">> N-body Simulation: Device["
+            << i
+            << "] could not compile 'nbody_gp.ocl'!"
+            << std::endl;
+            return err;
+        } // if
+        
+        err = clBuildProgram(mpProgram,
+                             mnDeviceCount,
+                             mpDevice,
+                             pOptions,
+                             NULL,
+                             NULL);
+    } // if
     
     if(err != CL_SUCCESS)
     {
@@ -329,8 +515,40 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
         return err;
     } // if
     
+    if(!bCached)
+    {
+        cache.store(mpProgram);
+    } // if
+    
+    std::chrono::duration<GLdouble, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    
+    std::cout
+    << ">> N-body Simulation: Device["
+    << i
+    << "] program cache "
+    << (bCached ? "hit" : "miss")
+    << ", ready in "
+    << elapsed.count()
+    << " ms"
+    << std::endl;
+    
+    const char *pKernel = kIntegrateSystem;
+    
+    if(mnPrecision != ePrecisionFloat)
+    {
+        pKernel = kIntegratePrecise;
+    } // if
+    else if(mnLayout == eLayoutSoA)
+    {
+        pKernel = kIntegrateSoA;
+    } // else if
+    else if(mbVector)
+    {
+        pKernel = kIntegrateVector;
+    } // else if
+    
     mpKernel = clCreateKernel(mpProgram,
-                              kIntegrateSystem,
+                              pKernel,
                               &err);
     
     if(err != CL_SUCCESS)
@@ -338,22 +556,60 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
         return err;
     } // if
     
+    mpSwapKernel = clCreateKernel(mpProgram,
+                                  pKernel,
+                                  &err);
+    
+    if(err != CL_SUCCESS)
+    {
+        return err;
+    } // if
+    
+    err = build();
+    
+    if(err != CL_SUCCESS)
+    {
+        return err;
+    } // if
+    
+    cl_kernel kernels[10] =
+    {
+        mpKernel,
+        mpAccelerateKernel,
+        mpJerkKernel,
+        mpCountKernel,
+        mpScanKernel,
+        mpScatterKernel,
+        mpShortKernel,
+        mpDensityKernel,
+        mpForceKernel,
+        mpUpdateKernel
+    };
+    
     size_t localSize = 0;
     
     for(i = 0; i < mnDeviceCount; ++i)
     {
-        err = clGetKernelWorkGroupInfo(mpKernel,
-                                       mpDevice[i],
-                                       CL_KERNEL_WORK_GROUP_SIZE,
-                                       GLM::Size::kULong,
-                                       &localSize,
-                                       NULL);
-        if(err != CL_SUCCESS)
+        for(cl_kernel kernel : kernels)
         {
-            return err;
-        } // if
-        
-        mnWorkItemX = GLuint((mnWorkItemX <= localSize) ? mnWorkItemX : localSize);
+            if(kernel == NULL)
+            {
+                continue;
+            } // if
+            
+            err = clGetKernelWorkGroupInfo(kernel,
+                                           mpDevice[i],
+                                           CL_KERNEL_WORK_GROUP_SIZE,
+                                           GLM::Size::kULong,
+                                           &localSize,
+                                           NULL);
+            if(err != CL_SUCCESS)
+            {
+                return err;
+            } // if
+            
+            mnWorkItemX = GLuint((mnWorkItemX <= localSize) ? mnWorkItemX : localSize);
+        } // for
     } // for
     
     bool isInvalidWorkDim = bool(mnBodyCount % mnWorkItemX);
@@ -374,6 +630,9 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     
     const size_t size = 4 * GLM::Size::kFloat * mnBodyCount;
     
+    // Three velocity streams, without the unused fourth component
+    const size_t nVelocitySize = (mnLayout == eLayoutSoA) ? (3 * GLM::Size::kFloat * mnBodyCount) : size;
+    
     mpDevicePosition[0] = clCreateBuffer(mpContext,
                                          stream_flags,
                                          size,
@@ -398,7 +657,7 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     
     mpDeviceVelocity[0] = clCreateBuffer(mpContext,
                                          CL_MEM_READ_WRITE,
-                                         size,
+                                         nVelocitySize,
                                          NULL,
                                          &err);
     
@@ -409,7 +668,7 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
     
     mpDeviceVelocity[1] = clCreateBuffer(mpContext,
                                          CL_MEM_READ_WRITE,
-                                         size,
+                                         nVelocitySize,
                                          NULL,
                                          &err);
     
@@ -429,106 +688,1241 @@ GLint NBody::Simulation::GPU::setup(const NBody::Simulation::String& options)
         return -104;
     } // if
     
-    bind();
-    
-    CF::IFStreamRelease(pStream);
+    if(mnPrecision != ePrecisionFloat)
+    {
+        for(i = 0; i < 2; ++i)
+        {
+            mpDevicePositionLow[i] = clCreateBuffer(mpContext,
+                                                    CL_MEM_READ_WRITE,
+                                                    size,
+                                                    NULL,
+                                                    &err);
+            
+            if(err != CL_SUCCESS)
+            {
+                return -107;
+            } // if
+            
+            mpDeviceVelocityLow[i] = clCreateBuffer(mpContext,
+                                                    CL_MEM_READ_WRITE,
+                                                    size,
+                                                    NULL,
+                                                    &err);
+            
+            if(err != CL_SUCCESS)
+            {
+                return -108;
+            } // if
+        } // for
+    } // if
     
-    return 0;
-} // setup
-
-GLint NBody::Simulation::GPU::execute()
-{
-    GLint err = CL_INVALID_KERNEL;
+    // Accelerations, and jerks for Hermite, at the start and the end of
+    // a step for the staged integrators
+    if(mpAccelerateKernel != NULL)
+    {
+        for(i = 0; i < 2; ++i)
+        {
+            mpDeviceAcceleration[i] = clCreateBuffer(mpContext,
+                                                     CL_MEM_READ_WRITE,
+                                                     size,
+                                                     NULL,
+                                                     &err);
+            
+            if(err != CL_SUCCESS)
+            {
+                return -105;
+            } // if
+            
+            if(mpJerkKernel != NULL)
+            {
+                mpDeviceJerk[i] = clCreateBuffer(mpContext,
+                                                 CL_MEM_READ_WRITE,
+                                                 size,
+                                                 NULL,
+                                                 &err);
+                
+                if(err != CL_SUCCESS)
+                {
+                    return -106;
+                } // if
+            } // if
+        } // for
+    } // if
     
-    if(mpKernel != NULL)
+    // Bucket counts and starts of the cell list, with a power of two
+    // buckets no fewer than the bodies, and the bucket, rank and sorted
+    // index of each body, shared by the short range and gas passes
+    if(mpCountKernel != NULL)
     {
-        size_t global_dim[2];
-        size_t local_dim[2];
-        
-        local_dim[0]  = mnWorkItemX;
-        local_dim[1]  = 1;
-        
-        global_dim[0] = mnMaxIndex - mnMinIndex;
-        global_dim[1] = 1;
+        mnCells = 1;
         
-        void   *values[4];
-        size_t  sizes[4];
-        GLuint  indices[4];
-        
-        values[0] = &mpDevicePosition[mnWriteIndex];
-        values[1] = &mpDeviceVelocity[mnWriteIndex];
-        values[2] = &mpDevicePosition[mnReadIndex];
-        values[3] = &mpDeviceVelocity[mnReadIndex];
+        while(mnCells < mnBodyCount)
+        {
+            mnCells <<= 1;
+        } // while
         
-        sizes[0] = kSizeCLMem;
-        sizes[1] = kSizeCLMem;
-        sizes[2] = kSizeCLMem;
-        sizes[3] = kSizeCLMem;
+        const size_t nCellSize = GLM::Size::kUInt * mnCells;
+        const size_t nBodySize = GLM::Size::kUInt * mnBodyCount;
         
-        indices[0] = 0;
-        indices[1] = 1;
-        indices[2] = 2;
-        indices[3] = 3;
+        cl_mem *pBuffers[5] = {&mpCellCount, &mpCellStart, &mpBodyCell, &mpBodyRank, &mpCellIndex};
         
-        GLuint i;
+        const size_t nSizes[5] = {nCellSize, nCellSize + GLM::Size::kUInt, nBodySize, nBodySize, nBodySize};
         
-        for (i = 0; i < 4; ++i)
+        for(i = 0; i < 5; ++i)
         {
-            err = clSetKernelArg(mpKernel, indices[i], sizes[i], values[i]);
+            *pBuffers[i] = clCreateBuffer(mpContext,
+                                          CL_MEM_READ_WRITE,
+                                          nSizes[i],
+                                          NULL,
+                                          &err);
             
             if(err != CL_SUCCESS)
             {
-                return err;
+                return -109;
             } // if
         } // for
         
+        // Zeroed once here, and by the scan after each count
+        const cl_uint zero = 0;
+        
         for(i = 0; i < mnDeviceCount; ++i)
         {
-            if(mpQueue[i] != NULL)
+            err = clEnqueueFillBuffer(mpQueue[i],
+                                      mpCellCount,
+                                      &zero,
+                                      sizeof(zero),
+                                      0,
+                                      nCellSize,
+                                      0,
+                                      NULL,
+                                      NULL);
+            
+            if(err != CL_SUCCESS)
             {
-                err = clEnqueueNDRangeKernel(mpQueue[i],
-                                             mpKernel,
-                                             2,
-                                             NULL,
-                                             global_dim,
-                                             local_dim,
-                                             0,
-                                             NULL,
-                                             NULL);
-                
-                if(err != CL_SUCCESS)
-                {
-                    return err;
-                } // if
+                return -110;
             } // if
         } // for
     } // if
     
-    return err;
-} // execute
-
-GLint NBody::Simulation::GPU::restart()
-{
-    GLint err = CL_INVALID_KERNEL;
-    
-    if(mpKernel != NULL)
-    {       
-        if(mConductor.acquire(mpHostPosition, mpHostVelocity))
+    // Gas state of every body, fluid terms of the gas bodies, and the
+    // count of pairs visited by the gas passes since the last step
+    if(mpDensityKernel != NULL)
+    {
+        cl_mem *pBuffers[3] = {&mpDeviceGas, &mpDeviceFluid, &mpPairCount};
+        
+        const size_t nSizes[3] = {size, 4 * GLM::Size::kFloat * mnGasCount, GLM::Size::kUInt};
+        
+        for(i = 0; i < 3; ++i)
         {
-            const size_t size = 4 * GLM::Size::kFloat * mnBodyCount;
+            *pBuffers[i] = clCreateBuffer(mpContext,
+                                          CL_MEM_READ_WRITE,
+                                          nSizes[i],
+                                          NULL,
+                                          &err);
             
-            GLuint i = 0;
+            if(err != CL_SUCCESS)
+            {
+                return -111;
+            } // if
+        } // for
+        
+        const cl_uint zero = 0;
+        
+        for(i = 0; i < mnDeviceCount; ++i)
+        {
+            err = clEnqueueFillBuffer(mpQueue[i],
+                                      mpPairCount,
+                                      &zero,
+                                      sizeof(zero),
+                                      0,
+                                      GLM::Size::kUInt,
+                                      0,
+                                      NULL,
+                                      NULL);
             
-            for(i = 0; i < mnDeviceCount; ++i)
+            if(err != CL_SUCCESS)
             {
-                if(mpQueue[i] != NULL)
-                {
+                return -112;
+            } // if
+        } // for
+    } // if
+    
+    // Ewald correction of the periodic box, built once on the host in
+    // units of the box and only ever read by the kernels
+    if(mbPeriodic)
+    {
+        Dispatch dispatch;
+        Ewald    table(Periodic::kTableSize, dispatch);
+        
+        const size_t nRow = table.size() + 1;
+        
+        mpDeviceEwald = clCreateBuffer(mpContext,
+                                       CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                       4 * GLM::Size::kFloat * nRow * nRow * nRow,
+                                       (void *)table.table(),
+                                       &err);
+        
+        if(err != CL_SUCCESS)
+        {
+            return -113;
+        } // if
+    } // if
+    
+    // Readback frames in pinned host memory, mapped for the consumer
+    // in turn, so that published positions are never copied on the host
+    for(i = 0; i < 3; ++i)
+    {
+        mpFrameBuffer[i] = clCreateBuffer(mpContext,
+                                          CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                          mnSize,
+                                          NULL,
+                                          &err);
+        
+        if(err != CL_SUCCESS)
+        {
+            return -114;
+        } // if
+    } // for
+    
+    bind();
+    
+    CF::IFStreamRelease(pStream);
+    
+    return 0;
+} // setup
+
+GLint NBody::Simulation::GPU::execute()
+{
+    GLint err = CL_INVALID_KERNEL;
+    
+    if(mpAccelerateKernel != NULL)
+    {
+        switch(mnIntegrator)
+        {
+            case eIntegratorYoshida:
+                err = yoshida();
+                break;
+                
+            case eIntegratorHermite:
+                err = hermite();
+                break;
+                
+            default:
+                err = leapfrog();
+                break;
+        } // switch
+        
+        if(err == CL_SUCCESS)
+        {
+            err = heat(mpDevicePosition[mnWriteIndex]);
+        } // if
+    } // if
+    else if(mpKernel != NULL)
+    {
+        size_t global_dim[2];
+        size_t local_dim[2];
+        
+        local_dim[0]  = mnWorkItemX;
+        local_dim[1]  = 1;
+        
+        global_dim[0] = mnMaxIndex - mnMinIndex;
+        global_dim[1] = 1;
+        
+        cl_kernel pKernel = (mnReadIndex == mnBoundIndex) ? mpKernel : mpSwapKernel;
+        
+        GLuint i;
+        
+        for(i = 0; i < mnDeviceCount; ++i)
+        {
+            if(mpQueue[i] != NULL)
+            {
+                err = clEnqueueNDRangeKernel(mpQueue[i],
+                                             pKernel,
+                                             2,
+                                             NULL,
+                                             global_dim,
+                                             local_dim,
+                                             0,
+                                             NULL,
+                                             NULL);
+                
+                if(err != CL_SUCCESS)
+                {
+                    return err;
+                } // if
+            } // if
+        } // for
+    } // if
+    
+    return err;
+} // execute
+
+// Kernels of the staged integrators, none for the default one
+GLint NBody::Simulation::GPU::build()
+{
+    GLint err = CL_SUCCESS;
+    
+    if((mnIntegrator != eIntegratorLeapfrog)
+       && (mnIntegrator != eIntegratorYoshida)
+       && (mnIntegrator != eIntegratorHermite))
+    {
+        return err;
+    } // if
+    
+    const char *pAccelerate = kAccelerateSystem;
+    
+    if(mbPeriodic)
+    {
+        pAccelerate = kPeriodicSystem;
+    } // if
+    else if(mbVector)
+    {
+        pAccelerate = kVectorSystem;
+    } // else if
+    
+    mpAccelerateKernel = clCreateKernel(mpProgram, pAccelerate, &err);
+    
+    if(err != CL_SUCCESS)
+    {
+        return err;
+    } // if
+    
+    mpAdvanceKernel = clCreateKernel(mpProgram, kAdvanceSystem, &err);
+    
+    if(err != CL_SUCCESS)
+    {
+        return err;
+    } // if
+    
+    if(mnIntegrator == eIntegratorHermite)
+    {
+        mpJerkKernel = clCreateKernel(mpProgram, kJerkSystem, &err);
+        
+        if(err != CL_SUCCESS)
+        {
+            return err;
+        } // if
+        
+        mpPredictKernel = clCreateKernel(mpProgram, kPredictSystem, &err);
+        
+        if(err != CL_SUCCESS)
+        {
+            return err;
+        } // if
+        
+        mpCorrectKernel = clCreateKernel(mpProgram, kCorrectSystem, &err);
+        
+        if(err != CL_SUCCESS)
+        {
+            return err;
+        } // if
+    } // if
+    
+    if((mnCutoff > 0.0f) || (mnGasCount > 0))
+    {
+        cl_kernel *pKernels[3] = {&mpCountKernel, &mpScanKernel, &mpScatterKernel};
+        
+        const char *pNames[3] = {kCountCells, kScanCells, kScatterCells};
+        
+        GLuint i;
+        
+        for(i = 0; (i < 3) && (err == CL_SUCCESS); ++i)
+        {
+            *pKernels[i] = clCreateKernel(mpProgram, pNames[i], &err);
+        } // for
+    } // if
+    
+    if((mnCutoff > 0.0f) && (err == CL_SUCCESS))
+    {
+        mpShortKernel = clCreateKernel(mpProgram, kShortRangeSystem, &err);
+    } // if
+    
+    if((mnGasCount > 0) && (err == CL_SUCCESS))
+    {
+        cl_kernel *pKernels[3] = {&mpDensityKernel, &mpForceKernel, &mpUpdateKernel};
+        
+        const char *pNames[3] = {kHydroDensity, kHydroForce, kHydroUpdate};
+        
+        GLuint i;
+        
+        for(i = 0; (i < 3) && (err == CL_SUCCESS); ++i)
+        {
+            *pKernels[i] = clCreateKernel(mpProgram, pNames[i], &err);
+        } // for
+    } // if
+    
+    return err;
+} // build
+
+// One work item per active body, as in execute
+GLint NBody::Simulation::GPU::enqueue(cl_kernel pKernel)
+{
+    return enqueue(pKernel, mnMaxIndex - mnMinIndex, mnWorkItemX);
+} // enqueue
+
+GLint NBody::Simulation::GPU::enqueue(cl_kernel pKernel,
+                                      const size_t& nGlobal,
+                                      const size_t& nLocal,
+                                      cl_event *pEvent)
+{
+    GLint err = CL_INVALID_KERNEL;
+    
+    size_t global_dim[2];
+    size_t local_dim[2];
+    
+    local_dim[0]  = nLocal;
+    local_dim[1]  = 1;
+    
+    global_dim[0] = nGlobal;
+    global_dim[1] = 1;
+    
+    GLuint i;
+    
+    for(i = 0; i < mnDeviceCount; ++i)
+    {
+        if(mpQueue[i] != NULL)
+        {
+            err = clEnqueueNDRangeKernel(mpQueue[i],
+                                         pKernel,
+                                         2,
+                                         NULL,
+                                         global_dim,
+                                         local_dim,
+                                         0,
+                                         NULL,
+                                         pEvent);
+            
+            if(err != CL_SUCCESS)
+            {
+                return err;
+            } // if
+        } // if
+    } // for
+    
+    return err;
+} // enqueue
+
+// Accelerations of the active bodies into the first acceleration buffer
+GLint NBody::Simulation::GPU::accelerate(cl_mem pPosition,
+                                         cl_mem pVelocity)
+{
+    const cl_float nSoftening = m_ActiveParams.mnSoftening;
+    const cl_int   nCount     = cl_int(mnBodyCount);
+    const cl_int   nStart     = cl_int(mnMinIndex);
+    
+    const void *values[6] = {&mpDeviceAcceleration[0], &pPosition, &nSoftening, &nCount, &nStart, NULL};
+    
+    const size_t sizes[6] = {kSizeCLMem, kSizeCLMem, mnSamples, GLM::Size::kInt, GLM::Size::kInt, 4 * mnSamples * mnWorkItemX};
+    
+    GLint err = NBodySimulationGPUSetArgs(mpAccelerateKernel, 6, sizes, values);
+    
+    // The periodic sum takes the correction table last
+    if((err == CL_SUCCESS) && (mpDeviceEwald != NULL))
+    {
+        err = clSetKernelArg(mpAccelerateKernel, 6, kSizeCLMem, &mpDeviceEwald);
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        err = enqueue(mpAccelerateKernel);
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        err = cutoff(pPosition, mpDeviceAcceleration[0]);
+    } // if
+    
+    return (err == CL_SUCCESS) ? hydro(pPosition, pVelocity, mpDeviceAcceleration[0]) : err;
+} // accelerate
+
+// Cell list of all the bodies, then the short range accelerations of
+// the active bodies from their neighbouring cells, added to those in
+// pAcceleration
+GLint NBody::Simulation::GPU::cutoff(cl_mem pPosition,
+                                     cl_mem pAcceleration)
+{
+    if(mpShortKernel == NULL)
+    {
+        return CL_SUCCESS;
+    } // if
+    
+    const cl_float nCutoff     = mnCutoff;
+    const cl_float nSoftening  = m_ActiveParams.mnSoftening;
+    const cl_float nInvSide    = 1.0f / mnCutoff;
+    const cl_uint  nMask       = cl_uint(mnCells - 1);
+    const cl_int   nStart      = cl_int(mnMinIndex);
+    
+    GLint err = bin(pPosition, nInvSide, 0, mnBodyCount);
+    
+    if(err == CL_SUCCESS)
+    {
+        const void *values[9] = {&pAcceleration, &pPosition, &mpCellIndex, &mpCellStart, &nCutoff, &nSoftening, &nInvSide, &nMask, &nStart};
+        
+        const size_t sizes[9] = {kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, mnSamples, mnSamples, mnSamples, GLM::Size::kUInt, GLM::Size::kInt};
+        
+        err = NBodySimulationGPUSetArgs(mpShortKernel, 9, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            err = enqueue(mpShortKernel);
+        } // if
+    } // if
+    
+    return err;
+} // cutoff
+
+// Counting sort of the bodies into the buckets of a hashed grid, with a
+// work item per body rounded up to whole work groups
+GLint NBody::Simulation::GPU::bin(cl_mem pPosition,
+                                  const cl_float& nInvSide,
+                                  const size_t& nBegin,
+                                  const size_t& nEnd)
+{
+    const cl_uint nMask  = cl_uint(mnCells - 1);
+    const cl_uint nCells = cl_uint(mnCells);
+    const cl_int  nFirst = cl_int(nBegin);
+    const cl_int  nLast  = cl_int(nEnd);
+    
+    const size_t nGlobal = (nEnd - nBegin + mnWorkItemX - 1) / mnWorkItemX * mnWorkItemX;
+    
+    const void *countValues[8] = {&mpCellCount, &mpBodyCell, &mpBodyRank, &pPosition, &nInvSide, &nMask, &nFirst, &nLast};
+    
+    const size_t countSizes[8] = {kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, mnSamples, GLM::Size::kUInt, GLM::Size::kInt, GLM::Size::kInt};
+    
+    GLint err = NBodySimulationGPUSetArgs(mpCountKernel, 8, countSizes, countValues);
+    
+    if(err == CL_SUCCESS)
+    {
+        err = enqueue(mpCountKernel, nGlobal, mnWorkItemX);
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        const void *values[4] = {&mpCellStart, &mpCellCount, &nCells, NULL};
+        
+        const size_t sizes[4] = {kSizeCLMem, kSizeCLMem, GLM::Size::kUInt, GLM::Size::kUInt * mnWorkItemX};
+        
+        err = NBodySimulationGPUSetArgs(mpScanKernel, 4, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            err = enqueue(mpScanKernel, mnWorkItemX, mnWorkItemX);
+        } // if
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        const void *values[6] = {&mpCellIndex, &mpBodyCell, &mpBodyRank, &mpCellStart, &nFirst, &nLast};
+        
+        const size_t sizes[6] = {kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, GLM::Size::kInt, GLM::Size::kInt};
+        
+        err = NBodySimulationGPUSetArgs(mpScatterKernel, 6, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            err = enqueue(mpScatterKernel, nGlobal, mnWorkItemX);
+        } // if
+    } // if
+    
+    return err;
+} // bin
+
+// Cell list of the gas bodies, with cells as wide as the support of the
+// largest smoothing length, then the densities of all the gas bodies and
+// the pressure and viscous accelerations of the active ones
+GLint NBody::Simulation::GPU::hydro(cl_mem pPosition,
+                                    cl_mem pVelocity,
+                                    cl_mem pAcceleration)
+{
+    if(mpDensityKernel == NULL)
+    {
+        return CL_SUCCESS;
+    } // if
+    
+    const cl_float nGamma   = SPH::kGamma;
+    const cl_float nAlpha   = SPH::kAlpha;
+    const cl_float nBeta    = SPH::kBeta;
+    const cl_float nInvSide = 1.0f / (2.0f * SPH::kSmoothingMax * mnSmoothing);
+    const cl_uint  nMask    = cl_uint(mnCells - 1);
+    const cl_int   nFirst   = cl_int(mnBodyCount - mnGasCount);
+    const cl_int   nLast    = cl_int(mnBodyCount);
+    const cl_int   nMin     = cl_int(mnMinIndex);
+    const cl_int   nMax     = cl_int(mnMaxIndex);
+    
+    const size_t nGlobal = (mnGasCount + mnWorkItemX - 1) / mnWorkItemX * mnWorkItemX;
+    
+    GLint err = bin(pPosition, nInvSide, mnBodyCount - mnGasCount, mnBodyCount);
+    
+    if(err == CL_SUCCESS)
+    {
+        const void *values[11] = {&mpDeviceGas, &mpDeviceFluid, &pPosition, &mpCellIndex, &mpCellStart, &mpPairCount, &nGamma, &nInvSide, &nMask, &nFirst, &nLast};
+        
+        const size_t sizes[11] = {kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, mnSamples, mnSamples, GLM::Size::kUInt, GLM::Size::kInt, GLM::Size::kInt};
+        
+        err = NBodySimulationGPUSetArgs(mpDensityKernel, 11, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            cl_event pEvent = NULL;
+            
+            err = enqueue(mpDensityKernel, nGlobal, mnWorkItemX, &pEvent);
+            
+            m_Events.push_back(pEvent);
+        } // if
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        const void *values[16] =
+        {
+            &pAcceleration,
+            &mpDeviceGas,
+            &mpDeviceFluid,
+            &pPosition,
+            &pVelocity,
+            &mpCellIndex,
+            &mpCellStart,
+            &mpPairCount,
+            &nAlpha,
+            &nBeta,
+            &nInvSide,
+            &nMask,
+            &nFirst,
+            &nLast,
+            &nMin,
+            &nMax
+        };
+        
+        const size_t sizes[16] =
+        {
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            mnSamples,
+            mnSamples,
+            mnSamples,
+            GLM::Size::kUInt,
+            GLM::Size::kInt,
+            GLM::Size::kInt,
+            GLM::Size::kInt,
+            GLM::Size::kInt
+        };
+        
+        err = NBodySimulationGPUSetArgs(mpForceKernel, 16, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            cl_event pEvent = NULL;
+            
+            err = enqueue(mpForceKernel, nGlobal, mnWorkItemX, &pEvent);
+            
+            m_Events.push_back(pEvent);
+        } // if
+    } // if
+    
+    return err;
+} // hydro
+
+// Energies of the gas bodies advanced over the step, and their smoothing
+// lengths adapted to the densities of its last force evaluation
+GLint NBody::Simulation::GPU::heat(cl_mem pPosition)
+{
+    if(mpUpdateKernel == NULL)
+    {
+        return CL_SUCCESS;
+    } // if
+    
+    const cl_float nTimeStep = m_ActiveParams.mnTimeStamp;
+    const cl_float nEta      = SPH::kEta;
+    const cl_float nEnergy   = SPH::kEnergyMin;
+    const cl_float nMin      = SPH::kSmoothingMin * mnSmoothing;
+    const cl_float nMax      = SPH::kSmoothingMax * mnSmoothing;
+    const cl_int   nFirst    = cl_int(mnBodyCount - mnGasCount);
+    const cl_int   nLast     = cl_int(mnBodyCount);
+    
+    const size_t nGlobal = (mnGasCount + mnWorkItemX - 1) / mnWorkItemX * mnWorkItemX;
+    
+    const void *values[9] = {&mpDeviceGas, &pPosition, &nTimeStep, &nEta, &nEnergy, &nMin, &nMax, &nFirst, &nLast};
+    
+    const size_t sizes[9] = {kSizeCLMem, kSizeCLMem, mnSamples, mnSamples, mnSamples, mnSamples, mnSamples, GLM::Size::kInt, GLM::Size::kInt};
+    
+    GLint err = NBodySimulationGPUSetArgs(mpUpdateKernel, 9, sizes, values);
+    
+    if(err == CL_SUCCESS)
+    {
+        cl_event pEvent = NULL;
+        
+        err = enqueue(mpUpdateKernel, nGlobal, mnWorkItemX, &pEvent);
+        
+        m_Events.push_back(pEvent);
+    } // if
+    
+    return err;
+} // heat
+
+// Seconds spent in the gas kernels, from their profiling events, and
+// the pairs they visited, without waiting on the device. The counter is
+// read behind the kernels enqueued so far and cleared on the device, and
+// the totals are taken once that read is done, with the kernels before
+// it, so that a batch runs on without a host sync.
+void NBody::Simulation::GPU::profile()
+{
+    if(mpPairCount == NULL)
+    {
+        mnHydroInteractions = 0.0;
+        mnHydroTime         = 0.0;
+        
+        return;
+    } // if
+    
+    if(mpPairEvent != NULL)
+    {
+        cl_int nStatus = CL_COMPLETE;
+        
+        clGetEventInfo(mpPairEvent,
+                       CL_EVENT_COMMAND_EXECUTION_STATUS,
+                       sizeof(nStatus),
+                       &nStatus,
+                       NULL);
+        
+        if(nStatus > CL_COMPLETE)
+        {
+            return;
+        } // if
+        
+        clReleaseEvent(mpPairEvent);
+        
+        mpPairEvent = NULL;
+        
+        GLdouble nTime = 0.0;
+        
+        size_t i;
+        
+        for(i = 0; i < mnPairEvents; ++i)
+        {
+            cl_event pEvent = m_Events[i];
+            
+            if(pEvent != NULL)
+            {
+                cl_ulong start = 0;
+                cl_ulong end   = 0;
+                
+                clGetEventProfilingInfo(pEvent, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+                clGetEventProfilingInfo(pEvent, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+                
+                nTime += 1.0e-9 * GLdouble(end - start);
+                
+                clReleaseEvent(pEvent);
+            } // if
+        } // for
+        
+        m_Events.erase(m_Events.begin(), m_Events.begin() + mnPairEvents);
+        
+        if(nStatus == CL_COMPLETE)
+        {
+            mnHydroInteractions = GLdouble(mnPairCount);
+            mnHydroTime         = nTime;
+        } // if
+    } // if
+    
+    if(m_Events.empty())
+    {
+        return;
+    } // if
+    
+    const cl_uint zero = 0;
+    
+    mnPairEvents = m_Events.size();
+    
+    GLint err = clEnqueueReadBuffer(mpQueue[0],
+                                    mpPairCount,
+                                    CL_FALSE,
+                                    0,
+                                    sizeof(mnPairCount),
+                                    &mnPairCount,
+                                    0,
+                                    NULL,
+                                    &mpPairEvent);
+    
+    if(err != CL_SUCCESS)
+    {
+        mpPairEvent = NULL;
+        
+        return;
+    } // if
+    
+    clEnqueueFillBuffer(mpQueue[0],
+                        mpPairCount,
+                        &zero,
+                        sizeof(zero),
+                        0,
+                        sizeof(zero),
+                        0,
+                        NULL,
+                        NULL);
+    
+    clFlush(mpQueue[0]);
+} // profile
+
+GLint NBody::Simulation::GPU::readback()
+{
+    GLuint i = 0;
+    
+    // Acquire pairs with the release of a frame by the consumer, so that
+    // it is done reading the frame before it is written again
+    while((i < 3) && !mbFrameFree[i].load(std::memory_order_acquire))
+    {
+        ++i;
+    } // while
+    
+    // Every frame is still held, so this step is not published
+    if(i == 3)
+    {
+        return CL_SUCCESS;
+    } // if
+    
+    mbFrameFree[i].store(false, std::memory_order_release);
+    
+    mnFrameIndex = i;
+    
+    GLint err = CL_SUCCESS;
+    
+    if(mpHostFrame[i] != NULL)
+    {
+        err = clEnqueueUnmapMemObject(mpReadQueue,
+                                      mpFrameBuffer[i],
+                                      mpHostFrame[i],
+                                      0,
+                                      NULL,
+                                      NULL);
+        
+        mpHostFrame[i] = NULL;
+        
+        if(err != CL_SUCCESS)
+        {
+            mbFrameFree[i].store(true, std::memory_order_release);
+            
+            return err;
+        } // if
+    } // if
+    
+    cl_event pDone = NULL;
+    
+    err = clEnqueueMarkerWithWaitList(mpQueue[0], 0, NULL, &pDone);
+    
+    if(err != CL_SUCCESS)
+    {
+        mbFrameFree[i].store(true, std::memory_order_release);
+        
+        return err;
+    } // if
+    
+    clFlush(mpQueue[0]);
+    
+    err = clEnqueueCopyBuffer(mpReadQueue,
+                              mpDevicePosition[mnWriteIndex],
+                              mpFrameBuffer[i],
+                              0,
+                              0,
+                              mnSize,
+                              1,
+                              &pDone,
+                              NULL);
+    
+    clReleaseEvent(pDone);
+    
+    if(err == CL_SUCCESS)
+    {
+        mpHostFrame[i] = (GLfloat *)clEnqueueMapBuffer(mpReadQueue,
+                                                       mpFrameBuffer[i],
+                                                       CL_FALSE,
+                                                       CL_MAP_READ,
+                                                       0,
+                                                       mnSize,
+                                                       0,
+                                                       NULL,
+                                                       &mpReadEvent,
+                                                       &err);
+    } // if
+    
+    if(err != CL_SUCCESS)
+    {
+        mpHostFrame[i] = NULL;
+        mpReadEvent    = NULL;
+        mbFrameFree[i].store(true, std::memory_order_release);
+        
+        return err;
+    } // if
+    
+    clFlush(mpReadQueue);
+    
+    mnReadBuffer = mnWriteIndex;
+    
+    return err;
+} // readback
+
+void NBody::Simulation::GPU::publish(const bool& bWait)
+{
+    if(mpReadEvent == NULL)
+    {
+        return;
+    } // if
+    
+    cl_int nStatus = CL_COMPLETE;
+    
+    if(bWait)
+    {
+        nStatus = clWaitForEvents(1, &mpReadEvent);
+    } // if
+    else
+    {
+        clGetEventInfo(mpReadEvent,
+                       CL_EVENT_COMMAND_EXECUTION_STATUS,
+                       sizeof(nStatus),
+                       &nStatus,
+                       NULL);
+        
+        // Still in flight, and not needed yet
+        if(nStatus > CL_COMPLETE)
+        {
+            return;
+        } // if
+    } // else
+    
+    clReleaseEvent(mpReadEvent);
+    
+    mpReadEvent = NULL;
+    
+    // A failed read leaves the last published frame in place, and
+    // streams are interleaved into a copy that frees the frame at once
+    if(nStatus != CL_COMPLETE)
+    {
+        mbFrameFree[mnFrameIndex].store(true, std::memory_order_release);
+    } // if
+    else if(mnLayout == eLayoutSoA)
+    {
+        setData(mpHostFrame[mnFrameIndex], mnLayout);
+        
+        mbFrameFree[mnFrameIndex].store(true, std::memory_order_release);
+    } // else if
+    else
+    {
+        setFrame(mpHostFrame[mnFrameIndex]);
+    } // else
+} // publish
+
+// Drop a read in flight, once it is done with the device buffers
+void NBody::Simulation::GPU::discard()
+{
+    if(mpReadEvent != NULL)
+    {
+        clWaitForEvents(1, &mpReadEvent);
+        clReleaseEvent(mpReadEvent);
+        
+        mpReadEvent = NULL;
+        
+        mbFrameFree[mnFrameIndex].store(true, std::memory_order_release);
+    } // if
+} // discard
+
+// Kick and drift from the given state into the write buffers
+GLint NBody::Simulation::GPU::advance(cl_mem pPosition,
+                                      cl_mem pVelocity,
+                                      const GLfloat& nKick,
+                                      const GLfloat& nDrift,
+                                      const GLfloat& nDamping)
+{
+    const cl_int nStart = cl_int(mnMinIndex);
+    
+    const void *values[9] =
+    {
+        &mpDevicePosition[mnWriteIndex],
+        &mpDeviceVelocity[mnWriteIndex],
+        &pPosition,
+        &pVelocity,
+        &mpDeviceAcceleration[0],
+        &nKick,
+        &nDrift,
+        &nDamping,
+        &nStart
+    };
+    
+    const size_t sizes[9] =
+    {
+        kSizeCLMem,
+        kSizeCLMem,
+        kSizeCLMem,
+        kSizeCLMem,
+        kSizeCLMem,
+        mnSamples,
+        mnSamples,
+        mnSamples,
+        GLM::Size::kInt
+    };
+    
+    GLint err = NBodySimulationGPUSetArgs(mpAdvanceKernel, 9, sizes, values);
+    
+    return (err == CL_SUCCESS) ? enqueue(mpAdvanceKernel) : err;
+} // advance
+
+// Kick-drift-kick, reusing the accelerations of the last closing kick
+GLint NBody::Simulation::GPU::leapfrog()
+{
+    const GLfloat nTimeStamp = m_ActiveParams.mnTimeStamp;
+    const GLfloat nHalf      = 0.5f * nTimeStamp;
+    
+    GLint err = CL_SUCCESS;
+    
+    if(!mbAccelerated)
+    {
+        err = accelerate(mpDevicePosition[mnReadIndex], mpDeviceVelocity[mnReadIndex]);
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        err = advance(mpDevicePosition[mnReadIndex], mpDeviceVelocity[mnReadIndex], nHalf, nTimeStamp, 1.0f);
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        err = accelerate(mpDevicePosition[mnWriteIndex], mpDeviceVelocity[mnWriteIndex]);
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        err = advance(mpDevicePosition[mnWriteIndex], mpDeviceVelocity[mnWriteIndex], nHalf, 0.0f, m_ActiveParams.mnDamping);
+    } // if
+    
+    mbAccelerated = err == CL_SUCCESS;
+    
+    return err;
+} // leapfrog
+
+// Fourth order Yoshida, three drift-kick-drift leapfrogs with the
+// weights w1, w0 and w1, the first drift without a kick
+GLint NBody::Simulation::GPU::yoshida()
+{
+    const GLfloat nTimeStamp = m_ActiveParams.mnTimeStamp;
+    
+    const GLfloat c[4] = {0.5f * Yoshida::kW1, 0.5f * (Yoshida::kW0 + Yoshida::kW1), 0.5f * (Yoshida::kW0 + Yoshida::kW1), 0.5f * Yoshida::kW1};
+    const GLfloat d[3] = {Yoshida::kW1, Yoshida::kW0, Yoshida::kW1};
+    
+    GLint err = advance(mpDevicePosition[mnReadIndex], mpDeviceVelocity[mnReadIndex], 0.0f, c[0] * nTimeStamp, 1.0f);
+    
+    size_t s;
+    
+    for(s = 0; (s < 3) && (err == CL_SUCCESS); ++s)
+    {
+        err = accelerate(mpDevicePosition[mnWriteIndex], mpDeviceVelocity[mnWriteIndex]);
+        
+        if(err == CL_SUCCESS)
+        {
+            err = advance(mpDevicePosition[mnWriteIndex],
+                          mpDeviceVelocity[mnWriteIndex],
+                          d[s] * nTimeStamp,
+                          c[s + 1] * nTimeStamp,
+                          (s == 2) ? m_ActiveParams.mnDamping : 1.0f);
+        } // if
+    } // for
+    
+    return err;
+} // yoshida
+
+// Fourth order Hermite, predicting from the read buffers into the write
+// buffers and correcting there. The accelerations and jerks at the
+// predicted state start the next step.
+GLint NBody::Simulation::GPU::hermite()
+{
+    const cl_float nTimeStamp = m_ActiveParams.mnTimeStamp;
+    const cl_float nDamping   = m_ActiveParams.mnDamping;
+    const cl_float nSoftening = m_ActiveParams.mnSoftening;
+    const cl_int   nCount     = cl_int(mnBodyCount);
+    const cl_int   nStart     = cl_int(mnMinIndex);
+    const size_t   nShared    = 4 * mnSamples * mnWorkItemX;
+    
+    const GLuint nOld = mnForceIndex;
+    const GLuint nNew = 1 - mnForceIndex;
+    
+    GLint err = CL_SUCCESS;
+    
+    if(!mbAccelerated)
+    {
+        const void *values[9] = {&mpDeviceAcceleration[nOld], &mpDeviceJerk[nOld], &mpDevicePosition[mnReadIndex], &mpDeviceVelocity[mnReadIndex], &nSoftening, &nCount, &nStart, NULL, NULL};
+        
+        const size_t sizes[9] = {kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, mnSamples, GLM::Size::kInt, GLM::Size::kInt, nShared, nShared};
+        
+        err = NBodySimulationGPUSetArgs(mpJerkKernel, 9, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            err = enqueue(mpJerkKernel);
+        } // if
+        
+        if(err == CL_SUCCESS)
+        {
+            err = cutoff(mpDevicePosition[mnReadIndex], mpDeviceAcceleration[nOld]);
+        } // if
+        
+        if(err == CL_SUCCESS)
+        {
+            err = hydro(mpDevicePosition[mnReadIndex], mpDeviceVelocity[mnReadIndex], mpDeviceAcceleration[nOld]);
+        } // if
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        const void *values[8] = {&mpDevicePosition[mnWriteIndex], &mpDeviceVelocity[mnWriteIndex], &mpDevicePosition[mnReadIndex], &mpDeviceVelocity[mnReadIndex], &mpDeviceAcceleration[nOld], &mpDeviceJerk[nOld], &nTimeStamp, &nStart};
+        
+        const size_t sizes[8] = {kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, mnSamples, GLM::Size::kInt};
+        
+        err = NBodySimulationGPUSetArgs(mpPredictKernel, 8, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            err = enqueue(mpPredictKernel);
+        } // if
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        const void *values[9] = {&mpDeviceAcceleration[nNew], &mpDeviceJerk[nNew], &mpDevicePosition[mnWriteIndex], &mpDeviceVelocity[mnWriteIndex], &nSoftening, &nCount, &nStart, NULL, NULL};
+        
+        const size_t sizes[9] = {kSizeCLMem, kSizeCLMem, kSizeCLMem, kSizeCLMem, mnSamples, GLM::Size::kInt, GLM::Size::kInt, nShared, nShared};
+        
+        err = NBodySimulationGPUSetArgs(mpJerkKernel, 9, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            err = enqueue(mpJerkKernel);
+        } // if
+        
+        // The short range and gas forces add no jerk to the corrector
+        if(err == CL_SUCCESS)
+        {
+            err = cutoff(mpDevicePosition[mnWriteIndex], mpDeviceAcceleration[nNew]);
+        } // if
+        
+        if(err == CL_SUCCESS)
+        {
+            err = hydro(mpDevicePosition[mnWriteIndex], mpDeviceVelocity[mnWriteIndex], mpDeviceAcceleration[nNew]);
+        } // if
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        const void *values[11] =
+        {
+            &mpDevicePosition[mnWriteIndex],
+            &mpDeviceVelocity[mnWriteIndex],
+            &mpDevicePosition[mnReadIndex],
+            &mpDeviceVelocity[mnReadIndex],
+            &mpDeviceAcceleration[nOld],
+            &mpDeviceJerk[nOld],
+            &mpDeviceAcceleration[nNew],
+            &mpDeviceJerk[nNew],
+            &nTimeStamp,
+            &nDamping,
+            &nStart
+        };
+        
+        const size_t sizes[11] =
+        {
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            kSizeCLMem,
+            mnSamples,
+            mnSamples,
+            GLM::Size::kInt
+        };
+        
+        err = NBodySimulationGPUSetArgs(mpCorrectKernel, 11, sizes, values);
+        
+        if(err == CL_SUCCESS)
+        {
+            err = enqueue(mpCorrectKernel);
+        } // if
+    } // if
+    
+    if(err == CL_SUCCESS)
+    {
+        mnForceIndex  = nNew;
+        mbAccelerated = true;
+    } // if
+    else
+    {
+        mbAccelerated = false;
+    } // else
+    
+    return err;
+} // hermite
+
+GLint NBody::Simulation::GPU::restart()
+{
+    GLint err = CL_INVALID_KERNEL;
+    
+    if(mpKernel != NULL)
+    {       
+        if(mConductor.acquire(mpHostPosition, mpHostVelocity))
+        {
+            const size_t size = 4 * GLM::Size::kFloat * mnBodyCount;
+            
+            size_t nVelocitySize = size;
+            
+            const GLfloat *pPosition = mpHostPosition;
+            const GLfloat *pVelocity = mpHostVelocity;
+            
+            std::vector<GLfloat> streams;
+            
+            if(mnLayout == eLayoutSoA)
+            {
+                streams.resize(7 * mnBodyCount);
+                
+                split(mpHostPosition, streams.data(), 4);
+                split(mpHostVelocity, streams.data() + 4 * mnBodyCount, 3);
+                
+                pPosition = streams.data();
+                pVelocity = streams.data() + 4 * mnBodyCount;
+                
+                nVelocitySize = 3 * GLM::Size::kFloat * mnBodyCount;
+            } // if
+            
+            // The last bodies made gas, as on the cpu, with the initial
+            // smoothing length fixing the cells of the gas passes
+            std::vector<Gas> gas;
+            
+            if(mpDeviceGas != NULL)
+            {
+                Hydro seeder(mnBodyCount, mnGasCount);
+                
+                gas.resize(mnBodyCount);
+                
+                seeder.seed(mpHostPosition, gas.data(), m_ActiveParams.mnGasEnergy);
+                
+                mnSmoothing = seeder.smoothing();
+            } // if
+            
+            GLuint i = 0;
+            
+            for(i = 0; i < mnDeviceCount; ++i)
+            {
+                if(mpQueue[i] != NULL)
+                {
                     err = clEnqueueWriteBuffer(mpQueue[i],
                                                mpDevicePosition[mnReadIndex],
                                                CL_TRUE,
                                                0,
                                                size,
-                                               mpHostPosition,
+                                               pPosition,
                                                0,
                                                NULL,
                                                NULL);
@@ -542,8 +1936,8 @@ GLint NBody::Simulation::GPU::restart()
                                                mpDeviceVelocity[mnReadIndex],
                                                CL_TRUE,
                                                0,
-                                               size,
-                                               mpHostVelocity,
+                                               nVelocitySize,
+                                               pVelocity,
                                                0,
                                                NULL,
                                                NULL);
@@ -552,9 +1946,77 @@ GLint NBody::Simulation::GPU::restart()
                     {
                         return err;
                     } // if
+                    
+                    // The initial state is exact in single precision
+                    cl_mem low[2] = {mpDevicePositionLow[mnReadIndex], mpDeviceVelocityLow[mnReadIndex]};
+                    
+                    for(cl_mem pLow : low)
+                    {
+                        if(pLow != NULL)
+                        {
+                            const cl_float4 zero = {{0.0f, 0.0f, 0.0f, 0.0f}};
+                            
+                            err = clEnqueueFillBuffer(mpQueue[i],
+                                                      pLow,
+                                                      &zero,
+                                                      sizeof(zero),
+                                                      0,
+                                                      size,
+                                                      0,
+                                                      NULL,
+                                                      NULL);
+                            
+                            if(err != CL_SUCCESS)
+                            {
+                                return err;
+                            } // if
+                        } // if
+                    } // for
+                    
+                    // Yoshida opens with a drift that scales the
+                    // accelerations by zero, so they must be finite
+                    if(mpDeviceAcceleration[0] != NULL)
+                    {
+                        const cl_float4 zero = {{0.0f, 0.0f, 0.0f, 0.0f}};
+                        
+                        err = clEnqueueFillBuffer(mpQueue[i],
+                                                  mpDeviceAcceleration[0],
+                                                  &zero,
+                                                  sizeof(zero),
+                                                  0,
+                                                  size,
+                                                  0,
+                                                  NULL,
+                                                  NULL);
+                        
+                        if(err != CL_SUCCESS)
+                        {
+                            return err;
+                        } // if
+                    } // if
+                    
+                    if(mpDeviceGas != NULL)
+                    {
+                        err = clEnqueueWriteBuffer(mpQueue[i],
+                                                   mpDeviceGas,
+                                                   CL_TRUE,
+                                                   0,
+                                                   size,
+                                                   gas.data(),
+                                                   0,
+                                                   NULL,
+                                                   NULL);
+                        
+                        if(err != CL_SUCCESS)
+                        {
+                            return err;
+                        } // if
+                    } // if
                 } // if
             } // for
             
+            mbAccelerated = false;
+            
             bind();
         } // if
     } // if
@@ -562,6 +2024,70 @@ GLint NBody::Simulation::GPU::restart()
     return err;
 } // restart
 
+#pragma mark -
+#pragma mark Public - Devices
+
+cl_device_type NBody::Simulation::GPU::type(const GLuint& nDevice)
+{
+    switch(nDevice)
+    {
+        case eDeviceCPU:
+            return CL_DEVICE_TYPE_CPU;
+            
+        case eDeviceAccelerator:
+            return CL_DEVICE_TYPE_ACCELERATOR;
+            
+        case eDeviceAll:
+            return CL_DEVICE_TYPE_ALL;
+            
+        default:
+            return CL_DEVICE_TYPE_GPU;
+    } // switch
+} // type
+
+// Platforms in the order the runtime lists them, and their devices of
+// the type in order, so that an index picks the same device each time
+GLuint NBody::Simulation::GPU::devices(const cl_device_type& nType,
+                                       cl_device_id *pDevices,
+                                       const GLuint& nMax)
+{
+    cl_platform_id platforms[kMaxPlatforms] = {0};
+    
+    cl_uint nPlatforms = 0;
+    
+    GLint err = clGetPlatformIDs(kMaxPlatforms, platforms, &nPlatforms);
+    
+    if(err != CL_SUCCESS)
+    {
+        std::cerr
+        << ">> N-body Simulation: Failed acquiring the opencl platforms!"
+        << std::endl;
+        
+        return 0;
+    } // if
+    
+    nPlatforms = std::min(nPlatforms, cl_uint(kMaxPlatforms));
+    
+    GLuint nCount = 0;
+    
+    cl_uint i;
+    
+    for(i = 0; (i < nPlatforms) && (nCount < nMax); ++i)
+    {
+        cl_uint nDevices = 0;
+        
+        err = clGetDeviceIDs(platforms[i], nType, nMax - nCount, pDevices + nCount, &nDevices);
+        
+        // A platform without devices of the type is not an error
+        if(err == CL_SUCCESS)
+        {
+            nCount += std::min(GLuint(nDevices), nMax - nCount);
+        } // if
+    } // for
+    
+    return nCount;
+} // devices
+
 #pragma mark -
 #pragma mark Public - Constructor
 
@@ -581,6 +2107,28 @@ NBody::Simulation::GPU::GPU(const size_t& nbodies,
     mpHostPosition = NULL;
     mpHostVelocity = NULL;
     
+    GLuint i;
+    
+    for(i = 0; i < 3; ++i)
+    {
+        mpFrameBuffer[i] = NULL;
+        mpHostFrame[i]   = NULL;
+        mbFrameFree[i]   = true;
+    } // for
+    
+    mpReadQueue  = NULL;
+    mpReadEvent  = NULL;
+    mnFrameIndex = 0;
+    mnReadBuffer = 0;
+    
+    mpSwapKernel = NULL;
+    mnBoundIndex = 0;
+    mnBatch      = 1;
+    
+    mpPairEvent  = NULL;
+    mnPairCount  = 0;
+    mnPairEvents = 0;
+    
     mpContext  = NULL;
     mpProgram  = NULL;
     mpKernel   = NULL;
@@ -597,6 +2145,100 @@ NBody::Simulation::GPU::GPU(const size_t& nbodies,
     
     mpDeviceVelocity[0] = NULL;
     mpDeviceVelocity[1] = NULL;
+    
+    mpAccelerateKernel = NULL;
+    mpJerkKernel       = NULL;
+    mpAdvanceKernel    = NULL;
+    mpPredictKernel    = NULL;
+    mpCorrectKernel    = NULL;
+    
+    mpDeviceAcceleration[0] = NULL;
+    mpDeviceAcceleration[1] = NULL;
+    
+    mpDeviceJerk[0] = NULL;
+    mpDeviceJerk[1] = NULL;
+    
+    mnForceIndex  = 0;
+    mnIntegrator  = params.mnIntegrator;
+    mbAccelerated = false;
+    
+    mpCountKernel   = NULL;
+    mpScanKernel    = NULL;
+    mpScatterKernel = NULL;
+    mpShortKernel   = NULL;
+    
+    mpCellCount = NULL;
+    mpCellStart = NULL;
+    mpBodyCell  = NULL;
+    mpBodyRank  = NULL;
+    mpCellIndex = NULL;
+    
+    mnCells  = 0;
+    mnCutoff = std::max(params.mnCutoff, 0.0f);
+    
+    mpDensityKernel = NULL;
+    mpForceKernel   = NULL;
+    mpUpdateKernel  = NULL;
+    
+    mpDeviceGas   = NULL;
+    mpDeviceFluid = NULL;
+    mpPairCount   = NULL;
+    
+    mnGasCount  = std::min(size_t(params.mnGasCount), nbodies);
+    mnSmoothing = 1.0f;
+    
+    mnDeviceType = type(params.mnDevice);
+    mbVector     = false;
+    
+    mbPeriodic    = params.mnPeriodic != 0;
+    mnBoxSize     = (params.mnBoxSize > 0.0f) ? params.mnBoxSize : Periodic::kBoxSize;
+    mpDeviceEwald = NULL;
+    
+    // The short range and gas passes run between the force and kick
+    // stages, and the periodic sum and wrap are their own force and
+    // drift kernels, so the default fused kernel gives way to staged
+    // leapfrog
+    if(((mnCutoff > 0.0f) || (mnGasCount > 0) || mbPeriodic)
+       && (mnIntegrator != eIntegratorLeapfrog)
+       && (mnIntegrator != eIntegratorYoshida)
+       && (mnIntegrator != eIntegratorHermite))
+    {
+        mnIntegrator = eIntegratorLeapfrog;
+    } // if
+    
+    // There is no periodic jerk, so Hermite falls back to leapfrog too
+    if(mbPeriodic && (mnIntegrator == eIntegratorHermite))
+    {
+        mnIntegrator = eIntegratorLeapfrog;
+    } // if
+    
+    // The staged integrators only have single precision kernels
+    mnPrecision = (params.mnPrecision != ePrecisionDefault) ? params.mnPrecision : GLuint(ePrecisionFloat);
+    
+    if((mnIntegrator == eIntegratorLeapfrog)
+       || (mnIntegrator == eIntegratorYoshida)
+       || (mnIntegrator == eIntegratorHermite))
+    {
+        mnPrecision = ePrecisionFloat;
+    } // if
+    
+    // Streams only have a kernel for the default integrator at single
+    // precision, and are interleaved otherwise
+    mnLayout = (params.mnLayout == eLayoutSoA) ? GLuint(eLayoutSoA) : GLuint(eLayoutAoS);
+    
+    if((mnPrecision != ePrecisionFloat)
+       || (mnIntegrator == eIntegratorLeapfrog)
+       || (mnIntegrator == eIntegratorYoshida)
+       || (mnIntegrator == eIntegratorHermite))
+    {
+        mnLayout = eLayoutAoS;
+    } // if
+    
+    mpDevicePositionLow[0] = NULL;
+    mpDevicePositionLow[1] = NULL;
+    
+    mpDeviceVelocityLow[0] = NULL;
+    mpDeviceVelocityLow[1] = NULL;
 } // Constructor
 
 #pragma mark -
@@ -639,6 +2281,8 @@ void NBody::Simulation::GPU::initialize(const NBody::Simulation::String& options
 
 GLint NBody::Simulation::GPU::reset()
 {
+    discard();
+    
     GLint err = restart();
     
     if(err != CL_SUCCESS)
@@ -653,14 +2297,89 @@ GLint NBody::Simulation::GPU::reset()
     return err;
 } // reset
 
+GLuint NBody::Simulation::GPU::batch()
+{
+    GLuint nMax = Batch::kSteps;
+    
+    if(m_ActiveParams.mnBatch > 0)
+    {
+        nMax = std::min(m_ActiveParams.mnBatch, Batch::kStepsMax);
+    } // if
+    
+    if(!mbIsUpdated)
+    {
+        mnBatch = nMax;
+    } // if
+    else if(isConsumed())
+    {
+        mnBatch = std::max(mnBatch / 2, GLuint(1));
+    } // else if
+    else
+    {
+        mnBatch = std::min(2 * mnBatch, nMax);
+    } // else
+    
+    mnBatch = std::min(mnBatch, nMax);
+    
+    return mnBatch;
+} // batch
+
 void NBody::Simulation::GPU::step()
 {
     if(!isPaused() || !isStopped())
     {
-        GLint err = execute();
+        const GLuint nSteps = batch();
+        
+        GLint err = CL_SUCCESS;
+        
+        bool bOrdered = false;
+        
+        GLuint nDone = 0;
+        
+        GLuint s;
+        
+        for(s = 0; s < nSteps; ++s)
+        {
+            // The kernels of this step must not overwrite the buffer that
+            // a read still in flight is taken from
+            if(!bOrdered && (mpReadEvent != NULL) && (mnReadBuffer == mnWriteIndex))
+            {
+                clEnqueueBarrierWithWaitList(mpQueue[0], 1, &mpReadEvent, NULL);
+                
+                bOrdered = true;
+            } // if
+            
+            err = execute();
+            
+            if(err != CL_SUCCESS)
+            {
+                break;
+            } // if
+            
+            ++nDone;
+            
+            // Only the last step of a batch is read back
+            if(s + 1 < nSteps)
+            {
+                std::swap(mnReadIndex, mnWriteIndex);
+            } // if
+        } // for
+        
+        // Only the steps that were enqueued count, and a failure starts
+        // the next batch over from a single step
+        mnStepCount = nDone;
         
         if(err != CL_SUCCESS)
         {
+            // The last step that did run wrote the read buffers, which is
+            // what the readback and the swap below take as this step's
+            if(nDone > 0)
+            {
+                std::swap(mnReadIndex, mnWriteIndex);
+            } // if
+            
+            mnBatch = 1;
+            
             std::cerr
             << ">> N-body Simulation["
             << err
@@ -668,22 +2387,26 @@ void NBody::Simulation::GPU::step()
             << std::endl;
         } // if
         
-        GLuint i  = 0;
+        // The last read is only waited for when its frame is needed, as
+        // the consumer has taken the one before it
+        publish(isConsumed());
         
-        if(mbIsUpdated)
+        if(mbIsUpdated && (mpReadEvent == NULL))
         {
-            for (i = 0; i < mnDeviceCount; ++i)
+            err = readback();
+            
+            if(err != CL_SUCCESS)
             {
-                NBodySimulationGPUReadBuffer(mpQueue[i],
-                                             mpHostPosition,
-                                             mpDevicePosition[mnWriteIndex],
-                                             mnSize,
-                                             0);
-                
-                setData(mpHostPosition);
-            } // for
+                std::cerr
+                << ">> N-body Simulation["
+                << err
+                << "]: Failed reading back positions!"
+                << std::endl;
+            } // if
         } // if
         
+        profile();
+        
         std::swap(mnReadIndex, mnWriteIndex);
     } // if
 } // step
@@ -702,6 +2425,34 @@ void NBody::Simulation::GPU::terminate()
             } // if
         } // for
         
+        discard();
+        
+        // Take back a frame published but never consumed
+        release(data());
+        
+        if(mpReadQueue != NULL)
+        {
+            for(i = 0; i < 3; ++i)
+            {
+                if(mpHostFrame[i] != NULL)
+                {
+                    clEnqueueUnmapMemObject(mpReadQueue,
+                                            mpFrameBuffer[i],
+                                            mpHostFrame[i],
+                                            0,
+                                            NULL,
+                                            NULL);
+                    
+                    mpHostFrame[i] = NULL;
+                } // if
+            } // for
+            
+            clFinish(mpReadQueue);
+            clReleaseCommandQueue(mpReadQueue);
+            
+            mpReadQueue = NULL;
+        } // if
+        
         if(mpDevicePosition[0] != NULL)
         {
             clReleaseMemObject(mpDevicePosition[0]);
@@ -737,13 +2488,106 @@ void NBody::Simulation::GPU::terminate()
             mpBodyRangeParams = NULL;
         } // if
         
-        if(mpKernel != NULL)
+        for(i = 0; i < 2; ++i)
+        {
+            if(mpDevicePositionLow[i] != NULL)
+            {
+                clReleaseMemObject(mpDevicePositionLow[i]);
+                
+                mpDevicePositionLow[i] = NULL;
+            } // if
+            
+            if(mpDeviceVelocityLow[i] != NULL)
+            {
+                clReleaseMemObject(mpDeviceVelocityLow[i]);
+                
+                mpDeviceVelocityLow[i] = NULL;
+            } // if
+            
+            if(mpDeviceAcceleration[i] != NULL)
+            {
+                clReleaseMemObject(mpDeviceAcceleration[i]);
+                
+                mpDeviceAcceleration[i] = NULL;
+            } // if
+            
+            if(mpDeviceJerk[i] != NULL)
+            {
+                clReleaseMemObject(mpDeviceJerk[i]);
+                
+                mpDeviceJerk[i] = NULL;
+            } // if
+        } // for
+        
+        if(mpPairEvent != NULL)
         {
-            clReleaseKernel(mpKernel);
+            clWaitForEvents(1, &mpPairEvent);
+            clReleaseEvent(mpPairEvent);
             
-            mpKernel = NULL;
+            mpPairEvent = NULL;
         } // if
         
+        for(cl_event pEvent : m_Events)
+        {
+            if(pEvent != NULL)
+            {
+                clReleaseEvent(pEvent);
+            } // if
+        } // for
+        
+        m_Events.clear();
+        
+        cl_mem *pBuffers[9] =
+        {
+            &mpCellCount,
+            &mpCellStart,
+            &mpBodyCell,
+            &mpBodyRank,
+            &mpCellIndex,
+            &mpDeviceGas,
+            &mpDeviceFluid,
+            &mpPairCount,
+            &mpDeviceEwald
+        };
+        
+        for(cl_mem *pBuffer : pBuffers)
+        {
+            if(*pBuffer != NULL)
+            {
+                clReleaseMemObject(*pBuffer);
+                
+                *pBuffer = NULL;
+            } // if
+        } // for
+        
+        cl_kernel *pKernels[14] =
+        {
+            &mpKernel,
+            &mpSwapKernel,
+            &mpAccelerateKernel,
+            &mpJerkKernel,
+            &mpAdvanceKernel,
+            &mpPredictKernel,
+            &mpCorrectKernel,
+            &mpCountKernel,
+            &mpScanKernel,
+            &mpScatterKernel,
+            &mpShortKernel,
+            &mpDensityKernel,
+            &mpForceKernel,
+            &mpUpdateKernel
+        };
+        
+        for(cl_kernel *pKernel : pKernels)
+        {
+            if(*pKernel != NULL)
+            {
+                clReleaseKernel(*pKernel);
+                
+                *pKernel = NULL;
+            } // if
+        } // for
+        
         if(mpProgram != NULL)
         {
             clReleaseProgram(mpProgram);
@@ -781,7 +2625,37 @@ void NBody::Simulation::GPU::terminate()
             
             mpHostVelocity = NULL;
         } // if
+        
+        for(i = 0; i < 3; ++i)
+        {
+            if(mpFrameBuffer[i] != NULL)
+            {
+                clReleaseMemObject(mpFrameBuffer[i]);
+                
+                mpFrameBuffer[i] = NULL;
+            } // if
+        } // for
 
         mbTerminated = true;
     } // if
 } // terminate
+
+void NBody::Simulation::GPU::release(GLfloat *pData)
+{
+    if(pData != NULL)
+    {
+        GLuint i;
+        
+        for(i = 0; i < 3; ++i)
+        {
+            if(pData == mpHostFrame[i])
+            {
+                mbFrameFree[i].store(true, std::memory_order_release);
+                
+                return;
+            } // if
+        } // for
+        
+        Base::release(pData);
+    } // if
+} // release
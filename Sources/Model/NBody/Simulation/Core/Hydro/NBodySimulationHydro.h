@@ -0,0 +1,108 @@
+/*
+     File: NBodySimulationHydro.h
+ Abstract:
+ Utility class for the gas bodies of an n-body simulation, with smoothed
+ particle hydrodynamics over a cell list of the gas.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_HYDRO_H_
+#define _NBODY_SIMULATION_HYDRO_H_
+
+#import <vector>
+
+#import <OpenGL/OpenGL.h>
+
+#import "NBodySimulationCells.h"
+#import "NBodySimulationDispatch.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        // Gas state of each body, as float4 alongside its position and
+        // velocity. Stars have a zero smoothing length.
+        struct Gas
+        {
+            GLfloat  mnSmoothing;
+            GLfloat  mnEnergy;
+            GLfloat  mnDensity;
+            GLfloat  mnHeating;
+        }; // Gas
+        
+        class Hydro
+        {
+        public:
+            Hydro(const size_t& nBodies,
+                  const size_t& nGas);
+            
+            virtual ~Hydro();
+            
+            // Make the last nGas bodies gas, with the given energy and a
+            // smoothing length from the spacing of their bounding box,
+            // and the others stars
+            void seed(const GLfloat * const pPosition,
+                      Gas *pGas,
+                      const GLfloat& nEnergy);
+            
+            // Densities of all the gas bodies, then the pressure and
+            // viscous accelerations and the heating of those within
+            // [nBegin, nEnd), added to the accelerations as float4
+            void accelerate(const GLfloat * const pPosition,
+                            const GLfloat * const pVelocity,
+                            Gas *pGas,
+                            const size_t& nBegin,
+                            const size_t& nEnd,
+                            GLfloat *pAcceleration,
+                            const Dispatch& rDispatch);
+            
+            // Advance the energies by a step, from the last heating, and
+            // adapt the smoothing lengths to the last densities
+            void update(const GLfloat * const pPosition,
+                        Gas *pGas,
+                        const GLfloat& nTimeStep,
+                        const Dispatch& rDispatch) const;
+            
+            // Initial smoothing length, and the pairs within the kernel
+            // support visited by the last accelerate
+            const GLfloat&  smoothing()    const;
+            const GLdouble& interactions() const;
+            
+        private:
+            void gather(const GLfloat * const pPosition,
+                        const GLfloat * const pVelocity,
+                        const Gas * const pGas,
+                        const Dispatch& rDispatch);
+            
+            void density(Gas *pGas,
+                         const Dispatch& rDispatch);
+            
+            void force(Gas *pGas,
+                       const size_t& nBegin,
+                       const size_t& nEnd,
+                       GLfloat *pAcceleration,
+                       const Dispatch& rDispatch);
+            
+        private:
+            size_t                mnBodies;
+            size_t                mnGas;
+            GLfloat               mnSmoothing;
+            GLfloat               mnSupport;
+            GLdouble              mnInteractions;
+            Cells                *mpCells;
+            std::vector<GLuint>   m_Body;
+            std::vector<GLfloat>  m_Position;
+            std::vector<GLfloat>  m_Velocity;
+            std::vector<GLfloat>  m_Fluid;
+            std::vector<GLuint>   m_Pairs;
+        }; // Hydro
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
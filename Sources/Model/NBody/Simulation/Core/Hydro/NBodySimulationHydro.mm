@@ -0,0 +1,466 @@
+/*
+     File: NBodySimulationHydro.mm
+ Abstract:
+ Utility class for the gas bodies of an n-body simulation, with smoothed
+ particle hydrodynamics over a cell list of the gas.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <cfloat>
+#import <cmath>
+
+#import "NBodyConstants.h"
+
+#import "NBodySimulationHydro.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+static const size_t kGrainSize = 256;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Cubic spline kernel of Monaghan and Lattanzio, with a support of two
+// smoothing lengths, and its derivative over the distance, so that the
+// gradient is that times the separation
+static inline GLfloat NBodySimulationHydroKernel(const GLfloat& r,
+                                                 const GLfloat& h)
+{
+    const GLfloat q = r / h;
+    const GLfloat s = 1.0f / (GLfloat(M_PI) * h * h * h);
+    
+    if(q < 1.0f)
+    {
+        return s * (1.0f - 1.5f * q * q + 0.75f * q * q * q);
+    } // if
+    else if(q < 2.0f)
+    {
+        const GLfloat t = 2.0f - q;
+        
+        return s * 0.25f * t * t * t;
+    } // else if
+    
+    return 0.0f;
+} // NBodySimulationHydroKernel
+
+static inline GLfloat NBodySimulationHydroGradient(const GLfloat& r,
+                                                   const GLfloat& h)
+{
+    const GLfloat q = r / h;
+    const GLfloat s = 1.0f / (GLfloat(M_PI) * h * h * h * h);
+    
+    if(q < 1.0f)
+    {
+        return s * (-3.0f + 2.25f * q) / h;
+    } // if
+    else if(q < 2.0f)
+    {
+        const GLfloat t = 2.0f - q;
+        
+        return -s * 0.75f * t * t / std::max(r, FLT_MIN);
+    } // else if
+    
+    return 0.0f;
+} // NBodySimulationHydroGradient
+
+#pragma mark -
+#pragma mark Private - Passes
+
+// Positions and velocities of the gas bodies, wherever the sorts of the
+// simulator have moved them, and a cell list at least as wide as the
+// largest kernel support
+void NBody::Simulation::Hydro::gather(const GLfloat * const pPosition,
+                                      const GLfloat * const pVelocity,
+                                      const Gas * const pGas,
+                                      const Dispatch& rDispatch)
+{
+    size_t i;
+    size_t g = 0;
+    
+    GLfloat nSmoothing = 0.0f;
+    
+    for(i = 0; (i < mnBodies) && (g < mnGas); ++i)
+    {
+        if(pGas[i].mnSmoothing > 0.0f)
+        {
+            m_Body[g++] = GLuint(i);
+            
+            nSmoothing = std::max(nSmoothing, pGas[i].mnSmoothing);
+        } // if
+    } // for
+    
+    rDispatch.apply(0, mnGas, kGrainSize, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t g;
+        size_t k;
+        
+        for(g = nBegin; g < nEnd; ++g)
+        {
+            const GLuint j = m_Body[g];
+            
+            for(k = 0; k < 4; ++k)
+            {
+                m_Position[4 * g + k] = pPosition[4 * j + k];
+                m_Velocity[4 * g + k] = pVelocity[4 * j + k];
+            } // for
+        } // for
+    });
+    
+    mnSupport = 2.0f * nSmoothing;
+    
+    mpCells->build(m_Position.data(), mnSupport, rDispatch);
+} // gather
+
+// Density from the neighbours within two of its own smoothing lengths,
+// itself included, then the pressure term P / rho^2 and sound speed
+void NBody::Simulation::Hydro::density(Gas *pGas,
+                                       const Dispatch& rDispatch)
+{
+    rDispatch.apply(0, mnGas, kGrainSize, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        const GLuint *pIndex = mpCells->index();
+        
+        GLuint first[9];
+        GLuint last[9];
+        
+        size_t g;
+        size_t j;
+        size_t r;
+        
+        for(g = nBegin; g < nEnd; ++g)
+        {
+            const GLfloat *x = m_Position.data() + 4 * g;
+            
+            Gas& gas = pGas[m_Body[g]];
+            
+            const GLfloat h  = gas.mnSmoothing;
+            const GLfloat h2 = 4.0f * h * h;
+            
+            const size_t nRows = mpCells->rows(g, first, last);
+            
+            GLfloat nDensity = 0.0f;
+            GLuint  nPairs   = 0;
+            
+            for(r = 0; r < nRows; ++r)
+            {
+                for(j = first[r]; j < last[r]; ++j)
+                {
+                    const GLfloat *y = m_Position.data() + 4 * pIndex[j];
+                    
+                    const GLfloat dx = x[0] - y[0];
+                    const GLfloat dy = x[1] - y[1];
+                    const GLfloat dz = x[2] - y[2];
+                    
+                    const GLfloat d2 = dx * dx + dy * dy + dz * dz;
+                    
+                    if(d2 < h2)
+                    {
+                        nDensity += y[3] * NBodySimulationHydroKernel(std::sqrt(d2), h);
+                        
+                        ++nPairs;
+                    } // if
+                } // for
+            } // for
+            
+            const GLfloat nPressure = (SPH::kGamma - 1.0f) * nDensity * gas.mnEnergy;
+            
+            GLfloat *pFluid = m_Fluid.data() + 4 * g;
+            
+            pFluid[0] = h;
+            pFluid[1] = nDensity;
+            pFluid[2] = nPressure / (nDensity * nDensity);
+            pFluid[3] = std::sqrt(SPH::kGamma * nPressure / nDensity);
+            
+            gas.mnDensity = nDensity;
+            
+            m_Pairs[g] = nPairs;
+        } // for
+    });
+} // density
+
+// Pressure and viscous accelerations, and the heating, from the pairs
+// within the support of either body, with the kernel gradients of both
+// averaged so that the forces between a pair are equal and opposite
+void NBody::Simulation::Hydro::force(Gas *pGas,
+                                     const size_t& nBegin,
+                                     const size_t& nEnd,
+                                     GLfloat *pAcceleration,
+                                     const Dispatch& rDispatch)
+{
+    rDispatch.apply(0, mnGas, kGrainSize, [&](const size_t& nFirst, const size_t& nLast)
+    {
+        const GLuint *pIndex = mpCells->index();
+        
+        GLuint first[9];
+        GLuint last[9];
+        
+        size_t g;
+        size_t j;
+        size_t r;
+        
+        for(g = nFirst; g < nLast; ++g)
+        {
+            const GLuint b = m_Body[g];
+            
+            if((b < nBegin) || (b >= nEnd))
+            {
+                continue;
+            } // if
+            
+            const GLfloat *x  = m_Position.data() + 4 * g;
+            const GLfloat *v  = m_Velocity.data() + 4 * g;
+            const GLfloat *fi = m_Fluid.data() + 4 * g;
+            
+            const size_t nRows = mpCells->rows(g, first, last);
+            
+            GLfloat force[3] = {0.0f, 0.0f, 0.0f};
+            GLfloat nHeating = 0.0f;
+            GLuint  nPairs   = 0;
+            
+            for(r = 0; r < nRows; ++r)
+            {
+                for(j = first[r]; j < last[r]; ++j)
+                {
+                    const GLuint k = pIndex[j];
+                    
+                    if(k == g)
+                    {
+                        continue;
+                    } // if
+                    
+                    const GLfloat *y  = m_Position.data() + 4 * k;
+                    const GLfloat *fj = m_Fluid.data() + 4 * k;
+                    
+                    const GLfloat h  = std::max(fi[0], fj[0]);
+                    
+                    const GLfloat dx = x[0] - y[0];
+                    const GLfloat dy = x[1] - y[1];
+                    const GLfloat dz = x[2] - y[2];
+                    
+                    const GLfloat d2 = dx * dx + dy * dy + dz * dz;
+                    
+                    if(d2 >= 4.0f * h * h)
+                    {
+                        continue;
+                    } // if
+                    
+                    const GLfloat *w = m_Velocity.data() + 4 * k;
+                    
+                    const GLfloat du = v[0] - w[0];
+                    const GLfloat dv = v[1] - w[1];
+                    const GLfloat dw = v[2] - w[2];
+                    
+                    const GLfloat d = std::sqrt(d2);
+                    const GLfloat f = 0.5f * (NBodySimulationHydroGradient(d, fi[0]) + NBodySimulationHydroGradient(d, fj[0]));
+                    
+                    // Monaghan viscosity, for approaching pairs only
+                    const GLfloat vr = du * dx + dv * dy + dw * dz;
+                    
+                    GLfloat nViscosity = 0.0f;
+                    
+                    if(vr < 0.0f)
+                    {
+                        const GLfloat hm = 0.5f * (fi[0] + fj[0]);
+                        const GLfloat mu = hm * vr / (d2 + 0.01f * hm * hm);
+                        const GLfloat cm = 0.5f * (fi[3] + fj[3]);
+                        const GLfloat rm = 0.5f * (fi[1] + fj[1]);
+                        
+                        nViscosity = (-SPH::kAlpha * cm * mu + SPH::kBeta * mu * mu) / rm;
+                    } // if
+                    
+                    const GLfloat s = y[3] * (fi[2] + fj[2] + nViscosity) * f;
+                    
+                    force[0] -= s * dx;
+                    force[1] -= s * dy;
+                    force[2] -= s * dz;
+                    
+                    nHeating += y[3] * (fi[2] + 0.5f * nViscosity) * vr * f;
+                    
+                    ++nPairs;
+                } // for
+            } // for
+            
+            pAcceleration[4 * b + 0] += force[0];
+            pAcceleration[4 * b + 1] += force[1];
+            pAcceleration[4 * b + 2] += force[2];
+            
+            pGas[b].mnHeating = nHeating;
+            
+            m_Pairs[g] += nPairs;
+        } // for
+    });
+} // force
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Hydro::Hydro(const size_t& nBodies,
+                                const size_t& nGas)
+{
+    mnBodies       = nBodies;
+    mnGas          = std::min(nGas, nBodies);
+    mnSmoothing    = 0.0f;
+    mnSupport      = 0.0f;
+    mnInteractions = 0.0;
+    
+    mpCells = new Cells(mnGas);
+    
+    m_Body.resize(mnGas);
+    m_Position.resize(4 * mnGas);
+    m_Velocity.resize(4 * mnGas);
+    m_Fluid.resize(4 * mnGas);
+    m_Pairs.resize(mnGas);
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Hydro::~Hydro()
+{
+    if(mpCells != NULL)
+    {
+        delete mpCells;
+        
+        mpCells = NULL;
+    } // if
+    
+    mnBodies = 0;
+    mnGas    = 0;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+void NBody::Simulation::Hydro::seed(const GLfloat * const pPosition,
+                                    Gas *pGas,
+                                    const GLfloat& nEnergy)
+{
+    const size_t nFirst = mnBodies - mnGas;
+    
+    GLfloat nMin[3] = { FLT_MAX,  FLT_MAX,  FLT_MAX};
+    GLfloat nMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    
+    size_t i;
+    size_t k;
+    
+    for(i = nFirst; i < mnBodies; ++i)
+    {
+        for(k = 0; k < 3; ++k)
+        {
+            nMin[k] = std::min(nMin[k], pPosition[4 * i + k]);
+            nMax[k] = std::max(nMax[k], pPosition[4 * i + k]);
+        } // for
+    } // for
+    
+    // Mean spacing in the bounding box, with flat boxes given some depth
+    GLfloat nExtent = 0.0f;
+    
+    for(k = 0; k < 3; ++k)
+    {
+        nExtent = std::max(nExtent, nMax[k] - nMin[k]);
+    } // for
+    
+    GLfloat nVolume = 1.0f;
+    
+    for(k = 0; k < 3; ++k)
+    {
+        nVolume *= std::max(nMax[k] - nMin[k], 1.0e-3f * nExtent);
+    } // for
+    
+    mnSmoothing = (mnGas > 0) ? SPH::kEta * std::cbrt(nVolume / GLfloat(mnGas)) : 0.0f;
+    
+    if(!(mnSmoothing > 0.0f))
+    {
+        mnSmoothing = SPH::kEta;
+    } // if
+    
+    const GLfloat nInitial = (nEnergy > 0.0f) ? nEnergy : SPH::kEnergy;
+    
+    for(i = 0; i < mnBodies; ++i)
+    {
+        const bool bGas = i >= nFirst;
+        
+        pGas[i].mnSmoothing = bGas ? mnSmoothing : 0.0f;
+        pGas[i].mnEnergy    = bGas ? nInitial    : 0.0f;
+        pGas[i].mnDensity   = 0.0f;
+        pGas[i].mnHeating   = 0.0f;
+    } // for
+} // seed
+
+void NBody::Simulation::Hydro::accelerate(const GLfloat * const pPosition,
+                                          const GLfloat * const pVelocity,
+                                          Gas *pGas,
+                                          const size_t& nBegin,
+                                          const size_t& nEnd,
+                                          GLfloat *pAcceleration,
+                                          const Dispatch& rDispatch)
+{
+    if(mnGas == 0)
+    {
+        return;
+    } // if
+    
+    gather(pPosition, pVelocity, pGas, rDispatch);
+    
+    density(pGas, rDispatch);
+    
+    force(pGas, nBegin, nEnd, pAcceleration, rDispatch);
+    
+    mnInteractions = 0.0;
+    
+    for(GLuint nPairs : m_Pairs)
+    {
+        mnInteractions += GLdouble(nPairs);
+    } // for
+} // accelerate
+
+// A first order step of the energies, floored so that strong cooling
+// from expansion never leaves negative pressures, and smoothing lengths
+// that keep a steady number of neighbours as the density changes
+void NBody::Simulation::Hydro::update(const GLfloat * const pPosition,
+                                      Gas *pGas,
+                                      const GLfloat& nTimeStep,
+                                      const Dispatch& rDispatch) const
+{
+    const GLfloat nMin = SPH::kSmoothingMin * mnSmoothing;
+    const GLfloat nMax = SPH::kSmoothingMax * mnSmoothing;
+    
+    rDispatch.apply(0, mnBodies, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            Gas& gas = pGas[i];
+            
+            if(gas.mnSmoothing > 0.0f)
+            {
+                gas.mnEnergy = std::max(gas.mnEnergy + gas.mnHeating * nTimeStep, SPH::kEnergyMin);
+                
+                if(gas.mnDensity > 0.0f)
+                {
+                    const GLfloat h = SPH::kEta * std::cbrt(pPosition[4 * i + 3] / gas.mnDensity);
+                    
+                    gas.mnSmoothing = std::min(std::max(h, nMin), nMax);
+                } // if
+            } // if
+        } // for
+    });
+} // update
+
+const GLfloat& NBody::Simulation::Hydro::smoothing() const
+{
+    return mnSmoothing;
+} // smoothing
+
+const GLdouble& NBody::Simulation::Hydro::interactions() const
+{
+    return mnInteractions;
+} // interactions
@@ -0,0 +1,58 @@
+/*
+     File: NBodySimulationEwald.h
+ Abstract:
+ Utility class for the Ewald correction of direct sums in a periodic box,
+ tabulated once and interpolated per pair.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_EWALD_H_
+#define _NBODY_SIMULATION_EWALD_H_
+
+#import <vector>
+
+#import <OpenGL/OpenGL.h>
+
+#import "NBodySimulationDispatch.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class Ewald
+        {
+        public:
+            // Table of (n + 1)^3 float4 over one octant of half a unit
+            // box, indexed (x (n + 1) + y) (n + 1) + z
+            Ewald(const size_t& n,
+                  const Dispatch& rDispatch);
+            
+            virtual ~Ewald();
+            
+            // Correction for a unit mass to the acceleration at the
+            // nearest image separation d of a box of side nBox, the sum
+            // over all the other images and the mean density, added to f
+            void correct(const GLfloat * const d,
+                         const GLfloat& nBox,
+                         GLfloat *f) const;
+            
+            const GLfloat *table() const;
+            const size_t&  size()  const;
+            
+        private:
+            void tabulate(const Dispatch& rDispatch);
+            
+        private:
+            size_t                mnSize;
+            std::vector<GLfloat>  m_Table;
+        }; // Ewald
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
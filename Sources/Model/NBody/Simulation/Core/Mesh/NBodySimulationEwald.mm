@@ -0,0 +1,239 @@
+/*
+     File: NBodySimulationEwald.mm
+ Abstract:
+ Utility class for the Ewald correction of direct sums in a periodic box,
+ tabulated once and interpolated per pair.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <cmath>
+
+#import "NBodyConstants.h"
+
+#import "NBodySimulationEwald.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+static const size_t kGrainSize = 1;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Acceleration at separation x of a unit mass in a unit box, summed
+// over all its images against a uniform background, split at alpha
+// into a real space sum of images and a sum over wave vectors, less
+// the Newtonian term of the nearest image
+static void NBodySimulationEwaldCorrection(const GLdouble * const x,
+                                           GLdouble *f)
+{
+    const GLdouble alpha  = NBody::Periodic::kAlpha;
+    const GLint    nImage = GLint(NBody::Periodic::kImages);
+    const GLint    nWave  = GLint(NBody::Periodic::kWaves);
+    
+    const GLdouble r2 = x[0] * x[0] + x[1] * x[1] + x[2] * x[2];
+    
+    f[0] = 0.0;
+    f[1] = 0.0;
+    f[2] = 0.0;
+    
+    // The correction is odd, and vanishes at the origin
+    if(r2 == 0.0)
+    {
+        return;
+    } // if
+    
+    const GLdouble r = std::sqrt(r2);
+    
+    f[0] = x[0] / (r2 * r);
+    f[1] = x[1] / (r2 * r);
+    f[2] = x[2] / (r2 * r);
+    
+    GLint i;
+    GLint j;
+    GLint k;
+    
+    for(i = -nImage; i <= nImage; ++i)
+    {
+        for(j = -nImage; j <= nImage; ++j)
+        {
+            for(k = -nImage; k <= nImage; ++k)
+            {
+                const GLdouble d[3] = {x[0] - i, x[1] - j, x[2] - k};
+                
+                const GLdouble s2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                const GLdouble s  = std::sqrt(s2);
+                
+                const GLdouble g = (std::erfc(alpha * s) + alpha * s * M_2_SQRTPI * std::exp(-alpha * alpha * s2)) / (s2 * s);
+                
+                f[0] -= d[0] * g;
+                f[1] -= d[1] * g;
+                f[2] -= d[2] * g;
+            } // for
+        } // for
+    } // for
+    
+    for(i = -nWave; i <= nWave; ++i)
+    {
+        for(j = -nWave; j <= nWave; ++j)
+        {
+            for(k = -nWave; k <= nWave; ++k)
+            {
+                const GLint h2 = i * i + j * j + k * k;
+                
+                if((h2 == 0) || (h2 > nWave * nWave))
+                {
+                    continue;
+                } // if
+                
+                const GLdouble g = 2.0 / GLdouble(h2) * std::exp(-M_PI * M_PI * h2 / (alpha * alpha)) * std::sin(2.0 * M_PI * (i * x[0] + j * x[1] + k * x[2]));
+                
+                f[0] -= i * g;
+                f[1] -= j * g;
+                f[2] -= k * g;
+            } // for
+        } // for
+    } // for
+} // NBodySimulationEwaldCorrection
+
+#pragma mark -
+#pragma mark Private - Tabulation
+
+void NBody::Simulation::Ewald::tabulate(const Dispatch& rDispatch)
+{
+    const size_t   n     = mnSize;
+    const GLdouble nStep = 0.5 / GLdouble(n);
+    
+    GLfloat *pTable = m_Table.data();
+    
+    rDispatch.apply(0, n + 1, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        size_t j;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            for(j = 0; j <= n; ++j)
+            {
+                for(k = 0; k <= n; ++k)
+                {
+                    const GLdouble x[3] = {i * nStep, j * nStep, k * nStep};
+                    
+                    GLdouble f[3];
+                    
+                    NBodySimulationEwaldCorrection(x, f);
+                    
+                    GLfloat *t = pTable + 4 * ((i * (n + 1) + j) * (n + 1) + k);
+                    
+                    t[0] = GLfloat(f[0]);
+                    t[1] = GLfloat(f[1]);
+                    t[2] = GLfloat(f[2]);
+                    t[3] = 0.0f;
+                } // for
+            } // for
+        } // for
+    });
+} // tabulate
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Ewald::Ewald(const size_t& n,
+                                const Dispatch& rDispatch)
+{
+    mnSize = std::max(n, size_t(1));
+    
+    m_Table.resize(4 * (mnSize + 1) * (mnSize + 1) * (mnSize + 1));
+    
+    tabulate(rDispatch);
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Ewald::~Ewald()
+{
+    mnSize = 0;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+// Trilinear in the octant of |d|, with the signs of d put back after
+void NBody::Simulation::Ewald::correct(const GLfloat * const d,
+                                       const GLfloat& nBox,
+                                       GLfloat *f) const
+{
+    const size_t  n      = mnSize;
+    const GLfloat nScale = 2.0f * GLfloat(n) / nBox;
+    
+    size_t  index[3];
+    GLfloat frac[3];
+    GLfloat sign[3];
+    
+    size_t k;
+    
+    for(k = 0; k < 3; ++k)
+    {
+        const GLfloat u = std::min(std::abs(d[k]) * nScale, GLfloat(n));
+        
+        index[k] = std::min(size_t(u), n - 1);
+        frac[k]  = u - GLfloat(index[k]);
+        sign[k]  = (d[k] < 0.0f) ? -1.0f : 1.0f;
+    } // for
+    
+    const size_t nRow   = n + 1;
+    const size_t nPlane = nRow * nRow;
+    
+    const GLfloat *t = m_Table.data() + 4 * ((index[0] * nRow + index[1]) * nRow + index[2]);
+    
+    GLfloat c[3] = {0.0f, 0.0f, 0.0f};
+    
+    size_t corner;
+    
+    for(corner = 0; corner < 8; ++corner)
+    {
+        const size_t a = (corner >> 2) & 1;
+        const size_t b = (corner >> 1) & 1;
+        const size_t e = corner & 1;
+        
+        const GLfloat w = (a ? frac[0] : 1.0f - frac[0])
+                        * (b ? frac[1] : 1.0f - frac[1])
+                        * (e ? frac[2] : 1.0f - frac[2]);
+        
+        const GLfloat *p = t + 4 * (a * nPlane + b * nRow + e);
+        
+        for(k = 0; k < 3; ++k)
+        {
+            c[k] += w * p[k];
+        } // for
+    } // for
+    
+    // Accelerations scale as the inverse square of the box
+    const GLfloat nInvBox2 = 1.0f / (nBox * nBox);
+    
+    for(k = 0; k < 3; ++k)
+    {
+        f[k] += sign[k] * c[k] * nInvBox2;
+    } // for
+} // correct
+
+#pragma mark -
+#pragma mark Public - Accessors
+
+const GLfloat *NBody::Simulation::Ewald::table() const
+{
+    return m_Table.data();
+} // table
+
+const size_t& NBody::Simulation::Ewald::size() const
+{
+    return mnSize;
+} // size
@@ -0,0 +1,76 @@
+/*
+     File: NBodySimulationFFT.h
+ Abstract: 
+ Utility class for real-to-complex fast Fourier transforms of cubic meshes.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_FFT_H_
+#define _NBODY_SIMULATION_FFT_H_
+
+#import <complex>
+#import <vector>
+
+#import <OpenGL/OpenGL.h>
+
+#import "NBodySimulationDispatch.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class FFT
+        {
+        public:
+            typedef std::complex<GLfloat> Complex;
+            
+        public:
+            // Transforms of an n x n x n mesh, n a power of two
+            FFT(const size_t& n);
+            
+            virtual ~FFT();
+            
+            // Real mesh, indexed (x n + y) n + z, to its half spectrum,
+            // indexed (x n + y) (n / 2 + 1) + z. Unnormalized.
+            void forward(const GLfloat * const pReal,
+                         Complex *pSpectrum,
+                         const Dispatch& rDispatch) const;
+            
+            // Half spectrum back to the real mesh, scaled by 1 / n^3 so
+            // that it inverts forward. The spectrum is overwritten.
+            void inverse(Complex *pSpectrum,
+                         GLfloat *pReal,
+                         const Dispatch& rDispatch) const;
+            
+            const size_t& size() const;
+            
+            // Complex values along z in the half spectrum
+            const size_t& width() const;
+            
+        private:
+            void transform(Complex *pLine,
+                           const size_t& nLength,
+                           const bool& bInverse) const;
+            
+            void lines(Complex *pSpectrum,
+                       const size_t& nStride,
+                       const size_t& nStep,
+                       const bool& bInverse,
+                       const Dispatch& rDispatch) const;
+                       
+        private:
+            size_t                 mnSize;
+            size_t                 mnWidth;
+            std::vector<Complex>   m_Twiddle;   // exp(-2 pi i k / n), k < n / 2
+            std::vector<GLuint>    m_Reverse[2]; // Bit reversal for lengths n and n / 2
+        }; // FFT
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
@@ -0,0 +1,276 @@
+/*
+     File: NBodySimulationFFT.mm
+ Abstract: 
+ Utility class for real-to-complex fast Fourier transforms of cubic meshes.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <cmath>
+
+#import "NBodySimulationFFT.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Mesh lines handed to a worker at a time
+static const size_t kGrainSize = 16;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+static void NBodySimulationFFTReverse(const size_t& n,
+                                      std::vector<GLuint>& rReverse)
+{
+    size_t nBits = 0;
+    size_t i;
+    size_t b;
+    
+    while((size_t(1) << nBits) < n)
+    {
+        ++nBits;
+    } // while
+    
+    rReverse.resize(n);
+    
+    for(i = 0; i < n; ++i)
+    {
+        size_t r = 0;
+        
+        for(b = 0; b < nBits; ++b)
+        {
+            r |= ((i >> b) & 1) << (nBits - 1 - b);
+        } // for
+        
+        rReverse[i] = GLuint(r);
+    } // for
+} // NBodySimulationFFTReverse
+
+// In-place iterative radix-2 transform of a line of length n or n / 2
+void NBody::Simulation::FFT::transform(Complex *pLine,
+                                       const size_t& nLength,
+                                       const bool& bInverse) const
+{
+    const GLuint *pReverse = (nLength == mnSize) ? m_Reverse[0].data() : m_Reverse[1].data();
+    
+    size_t i;
+    size_t h;
+    size_t s;
+    size_t k;
+    
+    for(i = 0; i < nLength; ++i)
+    {
+        const size_t j = pReverse[i];
+        
+        if(i < j)
+        {
+            std::swap(pLine[i], pLine[j]);
+        } // if
+    } // for
+    
+    for(h = 1; h < nLength; h <<= 1)
+    {
+        const size_t nStep = mnSize / (2 * h);
+        
+        for(s = 0; s < nLength; s += 2 * h)
+        {
+            for(k = 0; k < h; ++k)
+            {
+                const Complex w = bInverse ? std::conj(m_Twiddle[k * nStep]) : m_Twiddle[k * nStep];
+                
+                const Complex u = pLine[s + k];
+                const Complex t = w * pLine[s + k + h];
+                
+                pLine[s + k]     = u + t;
+                pLine[s + k + h] = u - t;
+            } // for
+        } // for
+    } // for
+} // transform
+
+// Transform every line of the half spectrum along one of x or y, where
+// line l starts at (l / width) nStride + (l % width) with elements nStep
+// apart
+void NBody::Simulation::FFT::lines(Complex *pSpectrum,
+                                   const size_t& nStride,
+                                   const size_t& nStep,
+                                   const bool& bInverse,
+                                   const Dispatch& rDispatch) const
+{
+    rDispatch.apply(0, mnSize * mnWidth, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        std::vector<Complex> line(mnSize);
+        
+        size_t l;
+        size_t i;
+        
+        for(l = nBegin; l < nEnd; ++l)
+        {
+            Complex *pFirst = pSpectrum + (l / mnWidth) * nStride + (l % mnWidth);
+            
+            for(i = 0; i < mnSize; ++i)
+            {
+                line[i] = pFirst[i * nStep];
+            } // for
+            
+            transform(line.data(), mnSize, bInverse);
+            
+            for(i = 0; i < mnSize; ++i)
+            {
+                pFirst[i * nStep] = line[i];
+            } // for
+        } // for
+    });
+} // lines
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::FFT::FFT(const size_t& n)
+{
+    mnSize  = n;
+    mnWidth = n / 2 + 1;
+    
+    m_Twiddle.resize(mnSize / 2);
+    
+    size_t k;
+    
+    for(k = 0; k < (mnSize / 2); ++k)
+    {
+        const GLdouble a = -2.0 * M_PI * GLdouble(k) / GLdouble(mnSize);
+        
+        m_Twiddle[k] = Complex(GLfloat(std::cos(a)), GLfloat(std::sin(a)));
+    } // for
+    
+    NBodySimulationFFTReverse(mnSize,     m_Reverse[0]);
+    NBodySimulationFFTReverse(mnSize / 2, m_Reverse[1]);
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::FFT::~FFT()
+{
+    mnSize  = 0;
+    mnWidth = 0;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Accessors
+
+const size_t& NBody::Simulation::FFT::size() const
+{
+    return mnSize;
+} // size
+
+const size_t& NBody::Simulation::FFT::width() const
+{
+    return mnWidth;
+} // width
+
+#pragma mark -
+#pragma mark Public - Transforms
+
+// Each real z line is packed as n / 2 complex values, even samples in
+// the real part and odd in the imaginary, transformed at half length,
+// and then split into the spectra of the even and odd samples
+void NBody::Simulation::FFT::forward(const GLfloat * const pReal,
+                                     Complex *pSpectrum,
+                                     const Dispatch& rDispatch) const
+{
+    const size_t nHalf = mnSize / 2;
+    
+    rDispatch.apply(0, mnSize * mnSize, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        std::vector<Complex> line(nHalf);
+        
+        const Complex i(0.0f, 1.0f);
+        
+        size_t l;
+        size_t j;
+        size_t k;
+        
+        for(l = nBegin; l < nEnd; ++l)
+        {
+            const GLfloat *pLine = pReal + l * mnSize;
+            
+            Complex *pOut = pSpectrum + l * mnWidth;
+            
+            for(j = 0; j < nHalf; ++j)
+            {
+                line[j] = Complex(pLine[2 * j], pLine[2 * j + 1]);
+            } // for
+            
+            transform(line.data(), nHalf, false);
+            
+            for(k = 0; k <= nHalf; ++k)
+            {
+                const Complex z  = line[k % nHalf];
+                const Complex zc = std::conj(line[(nHalf - k) % nHalf]);
+                
+                const Complex even = 0.5f * (z + zc);
+                const Complex odd  = -0.5f * i * (z - zc);
+                
+                const Complex w = (k < nHalf) ? m_Twiddle[k] : Complex(-1.0f, 0.0f);
+                
+                pOut[k] = even + w * odd;
+            } // for
+        } // for
+    });
+    
+    lines(pSpectrum, mnSize * mnWidth, mnWidth,          false, rDispatch);
+    lines(pSpectrum, mnWidth,          mnSize * mnWidth, false, rDispatch);
+} // forward
+
+void NBody::Simulation::FFT::inverse(Complex *pSpectrum,
+                                     GLfloat *pReal,
+                                     const Dispatch& rDispatch) const
+{
+    lines(pSpectrum, mnWidth,          mnSize * mnWidth, true, rDispatch);
+    lines(pSpectrum, mnSize * mnWidth, mnWidth,          true, rDispatch);
+    
+    const size_t nHalf = mnSize / 2;
+    
+    const GLfloat nScale = GLfloat(2.0 / (GLdouble(mnSize) * GLdouble(mnSize) * GLdouble(mnSize)));
+    
+    rDispatch.apply(0, mnSize * mnSize, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        std::vector<Complex> line(nHalf);
+        
+        const Complex i(0.0f, 1.0f);
+        
+        size_t l;
+        size_t j;
+        size_t k;
+        
+        for(l = nBegin; l < nEnd; ++l)
+        {
+            const Complex *pIn = pSpectrum + l * mnWidth;
+            
+            GLfloat *pLine = pReal + l * mnSize;
+            
+            for(k = 0; k < nHalf; ++k)
+            {
+                const Complex x  = pIn[k];
+                const Complex xc = std::conj(pIn[nHalf - k]);
+                
+                const Complex even = 0.5f * (x + xc);
+                const Complex odd  = 0.5f * (x - xc) * std::conj(m_Twiddle[k]);
+                
+                line[k] = even + i * odd;
+            } // for
+            
+            transform(line.data(), nHalf, true);
+            
+            for(j = 0; j < nHalf; ++j)
+            {
+                pLine[2 * j]     = nScale * line[j].real();
+                pLine[2 * j + 1] = nScale * line[j].imag();
+            } // for
+        } // for
+    });
+} // inverse
@@ -0,0 +1,76 @@
+/*
+     File: NBodySimulationParticleMesh.h
+ Abstract: 
+ Utility class for managing a particle-mesh solver in a periodic box on the cpu for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_PARTICLE_MESH_H_
+#define _NBODY_SIMULATION_PARTICLE_MESH_H_
+
+#import "NBodySimulationCPU.h"
+#import "NBodySimulationFFT.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class ParticleMesh : public CPU
+        {
+        public:
+            ParticleMesh(const size_t& nBodies,
+                         const Params& rParams);
+            
+            virtual ~ParticleMesh();
+            
+            GLint reset();
+            
+        protected:
+            // Accelerations of the active bodies from the mesh alone
+            void accelerate();
+            
+            // Wrap positions back into the periodic box
+            void boundary();
+            
+            // No jerk from the approximate forces, so Hermite falls back
+            // to leapfrog
+            bool jerk();
+            
+            // No direct sum kernels to benchmark
+            void measure();
+            
+            // Assign the bodies to the mesh, solve Poisson's equation with
+            // the Green's function filtered by exp(-k^2 rs^2), and store
+            // the interpolated mesh accelerations of the active bodies.
+            // A split scale rs of zero leaves the full force on the mesh.
+            void mesh(const GLfloat& nSplit);
+            
+        private:
+            void bin();
+            void assign();
+            void solve(const GLfloat& nSplit);
+            void interpolate();
+            
+        protected:
+            GLfloat  mnBox;         // Side of the periodic box, centred on the origin
+            GLfloat  mnCell;        // Side of a mesh cell
+            GLuint   mnMesh;        // Mesh cells along each axis
+            GLuint   mnAssignment;  // Cloud-in-cell or triangular-shaped cloud
+            
+        private:
+            FFT                   m_FFT;
+            std::vector<GLfloat>  m_Density;   // Density, then potential, on the mesh
+            std::vector<FFT::Complex> m_Spectrum;
+            std::vector<GLuint>   m_Order;     // Bodies sorted by slab
+            std::vector<GLuint>   m_Slab;      // First body of each slab in m_Order
+        }; // ParticleMesh
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
@@ -0,0 +1,462 @@
+/*
+     File: NBodySimulationParticleMesh.mm
+ Abstract: 
+ Utility class for managing a particle-mesh solver in a periodic box on the cpu for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <cmath>
+#import <iostream>
+
+#import "NBodySimulationParticleMesh.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Mesh cells along x in a slab. Assignment touches at most three cells
+// along x, so slabs two apart never write the same cells.
+static const GLuint kSlabWidth = 4;
+
+// Bodies handed to a worker at a time
+static const size_t kGrainSize = 256;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Mesh cells along each axis, a power of two no smaller than the minimum
+static GLuint NBodySimulationParticleMeshSize(const NBody::Simulation::Params& rParams)
+{
+    const GLuint nRequest = (rParams.mnMeshSize > 0) ? rParams.mnMeshSize : NBody::Mesh::kSize;
+    
+    GLuint n = NBody::Mesh::kSizeMin;
+    
+    while(n < nRequest)
+    {
+        n <<= 1;
+    } // while
+    
+    return n;
+} // NBodySimulationParticleMeshSize
+
+// First cell and weights of the assignment stencil along one axis, for
+// a coordinate u in cells from the low face of the box. Cloud-in-cell
+// spreads over the two nearest cells, triangular-shaped cloud over three.
+static GLint NBodySimulationParticleMeshStencil(const GLfloat& u,
+                                                const GLuint& nAssignment,
+                                                GLfloat *pWeight)
+{
+    GLint i;
+    
+    if(nAssignment == NBody::Simulation::eAssignmentTSC)
+    {
+        i = GLint(std::floor(u));
+        
+        const GLfloat d = u - (GLfloat(i) + 0.5f);
+        
+        pWeight[0] = 0.5f * (0.5f - d) * (0.5f - d);
+        pWeight[1] = 0.75f - d * d;
+        pWeight[2] = 0.5f * (0.5f + d) * (0.5f + d);
+        
+        i -= 1;
+    } // if
+    else
+    {
+        i = GLint(std::floor(u - 0.5f));
+        
+        const GLfloat d = u - 0.5f - GLfloat(i);
+        
+        pWeight[0] = 1.0f - d;
+        pWeight[1] = d;
+        pWeight[2] = 0.0f;
+    } // else
+    
+    return i;
+} // NBodySimulationParticleMeshStencil
+
+static inline size_t NBodySimulationParticleMeshWrap(const GLint& i,
+                                                     const GLuint& n)
+{
+    return size_t(i & GLint(n - 1));
+} // NBodySimulationParticleMeshWrap
+
+// Sort the bodies by the slab of the first cell of their stencil along x
+void NBody::Simulation::ParticleMesh::bin()
+{
+    const GLuint  nSlabs   = mnMesh / kSlabWidth;
+    const GLfloat nInvCell = 1.0f / mnCell;
+    const GLfloat nHalfBox = 0.5f * mnBox;
+    
+    std::vector<GLuint> slab(mnBodyCount);
+    
+    parallel(0, mnBodyCount, kGrainSize, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        GLfloat w[3];
+        size_t  i;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            const GLint x = NBodySimulationParticleMeshStencil((mpPosition[4 * i] + nHalfBox) * nInvCell, mnAssignment, w);
+            
+            slab[i] = GLuint(NBodySimulationParticleMeshWrap(x, mnMesh) / kSlabWidth);
+        } // for
+    });
+    
+    m_Slab.assign(nSlabs + 1, 0);
+    
+    size_t i;
+    GLuint s;
+    
+    for(i = 0; i < mnBodyCount; ++i)
+    {
+        ++m_Slab[slab[i] + 1];
+    } // for
+    
+    for(s = 0; s < nSlabs; ++s)
+    {
+        m_Slab[s + 1] += m_Slab[s];
+    } // for
+    
+    std::vector<GLuint> next(m_Slab.begin(), m_Slab.end() - 1);
+    
+    for(i = 0; i < mnBodyCount; ++i)
+    {
+        m_Order[next[slab[i]]++] = GLuint(i);
+    } // for
+} // bin
+
+// Mass density on the mesh, even slabs then odd slabs in parallel
+void NBody::Simulation::ParticleMesh::assign()
+{
+    const GLuint  nSlabs    = mnMesh / kSlabWidth;
+    const GLuint  nStencil  = (mnAssignment == eAssignmentTSC) ? 3 : 2;
+    const GLfloat nInvCell  = 1.0f / mnCell;
+    const GLfloat nInvVol   = nInvCell * nInvCell * nInvCell;
+    const GLfloat nHalfBox  = 0.5f * mnBox;
+    const size_t  n         = mnMesh;
+    
+    std::fill(m_Density.begin(), m_Density.end(), 0.0f);
+    
+    GLuint nPhase;
+    
+    for(nPhase = 0; nPhase < 2; ++nPhase)
+    {
+        parallel(0, nSlabs / 2, 1, [&](const size_t& nBegin, const size_t& nEnd)
+        {
+            GLfloat wx[3];
+            GLfloat wy[3];
+            GLfloat wz[3];
+            
+            size_t  s;
+            size_t  k;
+            GLuint  a;
+            GLuint  b;
+            GLuint  c;
+            
+            for(s = nBegin; s < nEnd; ++s)
+            {
+                const GLuint nSlab = GLuint(2 * s + nPhase);
+                
+                for(k = m_Slab[nSlab]; k < m_Slab[nSlab + 1]; ++k)
+                {
+                    const GLfloat *pBody = mpPosition + 4 * m_Order[k];
+                    
+                    const GLint x = NBodySimulationParticleMeshStencil((pBody[0] + nHalfBox) * nInvCell, mnAssignment, wx);
+                    const GLint y = NBodySimulationParticleMeshStencil((pBody[1] + nHalfBox) * nInvCell, mnAssignment, wy);
+                    const GLint z = NBodySimulationParticleMeshStencil((pBody[2] + nHalfBox) * nInvCell, mnAssignment, wz);
+                    
+                    const GLfloat m = pBody[3] * nInvVol;
+                    
+                    for(a = 0; a < nStencil; ++a)
+                    {
+                        const size_t i = NBodySimulationParticleMeshWrap(x + GLint(a), mnMesh);
+                        
+                        for(b = 0; b < nStencil; ++b)
+                        {
+                            const size_t j = NBodySimulationParticleMeshWrap(y + GLint(b), mnMesh);
+                            
+                            GLfloat *pLine = m_Density.data() + (i * n + j) * n;
+                            
+                            const GLfloat w = m * wx[a] * wy[b];
+                            
+                            for(c = 0; c < nStencil; ++c)
+                            {
+                                pLine[NBodySimulationParticleMeshWrap(z + GLint(c), mnMesh)] += w * wz[c];
+                            } // for
+                        } // for
+                    } // for
+                } // for
+            } // for
+        });
+    } // for
+} // assign
+
+// Potential psi, with acceleration grad psi, from -k^2 psi = -4 pi rho.
+// Without a split the density is deconvolved by the assignment window
+// once. Dividing by it twice, for the interpolation as well, amplifies
+// the modes near the Nyquist frequency and makes the force noticeably
+// anisotropic. A Gaussian split damps those modes anyway, and then the
+// full deconvolution keeps the long-range force from falling short near
+// the split scale. The mean density is dropped, as usual for a periodic
+// box.
+void NBody::Simulation::ParticleMesh::solve(const GLfloat& nSplit)
+{
+    m_FFT.forward(m_Density.data(), m_Spectrum.data(), m_Dispatch);
+    
+    const size_t n = mnMesh;
+    const size_t w = m_FFT.width();
+    
+    const GLdouble nFundamental = 2.0 * M_PI / GLdouble(mnBox);
+    const GLdouble nHalfCell    = 0.5 * GLdouble(mnCell);
+    const GLdouble nSplitSq     = GLdouble(nSplit) * GLdouble(nSplit);
+    const GLdouble nPower       = ((mnAssignment == eAssignmentTSC) ? 3.0 : 2.0) * ((nSplit > 0.0f) ? 2.0 : 1.0);
+    
+    parallel(0, n * n, 16, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        GLdouble k[3];
+        GLdouble s[3];
+        
+        size_t l;
+        size_t z;
+        size_t a;
+        
+        for(l = nBegin; l < nEnd; ++l)
+        {
+            const size_t x = l / n;
+            const size_t y = l % n;
+            
+            k[0] = nFundamental * ((x <= n / 2) ? GLdouble(x) : (GLdouble(x) - GLdouble(n)));
+            k[1] = nFundamental * ((y <= n / 2) ? GLdouble(y) : (GLdouble(y) - GLdouble(n)));
+            
+            FFT::Complex *pLine = m_Spectrum.data() + l * w;
+            
+            for(z = 0; z < w; ++z)
+            {
+                k[2] = nFundamental * GLdouble(z);
+                
+                const GLdouble k2 = k[0] * k[0] + k[1] * k[1] + k[2] * k[2];
+                
+                if(k2 > 0.0)
+                {
+                    GLdouble window = 1.0;
+                    
+                    for(a = 0; a < 3; ++a)
+                    {
+                        const GLdouble t = k[a] * nHalfCell;
+                        
+                        s[a]    = (t != 0.0) ? (std::sin(t) / t) : 1.0;
+                        window *= s[a];
+                    } // for
+                    
+                    const GLdouble g = 4.0 * M_PI * std::exp(-k2 * nSplitSq) / (k2 * std::pow(window, nPower));
+                    
+                    pLine[z] *= GLfloat(g);
+                } // if
+                else
+                {
+                    pLine[z] = FFT::Complex(0.0f, 0.0f);
+                } // else
+            } // for
+        } // for
+    });
+    
+    m_FFT.inverse(m_Spectrum.data(), m_Density.data(), m_Dispatch);
+} // solve
+
+// Accelerations from four point central differences of the potential,
+// gathered to the bodies with the same stencil as the assignment
+void NBody::Simulation::ParticleMesh::interpolate()
+{
+    const GLuint  nStencil = (mnAssignment == eAssignmentTSC) ? 3 : 2;
+    const GLfloat nInvCell = 1.0f / mnCell;
+    const GLfloat nHalfBox = 0.5f * mnBox;
+    const GLfloat nScale   = 1.0f / (12.0f * mnCell);
+    const size_t  n        = mnMesh;
+    
+    const GLfloat *pPotential = m_Density.data();
+    
+    parallel(mnMinIndex, mnMaxIndex, kGrainSize, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        GLfloat wx[3];
+        GLfloat wy[3];
+        GLfloat wz[3];
+        
+        size_t i;
+        GLuint a;
+        GLuint b;
+        GLuint c;
+        
+        auto phi = [&](const GLint& x, const GLint& y, const GLint& z) -> GLfloat
+        {
+            return pPotential[(NBodySimulationParticleMeshWrap(x, mnMesh) * n
+                               + NBodySimulationParticleMeshWrap(y, mnMesh)) * n
+                              + NBodySimulationParticleMeshWrap(z, mnMesh)];
+        };
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            const GLfloat *pBody = mpPosition + 4 * i;
+            
+            const GLint x = NBodySimulationParticleMeshStencil((pBody[0] + nHalfBox) * nInvCell, mnAssignment, wx);
+            const GLint y = NBodySimulationParticleMeshStencil((pBody[1] + nHalfBox) * nInvCell, mnAssignment, wy);
+            const GLint z = NBodySimulationParticleMeshStencil((pBody[2] + nHalfBox) * nInvCell, mnAssignment, wz);
+            
+            GLfloat f[3] = {0.0f, 0.0f, 0.0f};
+            
+            for(a = 0; a < nStencil; ++a)
+            {
+                const GLint p = x + GLint(a);
+                
+                for(b = 0; b < nStencil; ++b)
+                {
+                    const GLint q = y + GLint(b);
+                    
+                    for(c = 0; c < nStencil; ++c)
+                    {
+                        const GLint r = z + GLint(c);
+                        
+                        const GLfloat weight = wx[a] * wy[b] * wz[c];
+                        
+                        f[0] += weight * (8.0f * (phi(p + 1, q, r) - phi(p - 1, q, r)) - (phi(p + 2, q, r) - phi(p - 2, q, r)));
+                        f[1] += weight * (8.0f * (phi(p, q + 1, r) - phi(p, q - 1, r)) - (phi(p, q + 2, r) - phi(p, q - 2, r)));
+                        f[2] += weight * (8.0f * (phi(p, q, r + 1) - phi(p, q, r - 1)) - (phi(p, q, r + 2) - phi(p, q, r - 2)));
+                    } // for
+                } // for
+            } // for
+            
+            mpAcceleration[4 * i + 0] = nScale * f[0];
+            mpAcceleration[4 * i + 1] = nScale * f[1];
+            mpAcceleration[4 * i + 2] = nScale * f[2];
+            mpAcceleration[4 * i + 3] = 0.0f;
+        } // for
+    });
+} // interpolate
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::ParticleMesh::ParticleMesh(const size_t& nbodies,
+                                              const NBody::Simulation::Params& params)
+: NBody::Simulation::CPU(nbodies, params)
+, m_FFT(NBodySimulationParticleMeshSize(params))
+{
+    mnMesh       = GLuint(m_FFT.size());
+    mnAssignment = (params.mnAssignment == eAssignmentTSC) ? eAssignmentTSC : eAssignmentCIC;
+    mnBox        = params.mnBoxSize;
+    mnCell       = (mnBox > 0.0f) ? (mnBox / GLfloat(mnMesh)) : 0.0f;
+    
+    const size_t n = mnMesh;
+    
+    m_Density.resize(n * n * n);
+    m_Spectrum.resize(n * n * m_FFT.width());
+    m_Order.resize(nbodies);
+    
+    std::cout
+    << ">> N-body Simulation: Particle-mesh with a "
+    << mnMesh
+    << "^3 mesh ("
+    << ((mnAssignment == eAssignmentTSC) ? "TSC" : "CIC")
+    << ")"
+    << std::endl;
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::ParticleMesh::~ParticleMesh()
+{
+    stop();
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+// Without a box size in the parameters, the box is fitted once to the
+// initial bodies and then stays fixed
+GLint NBody::Simulation::ParticleMesh::reset()
+{
+    GLint err = CPU::reset();
+    
+    if((err == 0) && (m_ActiveParams.mnBoxSize <= 0.0f))
+    {
+        GLfloat nExtent = 0.0f;
+        size_t  i;
+        
+        for(i = 0; i < (4 * mnBodyCount); ++i)
+        {
+            if((i & 3) != 3)
+            {
+                nExtent = std::max(nExtent, std::abs(mpPosition[i]));
+            } // if
+        } // for
+        
+        mnBox  = (nExtent > 0.0f) ? (2.0f * Mesh::kPadding * nExtent) : 1.0f;
+        mnCell = mnBox / GLfloat(mnMesh);
+    } // if
+    
+    boundary();
+    
+    return err;
+} // reset
+
+#pragma mark -
+#pragma mark Protected - Utilities
+
+void NBody::Simulation::ParticleMesh::mesh(const GLfloat& nSplit)
+{
+    bin();
+    assign();
+    solve(nSplit);
+    interpolate();
+} // mesh
+
+void NBody::Simulation::ParticleMesh::accelerate()
+{
+    mesh(0.0f);
+    
+    // No pairwise sums on a mesh, so count one update per active body
+    mnInteractions = GLdouble(mnMaxIndex - mnMinIndex);
+} // accelerate
+
+bool NBody::Simulation::ParticleMesh::jerk()
+{
+    return false;
+} // jerk
+
+void NBody::Simulation::ParticleMesh::measure()
+{
+} // measure
+
+void NBody::Simulation::ParticleMesh::boundary()
+{
+    const GLfloat nBox     = mnBox;
+    const GLfloat nInvBox  = 1.0f / mnBox;
+    const GLfloat nHalfBox = 0.5f * mnBox;
+    
+    parallel(0, mnBodyCount, kGrainSize, [=](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            for(k = 0; k < 3; ++k)
+            {
+                GLfloat& x = mpPosition[4 * i + k];
+                
+                x -= nBox * std::floor((x + nHalfBox) * nInvBox);
+                
+                // Rounding can leave x exactly on the upper face
+                if(x >= nHalfBox)
+                {
+                    x -= nBox;
+                } // if
+            } // for
+        } // for
+    });
+} // boundary
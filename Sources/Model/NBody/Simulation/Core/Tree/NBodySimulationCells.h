@@ -0,0 +1,78 @@
+/*
+     File: NBodySimulationCells.h
+ Abstract:
+ Utility class for binning the bodies of an n-body simulation into a
+ uniform grid of cells, for short range forces within a cutoff.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_CELLS_H_
+#define _NBODY_SIMULATION_CELLS_H_
+
+#import <vector>
+
+#import <OpenGL/OpenGL.h>
+
+#import "NBodySimulationDispatch.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class Cells
+        {
+        public:
+            Cells(const size_t& nBodies);
+            
+            virtual ~Cells();
+            
+            // Bin positions stored as float4 into cubic cells no smaller
+            // than the cutoff, with a counting sort, so that every pair
+            // within the cutoff is in the same or in adjacent cells
+            void build(const GLfloat * const pPosition,
+                       const GLfloat& nCutoff,
+                       const Dispatch& rDispatch);
+            
+            // Add the short range accelerations of the bodies [nBegin,
+            // nEnd), from every body within the cutoff, as float4
+            void accelerate(const GLfloat * const pPosition,
+                            const size_t& nBegin,
+                            const size_t& nEnd,
+                            const GLfloat& nSoftening,
+                            GLfloat *pAcceleration) const;
+            
+            // Ranges of index() that hold the bodies in the cells around
+            // body i, one per row of adjacent cells, and their count
+            size_t rows(const size_t& i,
+                        GLuint *pFirst,
+                        GLuint *pLast) const;
+            
+            // Bodies sorted by cell
+            const GLuint *index() const;
+            
+        private:
+            void bound(const GLfloat * const pPosition,
+                       const Dispatch& rDispatch);
+            
+            GLuint cell(const GLfloat * const pPosition) const;
+            
+        private:
+            size_t               mnBodies;
+            GLfloat              mnCutoff;
+            GLfloat              m_Origin[3];
+            GLfloat              mnInvSide;
+            GLuint               m_Dims[3];
+            std::vector<GLuint>  m_Cell;
+            std::vector<GLuint>  m_Start;
+            std::vector<GLuint>  m_Index;
+        }; // Cells
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
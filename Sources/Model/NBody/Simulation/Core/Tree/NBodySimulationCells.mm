@@ -0,0 +1,298 @@
+/*
+     File: NBodySimulationCells.mm
+ Abstract:
+ Utility class for binning the bodies of an n-body simulation into a
+ uniform grid of cells, for short range forces within a cutoff.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <cfloat>
+#import <cmath>
+
+#import "NBodySimulationCells.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Most cells along an axis. Past this the cells grow beyond the cutoff,
+// which costs more pairs but never misses one.
+static const GLuint kCellsMax = 64;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Short range term of ComputeShortForce in nbody_gpu.ocl. The repulsive
+// pair force of ComputeDarkForce, tapered to zero at the cutoff.
+static inline void NBodySimulationCellsForce(const GLfloat * const pSource,
+                                             const GLfloat * const pSink,
+                                             const GLfloat& nCutoffSq,
+                                             const GLfloat& nSofteningSq,
+                                             GLfloat *pForce)
+{
+    const GLfloat dx = pSink[0] - pSource[0];
+    const GLfloat dy = pSink[1] - pSource[1];
+    const GLfloat dz = pSink[2] - pSource[2];
+    
+    const GLfloat r2 = dx * dx + dy * dy + dz * dz;
+    
+    if(r2 < nCutoffSq)
+    {
+        const GLfloat r = 1.0f / std::sqrt(r2 + nSofteningSq);
+        const GLfloat t = 1.0f - r2 / nCutoffSq;
+        const GLfloat s = pSource[3] * r * r * r * t * t;
+        
+        pForce[0] += dx * s;
+        pForce[1] += dy * s;
+        pForce[2] += dz * s;
+    } // if
+} // NBodySimulationCellsForce
+
+void NBody::Simulation::Cells::bound(const GLfloat * const pPosition,
+                                     const Dispatch& rDispatch)
+{
+    const size_t nRanges = rDispatch.threads();
+    
+    std::vector<GLfloat> lo(3 * nRanges,  FLT_MAX);
+    std::vector<GLfloat> hi(3 * nRanges, -FLT_MAX);
+    
+    const size_t nGrain = (mnBodies + nRanges - 1) / nRanges;
+    
+    rDispatch.apply(0, mnBodies, nGrain, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        const size_t r = nBegin / nGrain;
+        
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            for(k = 0; k < 3; ++k)
+            {
+                lo[3 * r + k] = std::min(lo[3 * r + k], pPosition[4 * i + k]);
+                hi[3 * r + k] = std::max(hi[3 * r + k], pPosition[4 * i + k]);
+            } // for
+        } // for
+    });
+    
+    GLfloat nMin[3] = { FLT_MAX,  FLT_MAX,  FLT_MAX};
+    GLfloat nMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    
+    size_t r;
+    size_t k;
+    
+    for(r = 0; r < nRanges; ++r)
+    {
+        for(k = 0; k < 3; ++k)
+        {
+            nMin[k] = std::min(nMin[k], lo[3 * r + k]);
+            nMax[k] = std::max(nMax[k], hi[3 * r + k]);
+        } // for
+    } // for
+    
+    const GLfloat nExtent = std::max(nMax[0] - nMin[0], std::max(nMax[1] - nMin[1], nMax[2] - nMin[2]));
+    
+    // Cubic cells, of the cutoff or of the extent over the most cells
+    const GLfloat nSide = std::max(mnCutoff, nExtent / GLfloat(kCellsMax));
+    
+    mnInvSide = 1.0f / nSide;
+    
+    for(k = 0; k < 3; ++k)
+    {
+        m_Origin[k] = nMin[k];
+        m_Dims[k]   = std::min(GLuint((nMax[k] - nMin[k]) * mnInvSide) + 1, kCellsMax);
+    } // for
+} // bound
+
+GLuint NBody::Simulation::Cells::cell(const GLfloat * const pPosition) const
+{
+    GLuint c[3];
+    
+    size_t k;
+    
+    for(k = 0; k < 3; ++k)
+    {
+        const GLfloat x = (pPosition[k] - m_Origin[k]) * mnInvSide;
+        
+        c[k] = std::min(GLuint(std::max(x, 0.0f)), m_Dims[k] - 1);
+    } // for
+    
+    return (c[2] * m_Dims[1] + c[1]) * m_Dims[0] + c[0];
+} // cell
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Cells::Cells(const size_t& nBodies)
+{
+    mnBodies  = nBodies;
+    mnCutoff  = 1.0f;
+    mnInvSide = 1.0f;
+    
+    m_Origin[0] = 0.0f;
+    m_Origin[1] = 0.0f;
+    m_Origin[2] = 0.0f;
+    
+    m_Dims[0] = 1;
+    m_Dims[1] = 1;
+    m_Dims[2] = 1;
+    
+    m_Cell.resize(mnBodies);
+    m_Index.resize(mnBodies);
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Cells::~Cells()
+{
+    mnBodies = 0;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+// The cell of each body in parallel, then a counting sort, serial since
+// a pass over the bodies is cheap next to the force evaluation
+void NBody::Simulation::Cells::build(const GLfloat * const pPosition,
+                                     const GLfloat& nCutoff,
+                                     const Dispatch& rDispatch)
+{
+    if((pPosition == NULL) || (mnBodies == 0) || (nCutoff <= 0.0f))
+    {
+        return;
+    } // if
+    
+    mnCutoff = nCutoff;
+    
+    bound(pPosition, rDispatch);
+    
+    rDispatch.apply(0, mnBodies, 1024, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            m_Cell[i] = cell(pPosition + 4 * i);
+        } // for
+    });
+    
+    const size_t nCells = size_t(m_Dims[0]) * size_t(m_Dims[1]) * size_t(m_Dims[2]);
+    
+    m_Start.assign(nCells + 1, 0);
+    
+    size_t i;
+    size_t c;
+    
+    for(i = 0; i < mnBodies; ++i)
+    {
+        ++m_Start[m_Cell[i] + 1];
+    } // for
+    
+    for(c = 0; c < nCells; ++c)
+    {
+        m_Start[c + 1] += m_Start[c];
+    } // for
+    
+    // Filled from the end of each cell, which leaves the start of cell c
+    // in m_Start[c + 1], and keeps the bodies of a cell in order
+    for(i = mnBodies; i > 0; --i)
+    {
+        m_Index[--m_Start[m_Cell[i - 1] + 1]] = GLuint(i - 1);
+    } // for
+    
+    for(c = 0; c < nCells; ++c)
+    {
+        m_Start[c] = m_Start[c + 1];
+    } // for
+    
+    m_Start[nCells] = GLuint(mnBodies);
+} // build
+
+void NBody::Simulation::Cells::accelerate(const GLfloat * const pPosition,
+                                          const size_t& nBegin,
+                                          const size_t& nEnd,
+                                          const GLfloat& nSoftening,
+                                          GLfloat *pAcceleration) const
+{
+    const GLfloat nCutoffSq    = mnCutoff * mnCutoff;
+    const GLfloat nSofteningSq = nSoftening * nSoftening;
+    
+    GLuint first[9];
+    GLuint last[9];
+    
+    size_t i;
+    size_t j;
+    size_t r;
+    
+    for(i = nBegin; i < nEnd; ++i)
+    {
+        const GLfloat *pSink = pPosition + 4 * i;
+        
+        const size_t nRows = rows(i, first, last);
+        
+        GLfloat force[3] = {0.0f, 0.0f, 0.0f};
+        
+        for(r = 0; r < nRows; ++r)
+        {
+            for(j = first[r]; j < last[r]; ++j)
+            {
+                if(m_Index[j] != i)
+                {
+                    NBodySimulationCellsForce(pPosition + 4 * m_Index[j], pSink, nCutoffSq, nSofteningSq, force);
+                } // if
+            } // for
+        } // for
+        
+        pAcceleration[4 * i + 0] += force[0];
+        pAcceleration[4 * i + 1] += force[1];
+        pAcceleration[4 * i + 2] += force[2];
+    } // for
+} // accelerate
+
+size_t NBody::Simulation::Cells::rows(const size_t& i,
+                                      GLuint *pFirst,
+                                      GLuint *pLast) const
+{
+    const GLint nDims[3] = {GLint(m_Dims[0]), GLint(m_Dims[1]), GLint(m_Dims[2])};
+    
+    const GLuint nCell = m_Cell[i];
+    
+    const GLint c[3] =
+    {
+        GLint(nCell % m_Dims[0]),
+        GLint((nCell / m_Dims[0]) % m_Dims[1]),
+        GLint(nCell / (m_Dims[0] * m_Dims[1]))
+    };
+    
+    size_t nRows = 0;
+    
+    GLint y;
+    GLint z;
+    
+    for(z = std::max(c[2] - 1, 0); z <= std::min(c[2] + 1, nDims[2] - 1); ++z)
+    {
+        for(y = std::max(c[1] - 1, 0); y <= std::min(c[1] + 1, nDims[1] - 1); ++y)
+        {
+            // The cells of a row along x are contiguous in the sort
+            const GLuint nRow = GLuint((z * nDims[1] + y) * nDims[0]);
+            
+            pFirst[nRows] = m_Start[nRow + GLuint(std::max(c[0] - 1, 0))];
+            pLast[nRows]  = m_Start[nRow + GLuint(std::min(c[0] + 1, nDims[0] - 1)) + 1];
+            
+            ++nRows;
+        } // for
+    } // for
+    
+    return nRows;
+} // rows
+
+const GLuint *NBody::Simulation::Cells::index() const
+{
+    return m_Index.data();
+} // index
@@ -0,0 +1,110 @@
+/*
+     File: NBodySimulationExpansion.h
+ Abstract: 
+ Utility class for Cartesian Taylor expansions of the softened gravitational
+ potential, up to a given order, as used by the fast multipole method.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_EXPANSION_H_
+#define _NBODY_SIMULATION_EXPANSION_H_
+
+#import <vector>
+
+#import <OpenGL/OpenGL.h>
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class Expansion
+        {
+        public:
+            // Expansions carry every multi-index k with |k| <= order
+            Expansion(const GLuint& nOrder);
+            
+            virtual ~Expansion();
+            
+            // Number of coefficients in an expansion
+            const size_t& size()  const;
+            const GLuint& order() const;
+            
+            // Accumulate the raw moments, sum of m (x - z)^k, of float4
+            // bodies with the mass in w about the centre z
+            void moments(const GLfloat * const pPosition,
+                         const size_t& nCount,
+                         const GLdouble * const pCenter,
+                         GLdouble *pMoments) const;
+            
+            // Accumulate moments about a child centre into those about a
+            // parent centre, where d is the child centre less the parent's
+            void shiftMoments(const GLdouble * const pMoments,
+                              const GLdouble * const d,
+                              GLdouble *pResult) const;
+            
+            // Accumulate into the local expansion of a sink cell the field
+            // of the moments of a source cell, where R is the sink centre
+            // less the source centre, for the Plummer softened potential
+            void interact(const GLdouble * const pMoments,
+                          const GLdouble * const R,
+                          const GLdouble& nSofteningSq,
+                          GLdouble *pLocal) const;
+            
+            // Accumulate a local expansion about a parent centre into one
+            // about a child centre, where d is the child centre less the
+            // parent's
+            void shiftLocal(const GLdouble * const pLocal,
+                            const GLdouble * const d,
+                            GLdouble *pResult) const;
+            
+            // Acceleration, the gradient of the local expansion, at the
+            // offset u from its centre
+            void evaluate(const GLdouble * const pLocal,
+                          const GLdouble * const u,
+                          GLdouble *pAcceleration) const;
+                          
+        private:
+            struct Recurrence
+            {
+                GLuint   mnLower[6];    // Index of k - e_i and k - 2e_i, or of a zero slot
+                GLdouble mnScale[2];    // (2|k| - 1) / |k| and (|k| - 1) / |k|
+            }; // Recurrence
+            
+            struct Term
+            {
+                GLuint   mnTarget;
+                GLuint   mnSource;
+                GLuint   mnPower;
+                GLdouble mnCoefficient;
+            }; // Term
+            
+            void powers(const GLdouble * const d,
+                        GLdouble *pPowers) const;
+            
+            void derivatives(const GLdouble * const R,
+                             const GLdouble& nSofteningSq,
+                             GLdouble *pDerivatives) const;
+                             
+        private:
+            GLuint                  mnOrder;
+            size_t                  mnSize;
+            std::vector<GLuint>     m_Index[3];    // Exponents of each multi-index
+            std::vector<GLint>      m_Lower[3];    // Index of k - e_i, or -1
+            std::vector<GLint>      m_Upper[3];    // Index of k + e_i, or -1
+            std::vector<Recurrence> m_Recurrence;  // Derivative recurrence of each multi-index
+            std::vector<Term>       m_Shift;       // Binomial terms for both shifts
+            std::vector<GLdouble>   m_Factorial;   // k! of each multi-index
+            std::vector<GLdouble>   m_Reciprocal;  // 1 / k! of each multi-index
+            std::vector<GLuint>     m_Prefix;      // Targets of the moment to local map for each source
+            std::vector<GLuint>     m_Interact;    // Index of a + b for each source a and target b
+        }; // Expansion
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
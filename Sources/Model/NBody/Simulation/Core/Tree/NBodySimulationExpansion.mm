@@ -0,0 +1,399 @@
+/*
+     File: NBodySimulationExpansion.mm
+ Abstract: 
+ Utility class for Cartesian Taylor expansions of the softened gravitational
+ potential, up to a given order, as used by the fast multipole method.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <cmath>
+
+#import "NBodyConstants.h"
+
+#import "NBodySimulationExpansion.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Coefficients of an expansion of the highest supported order
+static const size_t kExpansionSizeMax = (NBody::Tree::kExpansionOrderMax + 1)
+                                      * (NBody::Tree::kExpansionOrderMax + 2)
+                                      * (NBody::Tree::kExpansionOrderMax + 3) / 6;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+static GLdouble NBodySimulationExpansionFactorial(const GLuint& n)
+{
+    GLdouble f = 1.0;
+    GLuint   i;
+    
+    for(i = 2; i <= n; ++i)
+    {
+        f *= GLdouble(i);
+    } // for
+    
+    return f;
+} // NBodySimulationExpansionFactorial
+
+static GLdouble NBodySimulationExpansionBinomial(const GLuint& n,
+                                                 const GLuint& k)
+{
+    GLdouble c = 1.0;
+    GLuint   i;
+    
+    for(i = 1; i <= k; ++i)
+    {
+        c = c * GLdouble(n - k + i) / GLdouble(i);
+    } // for
+    
+    return c;
+} // NBodySimulationExpansionBinomial
+
+// Powers d^k of an offset for every multi-index, each from the one
+// below it along its first non-zero axis
+void NBody::Simulation::Expansion::powers(const GLdouble * const d,
+                                          GLdouble *pPowers) const
+{
+    pPowers[0] = 1.0;
+    
+    size_t t;
+    
+    for(t = 1; t < mnSize; ++t)
+    {
+        const GLuint a = (m_Index[0][t] > 0) ? 0 : ((m_Index[1][t] > 0) ? 1 : 2);
+        
+        pPowers[t] = pPowers[m_Lower[a][t]] * d[a];
+    } // for
+} // powers
+
+// Taylor coefficients D^k G(R) / k! of the softened kernel
+// G = (|R|^2 + eps^2)^(-1/2), by the recurrence of Lindsay and Krasny:
+// |k| r^2 a_k + (2|k| - 1) sum R_i a_(k-e_i) + (|k| - 1) sum a_(k-2e_i) = 0.
+// Missing lower terms read the zero slot past the end, so the loop has
+// no branches.
+void NBody::Simulation::Expansion::derivatives(const GLdouble * const R,
+                                               const GLdouble& nSofteningSq,
+                                               GLdouble *pDerivatives) const
+{
+    const GLdouble x = R[0];
+    const GLdouble y = R[1];
+    const GLdouble z = R[2];
+    
+    const GLdouble nInvR2 = 1.0 / (x * x + y * y + z * z + nSofteningSq);
+    
+    pDerivatives[0]      = std::sqrt(nInvR2);
+    pDerivatives[mnSize] = 0.0;
+    
+    size_t t;
+    
+    for(t = 1; t < mnSize; ++t)
+    {
+        const Recurrence& rStep = m_Recurrence[t];
+        
+        const GLdouble s1 = x * pDerivatives[rStep.mnLower[0]]
+                          + y * pDerivatives[rStep.mnLower[1]]
+                          + z * pDerivatives[rStep.mnLower[2]];
+        
+        const GLdouble s2 = pDerivatives[rStep.mnLower[3]]
+                          + pDerivatives[rStep.mnLower[4]]
+                          + pDerivatives[rStep.mnLower[5]];
+        
+        pDerivatives[t] = -(rStep.mnScale[0] * s1 + rStep.mnScale[1] * s2) * nInvR2;
+    } // for
+} // derivatives
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Expansion::Expansion(const GLuint& nOrder)
+{
+    mnOrder = std::min(std::max(nOrder, GLuint(1)), NBody::Tree::kExpansionOrderMax);
+    
+    const GLuint p = mnOrder;
+    const GLuint w = p + 1;
+    
+    // Multi-indices by increasing total order
+    std::vector<GLint> table(w * w * w, -1);
+    
+    GLuint n;
+    GLuint i;
+    GLuint j;
+    GLuint a;
+    
+    for(n = 0; n <= p; ++n)
+    {
+        for(i = n + 1; i-- > 0;)
+        {
+            for(j = n - i + 1; j-- > 0;)
+            {
+                table[(i * w + j) * w + (n - i - j)] = GLint(m_Index[0].size());
+                
+                m_Index[0].push_back(i);
+                m_Index[1].push_back(j);
+                m_Index[2].push_back(n - i - j);
+            } // for
+        } // for
+    } // for
+    
+    mnSize = m_Index[0].size();
+    
+    auto index = [&](const GLint& x, const GLint& y, const GLint& z) -> GLint
+    {
+        return ((x < 0) || (y < 0) || (z < 0) || ((x + y + z) > GLint(p)))
+        ? -1
+        : table[(x * w + y) * w + z];
+    };
+    
+    size_t t;
+    size_t s;
+    
+    m_Recurrence.resize(mnSize);
+    
+    for(a = 0; a < 3; ++a)
+    {
+        m_Lower[a].resize(mnSize);
+        m_Upper[a].resize(mnSize);
+    } // for
+    
+    for(t = 0; t < mnSize; ++t)
+    {
+        const GLint k[3] = {GLint(m_Index[0][t]), GLint(m_Index[1][t]), GLint(m_Index[2][t])};
+        
+        const GLdouble n = GLdouble(k[0] + k[1] + k[2]);
+        
+        Recurrence& rStep = m_Recurrence[t];
+        
+        rStep.mnScale[0] = (n > 0.0) ? ((2.0 * n - 1.0) / n) : 0.0;
+        rStep.mnScale[1] = (n > 0.0) ? ((n - 1.0) / n)       : 0.0;
+        
+        for(a = 0; a < 3; ++a)
+        {
+            const GLint e[3] = {a == 0, a == 1, a == 2};
+            
+            const GLint nLower = index(k[0] - 2 * e[0], k[1] - 2 * e[1], k[2] - 2 * e[2]);
+            
+            m_Lower[a][t] = index(k[0] - e[0], k[1] - e[1], k[2] - e[2]);
+            m_Upper[a][t] = index(k[0] + e[0], k[1] + e[1], k[2] + e[2]);
+            
+            rStep.mnLower[a]     = (m_Lower[a][t] >= 0) ? GLuint(m_Lower[a][t]) : GLuint(mnSize);
+            rStep.mnLower[3 + a] = (nLower        >= 0) ? GLuint(nLower)        : GLuint(mnSize);
+        } // for
+    } // for
+    
+    // Shift terms C(k, l) d^(k - l) for every l <= k
+    for(t = 0; t < mnSize; ++t)
+    {
+        for(s = 0; s < mnSize; ++s)
+        {
+            if(   (m_Index[0][s] <= m_Index[0][t])
+               && (m_Index[1][s] <= m_Index[1][t])
+               && (m_Index[2][s] <= m_Index[2][t]))
+            {
+                Term term;
+                
+                term.mnTarget = GLuint(t);
+                term.mnSource = GLuint(s);
+                term.mnPower  = GLuint(index(m_Index[0][t] - m_Index[0][s],
+                                             m_Index[1][t] - m_Index[1][s],
+                                             m_Index[2][t] - m_Index[2][s]));
+                
+                term.mnCoefficient = NBodySimulationExpansionBinomial(m_Index[0][t], m_Index[0][s])
+                                   * NBodySimulationExpansionBinomial(m_Index[1][t], m_Index[1][s])
+                                   * NBodySimulationExpansionBinomial(m_Index[2][t], m_Index[2][s]);
+                
+                m_Shift.push_back(term);
+            } // if
+        } // for
+    } // for
+    
+    // Moment to local map, truncated to a total order of p. With the
+    // scaled terms M'_a = (-1)^|a| M_a / a! and D'_g = g! a_g(R), each
+    // local coefficient is L_b = (1 / b!) sum D'_(a+b) M'_a. For a given
+    // a the targets b are all those of order at most p - |a|, which is
+    // a prefix of the multi-indices, so the inner loop is contiguous.
+    m_Factorial.resize(mnSize);
+    m_Reciprocal.resize(mnSize);
+    
+    for(t = 0; t < mnSize; ++t)
+    {
+        const GLdouble f = NBodySimulationExpansionFactorial(m_Index[0][t])
+                         * NBodySimulationExpansionFactorial(m_Index[1][t])
+                         * NBodySimulationExpansionFactorial(m_Index[2][t]);
+        
+        m_Factorial[t]  = f;
+        m_Reciprocal[t] = 1.0 / f;
+    } // for
+    
+    for(s = 0; s < mnSize; ++s)
+    {
+        const GLuint nDegree = m_Index[0][s] + m_Index[1][s] + m_Index[2][s];
+        
+        const GLuint q = p - nDegree;
+        
+        m_Prefix.push_back((q + 1) * (q + 2) * (q + 3) / 6);
+        
+        for(t = 0; t < m_Prefix.back(); ++t)
+        {
+            m_Interact.push_back(GLuint(index(m_Index[0][t] + m_Index[0][s],
+                                              m_Index[1][t] + m_Index[1][s],
+                                              m_Index[2][t] + m_Index[2][s])));
+        } // for
+    } // for
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Expansion::~Expansion()
+{
+    mnSize = 0;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Accessors
+
+const size_t& NBody::Simulation::Expansion::size() const
+{
+    return mnSize;
+} // size
+
+const GLuint& NBody::Simulation::Expansion::order() const
+{
+    return mnOrder;
+} // order
+
+#pragma mark -
+#pragma mark Public - Operators
+
+void NBody::Simulation::Expansion::moments(const GLfloat * const pPosition,
+                                           const size_t& nCount,
+                                           const GLdouble * const pCenter,
+                                           GLdouble *pMoments) const
+{
+    GLdouble pw[kExpansionSizeMax];
+    GLdouble d[3];
+    
+    size_t i;
+    size_t t;
+    
+    for(i = 0; i < nCount; ++i)
+    {
+        const GLdouble m = pPosition[4 * i + 3];
+        
+        d[0] = pPosition[4 * i + 0] - pCenter[0];
+        d[1] = pPosition[4 * i + 1] - pCenter[1];
+        d[2] = pPosition[4 * i + 2] - pCenter[2];
+        
+        powers(d, pw);
+        
+        for(t = 0; t < mnSize; ++t)
+        {
+            pMoments[t] += m * pw[t];
+        } // for
+    } // for
+} // moments
+
+void NBody::Simulation::Expansion::shiftMoments(const GLdouble * const pMoments,
+                                                const GLdouble * const d,
+                                                GLdouble *pResult) const
+{
+    GLdouble pw[kExpansionSizeMax];
+    
+    powers(d, pw);
+    
+    for(const Term& term : m_Shift)
+    {
+        pResult[term.mnTarget] += term.mnCoefficient * pw[term.mnPower] * pMoments[term.mnSource];
+    } // for
+} // shiftMoments
+
+void NBody::Simulation::Expansion::interact(const GLdouble * const pMoments,
+                                            const GLdouble * const R,
+                                            const GLdouble& nSofteningSq,
+                                            GLdouble *pLocal) const
+{
+    GLdouble D[kExpansionSizeMax + 1];
+    GLdouble L[kExpansionSizeMax];
+    
+    derivatives(R, nSofteningSq, D);
+    
+    size_t t;
+    size_t s;
+    
+    for(t = 0; t < mnSize; ++t)
+    {
+        D[t] *= m_Factorial[t];
+        L[t]  = 0.0;
+    } // for
+    
+    const GLuint *pPower = m_Interact.data();
+    
+    for(s = 0; s < mnSize; ++s)
+    {
+        const GLuint nDegree = m_Index[0][s] + m_Index[1][s] + m_Index[2][s];
+        
+        const GLdouble m = ((nDegree & 1) ? -m_Reciprocal[s] : m_Reciprocal[s]) * pMoments[s];
+        
+        const GLuint nPrefix = m_Prefix[s];
+        
+        for(t = 0; t < nPrefix; ++t)
+        {
+            L[t] += D[pPower[t]] * m;
+        } // for
+        
+        pPower += nPrefix;
+    } // for
+    
+    for(t = 0; t < mnSize; ++t)
+    {
+        pLocal[t] += L[t] * m_Reciprocal[t];
+    } // for
+} // interact
+
+void NBody::Simulation::Expansion::shiftLocal(const GLdouble * const pLocal,
+                                              const GLdouble * const d,
+                                              GLdouble *pResult) const
+{
+    GLdouble pw[kExpansionSizeMax];
+    
+    powers(d, pw);
+    
+    for(const Term& term : m_Shift)
+    {
+        pResult[term.mnSource] += term.mnCoefficient * pw[term.mnPower] * pLocal[term.mnTarget];
+    } // for
+} // shiftLocal
+
+void NBody::Simulation::Expansion::evaluate(const GLdouble * const pLocal,
+                                            const GLdouble * const u,
+                                            GLdouble *pAcceleration) const
+{
+    GLdouble pw[kExpansionSizeMax];
+    
+    powers(u, pw);
+    
+    pAcceleration[0] = 0.0;
+    pAcceleration[1] = 0.0;
+    pAcceleration[2] = 0.0;
+    
+    size_t t;
+    GLuint a;
+    
+    for(t = 0; t < mnSize; ++t)
+    {
+        for(a = 0; a < 3; ++a)
+        {
+            if(m_Upper[a][t] >= 0)
+            {
+                pAcceleration[a] += GLdouble(m_Index[a][t] + 1) * pLocal[m_Upper[a][t]] * pw[t];
+            } // if
+        } // for
+    } // for
+} // evaluate
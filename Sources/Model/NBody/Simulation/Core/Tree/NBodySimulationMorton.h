@@ -0,0 +1,75 @@
+/*
+     File: NBodySimulationMorton.h
+ Abstract: 
+ Utility class for sorting the bodies of an n-body simulation by their
+ 3D Morton keys, with a parallel radix sort.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_MORTON_H_
+#define _NBODY_SIMULATION_MORTON_H_
+
+#import <cstdint>
+#import <vector>
+
+#import <OpenGL/OpenGL.h>
+
+#import "NBodySimulationDispatch.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class Morton
+        {
+        public:
+            // Bits per axis of a key, and so the deepest level of an octree
+            static const GLuint kBits = 21;
+            
+        public:
+            Morton(const size_t& nBodies);
+            
+            virtual ~Morton();
+            
+            // Fit a cube to positions stored as float4, and sort the
+            // bodies by the Morton keys of their positions in it
+            void sort(const GLfloat * const pPosition,
+                      const Dispatch& rDispatch);
+            
+            // Keys in ascending order, and the body of each key
+            const uint64_t *keys()  const;
+            const GLuint   *index() const;
+            
+            // Lowest corner and side of the cube
+            const GLfloat *origin() const;
+            const GLfloat& extent() const;
+            
+            const size_t& size() const;
+            
+        private:
+            void bound(const GLfloat * const pPosition,
+                       const Dispatch& rDispatch);
+            
+            void encode(const GLfloat * const pPosition,
+                        const Dispatch& rDispatch);
+            
+            void radix(const Dispatch& rDispatch);
+            
+        private:
+            size_t                 mnBodies;
+            GLfloat                m_Origin[3];
+            GLfloat                mnExtent;
+            std::vector<uint64_t>  m_Keys[2];
+            std::vector<GLuint>    m_Index[2];
+            std::vector<size_t>    m_Counts;
+        }; // Morton
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
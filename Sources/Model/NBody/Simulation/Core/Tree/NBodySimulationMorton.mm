@@ -0,0 +1,274 @@
+/*
+     File: NBodySimulationMorton.mm
+ Abstract: 
+ Utility class for sorting the bodies of an n-body simulation by their
+ 3D Morton keys, with a parallel radix sort.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <cfloat>
+
+#import "NBodySimulationMorton.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Bits of the key sorted by each pass of the radix sort
+static const GLuint kRadixBits = 8;
+
+static const size_t kRadixSize = size_t(1) << kRadixBits;
+
+#pragma mark -
+#pragma mark Private - Class Constants
+
+const GLuint NBody::Simulation::Morton::kBits;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Interleave the low 21 bits of v with two zero bits between each
+static uint64_t NBodySimulationMortonSpread(const uint64_t& v)
+{
+    uint64_t x = v & 0x1fffff;
+    
+    x = (x | (x << 32)) & 0x001f00000000ffffull;
+    x = (x | (x << 16)) & 0x001f0000ff0000ffull;
+    x = (x | (x <<  8)) & 0x100f00f00f00f00full;
+    x = (x | (x <<  4)) & 0x10c30c30c30c30c3ull;
+    x = (x | (x <<  2)) & 0x1249249249249249ull;
+    
+    return x;
+} // NBodySimulationMortonSpread
+
+void NBody::Simulation::Morton::bound(const GLfloat * const pPosition,
+                                      const Dispatch& rDispatch)
+{
+    const size_t nRanges = rDispatch.threads();
+    
+    std::vector<GLfloat> lo(3 * nRanges,  FLT_MAX);
+    std::vector<GLfloat> hi(3 * nRanges, -FLT_MAX);
+    
+    const size_t nGrain = (mnBodies + nRanges - 1) / nRanges;
+    
+    rDispatch.apply(0, mnBodies, nGrain, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        const size_t r = nBegin / nGrain;
+        
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            for(k = 0; k < 3; ++k)
+            {
+                lo[3 * r + k] = std::min(lo[3 * r + k], pPosition[4 * i + k]);
+                hi[3 * r + k] = std::max(hi[3 * r + k], pPosition[4 * i + k]);
+            } // for
+        } // for
+    });
+    
+    GLfloat nMin[3] = { FLT_MAX,  FLT_MAX,  FLT_MAX};
+    GLfloat nMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    
+    size_t r;
+    size_t k;
+    
+    for(r = 0; r < nRanges; ++r)
+    {
+        for(k = 0; k < 3; ++k)
+        {
+            nMin[k] = std::min(nMin[k], lo[3 * r + k]);
+            nMax[k] = std::max(nMax[k], hi[3 * r + k]);
+        } // for
+    } // for
+    
+    mnExtent = std::max(nMax[0] - nMin[0], std::max(nMax[1] - nMin[1], nMax[2] - nMin[2]));
+    
+    // Pad the cube so that the largest coordinate quantizes inside it
+    mnExtent = (mnExtent > 0.0f) ? (1.0001f * mnExtent) : 1.0f;
+    
+    for(k = 0; k < 3; ++k)
+    {
+        m_Origin[k] = 0.5f * (nMin[k] + nMax[k]) - 0.5f * mnExtent;
+    } // for
+} // bound
+
+void NBody::Simulation::Morton::encode(const GLfloat * const pPosition,
+                                       const Dispatch& rDispatch)
+{
+    const GLfloat nLimit = GLfloat(1u << kBits) - 1.0f;
+    const GLfloat nScale = GLfloat(1u << kBits) / mnExtent;
+    
+    rDispatch.apply(0, mnBodies, 1024, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        uint64_t q[3];
+        
+        size_t i;
+        size_t k;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            for(k = 0; k < 3; ++k)
+            {
+                const GLfloat c = (pPosition[4 * i + k] - m_Origin[k]) * nScale;
+                
+                q[k] = uint64_t(std::min(std::max(c, 0.0f), nLimit));
+            } // for
+            
+            m_Keys[0][i]  = (NBodySimulationMortonSpread(q[0]) << 2) | (NBodySimulationMortonSpread(q[1]) << 1) | NBodySimulationMortonSpread(q[2]);
+            m_Index[0][i] = GLuint(i);
+        } // for
+    });
+} // encode
+
+// Least significant digit first. Each worker counts the digits of its
+// own contiguous range, and then scatters that range to the offsets
+// that the counts give it, which keeps every pass stable. Passes where
+// all keys share the same digit are skipped.
+void NBody::Simulation::Morton::radix(const Dispatch& rDispatch)
+{
+    const size_t nRanges = rDispatch.threads();
+    const size_t nGrain  = (mnBodies + nRanges - 1) / nRanges;
+    
+    m_Counts.resize(nRanges * kRadixSize);
+    
+    GLuint nShift;
+    
+    for(nShift = 0; nShift < (3 * kBits); nShift += kRadixBits)
+    {
+        const uint64_t *pKeys = m_Keys[0].data();
+        
+        std::fill(m_Counts.begin(), m_Counts.end(), 0);
+        
+        rDispatch.apply(0, mnBodies, nGrain, [&](const size_t& nBegin, const size_t& nEnd)
+        {
+            size_t *pCounts = m_Counts.data() + kRadixSize * (nBegin / nGrain);
+            size_t  i;
+            
+            for(i = nBegin; i < nEnd; ++i)
+            {
+                ++pCounts[(pKeys[i] >> nShift) & (kRadixSize - 1)];
+            } // for
+        });
+        
+        // Exclusive prefix over digits, then over ranges within a digit
+        size_t nOffset = 0;
+        size_t d;
+        size_t r;
+        bool   bSorted = false;
+        
+        for(d = 0; d < kRadixSize; ++d)
+        {
+            size_t nDigit = 0;
+            
+            for(r = 0; r < nRanges; ++r)
+            {
+                const size_t nCount = m_Counts[kRadixSize * r + d];
+                
+                m_Counts[kRadixSize * r + d] = nOffset;
+                
+                nOffset += nCount;
+                nDigit  += nCount;
+            } // for
+            
+            bSorted = bSorted || (nDigit == mnBodies);
+        } // for
+        
+        if(bSorted)
+        {
+            continue;
+        } // if
+        
+        rDispatch.apply(0, mnBodies, nGrain, [&](const size_t& nBegin, const size_t& nEnd)
+        {
+            size_t *pCounts = m_Counts.data() + kRadixSize * (nBegin / nGrain);
+            size_t  i;
+            
+            for(i = nBegin; i < nEnd; ++i)
+            {
+                const size_t j = pCounts[(pKeys[i] >> nShift) & (kRadixSize - 1)]++;
+                
+                m_Keys[1][j]  = pKeys[i];
+                m_Index[1][j] = m_Index[0][i];
+            } // for
+        });
+        
+        m_Keys[0].swap(m_Keys[1]);
+        m_Index[0].swap(m_Index[1]);
+    } // for
+} // radix
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Morton::Morton(const size_t& nBodies)
+{
+    mnBodies = nBodies;
+    mnExtent = 1.0f;
+    
+    m_Origin[0] = 0.0f;
+    m_Origin[1] = 0.0f;
+    m_Origin[2] = 0.0f;
+    
+    m_Keys[0].resize(mnBodies);
+    m_Keys[1].resize(mnBodies);
+    
+    m_Index[0].resize(mnBodies);
+    m_Index[1].resize(mnBodies);
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Morton::~Morton()
+{
+    mnBodies = 0;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+void NBody::Simulation::Morton::sort(const GLfloat * const pPosition,
+                                     const Dispatch& rDispatch)
+{
+    if((pPosition != NULL) && (mnBodies > 0))
+    {
+        bound(pPosition, rDispatch);
+        encode(pPosition, rDispatch);
+        radix(rDispatch);
+    } // if
+} // sort
+
+#pragma mark -
+#pragma mark Public - Accessors
+
+const uint64_t *NBody::Simulation::Morton::keys() const
+{
+    return m_Keys[0].data();
+} // keys
+
+const GLuint *NBody::Simulation::Morton::index() const
+{
+    return m_Index[0].data();
+} // index
+
+const GLfloat *NBody::Simulation::Morton::origin() const
+{
+    return m_Origin;
+} // origin
+
+const GLfloat& NBody::Simulation::Morton::extent() const
+{
+    return mnExtent;
+} // extent
+
+const size_t& NBody::Simulation::Morton::size() const
+{
+    return mnBodies;
+} // size
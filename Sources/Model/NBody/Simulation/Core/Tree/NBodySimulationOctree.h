@@ -0,0 +1,96 @@
+/*
+     File: NBodySimulationOctree.h
+ Abstract: 
+ Utility class for building a Morton ordered octree, with monopole and
+ quadrupole moments, over the bodies of an n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_OCTREE_H_
+#define _NBODY_SIMULATION_OCTREE_H_
+
+#import <cstdint>
+#import <vector>
+
+#import <OpenGL/OpenGL.h>
+
+#import "NBodyConstants.h"
+
+#import "NBodySimulationDispatch.h"
+#import "NBodySimulationMorton.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class Octree
+        {
+        public:
+            struct Node
+            {
+                GLfloat  mnCenter[3];   // Geometric centre of the cell
+                GLfloat  mnHalf;        // Half the side length of the cell
+                GLfloat  mnMass[4];     // Centre of mass, with the total mass in w
+                GLfloat  mnQuad[6];     // Traceless quadrupole about the centre of mass (xx, xy, xz, yy, yz, zz)
+                GLfloat  mnOpen;        // Squared distance inside which the cell must be opened
+                GLuint   mnFirst;       // First body of the cell, in Morton order
+                GLuint   mnCount;       // Number of bodies in the cell
+                GLuint   mnChild;       // First child node, or zero for a leaf
+                GLuint   mnChildren;    // Number of child nodes
+                GLuint   mnLevel;       // Depth of the cell, zero for the root
+            }; // Node
+            
+        public:
+            Octree(const size_t& nBodies,
+                   const GLuint& nLeafSize = Tree::kLeafSize);
+            
+            virtual ~Octree();
+            
+            // Rebuild the tree and its moments from positions stored as
+            // float4 with the mass in w. An opening angle of zero opens
+            // every cell, which reduces to a direct sum.
+            void build(const GLfloat * const pPosition,
+                       const GLfloat& nOpeningAngle,
+                       const Dispatch& rDispatch);
+            
+            const std::vector<Node>& nodes() const;
+            
+            // Body indices and float4 positions in Morton order
+            const GLuint  *index()     const;
+            const GLfloat *positions() const;
+            
+            const size_t& size() const;
+            
+        private:
+            void sort(const GLfloat * const pPosition,
+                      const Dispatch& rDispatch);
+            
+            void split(std::vector<Node>& rNodes,
+                       const GLuint& nNode) const;
+            
+            void subtree(std::vector<Node>& rNodes,
+                         const GLuint& nNode) const;
+            
+            void leaf(Node& rNode) const;
+            
+            void combine(std::vector<Node>& rNodes,
+                         const GLuint& nNode) const;
+                         
+        private:
+            size_t             mnBodies;
+            GLuint             mnLeafSize;
+            GLfloat            mnOpeningAngle;
+            Morton             m_Morton;
+            std::vector<Node>  m_Nodes;
+            std::vector<GLfloat> m_Position;
+        }; // Octree
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
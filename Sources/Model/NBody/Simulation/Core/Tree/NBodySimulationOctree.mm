@@ -0,0 +1,456 @@
+/*
+     File: NBodySimulationOctree.mm
+ Abstract: 
+ Utility class for building a Morton ordered octree, with monopole and
+ quadrupole moments, over the bodies of an n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <cfloat>
+#import <cmath>
+#import <cstring>
+
+#import "NBodySimulationOctree.h"
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Octant of a key for the children of a cell at the given level
+static GLuint NBodySimulationOctreeOctant(const uint64_t& key,
+                                          const GLuint& level)
+{
+    return GLuint((key >> (3 * (NBody::Simulation::Morton::kBits - 1 - level))) & 0x7);
+} // NBodySimulationOctreeOctant
+
+void NBody::Simulation::Octree::sort(const GLfloat * const pPosition,
+                                     const Dispatch& rDispatch)
+{
+    m_Morton.sort(pPosition, rDispatch);
+    
+    const GLuint *pIndex = m_Morton.index();
+    
+    rDispatch.apply(0, mnBodies, 1024, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            const GLuint j = pIndex[i];
+            
+            m_Position[4 * i + 0] = pPosition[4 * j + 0];
+            m_Position[4 * i + 1] = pPosition[4 * j + 1];
+            m_Position[4 * i + 2] = pPosition[4 * j + 2];
+            m_Position[4 * i + 3] = pPosition[4 * j + 3];
+        } // for
+    });
+} // sort
+
+// Append the non-empty children of a cell. Bodies of a cell are
+// contiguous in Morton order, so each octant is a sub-range of it.
+void NBody::Simulation::Octree::split(std::vector<Node>& rNodes,
+                                      const GLuint& nNode) const
+{
+    const Node parent = rNodes[nNode];
+    
+    const GLfloat nHalf = 0.5f * parent.mnHalf;
+    
+    GLuint nFirst = parent.mnFirst;
+    GLuint nLast  = parent.mnFirst + parent.mnCount;
+    GLuint nChild = GLuint(rNodes.size());
+    GLuint o;
+    
+    const uint64_t *pKeys = m_Morton.keys();
+    
+    for(o = 0; o < 8; ++o)
+    {
+        const GLuint nEnd = GLuint(std::partition_point(pKeys + nFirst,
+                                                        pKeys + nLast,
+                                                        [&](const uint64_t& key)
+                                                        {
+                                                            return NBodySimulationOctreeOctant(key, parent.mnLevel) <= o;
+                                                        }) - pKeys);
+        
+        if(nEnd > nFirst)
+        {
+            Node child;
+            
+            std::memset(&child, 0x0, sizeof(Node));
+            
+            child.mnCenter[0] = parent.mnCenter[0] + ((o & 4) ? nHalf : -nHalf);
+            child.mnCenter[1] = parent.mnCenter[1] + ((o & 2) ? nHalf : -nHalf);
+            child.mnCenter[2] = parent.mnCenter[2] + ((o & 1) ? nHalf : -nHalf);
+            
+            child.mnHalf  = nHalf;
+            child.mnFirst = nFirst;
+            child.mnCount = nEnd - nFirst;
+            child.mnLevel = parent.mnLevel + 1;
+            
+            rNodes.push_back(child);
+        } // if
+        
+        nFirst = nEnd;
+    } // for
+    
+    rNodes[nNode].mnChild    = nChild;
+    rNodes[nNode].mnChildren = GLuint(rNodes.size()) - nChild;
+} // split
+
+void NBody::Simulation::Octree::subtree(std::vector<Node>& rNodes,
+                                        const GLuint& nNode) const
+{
+    if((rNodes[nNode].mnCount > mnLeafSize) && (rNodes[nNode].mnLevel < Morton::kBits))
+    {
+        split(rNodes, nNode);
+        
+        const GLuint nChild = rNodes[nNode].mnChild;
+        const GLuint nLast  = nChild + rNodes[nNode].mnChildren;
+        
+        GLuint c;
+        
+        for(c = nChild; c < nLast; ++c)
+        {
+            subtree(rNodes, c);
+        } // for
+        
+        combine(rNodes, nNode);
+    } // if
+    else
+    {
+        leaf(rNodes[nNode]);
+    } // else
+} // subtree
+
+void NBody::Simulation::Octree::leaf(Node& rNode) const
+{
+    const GLfloat *pPosition = m_Position.data() + 4 * rNode.mnFirst;
+    
+    GLdouble m = 0.0;
+    GLdouble c[3] = {0.0, 0.0, 0.0};
+    
+    GLuint i;
+    GLuint k;
+    
+    for(i = 0; i < rNode.mnCount; ++i)
+    {
+        const GLdouble w = pPosition[4 * i + 3];
+        
+        m += w;
+        
+        for(k = 0; k < 3; ++k)
+        {
+            c[k] += w * pPosition[4 * i + k];
+        } // for
+    } // for
+    
+    for(k = 0; k < 3; ++k)
+    {
+        rNode.mnMass[k] = (m > 0.0) ? GLfloat(c[k] / m) : rNode.mnCenter[k];
+    } // for
+    
+    rNode.mnMass[3] = GLfloat(m);
+    
+    GLdouble q[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    
+    for(i = 0; i < rNode.mnCount; ++i)
+    {
+        const GLdouble w  = pPosition[4 * i + 3];
+        const GLdouble dx = pPosition[4 * i + 0] - rNode.mnMass[0];
+        const GLdouble dy = pPosition[4 * i + 1] - rNode.mnMass[1];
+        const GLdouble dz = pPosition[4 * i + 2] - rNode.mnMass[2];
+        const GLdouble d2 = dx * dx + dy * dy + dz * dz;
+        
+        q[0] += w * (3.0 * dx * dx - d2);
+        q[1] += w * (3.0 * dx * dy);
+        q[2] += w * (3.0 * dx * dz);
+        q[3] += w * (3.0 * dy * dy - d2);
+        q[4] += w * (3.0 * dy * dz);
+        q[5] += w * (3.0 * dz * dz - d2);
+    } // for
+    
+    for(k = 0; k < 6; ++k)
+    {
+        rNode.mnQuad[k] = GLfloat(q[k]);
+    } // for
+} // leaf
+
+// Moments of a cell from those of its children, shifting each child
+// quadrupole to the parent centre of mass by the parallel axis theorem.
+void NBody::Simulation::Octree::combine(std::vector<Node>& rNodes,
+                                        const GLuint& nNode) const
+{
+    Node& rNode = rNodes[nNode];
+    
+    const GLuint nFirst = rNode.mnChild;
+    const GLuint nLast  = nFirst + rNode.mnChildren;
+    
+    GLdouble m = 0.0;
+    GLdouble c[3] = {0.0, 0.0, 0.0};
+    
+    GLuint i;
+    GLuint k;
+    
+    for(i = nFirst; i < nLast; ++i)
+    {
+        const GLdouble w = rNodes[i].mnMass[3];
+        
+        m += w;
+        
+        for(k = 0; k < 3; ++k)
+        {
+            c[k] += w * rNodes[i].mnMass[k];
+        } // for
+    } // for
+    
+    for(k = 0; k < 3; ++k)
+    {
+        rNode.mnMass[k] = (m > 0.0) ? GLfloat(c[k] / m) : rNode.mnCenter[k];
+    } // for
+    
+    rNode.mnMass[3] = GLfloat(m);
+    
+    GLdouble q[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    
+    for(i = nFirst; i < nLast; ++i)
+    {
+        const Node& rChild = rNodes[i];
+        
+        const GLdouble w  = rChild.mnMass[3];
+        const GLdouble dx = rChild.mnMass[0] - rNode.mnMass[0];
+        const GLdouble dy = rChild.mnMass[1] - rNode.mnMass[1];
+        const GLdouble dz = rChild.mnMass[2] - rNode.mnMass[2];
+        const GLdouble d2 = dx * dx + dy * dy + dz * dz;
+        
+        q[0] += rChild.mnQuad[0] + w * (3.0 * dx * dx - d2);
+        q[1] += rChild.mnQuad[1] + w * (3.0 * dx * dy);
+        q[2] += rChild.mnQuad[2] + w * (3.0 * dx * dz);
+        q[3] += rChild.mnQuad[3] + w * (3.0 * dy * dy - d2);
+        q[4] += rChild.mnQuad[4] + w * (3.0 * dy * dz);
+        q[5] += rChild.mnQuad[5] + w * (3.0 * dz * dz - d2);
+    } // for
+    
+    for(k = 0; k < 6; ++k)
+    {
+        rNode.mnQuad[k] = GLfloat(q[k]);
+    } // for
+} // combine
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::Octree::Octree(const size_t& nBodies,
+                                  const GLuint& nLeafSize)
+: m_Morton(nBodies)
+{
+    mnBodies       = nBodies;
+    mnLeafSize     = (nLeafSize > 0) ? nLeafSize : 1;
+    mnOpeningAngle = Tree::kOpeningAngle;
+    
+    m_Position.resize(4 * mnBodies);
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::Octree::~Octree()
+{
+    mnBodies = 0;
+} // Destructor
+
+#pragma mark -
+#pragma mark Public - Utilities
+
+void NBody::Simulation::Octree::build(const GLfloat * const pPosition,
+                                      const GLfloat& nOpeningAngle,
+                                      const Dispatch& rDispatch)
+{
+    m_Nodes.clear();
+    
+    if((pPosition == NULL) || (mnBodies == 0))
+    {
+        return;
+    } // if
+    
+    mnOpeningAngle = nOpeningAngle;
+    
+    sort(pPosition, rDispatch);
+    
+    const GLfloat *pOrigin = m_Morton.origin();
+    const GLfloat  nExtent = m_Morton.extent();
+    
+    Node root;
+    
+    std::memset(&root, 0x0, sizeof(Node));
+    
+    root.mnCenter[0] = pOrigin[0] + 0.5f * nExtent;
+    root.mnCenter[1] = pOrigin[1] + 0.5f * nExtent;
+    root.mnCenter[2] = pOrigin[2] + 0.5f * nExtent;
+    
+    root.mnHalf  = 0.5f * nExtent;
+    root.mnCount = GLuint(mnBodies);
+    
+    m_Nodes.push_back(root);
+    
+    // Expand the top of the tree breadth first until there are enough
+    // independent subtrees to keep every thread busy
+    const size_t nTarget = 8 * rDispatch.threads();
+    
+    std::vector<GLuint> frontier(1, 0);
+    std::vector<GLuint> next;
+    
+    bool bSplit = true;
+    
+    while(bSplit && (frontier.size() < nTarget))
+    {
+        bSplit = false;
+        
+        next.clear();
+        
+        for(GLuint f : frontier)
+        {
+            if((m_Nodes[f].mnCount > mnLeafSize) && (m_Nodes[f].mnLevel < Morton::kBits))
+            {
+                split(m_Nodes, f);
+                
+                const GLuint nChild = m_Nodes[f].mnChild;
+                const GLuint nLast  = nChild + m_Nodes[f].mnChildren;
+                
+                GLuint c;
+                
+                for(c = nChild; c < nLast; ++c)
+                {
+                    next.push_back(c);
+                } // for
+                
+                bSplit = true;
+            } // if
+            else
+            {
+                next.push_back(f);
+            } // else
+        } // for
+        
+        if(bSplit)
+        {
+            frontier.swap(next);
+        } // if
+    } // while
+    
+    const size_t nUpper = m_Nodes.size();
+    
+    // Build the subtrees below the frontier independently, one job each,
+    // so that idle workers steal the remaining ones from busy workers
+    // that hold the denser subtrees
+    std::vector< std::vector<Node> > subtrees(frontier.size());
+    
+    {
+        Dispatch::Group group(rDispatch);
+        
+        size_t s;
+        
+        for(s = 0; s < frontier.size(); ++s)
+        {
+            subtrees[s].push_back(m_Nodes[frontier[s]]);
+            
+            group.fork([this, &subtrees, s]() { subtree(subtrees[s], 0); });
+        } // for
+        
+        group.join();
+    }
+    
+    // Splice the subtrees in, rebasing their child indices
+    std::vector<bool> isFrontier(nUpper, false);
+    
+    size_t s;
+    
+    for(s = 0; s < frontier.size(); ++s)
+    {
+        std::vector<Node>& rSubtree = subtrees[s];
+        
+        const GLuint nOffset = GLuint(m_Nodes.size()) - 1;
+        
+        size_t n;
+        
+        for(n = 0; n < rSubtree.size(); ++n)
+        {
+            if(rSubtree[n].mnChildren)
+            {
+                rSubtree[n].mnChild += nOffset;
+            } // if
+        } // for
+        
+        m_Nodes[frontier[s]] = rSubtree[0];
+        
+        m_Nodes.insert(m_Nodes.end(), rSubtree.begin() + 1, rSubtree.end());
+        
+        isFrontier[frontier[s]] = true;
+    } // for
+    
+    // Children of the upper cells always follow their parents
+    size_t n;
+    
+    for(n = nUpper; n > 0; --n)
+    {
+        if(!isFrontier[n - 1])
+        {
+            combine(m_Nodes, GLuint(n - 1));
+        } // if
+    } // for
+    
+    // Opening radius, s/theta plus the offset of the centre of mass from
+    // the cell centre, so that a lopsided cell is never accepted too early
+    const GLfloat nInvTheta = (mnOpeningAngle > 0.0f) ? (1.0f / mnOpeningAngle) : 0.0f;
+    
+    rDispatch.apply(0, m_Nodes.size(), 1024, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        size_t i;
+        
+        for(i = nBegin; i < nEnd; ++i)
+        {
+            Node& rNode = m_Nodes[i];
+            
+            if(nInvTheta > 0.0f)
+            {
+                const GLfloat dx = rNode.mnMass[0] - rNode.mnCenter[0];
+                const GLfloat dy = rNode.mnMass[1] - rNode.mnCenter[1];
+                const GLfloat dz = rNode.mnMass[2] - rNode.mnCenter[2];
+                
+                const GLfloat r = 2.0f * rNode.mnHalf * nInvTheta + std::sqrt(dx * dx + dy * dy + dz * dz);
+                
+                rNode.mnOpen = r * r;
+            } // if
+            else
+            {
+                rNode.mnOpen = FLT_MAX;
+            } // else
+        } // for
+    });
+} // build
+
+#pragma mark -
+#pragma mark Public - Accessors
+
+const std::vector<NBody::Simulation::Octree::Node>& NBody::Simulation::Octree::nodes() const
+{
+    return m_Nodes;
+} // nodes
+
+const GLuint *NBody::Simulation::Octree::index() const
+{
+    return m_Morton.index();
+} // index
+
+const GLfloat *NBody::Simulation::Octree::positions() const
+{
+    return m_Position.data();
+} // positions
+
+const size_t& NBody::Simulation::Octree::size() const
+{
+    return mnBodies;
+} // size
@@ -0,0 +1,47 @@
+/*
+     File: NBodySimulationTreePM.h
+ Abstract: 
+ Utility class for managing a tree particle-mesh solver in a periodic box on the cpu for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_TREE_PM_H_
+#define _NBODY_SIMULATION_TREE_PM_H_
+
+#import "NBodySimulationOctree.h"
+#import "NBodySimulationParticleMesh.h"
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        class TreePM : public ParticleMesh
+        {
+        public:
+            TreePM(const size_t& nBodies,
+                   const Params& rParams);
+            
+            virtual ~TreePM();
+            
+        protected:
+            // Long-range force from the mesh, smoothed with a Gaussian of
+            // the split scale, plus the complementary short-range force
+            // from a tree walk that ignores cells past the cutoff radius
+            void accelerate();
+            
+        private:
+            GLfloat              mnOpeningAngle;
+            GLfloat              mnSplitScale;   // Split scale in mesh cells
+            Octree               m_Octree;
+            std::vector<GLuint>  m_Groups;
+        }; // TreePM
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
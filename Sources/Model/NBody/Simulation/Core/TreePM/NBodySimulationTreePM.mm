@@ -0,0 +1,427 @@
+/*
+     File: NBodySimulationTreePM.mm
+ Abstract: 
+ Utility class for managing a tree particle-mesh solver in a periodic box on the cpu for n-body simulation.
+ 
+  Version: 3.1
+ 
+ */
+
+#pragma mark -
+#pragma mark Private - Headers
+
+#import <algorithm>
+#import <atomic>
+#import <cfloat>
+#import <cmath>
+#import <iostream>
+
+#import "NBodySimulationTreePM.h"
+
+#pragma mark -
+#pragma mark Private - Constants
+
+// Groups handed to a worker at a time
+static const size_t kGrainSize = 4;
+
+// Largest cell whose bodies share one interaction list
+static const GLuint kGroupCount = 64;
+
+// Sink bodies evaluated together against the list, one vector loop
+static const size_t kGroupSize = 16;
+
+// Deepest walk is 21 levels of at most 8 pending children
+static const size_t kStackSize = 256;
+
+#pragma mark -
+#pragma mark Private - Data Structures
+
+// Interaction list shared by the bodies of one group: the bodies of the
+// opened leaves and the monopoles of the accepted cells, as structure-
+// of-arrays, shifted to the periodic image nearest the group centre
+struct NBodySimulationTreePMList
+{
+    std::vector<GLfloat> m_Source[4];
+};
+
+typedef struct NBodySimulationTreePMList NBodySimulationTreePMList;
+
+// Scales of the force split, in the same units as the positions
+struct NBodySimulationTreePMSplit
+{
+    GLfloat mnBox;
+    GLfloat mnInvBox;
+    GLfloat mnInvScale;   // 1 / (2 rs)
+    GLfloat mnCutoffSq;
+};
+
+typedef struct NBodySimulationTreePMSplit NBodySimulationTreePMSplit;
+
+#pragma mark -
+#pragma mark Private - Utilities
+
+// Image offset that brings a separation d into [-L/2, L/2]
+static inline GLfloat NBodySimulationTreePMImage(const GLfloat& d,
+                                                 const NBodySimulationTreePMSplit& rSplit)
+{
+    return -rSplit.mnBox * std::floor(d * rSplit.mnInvBox + 0.5f);
+} // NBodySimulationTreePMImage
+
+static inline void NBodySimulationTreePMPush(NBodySimulationTreePMList& rList,
+                                             const GLfloat * const pSource,
+                                             const GLfloat * const pImage)
+{
+    rList.m_Source[0].push_back(pSource[0] + pImage[0]);
+    rList.m_Source[1].push_back(pSource[1] + pImage[1]);
+    rList.m_Source[2].push_back(pSource[2] + pImage[2]);
+    rList.m_Source[3].push_back(pSource[3]);
+} // NBodySimulationTreePMPush
+
+// Walk the tree once for all bodies of a group. Cells whose box is past
+// the cutoff from the group's bounding box, in either image along each
+// axis, are skipped, and the rest are accepted or opened as in the
+// Barnes-Hut walk. Sources are listed in the image nearest the group
+// centre, and the evaluation takes the nearest image of each pair.
+static void NBodySimulationTreePMGather(const NBody::Simulation::Octree& rTree,
+                                        const NBody::Simulation::Octree::Node& rGroup,
+                                        const NBodySimulationTreePMSplit& rSplit,
+                                        NBodySimulationTreePMList& rList)
+{
+    const NBody::Simulation::Octree::Node *pNodes = rTree.nodes().data();
+    
+    const GLfloat *pPosition = rTree.positions();
+    
+    GLfloat lo[3] = { FLT_MAX,  FLT_MAX,  FLT_MAX};
+    GLfloat hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    
+    GLuint i;
+    GLuint k;
+    
+    for(i = rGroup.mnFirst; i < (rGroup.mnFirst + rGroup.mnCount); ++i)
+    {
+        for(k = 0; k < 3; ++k)
+        {
+            lo[k] = std::min(lo[k], pPosition[4 * i + k]);
+            hi[k] = std::max(hi[k], pPosition[4 * i + k]);
+        } // for
+    } // for
+    
+    GLfloat center[3];
+    GLfloat half[3];
+    
+    for(k = 0; k < 3; ++k)
+    {
+        center[k] = 0.5f * (lo[k] + hi[k]);
+        half[k]   = 0.5f * (hi[k] - lo[k]);
+    } // for
+    
+    for(k = 0; k < 4; ++k)
+    {
+        rList.m_Source[k].clear();
+    } // for
+    
+    GLuint stack[kStackSize];
+    
+    size_t nDepth = 0;
+    
+    stack[nDepth++] = 0;
+    
+    while(nDepth)
+    {
+        const GLuint nNode = stack[--nDepth];
+        
+        const NBody::Simulation::Octree::Node& rNode = pNodes[nNode];
+        
+        GLfloat image[3];
+        GLfloat gap = 0.0f;
+        GLfloat far = 0.0f;
+        
+        for(k = 0; k < 3; ++k)
+        {
+            const GLfloat d = rNode.mnCenter[k] - center[k];
+            
+            image[k] = NBodySimulationTreePMImage(d, rSplit);
+            
+            // Separation of the cell box from the group box, and of the
+            // cell centre of mass from the group box. A group or cell
+            // that spans much of the box may be closer in the other
+            // image, so the box separation takes the nearer of the two.
+            const GLfloat a = std::abs(d + image[k]);
+            const GLfloat s = std::max(std::min(a, rSplit.mnBox - a) - half[k] - rNode.mnHalf, 0.0f);
+            const GLfloat c = std::max(std::abs(rNode.mnMass[k] + image[k] - center[k]) - half[k], 0.0f);
+            
+            gap += s * s;
+            far += c * c;
+        } // for
+        
+        if(gap > rSplit.mnCutoffSq)
+        {
+            continue;
+        } // if
+        
+        if(far > rNode.mnOpen)
+        {
+            NBodySimulationTreePMPush(rList, rNode.mnMass, image);
+        } // if
+        else if(rNode.mnChildren)
+        {
+            GLuint c;
+            
+            for(c = 0; c < rNode.mnChildren; ++c)
+            {
+                stack[nDepth++] = rNode.mnChild + c;
+            } // for
+        } // else if
+        else
+        {
+            for(i = rNode.mnFirst; i < (rNode.mnFirst + rNode.mnCount); ++i)
+            {
+                NBodySimulationTreePMPush(rList, pPosition + 4 * i, image);
+            } // for
+        } // else
+    } // while
+} // NBodySimulationTreePMGather
+
+// exp(-w) for 0 <= w <= kCutoff^2 / 4, as a Taylor series for exp(-w/8)
+// squared three times. Relative error is below 1e-5 over that range, and
+// unlike std::exp the whole thing vectorizes.
+static inline GLfloat NBodySimulationTreePMExp(const GLfloat& w)
+{
+    const GLfloat x = -0.125f * w;
+    
+    GLfloat e = 1.0f + x * (1.0f + x * (1.0f / 2.0f + x * (1.0f / 6.0f + x * (1.0f / 24.0f + x * (1.0f / 120.0f + x * (1.0f / 720.0f + x * (1.0f / 5040.0f)))))));
+    
+    e *= e;
+    e *= e;
+    e *= e;
+    
+    return e;
+} // NBodySimulationTreePMExp
+
+// Short-range accelerations on up to kGroupSize sink bodies. Each source
+// is scaled by the complement of the mesh force, erfc(u) + 2u/sqrt(pi)
+// exp(-u^2) with u = r / (2 rs), where erfc is the Abramowitz and Stegun
+// 7.1.26 rational approximation, so that the inner loop has no library
+// calls other than sqrt.
+static void NBodySimulationTreePMEvaluate(const NBodySimulationTreePMList& rList,
+                                          const GLfloat * const pSink,
+                                          const size_t& nCount,
+                                          const GLfloat& nSofteningSq,
+                                          const NBodySimulationTreePMSplit& rSplit,
+                                          GLfloat *pAcceleration)
+{
+    GLfloat x[kGroupSize];
+    GLfloat y[kGroupSize];
+    GLfloat z[kGroupSize];
+    
+    GLfloat ax[kGroupSize];
+    GLfloat ay[kGroupSize];
+    GLfloat az[kGroupSize];
+    
+    size_t i;
+    size_t j;
+    
+    // Short groups are padded with the first sink, so that every inner
+    // loop has the same fixed trip count
+    for(i = 0; i < kGroupSize; ++i)
+    {
+        const size_t k = (i < nCount) ? i : 0;
+        
+        x[i] = pSink[4 * k + 0];
+        y[i] = pSink[4 * k + 1];
+        z[i] = pSink[4 * k + 2];
+        
+        ax[i] = 0.0f;
+        ay[i] = 0.0f;
+        az[i] = 0.0f;
+    } // for
+    
+    const GLfloat *pX = rList.m_Source[0].data();
+    const GLfloat *pY = rList.m_Source[1].data();
+    const GLfloat *pZ = rList.m_Source[2].data();
+    const GLfloat *pM = rList.m_Source[3].data();
+    
+    const size_t nSources = rList.m_Source[0].size();
+    
+    const GLfloat nInvScale = rSplit.mnInvScale;
+    const GLfloat nCutoffSq = rSplit.mnCutoffSq;
+    const GLfloat nLimit    = 0.5f * NBody::Mesh::kCutoff;
+    
+    for(j = 0; j < nSources; ++j)
+    {
+        for(i = 0; i < kGroupSize; ++i)
+        {
+            // Nearest image of each pair, as the source was only shifted
+            // for the group centre, which is wrong for the pairs that
+            // straddle half the box
+            GLfloat dx = pX[j] - x[i];
+            GLfloat dy = pY[j] - y[i];
+            GLfloat dz = pZ[j] - z[i];
+            
+            dx += NBodySimulationTreePMImage(dx, rSplit);
+            dy += NBodySimulationTreePMImage(dy, rSplit);
+            dz += NBodySimulationTreePMImage(dz, rSplit);
+            
+            const GLfloat r2 = dx * dx + dy * dy + dz * dz;
+            const GLfloat r  = 1.0f / std::sqrt(r2 + nSofteningSq);
+            const GLfloat u  = std::min(std::sqrt(r2) * nInvScale, nLimit);
+            const GLfloat e  = NBodySimulationTreePMExp(u * u);
+            const GLfloat t  = 1.0f / (1.0f + 0.3275911f * u);
+            
+            const GLfloat erfc = t * (0.254829592f + t * (-0.284496736f + t * (1.421413741f + t * (-1.453152027f + t * 1.061405429f)))) * e;
+            const GLfloat f    = erfc + 1.128379167f * u * e;
+            
+            const GLfloat s = pM[j] * r * r * r * f * GLfloat(r2 < nCutoffSq);
+            
+            ax[i] += dx * s;
+            ay[i] += dy * s;
+            az[i] += dz * s;
+        } // for
+    } // for
+    
+    for(i = 0; i < nCount; ++i)
+    {
+        pAcceleration[4 * i + 0] = ax[i];
+        pAcceleration[4 * i + 1] = ay[i];
+        pAcceleration[4 * i + 2] = az[i];
+        pAcceleration[4 * i + 3] = 0.0f;
+    } // for
+} // NBodySimulationTreePMEvaluate
+
+#pragma mark -
+#pragma mark Public - Constructor
+
+NBody::Simulation::TreePM::TreePM(const size_t& nbodies,
+                                  const NBody::Simulation::Params& params)
+: NBody::Simulation::ParticleMesh(nbodies, params)
+, m_Octree(nbodies)
+{
+    mnOpeningAngle = (params.mnOpeningAngle > 0.0f) ? params.mnOpeningAngle : Tree::kOpeningAngle;
+    mnSplitScale   = (params.mnSplitScale   > 0.0f) ? params.mnSplitScale   : Mesh::kSplitScale;
+    
+    // Keep the cutoff within a quarter of the box, so that a pair only
+    // ever interacts through its nearest periodic image
+    mnSplitScale = std::min(mnSplitScale, GLfloat(mnMesh) / (4.0f * Mesh::kCutoff));
+    
+    std::cout
+    << ">> N-body Simulation: TreePM split scale "
+    << mnSplitScale
+    << " cells, opening angle "
+    << mnOpeningAngle
+    << std::endl;
+} // Constructor
+
+#pragma mark -
+#pragma mark Public - Destructor
+
+NBody::Simulation::TreePM::~TreePM()
+{
+    // The simulation thread walks the octree, so stop it before the
+    // octree is released
+    stop();
+} // Destructor
+
+#pragma mark -
+#pragma mark Protected - Utilities
+
+void NBody::Simulation::TreePM::accelerate()
+{
+    const GLfloat nSplit  = mnSplitScale * mnCell;
+    const GLfloat nCutoff = Mesh::kCutoff * nSplit;
+    
+    mesh(nSplit);
+    
+    NBodySimulationTreePMSplit split;
+    
+    split.mnBox      = mnBox;
+    split.mnInvBox   = 1.0f / mnBox;
+    split.mnInvScale = 0.5f / nSplit;
+    split.mnCutoffSq = nCutoff * nCutoff;
+    
+    m_Octree.build(mpPosition, mnOpeningAngle, m_Dispatch);
+    
+    const std::vector<Octree::Node>& rNodes = m_Octree.nodes();
+    
+    // Sink groups are the largest cells with at most kGroupCount bodies
+    m_Groups.clear();
+    
+    std::vector<GLuint> stack(1, 0);
+    
+    while(!stack.empty())
+    {
+        const GLuint nNode = stack.back();
+        
+        stack.pop_back();
+        
+        if((rNodes[nNode].mnCount <= kGroupCount) || (rNodes[nNode].mnChildren == 0))
+        {
+            m_Groups.push_back(nNode);
+        } // if
+        else
+        {
+            GLuint c;
+            
+            for(c = 0; c < rNodes[nNode].mnChildren; ++c)
+            {
+                stack.push_back(rNodes[nNode].mnChild + c);
+            } // for
+        } // else
+    } // while
+    
+    const GLfloat nSofteningSq = m_ActiveParams.mnSoftening * m_ActiveParams.mnSoftening;
+    
+    const GLuint  *pIndex    = m_Octree.index();
+    const GLfloat *pPosition = m_Octree.positions();
+    
+    std::atomic<size_t> nInteractions(0);
+    
+    parallel(0, m_Groups.size(), kGrainSize, [&](const size_t& nBegin, const size_t& nEnd)
+    {
+        NBodySimulationTreePMList list;
+        
+        GLfloat acceleration[4 * kGroupSize];
+        
+        size_t nCount = 0;
+        size_t l;
+        size_t g;
+        size_t i;
+        
+        for(l = nBegin; l < nEnd; ++l)
+        {
+            const Octree::Node& rGroup = rNodes[m_Groups[l]];
+            
+            NBodySimulationTreePMGather(m_Octree, rGroup, split, list);
+            
+            for(g = rGroup.mnFirst; g < (rGroup.mnFirst + rGroup.mnCount); g += kGroupSize)
+            {
+                const size_t nGroup = std::min(kGroupSize, size_t(rGroup.mnFirst + rGroup.mnCount) - g);
+                
+                NBodySimulationTreePMEvaluate(list,
+                                              pPosition + 4 * g,
+                                              nGroup,
+                                              nSofteningSq,
+                                              split,
+                                              acceleration);
+                
+                // Add to the mesh force, for the active range only
+                for(i = 0; i < nGroup; ++i)
+                {
+                    const size_t j = pIndex[g + i];
+                    
+                    if((j >= mnMinIndex) && (j < mnMaxIndex))
+                    {
+                        mpAcceleration[4 * j + 0] += acceleration[4 * i + 0];
+                        mpAcceleration[4 * j + 1] += acceleration[4 * i + 1];
+                        mpAcceleration[4 * j + 2] += acceleration[4 * i + 2];
+                        
+                        nCount += list.m_Source[0].size();
+                    } // if
+                } // for
+            } // for
+        } // for
+        
+        nInteractions += nCount;
+    });
+    
+    mnInteractions = GLdouble(nInteractions.load());
+} // accelerate
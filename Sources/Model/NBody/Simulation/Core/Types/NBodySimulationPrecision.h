@@ -0,0 +1,153 @@
+/*
+     File: NBodySimulationPrecision.h
+ Abstract:
+ Arithmetic policies for the cpu force kernels and integrators, in single,
+ double, or emulated double-single (float-float) precision.
+ 
+  Version: 3.1
+ 
+ */
+
+#ifndef _NBODY_SIMULATION_PRECISION_H_
+#define _NBODY_SIMULATION_PRECISION_H_
+
+#import <cmath>
+
+#import <OpenGL/OpenGL.h>
+
+#ifdef __cplusplus
+
+namespace NBody
+{
+    namespace Simulation
+    {
+        // An unevaluated sum hi + lo of two floats with |lo| <= ulp(hi)/2,
+        // for about 48 bits of significand at single precision speed.
+        // Relies on exact IEEE rounding, so no fast-math for its users.
+        struct DoubleSingle
+        {
+            GLfloat hi;
+            GLfloat lo;
+            
+            DoubleSingle()
+            : hi(0.0f), lo(0.0f) {}
+            
+            DoubleSingle(const GLfloat& nHi,
+                         const GLfloat& nLo = 0.0f)
+            : hi(nHi), lo(nLo) {}
+            
+            // Error free sum of two floats, Knuth's two-sum
+            static DoubleSingle sum(const GLfloat& a,
+                                    const GLfloat& b)
+            {
+                const GLfloat s = a + b;
+                const GLfloat v = s - a;
+                
+                return DoubleSingle(s, (a - (s - v)) + (b - v));
+            } // sum
+            
+            // Renormalise, for |a| >= |b|
+            static DoubleSingle fast(const GLfloat& a,
+                                     const GLfloat& b)
+            {
+                const GLfloat s = a + b;
+                
+                return DoubleSingle(s, b - (s - a));
+            } // fast
+            
+            DoubleSingle operator-() const
+            {
+                return DoubleSingle(-hi, -lo);
+            } // operator-
+            
+            DoubleSingle operator+(const DoubleSingle& b) const
+            {
+                DoubleSingle s = sum(hi, b.hi);
+                
+                return fast(s.hi, s.lo + lo + b.lo);
+            } // operator+
+            
+            DoubleSingle operator-(const DoubleSingle& b) const
+            {
+                return *this + (-b);
+            } // operator-
+            
+            DoubleSingle operator+(const GLfloat& b) const
+            {
+                DoubleSingle s = sum(hi, b);
+                
+                return fast(s.hi, s.lo + lo);
+            } // operator+
+            
+            // The product of the high part is split exactly with an fma
+            DoubleSingle operator*(const GLfloat& b) const
+            {
+                const GLfloat p = hi * b;
+                const GLfloat e = std::fma(lo, b, std::fma(hi, b, -p));
+                
+                return fast(p, e);
+            } // operator*
+            
+            DoubleSingle& operator+=(const GLfloat& b)
+            {
+                return *this = *this + b;
+            } // operator+=
+            
+            DoubleSingle& operator+=(const DoubleSingle& b)
+            {
+                return *this = *this + b;
+            } // operator+=
+            
+            explicit operator GLfloat() const
+            {
+                return hi;
+            } // operator GLfloat
+        }; // DoubleSingle
+        
+        // Per precision types and conversions. Scalar is the type of the
+        // pairwise terms, and Real that of positions, velocities and
+        // accumulators, kept in memory as a float and a float correction.
+        template <typename Real>
+        struct Arithmetic;
+        
+        template <>
+        struct Arithmetic<GLfloat>
+        {
+            typedef GLfloat Scalar;
+            
+            static const bool kCompensated = false;
+            
+            static GLfloat load(const GLfloat& hi, const GLfloat&)    { return hi; }
+            static GLfloat high(const GLfloat& x)                     { return x; }
+            static GLfloat low(const GLfloat&)                        { return 0.0f; }
+        }; // Arithmetic<GLfloat>
+        
+        template <>
+        struct Arithmetic<GLdouble>
+        {
+            typedef GLdouble Scalar;
+            
+            static const bool kCompensated = true;
+            
+            static GLdouble load(const GLfloat& hi, const GLfloat& lo) { return GLdouble(hi) + GLdouble(lo); }
+            static GLfloat  high(const GLdouble& x)                    { return GLfloat(x); }
+            static GLfloat  low(const GLdouble& x)                     { return GLfloat(x - GLdouble(GLfloat(x))); }
+        }; // Arithmetic<GLdouble>
+        
+        template <>
+        struct Arithmetic<DoubleSingle>
+        {
+            typedef GLfloat Scalar;
+            
+            static const bool kCompensated = true;
+            
+            static DoubleSingle load(const GLfloat& hi, const GLfloat& lo) { return DoubleSingle::fast(hi, lo); }
+            static GLfloat      high(const DoubleSingle& x)                { return x.hi; }
+            static GLfloat      low(const DoubleSingle& x)                 { return x.lo; }
+        }; // Arithmetic<DoubleSingle>
+    } // Simulation
+} // NBody
+
+#endif
+
+#endif
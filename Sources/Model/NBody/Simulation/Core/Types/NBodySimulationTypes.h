@@ -50,6 +50,8 @@
 #ifndef _NBODY_SIMULATION_TYPES_H_
 #define _NBODY_SIMULATION_TYPES_H_
 
+#import <string>
+
 #import <OpenGL/OpenGL.h>
 
 #import "NBodyConstants.h"
@@ -62,6 +64,121 @@ namespace NBody
     {
         typedef std::string String;
         
+        enum Solver
+        {
+            eSolverDefault = 0,
+            eSolverGPU,
+            eSolverCPU,
+            eSolverBarnesHut,
+            eSolverFMM,
+            eSolverParticleMesh,
+            eSolverTreePM
+        };
+        
+        typedef enum Solver Solver;
+        
+        // Mass assignment, and force interpolation, for mesh solvers
+        enum Assignment
+        {
+            eAssignmentDefault = 0,
+            eAssignmentCIC,
+            eAssignmentTSC
+        };
+        
+        typedef enum Assignment Assignment;
+        
+        // Time integration, semi-implicit Euler as in IntegrateSystem
+        // by default, or a symplectic or predictor-corrector scheme
+        enum Integrator
+        {
+            eIntegratorDefault = 0,
+            eIntegratorEuler,
+            eIntegratorLeapfrog,
+            eIntegratorYoshida,
+            eIntegratorHermite
+        };
+        
+        typedef enum Integrator Integrator;
+        
+        // Arithmetic of the direct sum and of the integration, single by
+        // default, double, or emulated double as a pair of floats
+        enum Precision
+        {
+            ePrecisionDefault = 0,
+            ePrecisionFloat,
+            ePrecisionDouble,
+            ePrecisionDoubleSingle
+        };
+        
+        typedef enum Precision Precision;
+        
+        // Body storage on the device, interleaved float4 positions and
+        // velocities by default, or separate x, y, z and mass streams and
+        // x, y and z velocity streams
+        enum Layout
+        {
+            eLayoutDefault = 0,
+            eLayoutAoS,
+            eLayoutSoA
+        };
+        
+        typedef enum Layout Layout;
+        
+        // Placement of the cpu worker threads, left to the scheduler by
+        // default, pinned to separate cores, or grouped by socket
+        enum Affinity
+        {
+            eAffinityDefault = 0,
+            eAffinityNone,
+            eAffinityPinned,
+            eAffinitySocket
+        };
+        
+        typedef enum Affinity Affinity;
+        
+        // Kind of each body, which selects the force law of every pair.
+        // Stars and dark matter attract everything, and tracers have no
+        // mass and only follow the others.
+        enum Species
+        {
+            eSpeciesStar = 0,
+            eSpeciesDark,
+            eSpeciesTracer,
+            eSpeciesCount
+        };
+        
+        typedef enum Species Species;
+        
+        // Analytic background field felt by every body, none by default,
+        // a softened point mass, a Hernquist or NFW halo, or a
+        // Miyamoto-Nagai disk in the xy plane
+        enum Potential
+        {
+            ePotentialDefault = 0,
+            ePotentialNone,
+            ePotentialPointMass,
+            ePotentialHernquist,
+            ePotentialNFW,
+            ePotentialMiyamotoNagai
+        };
+        
+        typedef enum Potential Potential;
+        
+        // Kind of OpenCL device for the default solver, a gpu by default,
+        // a cpu or accelerator runtime, or the first device of any kind
+        enum Device
+        {
+            eDeviceDefault = 0,
+            eDeviceGPU,
+            eDeviceCPU,
+            eDeviceAccelerator,
+            eDeviceAll
+        };
+        
+        typedef enum Device Device;
+        
+        // Fields past the view distance are optional, and a zero
+        // value selects the default for that field.
         struct Params
         {
             GLfloat  mnTimeStamp;
@@ -71,6 +188,32 @@ namespace NBody
             GLfloat  mnRotateX;
             GLfloat  mnRotateY;
             GLfloat  mnViewDistance;
+            GLuint   mnSolver;
+            GLfloat  mnOpeningAngle;
+            GLuint   mnExpansionOrder;
+            GLuint   mnMeshSize;
+            GLuint   mnAssignment;
+            GLfloat  mnBoxSize;
+            GLfloat  mnSplitScale;
+            GLuint   mnReorderInterval;
+            GLuint   mnBlockLevels;
+            GLuint   mnIntegrator;
+            GLuint   mnPrecision;
+            GLuint   mnLayout;
+            GLuint   mnAffinity;
+            GLfloat  mnCutoff;
+            GLuint   mnGasCount;
+            GLfloat  mnGasEnergy;
+            GLfloat  mnMergeRadius;
+            GLuint   mnDarkCount;
+            GLuint   mnTracerCount;
+            GLuint   mnPotential;
+            GLfloat  mnPotentialMass;
+            GLfloat  mnPotentialScale;
+            GLfloat  mnPotentialHeight;
+            GLuint   mnPeriodic;
+            GLuint   mnDevice;
+            GLuint   mnBatch;
         }; // Params
     } // Simulation
 } // NBody
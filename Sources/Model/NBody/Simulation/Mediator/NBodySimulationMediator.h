@@ -86,9 +86,14 @@ namespace NBody
             // unpause the current active simulator
             void unpause();
             
+            // Benchmark the force kernels of the current active simulator
+            void benchmark();
+            
             // Accessor Methods for the active simulator
             const GLdouble  performance() const;
             const GLdouble  updates()     const;
+            const GLdouble  hydro()       const;
+            const GLdouble  hydroTime()   const;
             
             // Get position data
             const GLfloat* position() const;
@@ -56,28 +56,43 @@
 #import "GLMSizes.h"
 
 #import "NBodySimulationMediator.h"
+#import "NBodySimulationBarnesHut.h"
+#import "NBodySimulationCPU.h"
+#import "NBodySimulationFMM.h"
 #import "NBodySimulationGPU.h"
+#import "NBodySimulationParticleMesh.h"
+#import "NBodySimulationTreePM.h"
 
 static const GLuint kNBodyMaxDeviceCount = 128;
 
-// Get the number of coumpute device counts
-static GLuint NBodyGetComputeDeviceCount(const GLint& type)
+// Get the number of coumpute devices of a type, over all the platforms
+static GLuint NBodyGetComputeDeviceCount(const cl_device_type& type)
 {
     cl_device_id ids[kNBodyMaxDeviceCount] = {0};
     
-    GLuint count = -1;
+    return NBody::Simulation::GPU::devices(type, ids, kNBodyMaxDeviceCount);
+} // NBodyGetComputeDeviceCount
+
+// Start a simulator paused, wait for it to set up, and delete it if that
+// failed
+static bool NBodyStartSimulator(NBody::Simulation::Base *&pSimulator)
+{
+    pSimulator->start();
     
-    GLint err = clGetDeviceIDs(NULL, type, kNBodyMaxDeviceCount, ids, &count);
+    while(!pSimulator->isAcquired() && !pSimulator->isFailed())
+    {
+        std::this_thread::yield();
+    } // while
     
-    if(err != CL_SUCCESS)
+    if(pSimulator->isFailed())
     {
-        std::cerr
-        << ">> ERROR: NBody Simulation Mediator - Failed acquiring maximum device count!"
-        << std::endl;
+        delete pSimulator;
+        
+        pSimulator = NULL;
     } // if
     
-    return count;
-} // NBodyGetComputeDeviceCount
+    return pSimulator != NULL;
+} // NBodyStartSimulator
 
 // Set the current active n-body parameters
 void NBody::Simulation::Mediator::setParams(const NBody::Simulation::Params& rParams)
@@ -104,23 +119,73 @@ void NBody::Simulation::Mediator::acquire(const NBody::Simulation::Params& rPara
 {
     setParams(rParams);
     
-    GLuint nGPUs = NBodyGetComputeDeviceCount(CL_DEVICE_TYPE_GPU);
+    bool bCPU = false;
     
-    if(nGPUs > 0)
+    switch(rParams.mnSolver)
     {
-        mpSimulator = new NBody::Simulation::GPU(mnBodies, rParams, nGPUs - 1);
-
-        if(mpSimulator != NULL)
+        case NBody::Simulation::eSolverCPU:
+            mpSimulator = new NBody::Simulation::CPU(mnBodies, rParams);
+            bCPU        = true;
+            break;
+        
+        case NBody::Simulation::eSolverBarnesHut:
+            mpSimulator = new NBody::Simulation::BarnesHut(mnBodies, rParams);
+            break;
+        
+        case NBody::Simulation::eSolverFMM:
+            mpSimulator = new NBody::Simulation::FMM(mnBodies, rParams);
+            break;
+        
+        case NBody::Simulation::eSolverParticleMesh:
+            mpSimulator = new NBody::Simulation::ParticleMesh(mnBodies, rParams);
+            break;
+        
+        case NBody::Simulation::eSolverTreePM:
+            mpSimulator = new NBody::Simulation::TreePM(mnBodies, rParams);
+            break;
+        
+        default:
         {
-            mpSimulator->start();
+            const cl_device_type type = NBody::Simulation::GPU::type(rParams.mnDevice);
+            
+            GLuint nDevices = NBodyGetComputeDeviceCount(type);
             
-            while(!mpSimulator->isAcquired())
+            if(nDevices > 0)
             {
-                std::this_thread::yield();
-            } // while
-        } // if
+                mpSimulator = new NBody::Simulation::GPU(mnBodies, rParams, nDevices - 1);
+            } // if
+            else
+            {
+                std::cout
+                << ">> N-body Simulation: No opencl compute devices, falling back to the cpu"
+                << std::endl;
+                
+                mpSimulator = new NBody::Simulation::CPU(mnBodies, rParams);
+                bCPU        = true;
+            } // else
+        }
+            break;
+    } // switch
+    
+    // A simulator that failed to set up falls back to the cpu one, and
+    // without that there is no simulation until the next reset
+    if((mpSimulator != NULL) && !NBodyStartSimulator(mpSimulator) && !bCPU)
+    {
+        std::cout
+        << ">> N-body Simulation: Failed setting up the simulator, falling back to the cpu"
+        << std::endl;
+        
+        mpSimulator = new NBody::Simulation::CPU(mnBodies, rParams);
+        
+        NBodyStartSimulator(mpSimulator);
+    } // if
+    
+    if(mpSimulator == NULL)
+    {
+        std::cerr
+        << ">> N-body Simulation: Failed setting up any simulator!"
+        << std::endl;
     } // if
-
 } // acquire
 
 // Construct a mediator object for GPUs, or CPU and CPUs
@@ -135,6 +200,14 @@ NBody::Simulation::Mediator::Mediator(const NBody::Simulation::Params& rParams,
 // Delete alll simulators
 NBody::Simulation::Mediator::~Mediator()
 {
+    // Positions may be owned by the simulator, so go back before it
+    if(mpSimulator != NULL)
+    {
+        mpSimulator->release(mpPosition);
+        
+        mpPosition = NULL;
+    } // if
+    
     delete mpSimulator;
     mpSimulator = nullptr;
     
@@ -165,6 +238,39 @@ void NBody::Simulation::Mediator::unpause()
     } // if
 } // unpause
 
+// Benchmark the force kernels of the current active simulator
+void NBody::Simulation::Mediator::benchmark()
+{
+    if(mpSimulator != NULL)
+    {
+        mpSimulator->benchmark();
+    } // if
+} // benchmark
+
+// Interactions per second of the active simulator
+const GLdouble NBody::Simulation::Mediator::performance() const
+{
+    return (mpSimulator != NULL) ? mpSimulator->performance() : 0.0;
+} // performance
+
+// Updates per second of the active simulator
+const GLdouble NBody::Simulation::Mediator::updates() const
+{
+    return (mpSimulator != NULL) ? mpSimulator->updates() : 0.0;
+} // updates
+
+// Gas interactions per second of the active simulator
+const GLdouble NBody::Simulation::Mediator::hydro() const
+{
+    return (mpSimulator != NULL) ? mpSimulator->hydro() : 0.0;
+} // hydro
+
+// Seconds per step in the gas passes of the active simulator
+const GLdouble NBody::Simulation::Mediator::hydroTime() const
+{
+    return (mpSimulator != NULL) ? mpSimulator->hydroTime() : 0.0;
+} // hydroTime
+
 // Get position data
 const GLfloat* NBody::Simulation::Mediator::position() const
 {
@@ -180,14 +286,16 @@ NBody::Simulation::Base* NBody::Simulation::Mediator::simulator()
 // void update position data
 void NBody::Simulation::Mediator::update()
 {
+    if(mpSimulator == NULL)
+    {
+        return;
+    } // if
+    
     GLfloat *pPosition = mpSimulator->data();
     
     if(pPosition != NULL)
     {
-        if(mpPosition != NULL)
-        {
-            free(mpPosition);
-        } // if
+        mpSimulator->release(mpPosition);
         
         mpPosition = pPosition;
     } // if
@@ -196,17 +304,64 @@ void NBody::Simulation::Mediator::update()
 // Reset all the gpu bound simulators
 void NBody::Simulation::Mediator::reset(Params& params)
 {
+    // A different solver, or different tree, mesh, ordering, time step,
+    // integrator, precision, layout, thread settings, short range cutoff,
+    // gas bodies, merge radius, species, background potential, periodic
+    // box or device, needs a new simulator rather than a reset of the
+    // current one, as does a simulator that could not be set up
+    if((mpSimulator == NULL)
+       || (   (params.mnSolver          != m_Params.mnSolver)
+           || (params.mnOpeningAngle    != m_Params.mnOpeningAngle)
+           || (params.mnExpansionOrder  != m_Params.mnExpansionOrder)
+           || (params.mnMeshSize        != m_Params.mnMeshSize)
+           || (params.mnAssignment      != m_Params.mnAssignment)
+           || (params.mnBoxSize         != m_Params.mnBoxSize)
+           || (params.mnSplitScale      != m_Params.mnSplitScale)
+           || (params.mnReorderInterval != m_Params.mnReorderInterval)
+           || (params.mnBlockLevels     != m_Params.mnBlockLevels)
+           || (params.mnIntegrator      != m_Params.mnIntegrator)
+           || (params.mnPrecision       != m_Params.mnPrecision)
+           || (params.mnLayout          != m_Params.mnLayout)
+           || (params.mnAffinity        != m_Params.mnAffinity)
+           || (params.mnCutoff          != m_Params.mnCutoff)
+           || (params.mnGasCount        != m_Params.mnGasCount)
+           || (params.mnMergeRadius     != m_Params.mnMergeRadius)
+           || (params.mnDarkCount       != m_Params.mnDarkCount)
+           || (params.mnTracerCount     != m_Params.mnTracerCount)
+           || (params.mnPotential       != m_Params.mnPotential)
+           || (params.mnPotentialMass   != m_Params.mnPotentialMass)
+           || (params.mnPotentialScale  != m_Params.mnPotentialScale)
+           || (params.mnPotentialHeight != m_Params.mnPotentialHeight)
+           || (params.mnPeriodic        != m_Params.mnPeriodic)
+           || (params.mnDevice          != m_Params.mnDevice)))
+    {
+        if(mpSimulator != NULL)
+        {
+            mpSimulator->release(mpPosition);
+            
+            mpPosition = NULL;
+            
+            delete mpSimulator;
+            
+            mpSimulator = NULL;
+        } // if
+        
+        // The new simulator starts paused, and is reset and resumed as
+        // the current one would be
+        acquire(params);
+    } // if
+    
     m_Params = params;
     
     if(mpSimulator != NULL)
     {
         if(mpPosition != NULL)
         {
-            free(mpPosition);
+            mpSimulator->release(mpPosition);
             
             mpPosition = NULL;
             
-            free(mpSimulator->data());
+            mpSimulator->release(mpSimulator->data());
         } // if
         
         mpSimulator->resetParams(m_Params);